@@ -125,11 +125,8 @@ namespace {
   template <typename V> \
   DEF_SEM(DUP_##size, V128W dst, R64 src) { \
     auto val = TruncTo<uint##size##_t>(Read(src)); \
-    V vec = {}; \
-    _Pragma("unroll") for (auto &element : vec.elems) { \
-      element = val; \
-    } \
-    UWriteV##size(dst, vec); \
+    using N = typename NativeVectorType<V>::Type; \
+    UWriteV##size(dst, FromNativeVector<V>(SplatNativeVector<N>(val))); \
     return memory; \
   }
 
@@ -165,18 +162,59 @@ ALWAYS_INLINE static T UMax(T lhs, T rhs) {
 #define SMin UMin
 #define SMax UMax
 
+// Element-wise operators on native vectors (see `NativeVectorType`). These
+// reach LLVM as single vector instructions, rather than as chains of element
+// extracts and inserts, so that lifted SIMD code can be compiled back into
+// SIMD code.
+template <typename N>
+ALWAYS_INLINE static N NativeAdd(N lhs, N rhs) {
+  return lhs + rhs;
+}
+
+template <typename N>
+ALWAYS_INLINE static N NativeSub(N lhs, N rhs) {
+  return lhs - rhs;
+}
+
+// Comparisons produce all-ones or all-zeroes masks.
+template <typename N>
+ALWAYS_INLINE static N NativeMin(N lhs, N rhs) {
+  auto mask = (N) (lhs < rhs);
+  return (lhs & mask) | (rhs & ~mask);
+}
+
+template <typename N>
+ALWAYS_INLINE static N NativeMax(N lhs, N rhs) {
+  auto mask = (N) (rhs < lhs);
+  return (lhs & mask) | (rhs & ~mask);
+}
+
+#define MAKE_NATIVE_CMP(name, op) \
+  template <typename N> \
+  ALWAYS_INLINE static N Native##name(N lhs, N rhs) { \
+    return (N) (lhs op rhs); \
+  }
+
+MAKE_NATIVE_CMP(CmpEq, ==)
+MAKE_NATIVE_CMP(CmpLt, <)
+MAKE_NATIVE_CMP(CmpLte, <=)
+MAKE_NATIVE_CMP(CmpGt, >)
+MAKE_NATIVE_CMP(CmpGte, >=)
+
+#undef MAKE_NATIVE_CMP
+
+template <typename N>
+ALWAYS_INLINE static N NativeCmpTst(N lhs, N rhs) {
+  return (N) ((lhs & rhs) != N{});
+}
+
 #define MAKE_BROADCAST(op, prefix, binop, size) \
   template <typename S, typename V> \
   DEF_SEM(op##_##size, V128W dst, S src1, S src2) { \
-    auto vec1 = prefix##ReadV##size(src1); \
-    auto vec2 = prefix##ReadV##size(src2); \
-    V sum = {}; \
-    _Pragma("unroll") for (size_t i = 0, max_i = NumVectorElems(sum); \
-                           i < max_i; ++i) { \
-      sum.elems[i] = prefix##binop(prefix##ExtractV##size(vec1, i), \
-                                   prefix##ExtractV##size(vec2, i)); \
-    } \
-    prefix##WriteV##size(dst, sum); \
+    using N = typename NativeVectorType<V>::Type; \
+    auto vec1 = ToNativeVector<N>(prefix##ReadV##size(src1)); \
+    auto vec2 = ToNativeVector<N>(prefix##ReadV##size(src2)); \
+    prefix##WriteV##size(dst, FromNativeVector<V>(Native##binop(vec1, vec2))); \
     return memory; \
   }
 
@@ -260,18 +298,10 @@ namespace {
   template <typename S, typename V> \
   DEF_SEM(op##_##size, V128W dst, S src1, I##size imm) { \
     auto vec1 = prefix##ReadV##size(src1); \
-    auto ucmp_val = Read(imm); \
-    auto cmp_val = Signed(ucmp_val); \
-    decltype(ucmp_val) zeros = 0; \
-    decltype(ucmp_val) ones = ~zeros; \
-    V res = {}; \
-    _Pragma("unroll") for (size_t i = 0, max_i = NumVectorElems(res); \
-                           i < max_i; ++i) { \
-      res.elems[i] = \
-          Select(prefix##binop(prefix##ExtractV##size(vec1, i), cmp_val), \
-                 ones, zeros); \
-    } \
-    UWriteV##size(dst, res); \
+    using N = typename NativeVectorType<decltype(vec1)>::Type; \
+    auto cmp_vec = SplatNativeVector<N>(Signed(Read(imm))); \
+    auto res = Native##binop(ToNativeVector<N>(vec1), cmp_vec); \
+    UWriteV##size(dst, FromNativeVector<V>(res)); \
     return memory; \
   }
 
@@ -359,24 +389,12 @@ namespace {
   DEF_SEM(op##_##size, V128W dst, S src1, S src2) { \
     auto vec1 = prefix##ReadV##size(src1); \
     auto vec2 = prefix##ReadV##size(src2); \
-    uint##size##_t zeros = 0; \
-    uint##size##_t ones = ~zeros; \
-    V res = {}; \
-    _Pragma("unroll") for (size_t i = 0, max_i = NumVectorElems(res); \
-                           i < max_i; ++i) { \
-      res.elems[i] = Select(prefix##binop(prefix##ExtractV##size(vec1, i), \
-                                          prefix##ExtractV##size(vec2, i)), \
-                            ones, zeros); \
-    } \
-    UWriteV##size(dst, res); \
+    using N = typename NativeVectorType<decltype(vec1)>::Type; \
+    auto res = Native##binop(ToNativeVector<N>(vec1), ToNativeVector<N>(vec2)); \
+    UWriteV##size(dst, FromNativeVector<V>(res)); \
     return memory; \
   }
 
-template <typename T>
-ALWAYS_INLINE static bool UCmpTst(T lhs, T rhs) {
-  return UCmpNeq(UAnd(lhs, rhs), T(0));
-}
-
 MAKE_CMP_BROADCAST(CMPEQ, S, CmpEq, 8)
 MAKE_CMP_BROADCAST(CMPEQ, S, CmpEq, 16)
 MAKE_CMP_BROADCAST(CMPEQ, S, CmpEq, 32)
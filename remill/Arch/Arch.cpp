@@ -30,7 +30,12 @@
 #include <llvm/IR/Module.h>
 
 #include <algorithm>
+#include <deque>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <string_view>
+#include <tuple>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -54,6 +59,11 @@ namespace remill {
 
 class ArchImpl {
  public:
+  explicit ArchImpl(const llvm::DataLayout &dl_) : dl(dl_) {}
+
+  // Data layout of the architecture.
+  const llvm::DataLayout dl;
+
   // State type.
   llvm::StructType *state_type{nullptr};
 
@@ -66,9 +76,15 @@ class ArchImpl {
   // Metadata type ID for remill registers.
   unsigned reg_md_id{0};
 
-  std::vector<std::unique_ptr<Register>> registers;
+  // Registers, in the order in which they were added. A `std::deque` never
+  // moves its elements, so the names of the registers can key `reg_by_name`.
+  std::deque<Register> registers;
+  std::unordered_map<std::string_view, const Register *> reg_by_name;
+
+  // Maps each byte offset in `State` to the register occupying it. This is
+  // built on first use by `Arch::RegisterAtStateOffset`.
+  std::once_flag reg_by_offset_once;
   std::vector<const Register *> reg_by_offset;
-  std::unordered_map<std::string, const Register *> reg_by_name;
 };
 
 namespace {
@@ -201,11 +217,6 @@ auto Arch::Build(llvm::LLVMContext *context_, OSName os_name_,
   }
 }
 
-const Arch *Arch::Get(llvm::LLVMContext &context, OSName os,
-                      ArchName arch_name) {
-  return Arch::Build(&context, os, arch_name).release();
-}
-
 auto Arch::GetHostArch(llvm::LLVMContext &ctx) -> ArchPtr {
   return Arch::Build(&ctx, GetOSName(REMILL_OS), GetArchName(REMILL_ARCH));
 }
@@ -244,6 +255,22 @@ llvm::FunctionType *Arch::LiftedFunctionType(void) const {
 // structure.
 const Register *Arch::RegisterAtStateOffset(uint64_t offset) const {
   auto &reg_by_offset = impl->reg_by_offset;
+  std::call_once(impl->reg_by_offset_once, [&](void) {
+    reg_by_offset.resize(impl->dl.getTypeAllocSize(impl->state_type));
+
+    // Later registers take precedence, e.g. `AL` over `RAX`.
+    for (const auto &reg : impl->registers) {
+      for (auto i = reg.offset; i < (reg.offset + reg.size); ++i) {
+        auto &reg_at_offset = reg_by_offset[i];
+        if (reg_at_offset) {
+          CHECK_EQ(reg_at_offset->EnclosingRegister(),
+                   reg.EnclosingRegister());
+        }
+        reg_at_offset = &reg;
+      }
+    }
+  });
+
   if (offset >= reg_by_offset.size()) {
     return nullptr;
   } else {
@@ -254,7 +281,7 @@ const Register *Arch::RegisterAtStateOffset(uint64_t offset) const {
 // Apply `cb` to every register.
 void Arch::ForEachRegister(std::function<void(const Register *)> cb) const {
   for (const auto &reg : impl->registers) {
-    cb(reg.get());
+    cb(&reg);
   }
 }
 
@@ -270,37 +297,40 @@ const Register *Arch::RegisterByName(const std::string &name) const {
 
 namespace {
 
-// NOTE(lukas): Structure that allows global caching of `Arch` objects,
-//              as key llvm::LLVMContext * is used. Eventually this should
-//              be removed in favor of Arch::Build/Get* but some old code may
-//              depend on this caching behaviour.
+// Architectures cached by `Arch::Get`. Each is tied to the context for which
+// it was built, so the cache is indexed by context, as well as by the OS and
+// architecture names, so that different architectures can share a context.
+// The cache is shared by all threads.
+//
+// NOTE(lukas): Eventually this should be removed in favor of Arch::Build/Get*
+//              but some old code may depend on this caching behaviour.
 struct AvailableArchs {
-  using ArchMap =
-      std::unordered_map<llvm::LLVMContext *, std::unique_ptr<const Arch>>;
+  using ArchKey = std::tuple<llvm::LLVMContext *, OSName, ArchName>;
+  using ArchMap = std::map<ArchKey, std::unique_ptr<const Arch>>;
 
+  static std::mutex lock;
   static ArchMap cached;
 
   static const Arch *GetOrCreate(llvm::LLVMContext *ctx, OSName os,
                                  ArchName name) {
-    auto &arch = cached[ctx];
+    std::lock_guard<std::mutex> locker(lock);
+    auto &arch = cached[ArchKey(ctx, os, name)];
     if (!arch) {
-      arch = Create(ctx, os, name);
+      arch = Arch::Build(ctx, os, name);
     }
     return arch.get();
   }
 
-  static const Arch *Get(llvm::LLVMContext *ctx) {
-    if (auto arch_it = cached.find(ctx); arch_it != cached.end())
-      return arch_it->second.get();
-    return nullptr;
-  }
-
-  static Arch::ArchPtr Create(llvm::LLVMContext *ctx, OSName os,
-                              ArchName name) {
-    return Arch::Build(ctx, os, name);
+  static void Release(llvm::LLVMContext *ctx) {
+    std::lock_guard<std::mutex> locker(lock);
+    auto arch_it = cached.lower_bound(ArchKey(ctx, kOSInvalid, kArchInvalid));
+    while (arch_it != cached.end() && std::get<0>(arch_it->first) == ctx) {
+      arch_it = cached.erase(arch_it);
+    }
   }
 };
 
+std::mutex AvailableArchs::lock;
 AvailableArchs::ArchMap AvailableArchs::cached = {};
 
 static const Arch *GetOrCreate(llvm::LLVMContext &ctx, OSName os,
@@ -310,6 +340,15 @@ static const Arch *GetOrCreate(llvm::LLVMContext &ctx, OSName os,
 
 }  // namespace
 
+const Arch *Arch::Get(llvm::LLVMContext &context, OSName os,
+                      ArchName arch_name) {
+  return GetOrCreate(context, os, arch_name);
+}
+
+void Arch::ReleaseCachedArchs(llvm::LLVMContext &context) {
+  AvailableArchs::Release(&context);
+}
+
 const Arch *GetHostArch(llvm::LLVMContext &ctx) {
   return GetOrCreate(ctx, GetOSName(REMILL_OS), GetArchName(REMILL_ARCH));
 }
@@ -389,11 +428,43 @@ Register::Register(const std::string &name_, uint64_t offset_, uint64_t size_,
       offset(offset_),
       size(size_),
       type(type_),
-      constant_name(
-          llvm::ConstantDataArray::getString(type->getContext(), name_)),
       parent(parent_),
       arch(arch_) {}
 
+// An LLVM constant that represents this register's name.
+llvm::Constant *Register::ConstantName(void) const {
+  std::call_once(constant_name_once, [this](void) {
+    constant_name =
+        llvm::ConstantDataArray::getString(type->getContext(), name);
+  });
+  return constant_name;
+}
+
+const llvm::SmallVectorImpl<llvm::Value *> &
+Register::GEPIndexList(void) const {
+  ComputeIndexes();
+  return gep_index_list;
+}
+
+size_t Register::GEPOffset(void) const {
+  ComputeIndexes();
+  return gep_offset;
+}
+
+llvm::Type *Register::GEPTypeAtOffset(void) const {
+  ComputeIndexes();
+  return gep_type_at_offset;
+}
+
+void Register::ComputeIndexes(void) const {
+  std::call_once(indexes_once, [this](void) {
+    gep_index_list.push_back(llvm::Constant::getNullValue(
+        llvm::Type::getInt32Ty(type->getContext())));
+    std::tie(gep_offset, gep_type_at_offset) =
+        BuildIndexes(arch->dl, arch->state_type, 0, offset, gep_index_list);
+  });
+}
+
 // Returns the enclosing register of size AT LEAST `size`, or `nullptr`.
 const Register *Register::EnclosingRegisterOfSize(uint64_t size_) const {
   auto enclosing = this;
@@ -469,7 +540,7 @@ FinishAddressOf(llvm::IRBuilder<> &ir, const llvm::DataLayout &dl,
 
   CHECK_LT(gep_offset, state_size);
 
-  const auto index_type = reg->gep_index_list[0]->getType();
+  const auto index_type = reg->GEPIndexList()[0]->getType();
   const auto goal_ptr_type = llvm::PointerType::get(reg->type, addr_space);
 
   // Best case: we've found a value field in the structure that
@@ -559,9 +630,9 @@ llvm::Value *Register::AddressOf(llvm::Value *state_ptr,
   if (auto const_state_ptr = llvm::dyn_cast<llvm::Constant>(state_ptr);
       const_state_ptr) {
     gep = llvm::ConstantExpr::getInBoundsGetElementPtr(
-        state_type, const_state_ptr, gep_index_list);
+        state_type, const_state_ptr, GEPIndexList());
   } else {
-    gep = ir.CreateInBoundsGEP(state_type, state_ptr, gep_index_list);
+    gep = ir.CreateInBoundsGEP(state_type, state_ptr, GEPIndexList());
   }
 
   auto state_size = dl.getTypeAllocSize(state_type);
@@ -571,10 +642,10 @@ llvm::Value *Register::AddressOf(llvm::Value *state_ptr,
   // Add the metadata to `inst`.
   if (auto inst = llvm::dyn_cast<llvm::Instruction>(ret); inst) {
 #if LLVM_VERSION_NUMBER >= LLVM_VERSION(3, 6)
-    auto reg_name_md = llvm::ValueAsMetadata::get(constant_name);
+    auto reg_name_md = llvm::ValueAsMetadata::get(ConstantName());
     auto reg_name_node = llvm::MDNode::get(context, reg_name_md);
 #else
-    auto reg_name_node = llvm::MDNode::get(context, reg->constant_name);
+    auto reg_name_node = llvm::MDNode::get(context, ConstantName());
 #endif
     inst->setMetadata(arch->reg_md_id, reg_name_node);
     inst->setName(name);
@@ -619,46 +690,28 @@ void Arch::PrepareModule(llvm::Module *mod) const {
   PrepareModuleDataLayout(mod);
 }
 
-void Arch::AddRegister(const char *reg_name_, llvm::Type *val_type,
+void Arch::AddRegister(const char *reg_name, llvm::Type *val_type,
                        size_t offset, const char *parent_reg_name) const {
-  const std::string reg_name(reg_name_);
-  auto &reg = impl->reg_by_name[reg_name];
-  if (reg) {
+  if (impl->reg_by_name.count(reg_name)) {
     return;
   }
 
-  const auto dl = this->DataLayout();
-
   // If this is a sub-register, then link it in.
   const Register *parent_reg = nullptr;
   if (parent_reg_name) {
-    parent_reg = impl->reg_by_name[parent_reg_name];
+    if (auto parent_it = impl->reg_by_name.find(parent_reg_name);
+        parent_it != impl->reg_by_name.end()) {
+      parent_reg = parent_it->second;
+    }
   }
 
-  auto reg_impl = new Register(reg_name, offset, dl.getTypeAllocSize(val_type),
-                               val_type, parent_reg, impl.get());
-  reg = reg_impl;
-  impl->registers.emplace_back(reg_impl);
+  const auto &reg = impl->registers.emplace_back(
+      reg_name, offset, impl->dl.getTypeAllocSize(val_type), val_type,
+      parent_reg, impl.get());
+  impl->reg_by_name.emplace(reg.name, &reg);
 
   if (parent_reg) {
-    const_cast<Register *>(reg->parent)->children.push_back(reg);
-  }
-
-  reg_impl->gep_index_list.push_back(
-      llvm::Constant::getNullValue(llvm::Type::getInt32Ty(*context)));
-  std::tie(reg_impl->gep_offset, reg_impl->gep_type_at_offset) = BuildIndexes(
-      dl, impl->state_type, 0, reg->offset, reg_impl->gep_index_list);
-
-  // Provide easy access to registers at specific offsets in the `State`
-  // structure.
-  for (auto i = reg->offset; i < (reg->offset + reg->size); ++i) {
-    auto &reg_at_offset = impl->reg_by_offset[i];
-    if (!reg_at_offset) {
-      reg_at_offset = reg;
-    } else if (reg_at_offset) {
-      CHECK_EQ(reg_at_offset->EnclosingRegister(), reg->EnclosingRegister());
-      reg_at_offset = reg;
-    }
+    const_cast<Register *>(parent_reg)->children.push_back(&reg);
   }
 }
 
@@ -668,17 +721,15 @@ void Arch::InitFromSemanticsModule(llvm::Module *module) const {
     return;
   }
 
-  impl.reset(new ArchImpl);
+  impl.reset(new ArchImpl(DataLayout()));
   CHECK(!impl->state_type);
 
-  const auto &dl = module->getDataLayout();
   const auto basic_block = BasicBlockFunction(module);
   const auto state_ptr_type = ::remill::StatePointerType(module);
   const auto state_type =
       llvm::dyn_cast<llvm::StructType>(state_ptr_type->getElementType());
 
   impl->state_type = state_type;
-  impl->reg_by_offset.resize(dl.getTypeAllocSize(state_type));
   impl->memory_type = ::remill::MemoryPointerType(module);
   impl->lifted_function_type = basic_block->getFunctionType();
   impl->reg_md_id = context->getMDKindID("remill_register");
@@ -27,6 +27,7 @@
 
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -69,25 +70,25 @@ struct Register {
   llvm::Type *type;
 
   // An LLVM constant that represents this register's name.
-  llvm::Constant *constant_name;
+  llvm::Constant *ConstantName(void) const;
 
-  // A pre-computed index list and type for creating pointers to this register
-  // given a `State` structure pointer.
-  llvm::SmallVector<llvm::Value *, 8> gep_index_list;
+  // An index list for creating pointers to this register given a `State`
+  // structure pointer.
+  const llvm::SmallVectorImpl<llvm::Value *> &GEPIndexList(void) const;
 
   // The offset in `State` nearest to `offset`. You can say that
-  // the `sizeof(gep_type_at_offset)` starting at `gep_offset` in the `State`
+  // the `sizeof(GEPTypeAtOffset())` starting at `GEPOffset()` in the `State`
   // structure fully enclose this register. The following invariant holds:
   //
-  //    gep_offset
+  //    GEPOffset()
   //        <= offset
   //            <= offset + sizeof(type)
-  //                <= gep_offset + sizeof(gep_type_at_offset)
-  size_t gep_offset{0};
+  //                <= GEPOffset() + sizeof(GEPTypeAtOffset())
+  size_t GEPOffset(void) const;
 
   // This may be different than `type`. If so, then a bitcast on a
-  // `getelementptr` produced using `gep_index_list` to a `type*` is needed.
-  llvm::Type *gep_type_at_offset{nullptr};
+  // `getelementptr` produced using `GEPIndexList()` to a `type*` is needed.
+  llvm::Type *GEPTypeAtOffset(void) const;
 
   // Returns the enclosing register of size AT LEAST `size`, or `nullptr`.
   const Register *EnclosingRegisterOfSize(uint64_t size) const;
@@ -110,11 +111,24 @@ struct Register {
  private:
   friend class Arch;
 
+  // Compute `gep_index_list`, `gep_offset`, and `gep_type_at_offset`.
+  void ComputeIndexes(void) const;
+
   const Register *const parent;
   const ArchImpl *const arch;
 
   // The directly enclosed registers.
   std::vector<const Register *> children;
+
+  // Most registers are never accessed by a given lift, so these are computed
+  // on first use rather than when the architecture's registers are added.
+  // Architectures are shared between threads, so each is computed once.
+  mutable std::once_flag constant_name_once;
+  mutable llvm::Constant *constant_name{nullptr};
+  mutable std::once_flag indexes_once;
+  mutable llvm::SmallVector<llvm::Value *, 8> gep_index_list;
+  mutable size_t gep_offset{0};
+  mutable llvm::Type *gep_type_at_offset{nullptr};
 };
 
 class Arch {
@@ -124,10 +138,19 @@ class Arch {
   virtual ~Arch(void);
 
   // Factory method for loading the correct architecture class for a given
-  // operating system and architecture class.
+  // operating system and architecture class. The returned architecture is
+  // cached, and owned by remill, so that repeated calls with the same
+  // arguments return the same architecture. This is safe to call from many
+  // threads, and different architectures can be used with the same context.
   static const Arch *Get(llvm::LLVMContext &context, OSName os,
                          ArchName arch_name);
 
+  // Destroy the architectures cached by `Arch::Get` for `context`. Cached
+  // architectures refer to the context for which they were built, so this
+  // should be called before `context` is destroyed; otherwise, a new context
+  // allocated at the same address would be handed stale architectures.
+  static void ReleaseCachedArchs(llvm::LLVMContext &context);
+
   // Return the type of the state structure.
   llvm::StructType *StateStructType(void) const;
 
@@ -144,7 +167,8 @@ class Arch {
   void ForEachRegister(std::function<void(const Register *)> cb) const;
 
   // Return information about the register at offset `offset` in the `State`
-  // structure.
+  // structure. If registers overlap, then the one added last is returned,
+  // e.g. `AL` rather than `RAX`. This is safe to call from many threads.
   const Register *RegisterAtStateOffset(uint64_t offset) const;
 
   // Return information about a register, given its name.
@@ -248,7 +272,8 @@ class Arch {
                        ArchName arch_name);
 
   // Get the architecture of the modelled code. This is based on command-line
-  // flags. Rather use directly Build.
+  // flags, i.e. `--os` and `--arch`. Rather use directly Build, which reads no
+  // global state, when lifting for several architectures at once.
   static ArchPtr GetTargetArch(llvm::LLVMContext &context);
 
   // Get the (approximate) architecture of the system library was built on. This may not
@@ -228,6 +228,8 @@ Instruction::Instruction(void)
       has_branch_taken_delay_slot(false),
       has_branch_not_taken_delay_slot(false),
       in_delay_slot(false),
+      flags_read(0),
+      flags_written(0),
       category(Instruction::kCategoryInvalid) {}
 
 void Instruction::Reset(void) {
@@ -241,6 +243,8 @@ void Instruction::Reset(void) {
   has_branch_taken_delay_slot = false;
   has_branch_not_taken_delay_slot = false;
   in_delay_slot = false;
+  flags_read = 0;
+  flags_written = 0;
   category = Instruction::kCategoryInvalid;
   arch_for_decode = nullptr;
   operands.clear();
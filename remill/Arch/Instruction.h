@@ -173,6 +173,12 @@ class Instruction {
   // Is this instruction decoded within the context of a delay slot?
   bool in_delay_slot;
 
+  // Architecture-specific bitmasks of the condition flags that this
+  // instruction reads, and that it unconditionally writes. The trace lifter
+  // uses these to find flag writes that are dead before they are read.
+  uint32_t flags_read;
+  uint32_t flags_written;
+
   enum Category {
     kCategoryInvalid,
     kCategoryNormal,
@@ -983,6 +983,52 @@ ALWAYS_INLINE static bool BNot(bool a) {
   return !a;
 }
 
+// Native vector type (i.e. one that Clang lowers to an LLVM `<N x T>` type)
+// with the same size as the aggregate vector type `T`, and whose elements are
+// of type `E`.
+template <typename T, typename E = typename VectorType<T>::BT>
+struct NativeVectorType {
+  static_assert(!(sizeof(T) % sizeof(E)),
+                "Invalid native vector element type.");
+  typedef E Type __attribute__((vector_size(sizeof(T))));
+};
+
+// Native vector type with the same size as the aggregate vector type `T`,
+// whose elements are unsigned integers. Integer arithmetic is done on these
+// so that signed overflow wraps, as it does in the scalar operators.
+template <typename T>
+struct UnsignedNativeVectorType
+    : public NativeVectorType<
+          T, typename UnsignedIntegerType<typename VectorType<T>::BT>::BT> {};
+
+// Convert an aggregate vector into a native vector.
+template <typename N, typename T>
+ALWAYS_INLINE static N ToNativeVector(const T &vec) {
+  static_assert(sizeof(N) == sizeof(T), "Invalid native vector conversion.");
+  N ret;
+  __builtin_memcpy(&ret, &vec, sizeof(ret));
+  return ret;
+}
+
+// Convert a native vector back into an aggregate vector.
+template <typename T, typename N>
+ALWAYS_INLINE static T FromNativeVector(const N &vec) {
+  static_assert(sizeof(N) == sizeof(T), "Invalid native vector conversion.");
+  T ret;
+  __builtin_memcpy(&ret, &vec, sizeof(ret));
+  return ret;
+}
+
+// Create a native vector with every element set to `val`.
+template <typename N, typename E>
+ALWAYS_INLINE static N SplatNativeVector(E val) {
+  N ret = {};
+  _Pragma("unroll") for (auto i = 0UL; i < sizeof(N) / sizeof(ret[0]); ++i) {
+    ret[i] = val;
+  }
+  return ret;
+}
+
 // Binary broadcast operator.
 #define MAKE_BIN_BROADCAST(op, size, accessor) \
   template <typename T> \
@@ -1005,6 +1051,25 @@ ALWAYS_INLINE static bool BNot(bool a) {
     return ret; \
   }
 
+// Binary broadcast operator that operates on native vectors, and so reaches
+// LLVM as a single vector instruction instead of a chain of element-wise
+// extracts and inserts.
+#define MAKE_NATIVE_BIN_BROADCAST(op, size, native, sym) \
+  template <typename T> \
+  ALWAYS_INLINE static T op##V##size(const T &L, const T &R) { \
+    using N = typename native<T>::Type; \
+    return FromNativeVector<T>(ToNativeVector<N>(L) \
+                                   sym ToNativeVector<N>(R)); \
+  }
+
+// Unary broadcast operator that operates on native vectors.
+#define MAKE_NATIVE_UN_BROADCAST(op, size, native, sym) \
+  template <typename T> \
+  ALWAYS_INLINE static T op##V##size(const T &R) { \
+    using N = typename native<T>::Type; \
+    return FromNativeVector<T>(sym ToNativeVector<N>(R)); \
+  }
+
 #define MAKE_BROADCASTS(op, make_int_broadcast, make_float_broadcast) \
   make_int_broadcast(U##op, 8, bytes) make_int_broadcast(U##op, 16, words) \
       make_int_broadcast(U##op, 32, dwords) \
@@ -1016,20 +1081,46 @@ ALWAYS_INLINE static bool BNot(bool a) {
                               make_float_broadcast(F##op, 32, floats) \
                                   make_float_broadcast(F##op, 64, doubles)
 
-MAKE_BROADCASTS(Add, MAKE_BIN_BROADCAST, MAKE_BIN_BROADCAST)
-MAKE_BROADCASTS(Sub, MAKE_BIN_BROADCAST, MAKE_BIN_BROADCAST)
-MAKE_BROADCASTS(Mul, MAKE_BIN_BROADCAST, MAKE_BIN_BROADCAST)
+#define MAKE_NATIVE_BROADCASTS(op, sym, make_int_broadcast, \
+                               make_float_broadcast) \
+  make_int_broadcast(U##op, 8, UnsignedNativeVectorType, sym) \
+      make_int_broadcast(U##op, 16, UnsignedNativeVectorType, sym) \
+          make_int_broadcast(U##op, 32, UnsignedNativeVectorType, sym) \
+              make_int_broadcast(U##op, 64, UnsignedNativeVectorType, sym) \
+                  make_int_broadcast(S##op, 8, UnsignedNativeVectorType, sym) \
+                      make_int_broadcast(S##op, 16, UnsignedNativeVectorType, \
+                                         sym) \
+                          make_int_broadcast(S##op, 32, \
+                                             UnsignedNativeVectorType, sym) \
+                              make_int_broadcast(S##op, 64, \
+                                                 UnsignedNativeVectorType, \
+                                                 sym) \
+                                  make_float_broadcast(F##op, 32, \
+                                                       NativeVectorType, sym) \
+                                      make_float_broadcast( \
+                                          F##op, 64, NativeVectorType, sym)
+
+MAKE_NATIVE_BROADCASTS(Add, +, MAKE_NATIVE_BIN_BROADCAST,
+                       MAKE_NATIVE_BIN_BROADCAST)
+MAKE_NATIVE_BROADCASTS(Sub, -, MAKE_NATIVE_BIN_BROADCAST,
+                       MAKE_NATIVE_BIN_BROADCAST)
+MAKE_NATIVE_BROADCASTS(Mul, *, MAKE_NATIVE_BIN_BROADCAST,
+                       MAKE_NATIVE_BIN_BROADCAST)
 MAKE_BROADCASTS(Div, MAKE_BIN_BROADCAST, MAKE_BIN_BROADCAST)
 MAKE_BROADCASTS(Rem, MAKE_BIN_BROADCAST, MAKE_NOP)
-MAKE_BROADCASTS(And, MAKE_BIN_BROADCAST, MAKE_NOP)
-MAKE_BROADCASTS(AndN, MAKE_BIN_BROADCAST, MAKE_NOP)
-MAKE_BROADCASTS(Or, MAKE_BIN_BROADCAST, MAKE_NOP)
-MAKE_BROADCASTS(Xor, MAKE_BIN_BROADCAST, MAKE_NOP)
+MAKE_NATIVE_BROADCASTS(And, &, MAKE_NATIVE_BIN_BROADCAST, MAKE_NOP)
+MAKE_NATIVE_BROADCASTS(AndN, &~, MAKE_NATIVE_BIN_BROADCAST, MAKE_NOP)
+MAKE_NATIVE_BROADCASTS(Or, |, MAKE_NATIVE_BIN_BROADCAST, MAKE_NOP)
+MAKE_NATIVE_BROADCASTS(Xor, ^, MAKE_NATIVE_BIN_BROADCAST, MAKE_NOP)
 MAKE_BROADCASTS(Shl, MAKE_BIN_BROADCAST, MAKE_NOP)
 MAKE_BROADCASTS(Shr, MAKE_BIN_BROADCAST, MAKE_NOP)
-MAKE_BROADCASTS(Neg, MAKE_UN_BROADCAST, MAKE_NOP)
-MAKE_BROADCASTS(Not, MAKE_UN_BROADCAST, MAKE_NOP)
+MAKE_NATIVE_BROADCASTS(Neg, -, MAKE_NATIVE_UN_BROADCAST,
+                       MAKE_NATIVE_UN_BROADCAST)
+MAKE_NATIVE_BROADCASTS(Not, ~, MAKE_NATIVE_UN_BROADCAST, MAKE_NOP)
 
+#undef MAKE_NATIVE_BROADCASTS
+#undef MAKE_NATIVE_BIN_BROADCAST
+#undef MAKE_NATIVE_UN_BROADCAST
 #undef MAKE_BIN_BROADCAST
 #undef MAKE_UN_BROADCAST
 
@@ -27,6 +27,7 @@
 #include <iomanip>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
 
@@ -359,6 +360,34 @@ static std::string InstructionFunctionName(const xed_decoded_inst_t *xedd) {
   return ss.str();
 }
 
+// Returns the subset of `flags` that are modelled by `State::aflag`, except
+// for the direction flag.
+static uint32_t ArithFlagsMask(const xed_flag_set_t *flags) {
+  xed_flag_set_t arith_flags = {};
+  arith_flags.s.cf = 1;
+  arith_flags.s.pf = 1;
+  arith_flags.s.af = 1;
+  arith_flags.s.zf = 1;
+  arith_flags.s.sf = 1;
+  arith_flags.s.of = 1;
+  return flags->flat & arith_flags.flat;
+}
+
+// Fill in the arithmetic flags that are read and unconditionally written by
+// the instruction.
+static void DecodeFlagsInfo(Instruction &inst, const xed_decoded_inst_t *xedd) {
+  auto rflags = xed_decoded_inst_get_rflags_info(xedd);
+  if (!rflags) {
+    return;
+  }
+  inst.flags_read = ArithFlagsMask(xed_simple_flag_get_read_flag_set(rflags));
+  if (xed_simple_flag_get_must_write(rflags) &&
+      !xed_simple_flag_get_may_write(rflags)) {
+    inst.flags_written =
+        ArithFlagsMask(xed_simple_flag_get_written_flag_set(rflags));
+  }
+}
+
 // Decode an instruction into the XED instuction format.
 static bool DecodeXED(xed_decoded_inst_t *xedd, const xed_state_t *mode,
                       std::string_view inst_bytes, uint64_t address) {
@@ -824,12 +853,13 @@ X86Arch::X86Arch(llvm::LLVMContext *context_, OSName os_name_,
                  ArchName arch_name_)
     : Arch(context_, os_name_, arch_name_) {
 
-  static bool xed_is_initialized = false;
-  if (!xed_is_initialized) {
+  // Architectures can be built concurrently by many threads, but XED's tables
+  // are global, and must only be initialized once.
+  static std::once_flag xed_is_initialized;
+  std::call_once(xed_is_initialized, [] {
     DLOG(INFO) << "Initializing XED tables";
     xed_tables_init();
-    xed_is_initialized = true;
-  }
+  });
 }
 
 X86Arch::~X86Arch(void) {}
@@ -987,6 +1017,8 @@ bool X86Arch::DecodeInstruction(uint64_t address, std::string_view inst_bytes,
     DecodeConditionalInterrupt(inst);
   }
 
+  DecodeFlagsInfo(inst, xedd);
+
   auto iform = xed_decoded_inst_get_iform_enum(xedd);
 
   if (!is_lazy || inst.IsControlFlow()) {
@@ -98,12 +98,21 @@
 #  define REG_XBX REG_EBX
 #endif  // 64 == ADDRESS_SIZE_BITS
 
-#define FLAG_CF state.aflag.cf
-#define FLAG_PF state.aflag.pf
-#define FLAG_AF state.aflag.af
-#define FLAG_ZF state.aflag.zf
-#define FLAG_SF state.aflag.sf
-#define FLAG_OF state.aflag.of
+#if REMILL_X86_LAZY_FLAGS
+#  define FLAG_CF MaterializeArithFlags(state).cf
+#  define FLAG_PF MaterializeArithFlags(state).pf
+#  define FLAG_AF MaterializeArithFlags(state).af
+#  define FLAG_ZF MaterializeArithFlags(state).zf
+#  define FLAG_SF MaterializeArithFlags(state).sf
+#  define FLAG_OF MaterializeArithFlags(state).of
+#else
+#  define FLAG_CF state.aflag.cf
+#  define FLAG_PF state.aflag.pf
+#  define FLAG_AF state.aflag.af
+#  define FLAG_ZF state.aflag.zf
+#  define FLAG_SF state.aflag.sf
+#  define FLAG_OF state.aflag.of
+#endif  // REMILL_X86_LAZY_FLAGS
 #define FLAG_DF state.aflag.df
 
 #define X87_ST0 state.st.elems[0].val
@@ -129,30 +138,15 @@
 #define REG_GS_BASE state.addr.gs_base.aword
 #define REG_CS_BASE IF_32BIT_ELSE(state.addr.cs_base.aword, 0)
 
-#define HYPER_CALL state.hyper_call
-#define INTERRUPT_VECTOR state.hyper_call_vector
-
-namespace {
-
-// Takes the place of an unsupported instruction.
-DEF_SEM(HandleUnsupported) {
-  return __remill_sync_hyper_call(
-      state, memory,
-      IF_64BIT_ELSE(SyncHyperCall::kAMD64EmulateInstruction,
-                    SyncHyperCall::kX86EmulateInstruction));
-}
-
-// Takes the place of an invalid instruction.
-DEF_SEM(HandleInvalidInstruction) {
-  HYPER_CALL = AsyncHyperCall::kInvalidInstruction;
-  return memory;
-}
-
-}  // namespace
+#if REMILL_X86_LAZY_FLAGS
 
-// Takes the place of an unsupported instruction.
-DEF_ISEL(UNSUPPORTED_INSTRUCTION) = HandleUnsupported;
-DEF_ISEL(INVALID_INSTRUCTION) = HandleInvalidInstruction;
+// Asynchronous hyper calls exit to the runtime, which expects to observe the
+// architectural flags.
+#  define HYPER_CALL MaterializeArithFlags(state), state.hyper_call
+#else
+#  define HYPER_CALL state.hyper_call
+#endif  // REMILL_X86_LAZY_FLAGS
+#define INTERRUPT_VECTOR state.hyper_call_vector
 
 namespace {
 template <typename T>
@@ -203,3 +197,39 @@ DEF_HELPER(PopFromStack)->T {
 #include "remill/Arch/X86/Semantics/XSAVE.cpp"
 
 // clang-format on
+
+namespace {
+
+// Takes the place of an unsupported instruction.
+DEF_SEM(HandleUnsupported) {
+  return __remill_sync_hyper_call(
+      state, memory,
+      IF_64BIT_ELSE(SyncHyperCall::kAMD64EmulateInstruction,
+                    SyncHyperCall::kX86EmulateInstruction));
+}
+
+// Takes the place of an invalid instruction.
+DEF_SEM(HandleInvalidInstruction) {
+  HYPER_CALL = AsyncHyperCall::kInvalidInstruction;
+  return memory;
+}
+
+#if REMILL_X86_LAZY_FLAGS
+
+// Called by the trace lifter before lifted code calls into the runtime, e.g.
+// by way of `__remill_jump`, which expects to observe the architectural flags.
+DEF_SEM(SyncLazyState) {
+  (void) MaterializeArithFlags(state);
+  return memory;
+}
+#endif  // REMILL_X86_LAZY_FLAGS
+
+}  // namespace
+
+// Takes the place of an unsupported instruction.
+DEF_ISEL(UNSUPPORTED_INSTRUCTION) = HandleUnsupported;
+DEF_ISEL(INVALID_INSTRUCTION) = HandleInvalidInstruction;
+
+#if REMILL_X86_LAZY_FLAGS
+DEF_ISEL(SYNC_LAZY_STATE) = SyncLazyState;
+#endif  // REMILL_X86_LAZY_FLAGS
@@ -45,6 +45,14 @@
 #  define HAS_FEATURE_AVX512 1
 #endif
 
+// When enabled, the semantics defer computing the arithmetic flags of common
+// flag-setting instructions until the flags are actually read. This adds a
+// `LazyArithFlags` record to the end of `State`, so code that shares `State`
+// with the semantics must be compiled with the same setting.
+#ifndef REMILL_X86_LAZY_FLAGS
+#  define REMILL_X86_LAZY_FLAGS 0
+#endif
+
 #if HAS_FEATURE_AVX
 #  define IF_AVX(...) __VA_ARGS__
 #  define IF_AVX_ELSE(a, b) a
@@ -416,6 +424,33 @@ struct alignas(8) ArithFlags final {
 
 static_assert(16 == sizeof(ArithFlags), "Invalid packing of `ArithFlags`.");
 
+#if REMILL_X86_LAZY_FLAGS
+
+// Kinds of operations whose arithmetic flags computations can be deferred.
+enum LazyFlagsOp : uint8_t {
+  kLazyFlagsNone,
+  kLazyFlagsAdd,
+  kLazyFlagsSub,
+  kLazyFlagsLogical
+};
+
+// The operands and result of the last flag-setting operation whose flags have
+// not yet been computed into `State::aflag`. Values are zero-extended from
+// `size` bytes.
+struct alignas(8) LazyArithFlags final {
+  LazyFlagsOp op;
+  uint8_t size;
+  uint8_t _0[6];
+  uint64_t lhs;
+  uint64_t rhs;
+  uint64_t res;
+} __attribute__((packed));
+
+static_assert(32 == sizeof(LazyArithFlags),
+              "Invalid packing of `LazyArithFlags`.");
+
+#endif  // REMILL_X86_LAZY_FLAGS
+
 union XCR0 {
   uint64_t flat;
 
@@ -750,10 +785,19 @@ struct alignas(16) State final : public ArchState {
   XCR0 xcr0;  // 8 bytes.
   FPU x87;  // 512 bytes
   SegmentCaches seg_caches;  // 96 bytes
+
+#if REMILL_X86_LAZY_FLAGS
+  LazyArithFlags lazy_aflag;  // 32 bytes.
+#endif
 } __attribute__((packed));
 
+#if REMILL_X86_LAZY_FLAGS
+static_assert((96 + 3264 + 16 + 32) == sizeof(State),
+              "Invalid packing of `struct State`");
+#else
 static_assert((96 + 3264 + 16) == sizeof(State),
               "Invalid packing of `struct State`");
+#endif
 
 using X86State = State;
 
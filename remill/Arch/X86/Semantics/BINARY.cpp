@@ -29,8 +29,15 @@ ALWAYS_INLINE static void WriteFlagsIncDec(State &state, T lhs, T rhs, T res) {
 
 template <typename Tag, typename T>
 ALWAYS_INLINE static void WriteFlagsAddSub(State &state, T lhs, T rhs, T res) {
+#if REMILL_X86_LAZY_FLAGS
+  DeferArithFlags(state,
+                  std::is_same<Tag, tag_add>::value ? kLazyFlagsAdd
+                                                    : kLazyFlagsSub,
+                  lhs, rhs, res);
+#else
   FLAG_CF = Carry<Tag>::Flag(lhs, rhs, res);
   WriteFlagsIncDec<Tag>(state, lhs, rhs, res);
+#endif  // REMILL_X86_LAZY_FLAGS
 }
 
 template <typename D, typename S1, typename S2>
@@ -96,6 +103,61 @@ DEF_ISEL_RnW_Rn_Rn(ADD_GPRv_GPRv_03, ADD);
 DEF_ISEL(ADD_AL_IMMb) = ADD<R8W, R8, I8>;
 DEF_ISEL_RnW_Rn_In(ADD_OrAX_IMMz, ADD);
 
+namespace {
+
+template <typename D, typename S1, typename S2>
+DEF_SEM(ADD_NOFLAGS, D dst, S1 src1, S2 src2) {
+  WriteZExt(dst, UAdd(Read(src1), Read(src2)));
+  return memory;
+}
+
+}  // namespace
+
+DEF_ISEL(NOFLAGS_ADD_MEMb_IMMb_80r0) = ADD_NOFLAGS<M8W, M8, I8>;
+DEF_ISEL(NOFLAGS_ADD_GPR8_IMMb_80r0) = ADD_NOFLAGS<R8W, R8, I8>;
+DEF_ISEL_MnW_Mn_In(NOFLAGS_ADD_MEMv_IMMz, ADD_NOFLAGS);
+DEF_ISEL_RnW_Rn_In(NOFLAGS_ADD_GPRv_IMMz, ADD_NOFLAGS);
+DEF_ISEL(NOFLAGS_ADD_MEMb_IMMb_82r0) = ADD_NOFLAGS<M8W, M8, I8>;
+DEF_ISEL(NOFLAGS_ADD_GPR8_IMMb_82r0) = ADD_NOFLAGS<R8W, R8, I8>;
+DEF_ISEL_MnW_Mn_In(NOFLAGS_ADD_MEMv_IMMb, ADD_NOFLAGS);
+DEF_ISEL_RnW_Rn_In(NOFLAGS_ADD_GPRv_IMMb, ADD_NOFLAGS);
+DEF_ISEL(NOFLAGS_ADD_MEMb_GPR8) = ADD_NOFLAGS<M8W, M8, R8>;
+DEF_ISEL(NOFLAGS_ADD_GPR8_GPR8_00) = ADD_NOFLAGS<R8W, R8, R8>;
+DEF_ISEL_MnW_Mn_Rn(NOFLAGS_ADD_MEMv_GPRv, ADD_NOFLAGS);
+DEF_ISEL_RnW_Rn_Rn(NOFLAGS_ADD_GPRv_GPRv_01, ADD_NOFLAGS);
+DEF_ISEL(NOFLAGS_ADD_GPR8_MEMb) = ADD_NOFLAGS<R8W, R8, M8>;
+DEF_ISEL(NOFLAGS_ADD_GPR8_GPR8_02) = ADD_NOFLAGS<R8W, R8, R8>;
+DEF_ISEL_RnW_Rn_Mn(NOFLAGS_ADD_GPRv_MEMv, ADD_NOFLAGS);
+DEF_ISEL_RnW_Rn_Rn(NOFLAGS_ADD_GPRv_GPRv_03, ADD_NOFLAGS);
+DEF_ISEL(NOFLAGS_ADD_AL_IMMb) = ADD_NOFLAGS<R8W, R8, I8>;
+DEF_ISEL_RnW_Rn_In(NOFLAGS_ADD_OrAX_IMMz, ADD_NOFLAGS);
+
+namespace {
+
+// The `ATOMIC_`-prefixed semantics are variants of those of `LOCK`-prefixed
+// instructions with memory destinations, here and in `LOGICAL.cpp` and
+// `SEMAPHORE.cpp`. They do the whole read-modify-write with a single
+// `__remill_fetch_and_*` intrinsic, instead of a read and a write between
+// `__remill_atomic_begin` and `__remill_atomic_end`, and are only used when
+// the lifter is asked to use native atomics.
+template <typename D, typename S1, typename S2>
+DEF_SEM(ATOMIC_ADD, D dst, S1, S2 src2) {
+  auto rhs = Read(src2);
+  auto lhs = UFetchAdd(dst, rhs);
+  auto res = UAdd(lhs, rhs);
+  WriteFlagsAddSub<tag_add>(state, lhs, rhs, res);
+  return memory;
+}
+
+}  // namespace
+
+DEF_ISEL(ATOMIC_ADD_MEMb_IMMb_80r0) = ATOMIC_ADD<M8W, M8, I8>;
+DEF_ISEL_MnW_Mn_In(ATOMIC_ADD_MEMv_IMMz, ATOMIC_ADD);
+DEF_ISEL(ATOMIC_ADD_MEMb_IMMb_82r0) = ATOMIC_ADD<M8W, M8, I8>;
+DEF_ISEL_MnW_Mn_In(ATOMIC_ADD_MEMv_IMMb, ATOMIC_ADD);
+DEF_ISEL(ATOMIC_ADD_MEMb_GPR8) = ATOMIC_ADD<M8W, M8, R8>;
+DEF_ISEL_MnW_Mn_Rn(ATOMIC_ADD_MEMv_GPRv, ATOMIC_ADD);
+
 DEF_ISEL(ADDPS_XMMps_MEMps) = ADDPS<V128W, V128, MV128>;
 DEF_ISEL(ADDPS_XMMps_XMMps) = ADDPS<V128W, V128, V128>;
 IF_AVX(DEF_ISEL(VADDPS_XMMdq_XMMdq_MEMdq) = ADDPS<VV128W, VV128, MV128>;)
@@ -185,6 +247,55 @@ DEF_ISEL_RnW_Rn_Mn(SUB_GPRv_MEMv, SUB);
 DEF_ISEL(SUB_AL_IMMb) = SUB<R8W, R8, I8>;
 DEF_ISEL_RnW_Rn_In(SUB_OrAX_IMMz, SUB);
 
+namespace {
+
+template <typename D, typename S1, typename S2>
+DEF_SEM(SUB_NOFLAGS, D dst, S1 src1, S2 src2) {
+  WriteZExt(dst, USub(Read(src1), Read(src2)));
+  return memory;
+}
+
+}  // namespace
+
+DEF_ISEL(NOFLAGS_SUB_MEMb_IMMb_80r5) = SUB_NOFLAGS<M8W, M8, I8>;
+DEF_ISEL(NOFLAGS_SUB_GPR8_IMMb_80r5) = SUB_NOFLAGS<R8W, R8, I8>;
+DEF_ISEL_MnW_Mn_In(NOFLAGS_SUB_MEMv_IMMz, SUB_NOFLAGS);
+DEF_ISEL_RnW_Rn_In(NOFLAGS_SUB_GPRv_IMMz, SUB_NOFLAGS);
+DEF_ISEL(NOFLAGS_SUB_MEMb_IMMb_82r5) = SUB_NOFLAGS<M8W, M8, I8>;
+DEF_ISEL(NOFLAGS_SUB_GPR8_IMMb_82r5) = SUB_NOFLAGS<R8W, R8, I8>;
+DEF_ISEL_MnW_Mn_In(NOFLAGS_SUB_MEMv_IMMb, SUB_NOFLAGS);
+DEF_ISEL_RnW_Rn_In(NOFLAGS_SUB_GPRv_IMMb, SUB_NOFLAGS);
+DEF_ISEL(NOFLAGS_SUB_MEMb_GPR8) = SUB_NOFLAGS<M8W, M8, I8>;
+DEF_ISEL(NOFLAGS_SUB_GPR8_GPR8_28) = SUB_NOFLAGS<R8W, R8, R8>;
+DEF_ISEL_MnW_Mn_Rn(NOFLAGS_SUB_MEMv_GPRv, SUB_NOFLAGS);
+DEF_ISEL_RnW_Rn_Rn(NOFLAGS_SUB_GPRv_GPRv_29, SUB_NOFLAGS);
+DEF_ISEL(NOFLAGS_SUB_GPR8_GPR8_2A) = SUB_NOFLAGS<R8W, R8, R8>;
+DEF_ISEL(NOFLAGS_SUB_GPR8_MEMb) = SUB_NOFLAGS<R8W, R8, M8>;
+DEF_ISEL_RnW_Rn_Rn(NOFLAGS_SUB_GPRv_GPRv_2B, SUB_NOFLAGS);
+DEF_ISEL_RnW_Rn_Mn(NOFLAGS_SUB_GPRv_MEMv, SUB_NOFLAGS);
+DEF_ISEL(NOFLAGS_SUB_AL_IMMb) = SUB_NOFLAGS<R8W, R8, I8>;
+DEF_ISEL_RnW_Rn_In(NOFLAGS_SUB_OrAX_IMMz, SUB_NOFLAGS);
+
+namespace {
+
+template <typename D, typename S1, typename S2>
+DEF_SEM(ATOMIC_SUB, D dst, S1, S2 src2) {
+  auto rhs = Read(src2);
+  auto lhs = UFetchSub(dst, rhs);
+  auto res = USub(lhs, rhs);
+  WriteFlagsAddSub<tag_sub>(state, lhs, rhs, res);
+  return memory;
+}
+
+}  // namespace
+
+DEF_ISEL(ATOMIC_SUB_MEMb_IMMb_80r5) = ATOMIC_SUB<M8W, M8, I8>;
+DEF_ISEL_MnW_Mn_In(ATOMIC_SUB_MEMv_IMMz, ATOMIC_SUB);
+DEF_ISEL(ATOMIC_SUB_MEMb_IMMb_82r5) = ATOMIC_SUB<M8W, M8, I8>;
+DEF_ISEL_MnW_Mn_In(ATOMIC_SUB_MEMv_IMMb, ATOMIC_SUB);
+DEF_ISEL(ATOMIC_SUB_MEMb_GPR8) = ATOMIC_SUB<M8W, M8, R8>;
+DEF_ISEL_MnW_Mn_Rn(ATOMIC_SUB_MEMv_GPRv, ATOMIC_SUB);
+
 DEF_ISEL(SUBPS_XMMps_MEMps) = SUBPS<V128W, V128, MV128>;
 DEF_ISEL(SUBPS_XMMps_XMMps) = SUBPS<V128W, V128, V128>;
 IF_AVX(DEF_ISEL(VSUBPS_XMMdq_XMMdq_MEMdq) = SUBPS<VV128W, VV128, MV128>;)
@@ -243,6 +354,36 @@ DEF_ISEL_Rn_In(CMP_OrAX_IMMz, CMP);
 
 namespace {
 
+template <typename S1, typename S2>
+DEF_SEM(CMP_NOFLAGS, S1 src1, S2 src2) {
+  (void) Read(src1);
+  (void) Read(src2);
+  return memory;
+}
+
+}  // namespace
+
+DEF_ISEL(NOFLAGS_CMP_MEMb_IMMb_80r7) = CMP_NOFLAGS<M8, I8>;
+DEF_ISEL(NOFLAGS_CMP_GPR8_IMMb_80r7) = CMP_NOFLAGS<R8, I8>;
+DEF_ISEL_Mn_In(NOFLAGS_CMP_MEMv_IMMz, CMP_NOFLAGS);
+DEF_ISEL_Rn_In(NOFLAGS_CMP_GPRv_IMMz, CMP_NOFLAGS);
+DEF_ISEL(NOFLAGS_CMP_MEMb_IMMb_82r7) = CMP_NOFLAGS<M8, I8>;
+DEF_ISEL(NOFLAGS_CMP_GPR8_IMMb_82r7) = CMP_NOFLAGS<R8, I8>;
+DEF_ISEL_Mn_In(NOFLAGS_CMP_MEMv_IMMb, CMP_NOFLAGS);
+DEF_ISEL_Rn_In(NOFLAGS_CMP_GPRv_IMMb, CMP_NOFLAGS);
+DEF_ISEL(NOFLAGS_CMP_MEMb_GPR8) = CMP_NOFLAGS<M8, I8>;
+DEF_ISEL(NOFLAGS_CMP_GPR8_GPR8_38) = CMP_NOFLAGS<R8, R8>;
+DEF_ISEL_Mn_In(NOFLAGS_CMP_MEMv_GPRv, CMP_NOFLAGS);
+DEF_ISEL_Rn_Rn(NOFLAGS_CMP_GPRv_GPRv_39, CMP_NOFLAGS);
+DEF_ISEL(NOFLAGS_CMP_GPR8_GPR8_3A) = CMP_NOFLAGS<R8, R8>;
+DEF_ISEL(NOFLAGS_CMP_GPR8_MEMb) = CMP_NOFLAGS<R8, M8>;
+DEF_ISEL_Rn_Rn(NOFLAGS_CMP_GPRv_GPRv_3B, CMP_NOFLAGS);
+DEF_ISEL_Rn_Mn(NOFLAGS_CMP_GPRv_MEMv, CMP_NOFLAGS);
+DEF_ISEL(NOFLAGS_CMP_AL_IMMb) = CMP_NOFLAGS<R8, I8>;
+DEF_ISEL_Rn_In(NOFLAGS_CMP_OrAX_IMMz, CMP_NOFLAGS);
+
+namespace {
+
 template <typename T, typename U, typename V>
 ALWAYS_INLINE static void WriteFlagsMul(State &state, T lhs, T rhs, U res,
                                         V res_trunc) {
@@ -628,12 +769,78 @@ DEF_ISEL_MnW_Mn(INC_MEMv, INC);
 DEF_ISEL_RnW_Rn(INC_GPRv_FFr0, INC);
 DEF_ISEL_RnW_Rn(INC_GPRv_40, INC);
 
+namespace {
+
+template <typename D, typename S1>
+DEF_SEM(INC_NOFLAGS, D dst, S1 src) {
+  auto val = Read(src);
+  WriteZExt(dst, UAdd(val, decltype(val)(1)));
+  return memory;
+}
+
+}  // namespace
+
+DEF_ISEL(NOFLAGS_INC_MEMb) = INC_NOFLAGS<M8W, M8>;
+DEF_ISEL(NOFLAGS_INC_GPR8) = INC_NOFLAGS<R8W, R8>;
+DEF_ISEL_MnW_Mn(NOFLAGS_INC_MEMv, INC_NOFLAGS);
+DEF_ISEL_RnW_Rn(NOFLAGS_INC_GPRv_FFr0, INC_NOFLAGS);
+DEF_ISEL_RnW_Rn(NOFLAGS_INC_GPRv_40, INC_NOFLAGS);
+
+namespace {
+
+template <typename D, typename S1>
+DEF_SEM(ATOMIC_INC, D dst, S1) {
+  auto_t(S1) rhs = 1;
+  auto lhs = UFetchAdd(dst, rhs);
+  auto res = UAdd(lhs, rhs);
+  WriteFlagsIncDec<tag_add>(state, lhs, rhs, res);
+  return memory;
+}
+
+}  // namespace
+
+DEF_ISEL(ATOMIC_INC_MEMb) = ATOMIC_INC<M8W, M8>;
+DEF_ISEL_MnW_Mn(ATOMIC_INC_MEMv, ATOMIC_INC);
+
 DEF_ISEL(DEC_MEMb) = DEC<M8W, M8>;
 DEF_ISEL(DEC_GPR8) = DEC<R8W, R8>;
 DEF_ISEL_MnW_Mn(DEC_MEMv, DEC);
 DEF_ISEL_RnW_Rn(DEC_GPRv_FFr1, DEC);
 DEF_ISEL_RnW_Rn(DEC_GPRv_48, DEC);
 
+namespace {
+
+template <typename D, typename S1>
+DEF_SEM(DEC_NOFLAGS, D dst, S1 src) {
+  auto val = Read(src);
+  WriteZExt(dst, USub(val, decltype(val)(1)));
+  return memory;
+}
+
+}  // namespace
+
+DEF_ISEL(NOFLAGS_DEC_MEMb) = DEC_NOFLAGS<M8W, M8>;
+DEF_ISEL(NOFLAGS_DEC_GPR8) = DEC_NOFLAGS<R8W, R8>;
+DEF_ISEL_MnW_Mn(NOFLAGS_DEC_MEMv, DEC_NOFLAGS);
+DEF_ISEL_RnW_Rn(NOFLAGS_DEC_GPRv_FFr1, DEC_NOFLAGS);
+DEF_ISEL_RnW_Rn(NOFLAGS_DEC_GPRv_48, DEC_NOFLAGS);
+
+namespace {
+
+template <typename D, typename S1>
+DEF_SEM(ATOMIC_DEC, D dst, S1) {
+  auto_t(S1) rhs = 1;
+  auto lhs = UFetchSub(dst, rhs);
+  auto res = USub(lhs, rhs);
+  WriteFlagsIncDec<tag_sub>(state, lhs, rhs, res);
+  return memory;
+}
+
+}  // namespace
+
+DEF_ISEL(ATOMIC_DEC_MEMb) = ATOMIC_DEC<M8W, M8>;
+DEF_ISEL_MnW_Mn(ATOMIC_DEC_MEMv, ATOMIC_DEC);
+
 DEF_ISEL(NEG_MEMb) = NEG<M8W, M8>;
 DEF_ISEL(NEG_GPR8) = NEG<R8W, R8>;
 DEF_ISEL_MnW_Mn(NEG_MEMv, NEG);
@@ -90,6 +90,7 @@ DEF_SEM(IRETD, IF_32BIT_ELSE(R32W, R64W) pc_dst) {
   Write(pc_dst, new_eip);
   Write(REG_CS.flat, new_cs);
   state.rflag = f;
+  DiscardLazyArithFlags(state);
   state.aflag.af = f.af;
   state.aflag.cf = f.cf;
   state.aflag.df = f.df;
@@ -114,6 +115,7 @@ DEF_SEM(IRETQ, IF_32BIT_ELSE(R32W, R64W) pc_dst) {
   Write(pc_dst, new_rip);
   Write(REG_CS.flat, new_cs);
   state.rflag = f;
+  DiscardLazyArithFlags(state);
   state.aflag.af = f.af;
   state.aflag.cf = f.cf;
   state.aflag.df = f.df;
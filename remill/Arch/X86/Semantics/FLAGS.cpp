@@ -170,10 +170,119 @@ struct Carry<tag_sub> {
   }
 };
 
+#if REMILL_X86_LAZY_FLAGS
+
+// Computes the arithmetic flags of a deferred `T`-sized addition or
+// subtraction.
+template <typename Tag, typename T>
+ALWAYS_INLINE static void ComputeLazyArithFlags(State &state,
+                                                const LazyArithFlags &lazy) {
+  const auto lhs = static_cast<T>(lazy.lhs);
+  const auto rhs = static_cast<T>(lazy.rhs);
+  const auto res = static_cast<T>(lazy.res);
+  state.aflag.cf = Carry<Tag>::Flag(lhs, rhs, res);
+  state.aflag.pf = ParityFlag(res);
+  state.aflag.af = AuxCarryFlag(lhs, rhs, res);
+  state.aflag.zf = ZeroFlag(res);
+  state.aflag.sf = SignFlag(res);
+  state.aflag.of = Overflow<Tag>::Flag(lhs, rhs, res);
+}
+
+// Computes the arithmetic flags of a deferred `T`-sized logical operation.
+template <typename T>
+ALWAYS_INLINE static void ComputeLazyLogicalFlags(State &state,
+                                                  const LazyArithFlags &lazy) {
+  const auto res = static_cast<T>(lazy.res);
+  state.aflag.cf = false;
+  state.aflag.pf = ParityFlag(res);
+  state.aflag.af = false;  // Undefined, but ends up being `0`.
+  state.aflag.zf = ZeroFlag(res);
+  state.aflag.sf = SignFlag(res);
+  state.aflag.of = false;
+}
+
+// Key of the `switch` in `MaterializeArithFlags`.
+static constexpr unsigned LazyFlagsKey(LazyFlagsOp op, unsigned size) {
+  return (static_cast<unsigned>(op) << 4u) | size;
+}
+
+// Computes every flag of the pending deferred operation, if any, into
+// `state.aflag`. Every read or partial write of the arithmetic flags goes
+// through here (via the `FLAG_*` macros). When the pending operation is
+// known at lift time, the `switch` folds away, and the optimizer only keeps
+// the flags that are used. Otherwise, the one `switch` fills in all of the
+// flags, and marks them as computed. That mark is stored unconditionally, so
+// that later flag reads by the same block see that nothing is pending, and
+// their `switch`es fold away.
+ALWAYS_INLINE static ArithFlags &MaterializeArithFlags(State &state) {
+  auto &lazy = state.lazy_aflag;
+  if (kLazyFlagsNone != lazy.op) {
+    switch (LazyFlagsKey(lazy.op, lazy.size)) {
+#    define MAKE_LAZY_FLAGS_CASES(size, type) \
+      case LazyFlagsKey(kLazyFlagsAdd, size): \
+        ComputeLazyArithFlags<tag_add, type>(state, lazy); \
+        break; \
+      case LazyFlagsKey(kLazyFlagsSub, size): \
+        ComputeLazyArithFlags<tag_sub, type>(state, lazy); \
+        break; \
+      case LazyFlagsKey(kLazyFlagsLogical, size): \
+        ComputeLazyLogicalFlags<type>(state, lazy); \
+        break;
+
+      MAKE_LAZY_FLAGS_CASES(1, uint8_t)
+      MAKE_LAZY_FLAGS_CASES(2, uint16_t)
+      MAKE_LAZY_FLAGS_CASES(4, uint32_t)
+      MAKE_LAZY_FLAGS_CASES(8, uint64_t)
+#    undef MAKE_LAZY_FLAGS_CASES
+      default: break;
+    }
+  }
+  lazy.op = kLazyFlagsNone;
+  return state.aflag;
+}
+
+// Records an operation whose arithmetic flags will be computed on demand.
+template <typename T>
+ALWAYS_INLINE static void DeferArithFlags(State &state, LazyFlagsOp op, T lhs,
+                                          T rhs, T res) {
+  static_assert(std::is_unsigned<T>::value,
+                "Deferred flags must be computed from unsigned values.");
+  state.lazy_aflag.op = op;
+  state.lazy_aflag.size = static_cast<uint8_t>(sizeof(T));
+  state.lazy_aflag.lhs = static_cast<uint64_t>(lhs);
+  state.lazy_aflag.rhs = static_cast<uint64_t>(rhs);
+  state.lazy_aflag.res = static_cast<uint64_t>(res);
+}
+
+// Drops the pending deferred operation, if any. Used when every arithmetic
+// flag is about to be overwritten.
+ALWAYS_INLINE static void DiscardLazyArithFlags(State &state) {
+  state.lazy_aflag.op = kLazyFlagsNone;
+}
+
+#else
+
+ALWAYS_INLINE static ArithFlags &MaterializeArithFlags(State &state) {
+  return state.aflag;
+}
+
+ALWAYS_INLINE static void DiscardLazyArithFlags(State &) {}
+
+#endif  // REMILL_X86_LAZY_FLAGS
+
 }  // namespace
 
+#if REMILL_X86_LAZY_FLAGS
+
+// Synchronous hyper calls hand the state over to the runtime, which expects
+// to observe the architectural flags.
+#  define __remill_sync_hyper_call(state, mem, call) \
+    __remill_sync_hyper_call((MaterializeArithFlags(state), state), mem, call)
+#endif  // REMILL_X86_LAZY_FLAGS
+
 #define ClearArithFlags() \
   do { \
+    DiscardLazyArithFlags(state); \
     state.aflag.cf = __remill_undefined_8(); \
     state.aflag.pf = __remill_undefined_8(); \
     state.aflag.af = __remill_undefined_8(); \
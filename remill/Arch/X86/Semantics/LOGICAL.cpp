@@ -20,12 +20,16 @@ namespace {
 
 template <typename T>
 ALWAYS_INLINE void SetFlagsLogical(State &state, T lhs, T rhs, T res) {
+#if REMILL_X86_LAZY_FLAGS
+  DeferArithFlags(state, kLazyFlagsLogical, lhs, rhs, res);
+#else
   state.aflag.cf = false;
   state.aflag.pf = ParityFlag(res);
   state.aflag.zf = ZeroFlag(res);
   state.aflag.sf = SignFlag(res);
   state.aflag.of = false;
   state.aflag.af = false;  // Undefined, but ends up being `0`.
+#endif  // REMILL_X86_LAZY_FLAGS
 }
 
 template <typename D, typename S1, typename S2>
@@ -94,6 +98,55 @@ DEF_ISEL_RnW_Rn_Mn(AND_GPRv_MEMv, AND);
 DEF_ISEL(AND_AL_IMMb) = AND<R8W, R8, I8>;
 DEF_ISEL_RnW_Rn_In(AND_OrAX_IMMz, AND);
 
+namespace {
+
+template <typename D, typename S1, typename S2>
+DEF_SEM(AND_NOFLAGS, D dst, S1 src1, S2 src2) {
+  WriteZExt(dst, UAnd(Read(src1), Read(src2)));
+  return memory;
+}
+
+}  // namespace
+
+DEF_ISEL(NOFLAGS_AND_MEMb_IMMb_80r4) = AND_NOFLAGS<M8W, M8, I8>;
+DEF_ISEL(NOFLAGS_AND_GPR8_IMMb_80r4) = AND_NOFLAGS<R8W, R8, I8>;
+DEF_ISEL_MnW_Mn_In(NOFLAGS_AND_MEMv_IMMz, AND_NOFLAGS);
+DEF_ISEL_RnW_Rn_In(NOFLAGS_AND_GPRv_IMMz, AND_NOFLAGS);
+DEF_ISEL(NOFLAGS_AND_MEMb_IMMb_82r4) = AND_NOFLAGS<M8W, M8, I8>;
+DEF_ISEL(NOFLAGS_AND_GPR8_IMMb_82r4) = AND_NOFLAGS<R8W, R8, I8>;
+DEF_ISEL_MnW_Mn_In(NOFLAGS_AND_MEMv_IMMb, AND_NOFLAGS);
+DEF_ISEL_RnW_Rn_In(NOFLAGS_AND_GPRv_IMMb, AND_NOFLAGS);
+DEF_ISEL(NOFLAGS_AND_MEMb_GPR8) = AND_NOFLAGS<M8W, M8, R8>;
+DEF_ISEL(NOFLAGS_AND_GPR8_GPR8_20) = AND_NOFLAGS<R8W, R8, R8>;
+DEF_ISEL_MnW_Mn_Rn(NOFLAGS_AND_MEMv_GPRv, AND_NOFLAGS);
+DEF_ISEL_RnW_Rn_Rn(NOFLAGS_AND_GPRv_GPRv_21, AND_NOFLAGS);
+DEF_ISEL(NOFLAGS_AND_GPR8_GPR8_22) = AND_NOFLAGS<R8W, R8, R8>;
+DEF_ISEL(NOFLAGS_AND_GPR8_MEMb) = AND_NOFLAGS<R8W, R8, M8>;
+DEF_ISEL_RnW_Rn_Rn(NOFLAGS_AND_GPRv_GPRv_23, AND_NOFLAGS);
+DEF_ISEL_RnW_Rn_Mn(NOFLAGS_AND_GPRv_MEMv, AND_NOFLAGS);
+DEF_ISEL(NOFLAGS_AND_AL_IMMb) = AND_NOFLAGS<R8W, R8, I8>;
+DEF_ISEL_RnW_Rn_In(NOFLAGS_AND_OrAX_IMMz, AND_NOFLAGS);
+
+namespace {
+
+template <typename D, typename S1, typename S2>
+DEF_SEM(ATOMIC_AND, D dst, S1, S2 src2) {
+  auto rhs = Read(src2);
+  auto lhs = UFetchAnd(dst, rhs);
+  auto res = UAnd(lhs, rhs);
+  SetFlagsLogical(state, lhs, rhs, res);
+  return memory;
+}
+
+}  // namespace
+
+DEF_ISEL(ATOMIC_AND_MEMb_IMMb_80r4) = ATOMIC_AND<M8W, M8, I8>;
+DEF_ISEL_MnW_Mn_In(ATOMIC_AND_MEMv_IMMz, ATOMIC_AND);
+DEF_ISEL(ATOMIC_AND_MEMb_IMMb_82r4) = ATOMIC_AND<M8W, M8, I8>;
+DEF_ISEL_MnW_Mn_In(ATOMIC_AND_MEMv_IMMb, ATOMIC_AND);
+DEF_ISEL(ATOMIC_AND_MEMb_GPR8) = ATOMIC_AND<M8W, M8, R8>;
+DEF_ISEL_MnW_Mn_Rn(ATOMIC_AND_MEMv_GPRv, ATOMIC_AND);
+
 DEF_ISEL(OR_MEMb_IMMb_80r1) = OR<M8W, M8, I8>;
 DEF_ISEL(OR_GPR8_IMMb_80r1) = OR<R8W, R8, I8>;
 DEF_ISEL_MnW_Mn_In(OR_MEMv_IMMz, OR);
@@ -113,6 +166,55 @@ DEF_ISEL_RnW_Rn_Rn(OR_GPRv_GPRv_0B, OR);
 DEF_ISEL(OR_AL_IMMb) = OR<R8W, R8, I8>;
 DEF_ISEL_RnW_Rn_In(OR_OrAX_IMMz, OR);
 
+namespace {
+
+template <typename D, typename S1, typename S2>
+DEF_SEM(OR_NOFLAGS, D dst, S1 src1, S2 src2) {
+  WriteZExt(dst, UOr(Read(src1), Read(src2)));
+  return memory;
+}
+
+}  // namespace
+
+DEF_ISEL(NOFLAGS_OR_MEMb_IMMb_80r1) = OR_NOFLAGS<M8W, M8, I8>;
+DEF_ISEL(NOFLAGS_OR_GPR8_IMMb_80r1) = OR_NOFLAGS<R8W, R8, I8>;
+DEF_ISEL_MnW_Mn_In(NOFLAGS_OR_MEMv_IMMz, OR_NOFLAGS);
+DEF_ISEL_RnW_Rn_In(NOFLAGS_OR_GPRv_IMMz, OR_NOFLAGS);
+DEF_ISEL(NOFLAGS_OR_MEMb_IMMb_82r1) = OR_NOFLAGS<M8W, M8, I8>;
+DEF_ISEL(NOFLAGS_OR_GPR8_IMMb_82r1) = OR_NOFLAGS<R8W, R8, I8>;
+DEF_ISEL_MnW_Mn_In(NOFLAGS_OR_MEMv_IMMb, OR_NOFLAGS);
+DEF_ISEL_RnW_Rn_In(NOFLAGS_OR_GPRv_IMMb, OR_NOFLAGS);
+DEF_ISEL(NOFLAGS_OR_MEMb_GPR8) = OR_NOFLAGS<M8W, M8, R8>;
+DEF_ISEL(NOFLAGS_OR_GPR8_GPR8_08) = OR_NOFLAGS<R8W, R8, R8>;
+DEF_ISEL_MnW_Mn_Rn(NOFLAGS_OR_MEMv_GPRv, OR_NOFLAGS);
+DEF_ISEL_RnW_Rn_Rn(NOFLAGS_OR_GPRv_GPRv_09, OR_NOFLAGS);
+DEF_ISEL(NOFLAGS_OR_GPR8_MEMb) = OR_NOFLAGS<R8W, R8, M8>;
+DEF_ISEL(NOFLAGS_OR_GPR8_GPR8_0A) = OR_NOFLAGS<R8W, R8, R8>;
+DEF_ISEL_RnW_Rn_Mn(NOFLAGS_OR_GPRv_MEMv, OR_NOFLAGS);
+DEF_ISEL_RnW_Rn_Rn(NOFLAGS_OR_GPRv_GPRv_0B, OR_NOFLAGS);
+DEF_ISEL(NOFLAGS_OR_AL_IMMb) = OR_NOFLAGS<R8W, R8, I8>;
+DEF_ISEL_RnW_Rn_In(NOFLAGS_OR_OrAX_IMMz, OR_NOFLAGS);
+
+namespace {
+
+template <typename D, typename S1, typename S2>
+DEF_SEM(ATOMIC_OR, D dst, S1, S2 src2) {
+  auto rhs = Read(src2);
+  auto lhs = UFetchOr(dst, rhs);
+  auto res = UOr(lhs, rhs);
+  SetFlagsLogical(state, lhs, rhs, res);
+  return memory;
+}
+
+}  // namespace
+
+DEF_ISEL(ATOMIC_OR_MEMb_IMMb_80r1) = ATOMIC_OR<M8W, M8, I8>;
+DEF_ISEL_MnW_Mn_In(ATOMIC_OR_MEMv_IMMz, ATOMIC_OR);
+DEF_ISEL(ATOMIC_OR_MEMb_IMMb_82r1) = ATOMIC_OR<M8W, M8, I8>;
+DEF_ISEL_MnW_Mn_In(ATOMIC_OR_MEMv_IMMb, ATOMIC_OR);
+DEF_ISEL(ATOMIC_OR_MEMb_GPR8) = ATOMIC_OR<M8W, M8, R8>;
+DEF_ISEL_MnW_Mn_Rn(ATOMIC_OR_MEMv_GPRv, ATOMIC_OR);
+
 DEF_ISEL(XOR_MEMb_IMMb_80r6) = XOR<M8W, M8, I8>;
 DEF_ISEL(XOR_GPR8_IMMb_80r6) = XOR<R8W, R8, I8>;
 DEF_ISEL_MnW_Mn_In(XOR_MEMv_IMMz, XOR);
@@ -132,6 +234,55 @@ DEF_ISEL_RnW_Rn_Mn(XOR_GPRv_MEMv, XOR);
 DEF_ISEL(XOR_AL_IMMb) = XOR<R8W, R8, I8>;
 DEF_ISEL_RnW_Rn_In(XOR_OrAX_IMMz, XOR);
 
+namespace {
+
+template <typename D, typename S1, typename S2>
+DEF_SEM(XOR_NOFLAGS, D dst, S1 src1, S2 src2) {
+  WriteZExt(dst, UXor(Read(src1), Read(src2)));
+  return memory;
+}
+
+}  // namespace
+
+DEF_ISEL(NOFLAGS_XOR_MEMb_IMMb_80r6) = XOR_NOFLAGS<M8W, M8, I8>;
+DEF_ISEL(NOFLAGS_XOR_GPR8_IMMb_80r6) = XOR_NOFLAGS<R8W, R8, I8>;
+DEF_ISEL_MnW_Mn_In(NOFLAGS_XOR_MEMv_IMMz, XOR_NOFLAGS);
+DEF_ISEL_RnW_Rn_In(NOFLAGS_XOR_GPRv_IMMz, XOR_NOFLAGS);
+DEF_ISEL(NOFLAGS_XOR_MEMb_IMMb_82r6) = XOR_NOFLAGS<M8W, M8, I8>;
+DEF_ISEL(NOFLAGS_XOR_GPR8_IMMb_82r6) = XOR_NOFLAGS<R8W, R8, I8>;
+DEF_ISEL_MnW_Mn_In(NOFLAGS_XOR_MEMv_IMMb, XOR_NOFLAGS);
+DEF_ISEL_RnW_Rn_In(NOFLAGS_XOR_GPRv_IMMb, XOR_NOFLAGS);
+DEF_ISEL(NOFLAGS_XOR_MEMb_GPR8) = XOR_NOFLAGS<M8W, M8, R8>;
+DEF_ISEL(NOFLAGS_XOR_GPR8_GPR8_30) = XOR_NOFLAGS<R8W, R8, R8>;
+DEF_ISEL_MnW_Mn_Rn(NOFLAGS_XOR_MEMv_GPRv, XOR_NOFLAGS);
+DEF_ISEL_RnW_Rn_Rn(NOFLAGS_XOR_GPRv_GPRv_31, XOR_NOFLAGS);
+DEF_ISEL(NOFLAGS_XOR_GPR8_GPR8_32) = XOR_NOFLAGS<R8W, R8, R8>;
+DEF_ISEL(NOFLAGS_XOR_GPR8_MEMb) = XOR_NOFLAGS<R8W, R8, M8>;
+DEF_ISEL_RnW_Rn_Rn(NOFLAGS_XOR_GPRv_GPRv_33, XOR_NOFLAGS);
+DEF_ISEL_RnW_Rn_Mn(NOFLAGS_XOR_GPRv_MEMv, XOR_NOFLAGS);
+DEF_ISEL(NOFLAGS_XOR_AL_IMMb) = XOR_NOFLAGS<R8W, R8, I8>;
+DEF_ISEL_RnW_Rn_In(NOFLAGS_XOR_OrAX_IMMz, XOR_NOFLAGS);
+
+namespace {
+
+template <typename D, typename S1, typename S2>
+DEF_SEM(ATOMIC_XOR, D dst, S1, S2 src2) {
+  auto rhs = Read(src2);
+  auto lhs = UFetchXor(dst, rhs);
+  auto res = UXor(lhs, rhs);
+  SetFlagsLogical(state, lhs, rhs, res);
+  return memory;
+}
+
+}  // namespace
+
+DEF_ISEL(ATOMIC_XOR_MEMb_IMMb_80r6) = ATOMIC_XOR<M8W, M8, I8>;
+DEF_ISEL_MnW_Mn_In(ATOMIC_XOR_MEMv_IMMz, ATOMIC_XOR);
+DEF_ISEL(ATOMIC_XOR_MEMb_IMMb_82r6) = ATOMIC_XOR<M8W, M8, I8>;
+DEF_ISEL_MnW_Mn_In(ATOMIC_XOR_MEMv_IMMb, ATOMIC_XOR);
+DEF_ISEL(ATOMIC_XOR_MEMb_GPR8) = ATOMIC_XOR<M8W, M8, R8>;
+DEF_ISEL_MnW_Mn_Rn(ATOMIC_XOR_MEMv_GPRv, ATOMIC_XOR);
+
 DEF_ISEL(NOT_MEMb) = NOT<M8W, M8>;
 DEF_ISEL(NOT_GPR8) = NOT<R8W, R8>;
 DEF_ISEL_MnW_Mn(NOT_MEMv, NOT);
@@ -154,6 +305,32 @@ DEF_ISEL_Rn_In(TEST_OrAX_IMMz, TEST);
 
 namespace {
 
+template <typename S1, typename S2>
+DEF_SEM(TEST_NOFLAGS, S1 src1, S2 src2) {
+  (void) Read(src1);
+  (void) Read(src2);
+  return memory;
+}
+
+}  // namespace
+
+DEF_ISEL(NOFLAGS_TEST_MEMb_IMMb_F6r0) = TEST_NOFLAGS<M8, I8>;
+DEF_ISEL(NOFLAGS_TEST_MEMb_IMMb_F6r1) = TEST_NOFLAGS<M8, I8>;
+DEF_ISEL(NOFLAGS_TEST_GPR8_IMMb_F6r0) = TEST_NOFLAGS<R8, I8>;
+DEF_ISEL(NOFLAGS_TEST_GPR8_IMMb_F6r1) = TEST_NOFLAGS<R8, I8>;
+DEF_ISEL_Mn_In(NOFLAGS_TEST_MEMv_IMMz_F7r0, TEST_NOFLAGS);
+DEF_ISEL_Mn_In(NOFLAGS_TEST_MEMv_IMMz_F7r1, TEST_NOFLAGS);
+DEF_ISEL_Rn_In(NOFLAGS_TEST_GPRv_IMMz_F7r0, TEST_NOFLAGS);
+DEF_ISEL_Rn_In(NOFLAGS_TEST_GPRv_IMMz_F7r1, TEST_NOFLAGS);
+DEF_ISEL(NOFLAGS_TEST_MEMb_GPR8) = TEST_NOFLAGS<M8, R8>;
+DEF_ISEL(NOFLAGS_TEST_GPR8_GPR8) = TEST_NOFLAGS<R8, R8>;
+DEF_ISEL_Mn_Rn(NOFLAGS_TEST_MEMv_GPRv, TEST_NOFLAGS);
+DEF_ISEL_Rn_Rn(NOFLAGS_TEST_GPRv_GPRv, TEST_NOFLAGS);
+DEF_ISEL(NOFLAGS_TEST_AL_IMMb) = TEST_NOFLAGS<R8, I8>;
+DEF_ISEL_Rn_In(NOFLAGS_TEST_OrAX_IMMz, TEST_NOFLAGS);
+
+namespace {
+
 template <typename D, typename S1, typename S2>
 DEF_SEM(PAND_64, D dst, S1 src1, S2 src2) {
   UWriteV64(dst, UAndV64(UReadV64(src1), UReadV64(src2)));
@@ -19,6 +19,7 @@
 namespace {
 
 static void SerializeFlags(State &state) {
+  MaterializeArithFlags(state);
   state.rflag.cf = state.aflag.cf;
 
   //state.rflag.must_be_1 = 1;
@@ -114,3 +114,20 @@ DEF_ISEL(XADD_MEMb_GPR8) = XADD<M8W, M8, R8W, R8>;
 DEF_ISEL(XADD_GPR8_GPR8) = XADD<R8W, R8, R8W, R8>;
 DEF_ISEL_MnW_Mn_RnW_Rn(XADD_MEMv_GPRv, XADD);
 DEF_ISEL_RnW_Rn_RnW_Rn(XADD_GPRv_GPRv, XADD);
+
+namespace {
+
+template <typename D1, typename S1, typename D2, typename S2>
+DEF_SEM(ATOMIC_XADD, D1 dst1, S1, D2 dst2, S2 src2) {
+  auto rhs = Read(src2);
+  auto lhs = UFetchAdd(dst1, rhs);
+  auto sum = UAdd(lhs, rhs);
+  WriteZExt(dst2, lhs);
+  WriteFlagsAddSub<tag_add>(state, lhs, rhs, sum);
+  return memory;
+}
+
+}  // namespace
+
+DEF_ISEL(ATOMIC_XADD_MEMb_GPR8) = ATOMIC_XADD<M8W, M8, R8W, R8>;
+DEF_ISEL_MnW_Mn_RnW_Rn(ATOMIC_XADD_MEMv_GPRv, ATOMIC_XADD);
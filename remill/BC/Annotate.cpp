@@ -93,4 +93,51 @@ llvm::Function *GetTied(llvm::Function *func, const std::string &kind) {
 }
 
 #endif
+
+FunctionOriginIndex::FunctionOriginIndex(llvm::Module &module) {
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(4, 0)
+  for (auto &func : module) {
+    auto metadata_node = func.getMetadata(BaseFunction::metadata_kind);
+    if (!metadata_node || metadata_node->getNumOperands() != 1) {
+      continue;
+    }
+
+    if (auto metadata_s =
+            llvm::dyn_cast<llvm::MDString>(metadata_node->getOperand(0))) {
+      Add(&func, metadata_s->getString().str());
+    }
+  }
+#else
+  LOG(ERROR)
+      << "LLVM version is less than 4.0, functions metadata are not avalaible";
+#endif
+}
+
+void FunctionOriginIndex::Add(llvm::Function *func, const std::string &origin) {
+  auto order = next_order;
+  if (auto origin_it = origin_of.find(func); origin_it != origin_of.end()) {
+    order = origin_it->second.second;
+    Erase(func);
+  } else {
+    ++next_order;
+  }
+
+  by_origin[origin].emplace(order, func);
+  origin_of.emplace(func, std::make_pair(origin, order));
+}
+
+void FunctionOriginIndex::Erase(llvm::Function *func) {
+  auto origin_it = origin_of.find(func);
+  if (origin_it == origin_of.end()) {
+    return;
+  }
+
+  auto funcs_it = by_origin.find(origin_it->second.first);
+  funcs_it->second.erase(origin_it->second.second);
+  if (funcs_it->second.empty()) {
+    by_origin.erase(funcs_it);
+  }
+  origin_of.erase(origin_it);
+}
+
 }  // namespace remill
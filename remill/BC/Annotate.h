@@ -20,6 +20,9 @@
 #include <llvm/IR/Metadata.h>
 #include <llvm/IR/Module.h>
 
+#include <algorithm>
+#include <cstdint>
+#include <map>
 #include <string>
 #include <unordered_map>
 #include <utility>
@@ -99,7 +102,8 @@ static bool Remove(llvm::Function *func) {
     return false;
   }
 
-  func->eraseMetadata(node->getMetadataID());
+  func->eraseMetadata(
+      func->getContext().getMDKindID(OriginType::metadata_kind));
   return true;
 }
 
@@ -126,7 +130,8 @@ static bool HasOriginType(llvm::Function *func) {
          HasOriginType<Second, OriginTypes...>(func);
 }
 
-// Return list of functions that are one of chosen OriginType
+// Return list of functions that are one of chosen OriginType. This scans the
+// whole module; see `FunctionOriginIndex` for passes that query repeatedly.
 template <typename Container, typename... OriginTypes>
 static void GetFunctionsByOrigin(llvm::Module &module, Container &result) {
   for (auto &func : module) {
@@ -386,5 +391,125 @@ GetTieMapping(llvm::Module &module, const std::string &kind = TieKind) {
 
 #endif
 
+// An index of the functions of a module by their OriginType, for passes that
+// query the annotations many times. Building the index scans the module once,
+// after which the queries below take time proportional to their results,
+// rather than to the size of the module.
+//
+// Annotations changed through the index keep it up to date. Annotations
+// changed with the free functions above, or functions erased from the module,
+// are not seen by the index, which must then be rebuilt.
+class FunctionOriginIndex {
+ public:
+  explicit FunctionOriginIndex(llvm::Module &module);
+
+  // Give function OriginType
+  template <typename OriginType>
+  void Annotate(llvm::Function *func) {
+    ::remill::Annotate<OriginType>(func);
+    Add(func, OriginType::metadata_value);
+  }
+
+  template <typename OriginType>
+  bool Remove(llvm::Function *func) {
+    if (!::remill::Remove<OriginType>(func)) {
+      return false;
+    }
+    Erase(func);
+    return true;
+  }
+
+  template <typename OriginType, typename OldType>
+  bool ChangeOriginType(llvm::Function *func) {
+    if (!HasOriginType<OldType>(func)) {
+      return false;
+    }
+    Annotate<OriginType>(func);
+    return true;
+  }
+
+  template <typename... OriginTypes>
+  bool HasOriginType(llvm::Function *func) const {
+    auto origin_it = origin_of.find(func);
+    if (origin_it == origin_of.end()) {
+      return false;
+    }
+    const auto &origin = origin_it->second.first;
+    return (IsOriginOrSubtype(origin, OriginTypes::metadata_value) || ...);
+  }
+
+  // Return list of functions that are one of chosen OriginType, in the order
+  // in which they appeared in the module, followed by those annotated since.
+  template <typename Container, typename... OriginTypes>
+  void GetFunctionsByOrigin(Container &result) const {
+    std::vector<const Functions *> matches;
+    for (const auto &origin_funcs : by_origin) {
+      if ((IsOriginOrSubtype(origin_funcs.first, OriginTypes::metadata_value) ||
+           ...)) {
+        matches.push_back(&origin_funcs.second);
+      }
+    }
+
+    // Each function has one origin, so there are no duplicates to remove,
+    // but the functions of several origins must be merged back into order.
+    std::vector<std::pair<uint64_t, llvm::Function *>> funcs;
+    for (auto origin_funcs : matches) {
+      funcs.insert(funcs.end(), origin_funcs->begin(), origin_funcs->end());
+    }
+    if (1 < matches.size()) {
+      std::sort(funcs.begin(), funcs.end());
+    }
+
+    // Method that is both in std::set and std::vector
+    for (const auto &func : funcs) {
+      result.insert(result.end(), func.second);
+    }
+  }
+
+  template <typename Container, typename... OriginTypes>
+  Container GetFunctionsByOrigin(void) const {
+    Container result;
+    GetFunctionsByOrigin<Container, OriginTypes...>(result);
+    return result;
+  }
+
+  // Map every function of `FromType` that is tied to a function of `ToType`
+  // to the latter. Only the functions of `FromType` are visited.
+  template <typename FromType, typename ToType = BaseFunction>
+  std::unordered_map<llvm::Function *, llvm::Function *>
+  GetTieMapping(const std::string &kind = TieKind) const {
+    std::unordered_map<llvm::Function *, llvm::Function *> result;
+    for (auto func : GetFunctionsByOrigin<std::vector<llvm::Function *>,
+                                          FromType>()) {
+      auto tied_to = GetTied(func, kind);
+      if (tied_to && HasOriginType<ToType>(tied_to)) {
+        result.insert({func, tied_to});
+      }
+    }
+    return result;
+  }
+
+ private:
+  // Functions of one origin, keyed by the order in which they were indexed.
+  using Functions = std::map<uint64_t, llvm::Function *>;
+
+  // Origin values are hierarchical, e.g. `base.helper.semantics`, so an origin
+  // is of a type if the type's value is a prefix of it.
+  static bool IsOriginOrSubtype(const std::string &origin,
+                                const std::string &type) {
+    return !origin.compare(0, type.size(), type);
+  }
+
+  void Add(llvm::Function *func, const std::string &origin);
+  void Erase(llvm::Function *func);
+
+  std::map<std::string, Functions> by_origin;
+
+  // Maps each indexed function to its origin, and to its key in `by_origin`.
+  std::unordered_map<llvm::Function *, std::pair<std::string, uint64_t>>
+      origin_of;
+
+  uint64_t next_order{0};
+};
 
 }  // namespace remill
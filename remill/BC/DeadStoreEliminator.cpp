@@ -712,10 +712,10 @@ bool ForwardAliasVisitor::Analyze(const remill::Arch *arch, KillCounter &stats,
     // Create the node for a `remill_register` annotation if it's missing.
     if (!inst->getMetadata(reg_md_id)) {
 #if LLVM_VERSION_NUMBER >= LLVM_VERSION(3, 6)
-      auto reg_name_md = llvm::ValueAsMetadata::get(reg->constant_name);
+      auto reg_name_md = llvm::ValueAsMetadata::get(reg->ConstantName());
       auto reg_name_node = llvm::MDNode::get(context, reg_name_md);
 #else
-      auto reg_name_node = llvm::MDNode::get(*context, reg.constant_name);
+      auto reg_name_node = llvm::MDNode::get(*context, reg->ConstantName());
 #endif
       inst->setMetadata(reg_md_id, reg_name_node);
     }
@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "remill/BC/ExecutionCounters.h"
+
+#include <glog/logging.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+
+#include <vector>
+
+namespace remill {
+namespace {
+
+static const char kCountsName[] = "__remill_execution_counts";
+static const char kInfoName[] = "__remill_execution_counter_info";
+static const char kNumCountersName[] = "__remill_num_execution_counters";
+
+// Returns `true` if `block` starts a basic block, i.e. if execution can reach
+// it from anywhere other than the end of the one block that precedes it.
+static bool IsBasicBlockLeader(llvm::BasicBlock *block) {
+  auto pred_block = block->getSinglePredecessor();
+  return !pred_block || 1 != pred_block->getTerminator()->getNumSuccessors();
+}
+
+// Add code before `inst` that increments counter `index`.
+static void AddIncrement(llvm::Instruction *inst, size_t index) {
+  auto module = inst->getModule();
+  auto &context = module->getContext();
+  auto i64_type = llvm::Type::getInt64Ty(context);
+  auto counts_type = llvm::ArrayType::get(i64_type, 0);
+
+  // Every trace uses this declaration until `DefineCounters` replaces it
+  // with the real array.
+  auto counts = llvm::cast<llvm::GlobalVariable>(
+      module->getOrInsertGlobal(kCountsName, counts_type));
+
+  llvm::Constant *indices[] = {llvm::ConstantInt::get(i64_type, 0),
+                               llvm::ConstantInt::get(i64_type, index)};
+  auto count_ptr =
+      llvm::ConstantExpr::getGetElementPtr(counts_type, counts, indices);
+
+  llvm::IRBuilder<> ir(inst);
+  auto count = ir.CreateLoad(i64_type, count_ptr);
+  ir.CreateStore(ir.CreateAdd(count, llvm::ConstantInt::get(i64_type, 1)),
+                 count_ptr);
+}
+
+}  // namespace
+
+// Instrument the lifted trace `func` with a counter for the trace itself, and
+// one for each basic block in it.
+void ExecutionCounters::InstrumentTrace(
+    uint64_t trace_pc, llvm::Function *func,
+    const std::map<uint64_t, llvm::BasicBlock *> &blocks) {
+  CHECK(!func->isDeclaration())
+      << "Cannot instrument undefined trace " << func->getName().str();
+
+  // The entry block of a trace holds the register variables, and then
+  // branches to the block of the first instruction. That first block might
+  // be a loop header, so the trace itself is counted separately.
+  AddIncrement(func->getEntryBlock().getTerminator(), counters.size());
+  counters.push_back({trace_pc, trace_pc, ExecutionCounterKind::kTrace});
+
+  for (const auto &pc_block : blocks) {
+    auto block = pc_block.second;
+    CHECK_EQ(block->getParent(), func)
+        << "Block for address " << std::hex << pc_block.first << std::dec
+        << " is not in trace " << func->getName().str();
+
+    if (pc_block.first == trace_pc || IsBasicBlockLeader(block)) {
+      AddIncrement(&*(block->getFirstInsertionPt()), counters.size());
+      counters.push_back({trace_pc, pc_block.first,
+                          ExecutionCounterKind::kBlock});
+    }
+  }
+}
+
+// Define the counter array and the counter info table in `module`.
+void ExecutionCounters::DefineCounters(llvm::Module *module) const {
+  auto &context = module->getContext();
+  auto i32_type = llvm::Type::getInt32Ty(context);
+  auto i64_type = llvm::Type::getInt64Ty(context);
+  const auto num_counters = counters.size();
+
+  auto counts_type = llvm::ArrayType::get(i64_type, num_counters);
+  auto counts = new llvm::GlobalVariable(
+      *module, counts_type, false, llvm::GlobalValue::ExternalLinkage,
+      llvm::ConstantAggregateZero::get(counts_type));
+
+  if (auto decl = module->getGlobalVariable(kCountsName)) {
+    CHECK(decl->isDeclaration())
+        << "Execution counters are already defined in module "
+        << module->getName().str();
+    decl->replaceAllUsesWith(
+        llvm::ConstantExpr::getBitCast(counts, decl->getType()));
+    counts->takeName(decl);
+    decl->eraseFromParent();
+  } else {
+    counts->setName(kCountsName);
+  }
+
+  auto info_type =
+      llvm::StructType::get(context, {i64_type, i64_type, i32_type});
+  std::vector<llvm::Constant *> infos;
+  infos.reserve(num_counters);
+  for (const auto &counter : counters) {
+    infos.push_back(llvm::ConstantStruct::get(
+        info_type,
+        {llvm::ConstantInt::get(i64_type, counter.trace_pc),
+         llvm::ConstantInt::get(i64_type, counter.pc),
+         llvm::ConstantInt::get(i32_type,
+                                static_cast<uint32_t>(counter.kind))}));
+  }
+
+  auto infos_type = llvm::ArrayType::get(info_type, num_counters);
+  (void) new llvm::GlobalVariable(
+      *module, infos_type, true, llvm::GlobalValue::ExternalLinkage,
+      llvm::ConstantArray::get(infos_type, infos), kInfoName);
+
+  (void) new llvm::GlobalVariable(
+      *module, i64_type, true, llvm::GlobalValue::ExternalLinkage,
+      llvm::ConstantInt::get(i64_type, num_counters), kNumCountersName);
+}
+
+}  // namespace remill
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+namespace llvm {
+class BasicBlock;
+class Function;
+class Module;
+}  // namespace llvm
+namespace remill {
+
+// What an execution counter counts.
+enum class ExecutionCounterKind : uint32_t {
+  // Entries into the lifted trace starting at the counter's program counter.
+  kTrace,
+
+  // Executions of the basic block starting at the counter's program counter.
+  kBlock
+};
+
+// Describes one counter in the execution counter array.
+//
+// NOTE: This must match the type of the elements of the
+//       `__remill_execution_counter_info` array.
+struct ExecutionCounter {
+  // Program counter of the first instruction of the trace that contains the
+  // counted code.
+  uint64_t trace_pc;
+
+  // Program counter of the first instruction of the counted code.
+  uint64_t pc;
+
+  ExecutionCounterKind kind;
+};
+
+// Instruments lifted traces with counters of how many times each trace is
+// entered, and how many times each basic block within the trace executes.
+//
+// Traces must be instrumented before they are optimized, as that is the only
+// time at which their blocks can be reliably tied back to program counters
+// (see `TraceManager::SetLiftedTraceBlocks`). The instrumentation is then
+// optimized along with the rest of the trace.
+//
+// Instrumented code increments the elements of an array of 64-bit counters,
+// `__remill_execution_counts`. Once everything has been instrumented,
+// `DefineCounters` defines this array, along with a table that describes what
+// each counter counts:
+//
+//    uint64_t __remill_execution_counts[N];
+//    const ExecutionCounter __remill_execution_counter_info[N];
+//    const uint64_t __remill_num_execution_counters = N;
+//
+// NOTE: Counters are incremented with plain loads and stores, so counts may
+//       be lost when multiple threads execute the same code at once.
+class ExecutionCounters {
+ public:
+  // Instrument the lifted trace `func`, which starts at `trace_pc`. `blocks`
+  // maps the program counter of each lifted instruction in the trace to the
+  // block into which it was lifted. Only blocks that begin basic blocks, i.e.
+  // that don't just fall through from a single other block, get a counter.
+  void InstrumentTrace(uint64_t trace_pc, llvm::Function *func,
+                       const std::map<uint64_t, llvm::BasicBlock *> &blocks);
+
+  // Define the counter array and the counter info table in `module`. The
+  // instrumented traces must be in `module`, have been moved into it, or be
+  // in modules that will be linked with it.
+  void DefineCounters(llvm::Module *module) const;
+
+  // Information about each counter, indexed by counter number.
+  std::vector<ExecutionCounter> counters;
+};
+
+}  // namespace remill
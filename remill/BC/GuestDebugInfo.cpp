@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "remill/BC/GuestDebugInfo.h"
+
+#include <glog/logging.h>
+#include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instruction.h>
+#include <llvm/IR/Module.h>
+
+#include "remill/BC/Version.h"
+
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(8, 0)
+#  include <llvm/BinaryFormat/Dwarf.h>
+#  include <llvm/IR/DIBuilder.h>
+#  include <llvm/IR/DebugInfoMetadata.h>
+#  include <llvm/IR/DebugLoc.h>
+#  include <llvm/IR/Metadata.h>
+
+#  include <unordered_set>
+#endif
+
+namespace remill {
+
+const char kGuestDebugFileName[] = "remill_guest_code";
+
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(8, 0)
+namespace {
+
+static const char kProducer[] = "remill";
+
+// Debug info in a module that doesn't say which version of the debug info
+// metadata it uses is dropped.
+static void AddDebugInfoVersion(llvm::Module *module) {
+  if (!module->getModuleFlag("Debug Info Version")) {
+    module->addModuleFlag(llvm::Module::Warning, "Debug Info Version",
+                          llvm::DEBUG_METADATA_VERSION);
+  }
+}
+
+// Find or create the compile unit in `module` to which all lifted traces
+// belong. Only line tables are emitted for it.
+static llvm::DICompileUnit *GetOrCreateCompileUnit(llvm::Module *module) {
+  for (auto cu : module->debug_compile_units()) {
+    auto file = cu->getFile();
+    if (cu->getProducer() == kProducer && file &&
+        file->getFilename() == kGuestDebugFileName) {
+      return cu;
+    }
+  }
+
+  AddDebugInfoVersion(module);
+  llvm::DIBuilder dib(*module);
+  auto file = dib.createFile(kGuestDebugFileName, "");
+  auto cu = dib.createCompileUnit(llvm::dwarf::DW_LANG_C, file, kProducer,
+                                  true /* isOptimized */, "", 0, "",
+                                  llvm::DICompileUnit::LineTablesOnly);
+  dib.finalize();
+  return cu;
+}
+
+// Returns the debug location, within `scope`, that encodes `pc`.
+static llvm::DILocation *GuestLocation(llvm::DISubprogram *scope,
+                                       uint64_t pc) {
+  return llvm::DILocation::get(scope->getContext(),
+                               static_cast<uint32_t>(pc),
+                               static_cast<uint32_t>((pc >> 32) & 0xFFFFu),
+                               scope);
+}
+
+}  // namespace
+
+// Attach debug locations that encode guest program counters to the
+// instructions of the lifted trace `func`.
+void AddGuestDebugLocations(
+    uint64_t trace_pc, llvm::Function *func,
+    const std::map<uint64_t, llvm::BasicBlock *> &blocks) {
+  CHECK(!func->isDeclaration())
+      << "Cannot add debug locations to undefined trace "
+      << func->getName().str();
+  CHECK(!func->getSubprogram())
+      << "Trace " << func->getName().str() << " already has debug info";
+
+  auto module = func->getParent();
+  auto cu = GetOrCreateCompileUnit(module);
+  llvm::DIBuilder dib(*module, true, cu);
+
+  const auto line = static_cast<uint32_t>(trace_pc);
+  auto scope = dib.createFunction(
+      cu, func->getName(), func->getName(), cu->getFile(), line,
+      dib.createSubroutineType(
+          dib.getOrCreateTypeArray(llvm::ArrayRef<llvm::Metadata *>())),
+      line, llvm::DINode::FlagZero,
+      llvm::DISubprogram::SPFlagDefinition |
+          llvm::DISubprogram::SPFlagOptimized);
+  func->setSubprogram(scope);
+
+  for (const auto &pc_block : blocks) {
+    auto block = pc_block.second;
+    CHECK_EQ(block->getParent(), func)
+        << "Block for address " << std::hex << pc_block.first << std::dec
+        << " is not in trace " << func->getName().str();
+
+    auto loc = GuestLocation(scope, pc_block.first);
+    for (auto &inst : *block) {
+      inst.setDebugLoc(loc);
+    }
+  }
+
+  // Calls to other traces must have locations once those traces have debug
+  // info of their own, so every remaining instruction is attributed to the
+  // trace itself.
+  auto trace_loc = GuestLocation(scope, trace_pc);
+  for (auto &block : *func) {
+    for (auto &inst : block) {
+      if (!inst.getDebugLoc()) {
+        inst.setDebugLoc(trace_loc);
+      }
+    }
+  }
+
+  dib.finalizeSubprogram(scope);
+  dib.finalize();
+}
+
+// List the compile units used by the functions in `module`, so that their
+// line tables are emitted.
+void AddGuestDebugCompileUnits(llvm::Module *module) {
+  std::unordered_set<llvm::DICompileUnit *> listed_cus;
+  for (auto cu : module->debug_compile_units()) {
+    listed_cus.insert(cu);
+  }
+
+  for (auto &func : *module) {
+    auto scope = func.getSubprogram();
+    if (!scope || !scope->getUnit()) {
+      continue;
+    }
+
+    auto cu = scope->getUnit();
+    if (listed_cus.insert(cu).second) {
+      module->getOrInsertNamedMetadata("llvm.dbg.cu")->addOperand(cu);
+      AddDebugInfoVersion(module);
+    }
+  }
+}
+
+#else
+
+void AddGuestDebugLocations(uint64_t, llvm::Function *,
+                            const std::map<uint64_t, llvm::BasicBlock *> &) {}
+
+void AddGuestDebugCompileUnits(llvm::Module *) {}
+
+#endif  // LLVM_VERSION_NUMBER >= LLVM_VERSION(8, 0)
+
+}  // namespace remill
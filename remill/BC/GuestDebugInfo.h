@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+
+namespace llvm {
+class BasicBlock;
+class Function;
+class Module;
+}  // namespace llvm
+namespace remill {
+
+// Name of the source file to which guest debug locations belong. Tools that
+// read the line tables of compiled lifted code can use this to tell guest
+// locations apart from those of anything else that was inlined into it.
+extern const char kGuestDebugFileName[];
+
+// Attach debug locations to the instructions of the lifted trace `func`, which
+// starts at `trace_pc`, so that profilers and debuggers can attribute compiled
+// code back to the guest instructions from which it was lifted. `blocks` maps
+// the program counter of each lifted instruction in the trace to the block
+// into which it was lifted (see `TraceManager::SetLiftedTraceBlocks`).
+//
+// A guest program counter is encoded into a debug location with its low 32
+// bits as the line number, and its next 16 bits as the column number (see
+// `GuestPCFromDebugLocation`). Code that doesn't belong to any one guest
+// instruction, e.g. the trace's entry block, is attributed to `trace_pc`.
+//
+// Like `ExecutionCounters::InstrumentTrace`, this must be done before the
+// trace is optimized; the locations then survive inlining of the semantics.
+//
+// NOTE: This requires LLVM 8 or newer, and does nothing otherwise.
+void AddGuestDebugLocations(
+    uint64_t trace_pc, llvm::Function *func,
+    const std::map<uint64_t, llvm::BasicBlock *> &blocks);
+
+// List the compile units of the guest debug info of the functions in `module`
+// in its `llvm.dbg.cu` metadata, so that code generation emits their line
+// tables. This must be called after traces with guest debug locations have
+// been moved into `module` with `MoveFunctionIntoModule`.
+void AddGuestDebugCompileUnits(llvm::Module *module);
+
+// Recover the guest program counter from the line and column numbers of a
+// debug location attached by `AddGuestDebugLocations`.
+inline static uint64_t GuestPCFromDebugLocation(uint32_t line,
+                                                uint32_t column) {
+  return (static_cast<uint64_t>(column & 0xFFFFu) << 32) | line;
+}
+
+}  // namespace remill
@@ -61,19 +61,30 @@ static llvm::Function *FindPureIntrinsic(llvm::Module *module,
   return function;
 }
 
+// Find a specific function that is only called on unusual paths, e.g. on
+// errors. Marking these as `cold` lets LLVM move the paths to them out of
+// the way of hot code.
+static llvm::Function *FindColdIntrinsic(llvm::Module *module,
+                                         const char *name) {
+  auto function = FindIntrinsic(module, name);
+  function->addFnAttr(llvm::Attribute::Cold);
+  return function;
+}
+
 }  // namespace
 
 IntrinsicTable::IntrinsicTable(llvm::Module *module)
-    : error(FindIntrinsic(module, "__remill_error")),
+    : error(FindColdIntrinsic(module, "__remill_error")),
 
       // Control-flow.
       function_call(FindIntrinsic(module, "__remill_function_call")),
       function_return(FindIntrinsic(module, "__remill_function_return")),
       jump(FindIntrinsic(module, "__remill_jump")),
-      missing_block(FindIntrinsic(module, "__remill_missing_block")),
+      missing_block(FindColdIntrinsic(module, "__remill_missing_block")),
 
       // OS interaction.
-      async_hyper_call(FindIntrinsic(module, "__remill_async_hyper_call")),
+      async_hyper_call(
+          FindColdIntrinsic(module, "__remill_async_hyper_call")),
 
       // Memory access.
       read_memory_8(FindPureIntrinsic(module, "__remill_read_memory_8")),
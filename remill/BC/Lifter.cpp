@@ -26,6 +26,7 @@
 #include <llvm/IR/Instructions.h>
 #include <llvm/IR/IntrinsicInst.h>
 #include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/MDBuilder.h>
 #include <llvm/IR/Metadata.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Operator.h>
@@ -35,8 +36,11 @@
 #include <llvm/Transforms/Utils/Cloning.h>
 #include <llvm/Transforms/Utils/ValueMapper.h>
 
+#include <algorithm>
+#include <cstdint>
 #include <functional>
 #include <ios>
+#include <iterator>
 #include <set>
 #include <sstream>
 #include <string>
@@ -56,6 +60,10 @@
 namespace remill {
 namespace {
 
+// Prefix of the names of instruction semantics that implement an atomic
+// read-modify-write with a single atomic memory intrinsic.
+const char kNativeAtomicPrefix[] = "ATOMIC_";
+
 // Try to find the function that implements this semantics.
 llvm::Function *GetInstructionFunction(llvm::Module *module,
                                        const std::string &function) {
@@ -88,6 +96,7 @@ InstructionLifter::InstructionLifter(const Arch *arch_,
       word_type(llvm::Type::getIntNTy(
           intrinsics_->async_hyper_call->getContext(), arch->address_size)),
       intrinsics(intrinsics_),
+      use_native_atomics(false),
       last_func(nullptr) {}
 
 // Lift a single instruction into a basic block. `is_delayed` signifies that
@@ -116,8 +125,16 @@ LiftStatus InstructionLifter::LiftIntoBlock(Instruction &arch_inst,
   }
   last_func = func;
 
+  auto is_atomic = arch_inst.is_atomic_read_modify_write;
   if (arch_inst.IsValid()) {
-    isel_func = GetInstructionFunction(module, arch_inst.function);
+    if (is_atomic && use_native_atomics) {
+      isel_func = GetInstructionFunction(
+          module, kNativeAtomicPrefix + arch_inst.function);
+      is_atomic = !isel_func;
+    }
+    if (!isel_func) {
+      isel_func = GetInstructionFunction(module, arch_inst.function);
+    }
   } else {
     LOG(ERROR) << "Cannot decode instruction bytes at " << std::hex
                << arch_inst.pc << std::dec;
@@ -174,7 +191,7 @@ LiftStatus InstructionLifter::LiftIntoBlock(Instruction &arch_inst,
   }
 
   // Begin an atomic block.
-  if (arch_inst.is_atomic_read_modify_write) {
+  if (is_atomic) {
     llvm::Value *temp_args[] = {ir.CreateLoad(mem_ptr_ref)};
     ir.CreateStore(ir.CreateCall(intrinsics->atomic_begin, temp_args),
                    mem_ptr_ref);
@@ -218,7 +235,7 @@ LiftStatus InstructionLifter::LiftIntoBlock(Instruction &arch_inst,
   ir.CreateStore(ir.CreateCall(isel_func, args), mem_ptr_ref);
 
   // End an atomic block.
-  if (arch_inst.is_atomic_read_modify_write) {
+  if (is_atomic) {
     llvm::Value *temp_args[] = {ir.CreateLoad(mem_ptr_ref)};
     ir.CreateStore(ir.CreateCall(intrinsics->atomic_end, temp_args),
                    mem_ptr_ref);
@@ -756,6 +773,11 @@ llvm::Function *TraceManager::GetLiftedTraceDefinition(uint64_t) {
   return nullptr;
 }
 
+// Called with the blocks of a newly lifted trace.
+void TraceManager::SetLiftedTraceBlocks(
+    uint64_t, llvm::Function *,
+    const std::map<uint64_t, llvm::BasicBlock *> &) {}
+
 // Apply a callback that gives the decoder access to multiple virtual
 // targets of this instruction (indirect call or jump).
 void TraceManager::ForEachDevirtualizedTarget(
@@ -765,6 +787,11 @@ void TraceManager::ForEachDevirtualizedTarget(
   // Must be extended.
 }
 
+// By default, no branches are profiled.
+bool TraceManager::TryGetBranchProfile(uint64_t, uint64_t *, uint64_t *) {
+  return false;
+}
+
 // Figure out the name for the trace starting at address `addr`.
 std::string TraceManager::TraceName(uint64_t addr) {
   std::stringstream ss;
@@ -776,6 +803,59 @@ namespace {
 
 using DecoderWorkList = std::set<uint64_t>;  // For ordering.
 
+// Prefix of the names of instruction semantics that skip writing the flags.
+const char kFlaglessPrefix[] = "NOFLAGS_";
+
+// Maximum number of instructions that are decoded ahead of a flag-writing
+// instruction when looking for later writes that kill its flags.
+constexpr unsigned kMaxFlagLivenessLookahead = 4;
+
+// Name of the semantics that bring state which the semantics keep in a
+// deferred form, e.g. the x86 arithmetic flags with `REMILL_X86_LAZY_FLAGS`,
+// up to date. Only defined by semantics that defer anything.
+const char kSyncLazyStateFunction[] = "SYNC_LAZY_STATE";
+
+// Index of the `State &` parameter of instruction semantics functions, which
+// are `Memory *(Memory *, State &, ...)`.
+constexpr unsigned kSemanticsStateArgNum = 1;
+
+// Returns `true` if `func` passes `state`, or a pointer into it, to a function
+// that isn't defined in the semantics module, either directly or by way of
+// the functions that it calls. Those functions belong to the runtime, e.g.
+// `__remill_sync_hyper_call`, and so can observe anything in the state.
+bool PassesStateToRuntime(llvm::Function *func, llvm::Value *state,
+                          std::set<llvm::Function *> &seen) {
+  if (!seen.insert(func).second) {
+    return false;
+  }
+  for (auto &block : *func) {
+    for (auto &inst : block) {
+      auto call = llvm::dyn_cast<llvm::CallInst>(&inst);
+      if (!call) {
+        continue;
+      }
+      auto callee = call->getCalledFunction();
+      if (callee && callee->isIntrinsic()) {
+        continue;
+      }
+      for (auto arg = call->arg_begin(); arg != call->arg_end(); ++arg) {
+        const auto arg_num =
+            static_cast<unsigned>(std::distance(call->arg_begin(), arg));
+        if ((*arg)->stripInBoundsOffsets() != state) {
+          continue;
+        }
+        if (!callee || callee->isDeclaration() ||
+            arg_num >= callee->arg_size() ||
+            PassesStateToRuntime(callee, &*(callee->arg_begin() + arg_num),
+                                 seen)) {
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
 }  // namespace
 
 class TraceLifter::Impl {
@@ -790,6 +870,22 @@ class TraceLifter::Impl {
   // Reads the bytes of an instruction at `addr` into `state.inst_bytes`.
   bool ReadInstructionBytes(uint64_t addr);
 
+  // Returns `true` if every flag written by `inst` is overwritten by one of
+  // the instructions that follow it before any of them read it.
+  bool FlagWritesAreDead(void);
+
+  // Returns `true` if the semantics `sem` hand the state to the runtime, which
+  // can then read any of the flags.
+  bool SyncsStateWithRuntime(llvm::Function *sem);
+
+  // Annotate `br`, the conditional branch lifted from `inst`, with the branch
+  // weights profiled by the trace manager, if any.
+  void AddBranchWeights(llvm::BranchInst *br);
+
+  // Call `sync_lazy_state` before every call in `func` that can leave the
+  // trace and enter the runtime.
+  void SyncLazyStateBeforeExits(void);
+
   // Return an already lifted trace starting with the code at address
   // `addr`.
   //
@@ -856,9 +952,19 @@ class TraceLifter::Impl {
   std::string inst_bytes;
   Instruction inst;
   Instruction delayed_inst;
+  Instruction lookahead_inst;
   DecoderWorkList trace_work_list;
   DecoderWorkList inst_work_list;
   std::map<uint64_t, llvm::BasicBlock *> blocks;
+
+  // Semantics of `SYNC_LAZY_STATE`, if the semantics module defines them.
+  llvm::Function *const sync_lazy_state;
+
+  // Cached results of `SyncsStateWithRuntime`.
+  std::unordered_map<llvm::Function *, bool> syncs_state_with_runtime;
+
+  // The subset of `blocks` into which instructions have been lifted.
+  std::map<uint64_t, llvm::BasicBlock *> inst_blocks;
 };
 
 TraceLifter::Impl::Impl(InstructionLifter *inst_lifter_, TraceManager *manager_)
@@ -872,7 +978,8 @@ TraceLifter::Impl::Impl(InstructionLifter *inst_lifter_, TraceManager *manager_)
       func(nullptr),
       block(nullptr),
       switch_inst(nullptr),
-      max_inst_bytes(arch->MaxInstructionSize()) {
+      max_inst_bytes(arch->MaxInstructionSize()),
+      sync_lazy_state(GetInstructionFunction(module, kSyncLazyStateFunction)) {
 
   inst_bytes.reserve(max_inst_bytes);
 }
@@ -943,6 +1050,110 @@ bool TraceLifter::Impl::ReadInstructionBytes(uint64_t addr) {
   return !inst_bytes.empty();
 }
 
+// Returns `true` if every flag written by `inst` is overwritten by one of the
+// instructions that follow it before any of them read it. When so, the lifter
+// uses the `NOFLAGS_`-prefixed variant of the semantics of `inst`, if there is
+// one, which does everything that `inst` does except write the flags. Memory
+// operands are still read by those variants, as the reads can fault. This only
+// looks at straight-line code, and gives up on anything it can't lift. An
+// instruction whose semantics hand the state to the runtime, e.g. `cpuid`,
+// reads every flag, whatever its `flags_read` says.
+bool TraceLifter::Impl::FlagWritesAreDead(void) {
+  auto live_flags = inst.flags_written;
+  auto next_pc = inst.next_pc;
+  for (auto i = 0U; live_flags && i < kMaxFlagLivenessLookahead; ++i) {
+    lookahead_inst.Reset();
+    if (!ReadInstructionBytes(next_pc) ||
+        !arch->DecodeInstruction(next_pc, inst_bytes, lookahead_inst)) {
+      return false;
+    }
+
+    auto sem = GetInstructionFunction(module, lookahead_inst.function);
+    if (!sem || (lookahead_inst.flags_read & live_flags) ||
+        SyncsStateWithRuntime(sem)) {
+      return false;
+    }
+
+    live_flags &= ~lookahead_inst.flags_written;
+    if (lookahead_inst.IsControlFlow() ||
+        arch->MayHaveDelaySlot(lookahead_inst)) {
+      break;
+    }
+    next_pc = lookahead_inst.next_pc;
+  }
+  return !live_flags;
+}
+
+// Returns `true` if the semantics `sem` hand the state to the runtime, which
+// can then read any of the flags.
+bool TraceLifter::Impl::SyncsStateWithRuntime(llvm::Function *sem) {
+  auto cached = syncs_state_with_runtime.find(sem);
+  if (cached != syncs_state_with_runtime.end()) {
+    return cached->second;
+  }
+
+  auto syncs = true;  // Assume the worst about anything unexpected.
+  if (!sem->isDeclaration() && sem->arg_size() > kSemanticsStateArgNum) {
+    std::set<llvm::Function *> seen;
+    syncs = PassesStateToRuntime(
+        sem, &*(sem->arg_begin() + kSemanticsStateArgNum), seen);
+  }
+  syncs_state_with_runtime.emplace(sem, syncs);
+  return syncs;
+}
+
+// Annotate `br`, the conditional branch lifted from `inst`, with the branch
+// weights profiled by the trace manager, if any. Branch weights are 32 bits,
+// so large counts are scaled down. Every weight is at least one, so that
+// paths that are rarely taken are still considered possible.
+void TraceLifter::Impl::AddBranchWeights(llvm::BranchInst *br) {
+  uint64_t taken = 0;
+  uint64_t not_taken = 0;
+  if (!manager.TryGetBranchProfile(inst.pc, &taken, &not_taken)) {
+    return;
+  }
+
+  const auto max_count = std::max(taken, not_taken);
+  const uint64_t scale =
+      max_count < UINT32_MAX ? 1 : max_count / UINT32_MAX + 1;
+
+  llvm::MDBuilder md(context);
+  br->setMetadata(llvm::LLVMContext::MD_prof,
+                  md.createBranchWeights(
+                      static_cast<uint32_t>(taken / scale + 1),
+                      static_cast<uint32_t>(not_taken / scale + 1)));
+}
+
+// Call `sync_lazy_state` before every call in `func` that can leave the
+// trace and enter the runtime. Calls to other traces are left alone, as they
+// have been lifted from the same semantics, and so understand deferred state.
+void TraceLifter::Impl::SyncLazyStateBeforeExits(void) {
+  const llvm::Function *const exits[] = {
+      intrinsics->error,         intrinsics->jump,
+      intrinsics->function_call, intrinsics->function_return,
+      intrinsics->missing_block, intrinsics->async_hyper_call};
+
+  std::vector<llvm::CallInst *> exit_calls;
+  for (auto &block : *func) {
+    for (auto &inst : block) {
+      auto call = llvm::dyn_cast<llvm::CallInst>(&inst);
+      if (call && std::find(std::begin(exits), std::end(exits),
+                            call->getCalledFunction()) != std::end(exits)) {
+        exit_calls.push_back(call);
+      }
+    }
+  }
+
+  for (auto call : exit_calls) {
+    auto memory = llvm::CallInst::Create(
+        sync_lazy_state,
+        {call->getArgOperand(kMemoryPointerArgNum),
+         call->getArgOperand(kStatePointerArgNum)},
+        "", call);
+    call->setArgOperand(kMemoryPointerArgNum, memory);
+  }
+}
+
 // Lift one or more traces starting from `addr`.
 bool TraceLifter::Lift(
     uint64_t addr, std::function<void(uint64_t, llvm::Function *)> callback) {
@@ -963,6 +1174,7 @@ bool TraceLifter::Impl::Lift(
   trace_work_list.clear();
   inst_work_list.clear();
   blocks.clear();
+  inst_blocks.clear();
   inst_bytes.clear();
   func = nullptr;
   switch_inst = nullptr;
@@ -1000,6 +1212,7 @@ bool TraceLifter::Impl::Lift(
 
     func = get_trace_decl(trace_addr);
     blocks.clear();
+    inst_blocks.clear();
 
     if (!func || !func->isDeclaration()) {
       const auto trace_name = manager.TraceName(trace_addr);
@@ -1057,10 +1270,24 @@ bool TraceLifter::Impl::Lift(
         continue;
       }
 
+      inst_blocks[inst_addr] = block;
       inst.Reset();
 
       (void) arch->DecodeInstruction(inst_addr, inst_bytes, inst);
 
+      // Use a variant of the semantics that doesn't compute any flags if the
+      // flags are overwritten before they are read, e.g. `add` followed by
+      // `cmp` on x86.
+      if (inst.flags_written && !arch->MayHaveDelaySlot(inst) &&
+          !(inst.is_atomic_read_modify_write &&
+            inst_lifter.use_native_atomics)) {
+        auto flagless_func = kFlaglessPrefix + inst.function;
+        if (GetInstructionFunction(module, flagless_func) &&
+            FlagWritesAreDead()) {
+          inst.function = std::move(flagless_func);
+        }
+      }
+
       auto lift_status = inst_lifter.LiftIntoBlock(inst, block, state_ptr);
       if (kLiftedInstruction != lift_status) {
         AddTerminatingTailCall(block, intrinsics->error);
@@ -1268,8 +1495,9 @@ bool TraceLifter::Impl::Lift(
         // checking if the hyper call returns to the next PC or not.
         case Instruction::kCategoryConditionalAsyncHyperCall: {
           auto do_hyper_call = llvm::BasicBlock::Create(context, "", func);
-          llvm::BranchInst::Create(do_hyper_call, GetOrCreateNextBlock(),
-                                   LoadBranchTaken(block), block);
+          AddBranchWeights(
+              llvm::BranchInst::Create(do_hyper_call, GetOrCreateNextBlock(),
+                                       LoadBranchTaken(block), block));
           block = do_hyper_call;
           AddCall(block, intrinsics->async_hyper_call);
           goto check_call_return;
@@ -1319,8 +1547,8 @@ bool TraceLifter::Impl::Lift(
             not_taken_block = new_not_taken_block;
           }
 
-          llvm::BranchInst::Create(taken_block, not_taken_block,
-                                   LoadBranchTaken(block), block);
+          AddBranchWeights(llvm::BranchInst::Create(
+              taken_block, not_taken_block, LoadBranchTaken(block), block));
           break;
         }
       }
@@ -1332,6 +1560,11 @@ bool TraceLifter::Impl::Lift(
       }
     }
 
+    if (sync_lazy_state) {
+      SyncLazyStateBeforeExits();
+    }
+
+    manager.SetLiftedTraceBlocks(trace_addr, func, inst_blocks);
     callback(trace_addr, func);
     manager.SetLiftedTraceDefinition(trace_addr, func);
   }
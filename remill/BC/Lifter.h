@@ -18,6 +18,7 @@
 
 #include <cstdint>
 #include <functional>
+#include <map>
 #include <memory>
 #include <string>
 #include <unordered_map>
@@ -83,6 +84,12 @@ class InstructionLifter {
   // Set of intrinsics.
   const IntrinsicTable *const intrinsics;
 
+  // Lift atomic read-modify-write instructions that have an `ATOMIC_`-prefixed
+  // semantics variant into a single call to an atomic memory intrinsic (e.g.
+  // `__remill_fetch_and_add_32`), instead of bracketing the normal semantics
+  // with `__remill_atomic_begin` and `__remill_atomic_end`.
+  bool use_native_atomics;
+
   // Load the address of a register.
   llvm::Value *LoadRegAddress(llvm::BasicBlock *block, llvm::Value *state_ptr,
                               const std::string &reg_name);
@@ -158,6 +165,15 @@ class TraceManager {
   virtual void SetLiftedTraceDefinition(uint64_t addr,
                                         llvm::Function *lifted_func) = 0;
 
+  // Called just before `SetLiftedTraceDefinition`, with the block into which
+  // each instruction of the trace was lifted, indexed by the address of the
+  // instruction. The blocks of a trace can only be tied back to addresses
+  // like this before the trace is optimized, e.g. for instrumentation (see
+  // `ExecutionCounters`).
+  virtual void
+  SetLiftedTraceBlocks(uint64_t addr, llvm::Function *lifted_func,
+                       const std::map<uint64_t, llvm::BasicBlock *> &blocks);
+
   // Get a declaration for a lifted trace. The idea here is that a derived
   // class might have additional global info available to them that lets
   // them declare traces ahead of time. In order to distinguish between
@@ -192,6 +208,14 @@ class TraceManager {
   // at address `addr` is executable and readable, and updates the byte
   // pointed to by `byte` with the read value.
   virtual bool TryReadExecutableByte(uint64_t addr, uint8_t *byte) = 0;
+
+  // Try to get a profile of the conditional branch (or conditional hyper
+  // call) instruction at address `addr`. Returns `true` if the number of
+  // times that the branch was taken and not taken are known, and updates
+  // `taken` and `not_taken` with those counts. The trace lifter turns these
+  // into `!prof` branch weights.
+  virtual bool TryGetBranchProfile(uint64_t addr, uint64_t *taken,
+                                   uint64_t *not_taken);
 };
 
 // Implements a recursive decoder that lifts a trace of instructions to bitcode.
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "remill/BC/LowerAtomics.h"
+
+#include <llvm/IR/Function.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+
+#include <string>
+#include <utility>
+
+#include "remill/BC/Util.h"
+#include "remill/BC/Version.h"
+
+namespace remill {
+namespace {
+
+static const std::pair<const char *, llvm::AtomicRMWInst::BinOp>
+    kFetchAndOps[] = {
+        {"add", llvm::AtomicRMWInst::Add}, {"sub", llvm::AtomicRMWInst::Sub},
+        {"and", llvm::AtomicRMWInst::And}, {"or", llvm::AtomicRMWInst::Or},
+        {"xor", llvm::AtomicRMWInst::Xor}, {"nand", llvm::AtomicRMWInst::Nand},
+};
+
+static const unsigned kAccessSizes[] = {8, 16, 32, 64, 128};
+
+// Lowers `__remill_fetch_and_<op>_<size>(memory, addr, value)`. The intrinsic
+// takes `value` by reference, and updates it with the prior value in memory.
+static void LowerFetchAndOp(llvm::CallInst *call, llvm::AtomicRMWInst::BinOp op,
+                            unsigned size, unsigned addr_space,
+                            llvm::Constant *base) {
+  llvm::IRBuilder<> ir(call);
+  auto ptr = GuestAddressToPointer(ir, call->getArgOperand(1),
+                                   ir.getIntNTy(size), addr_space, base);
+  auto val_ref = call->getArgOperand(2);
+  auto old_val = ir.CreateAtomicRMW(op, ptr, ir.CreateLoad(val_ref),
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(13, 0)
+                                    llvm::MaybeAlign(),
+#endif
+                                    llvm::AtomicOrdering::SequentiallyConsistent);
+  ir.CreateStore(old_val, val_ref);
+  call->replaceAllUsesWith(call->getArgOperand(0));
+  call->eraseFromParent();
+}
+
+// Lowers `__remill_compare_exchange_memory_<size>(memory, addr, expected,
+// desired)`. The intrinsic takes `expected` by reference, and updates it with
+// the prior value in memory. The 128-bit variant also takes `desired` by
+// reference.
+static void LowerCompareExchange(llvm::CallInst *call, unsigned size,
+                                 unsigned addr_space, llvm::Constant *base) {
+  llvm::IRBuilder<> ir(call);
+  auto ptr = GuestAddressToPointer(ir, call->getArgOperand(1),
+                                   ir.getIntNTy(size), addr_space, base);
+  auto expected_ref = call->getArgOperand(2);
+  llvm::Value *desired = call->getArgOperand(3);
+  if (desired->getType()->isPointerTy()) {
+    desired = ir.CreateLoad(desired);
+  }
+  auto pair = ir.CreateAtomicCmpXchg(
+      ptr, ir.CreateLoad(expected_ref), desired,
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(13, 0)
+      llvm::MaybeAlign(),
+#endif
+      llvm::AtomicOrdering::SequentiallyConsistent,
+      llvm::AtomicOrdering::SequentiallyConsistent);
+  ir.CreateStore(ir.CreateExtractValue(pair, 0), expected_ref);
+  call->replaceAllUsesWith(call->getArgOperand(0));
+  call->eraseFromParent();
+}
+
+}  // namespace
+
+// Replaces calls to the atomic memory intrinsics with LLVM atomics.
+void LowerAtomicIntrinsics(llvm::Module *module, unsigned addr_space,
+                           llvm::Constant *base) {
+  for (auto size : kAccessSizes) {
+    const auto size_str = std::to_string(size);
+    for (auto call : CallersOf(module->getFunction(
+             "__remill_compare_exchange_memory_" + size_str))) {
+      LowerCompareExchange(call, size, addr_space, base);
+    }
+
+    if (128 == size) {
+      continue;  // There are no 128-bit `fetch_and` intrinsics.
+    }
+
+    for (const auto &op : kFetchAndOps) {
+      const auto name = std::string("__remill_fetch_and_") + op.first + "_" +
+                        size_str;
+      for (auto call : CallersOf(module->getFunction(name))) {
+        LowerFetchAndOp(call, op.second, size, addr_space, base);
+      }
+    }
+  }
+}
+
+}  // namespace remill
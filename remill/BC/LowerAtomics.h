@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+namespace llvm {
+class Constant;
+class Module;
+}  // namespace llvm
+namespace remill {
+
+// Replaces every call to the `__remill_fetch_and_*` and
+// `__remill_compare_exchange_memory_*` intrinsics in `module` with the
+// equivalent sequentially consistent LLVM `atomicrmw` or `cmpxchg`
+// instruction. Guest addresses are converted directly into pointers in the
+// address space `addr_space`, or, if `base` is non-null, into offsets from
+// `base` (see `GuestAddressToPointer`). This is meant for runtimes that map
+// guest memory into host memory, and that want atomic instructions to compile
+// down to native atomics rather than calls into the runtime.
+//
+// NOTE: LLVM atomics assume naturally aligned addresses.
+void LowerAtomicIntrinsics(llvm::Module *module, unsigned addr_space = 0,
+                           llvm::Constant *base = nullptr);
+
+}  // namespace remill
@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "remill/BC/LowerMemory.h"
+
+#include <llvm/Analysis/PostDominators.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "remill/BC/Util.h"
+#include "remill/BC/Version.h"
+
+namespace remill {
+namespace {
+
+static const char *const kAccessSuffixes[] = {"8",   "16",  "32",  "64",
+                                              "f32", "f64", "f80", "f128"};
+
+static const std::pair<const char *, llvm::AtomicOrdering> kBarriers[] = {
+    {"__remill_barrier_load_load", llvm::AtomicOrdering::Acquire},
+    {"__remill_barrier_load_store", llvm::AtomicOrdering::Acquire},
+    {"__remill_barrier_store_store", llvm::AtomicOrdering::Release},
+    {"__remill_barrier_store_load",
+     llvm::AtomicOrdering::SequentiallyConsistent},
+};
+
+// Returns the type of the value as it is represented in memory. The `f80` and
+// `f128` intrinsics pass their values around as `double`s.
+static llvm::Type *MemoryValueType(const std::string &suffix,
+                                   llvm::Type *val_type) {
+  if (suffix == "f80") {
+    return llvm::Type::getX86_FP80Ty(val_type->getContext());
+  } else if (suffix == "f128") {
+    return llvm::Type::getFP128Ty(val_type->getContext());
+  } else {
+    return val_type;
+  }
+}
+
+// Guest memory accesses need not be naturally aligned.
+template <typename T>
+static void SetUnaligned(T *inst) {
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(11, 0)
+  inst->setAlignment(llvm::Align(1));
+#elif LLVM_VERSION_NUMBER >= LLVM_VERSION(10, 0)
+  inst->setAlignment(llvm::MaybeAlign(1));
+#else
+  inst->setAlignment(1);
+#endif
+}
+
+// Maximum depth of the address computations that are moved so that a load can
+// be placed just after the memory state that it reads.
+static constexpr unsigned kMaxHoistDepth = 8;
+
+// Returns the instruction just after the definition of `memory`, in `func`.
+static llvm::Instruction *AfterDefinition(llvm::Value *memory,
+                                          llvm::Function *func) {
+  if (auto phi = llvm::dyn_cast<llvm::PHINode>(memory)) {
+    return &*phi->getParent()->getFirstInsertionPt();
+  } else if (auto inst = llvm::dyn_cast<llvm::Instruction>(memory)) {
+    return inst->getNextNode();
+  } else {
+    return &*func->getEntryBlock().getFirstInsertionPt();
+  }
+}
+
+// Returns `true` if `point` is executed whenever `inst` is, and vice versa,
+// i.e. if the block of `point` dominates the block of `inst`, and is post-
+// dominated by it. Guest memory is host memory, so a load can't be moved to
+// where it would be executed on paths where the read it lowers isn't.
+static bool IsControlEquivalent(llvm::Instruction *point,
+                                llvm::Instruction *inst,
+                                const llvm::DominatorTree &dt,
+                                const llvm::PostDominatorTree &pdt) {
+  auto point_block = point->getParent();
+  auto inst_block = inst->getParent();
+  return point_block == inst_block ||
+         (dt.dominates(point_block, inst_block) &&
+          pdt.dominates(inst_block, point_block));
+}
+
+// Tries to make `val` available before `*point`, by moving its computation up
+// to `*point` if it isn't already computed by then. Only computations that
+// don't touch memory are moved. `*point` is advanced past `val` if `val` is
+// `*point`.
+static bool MakeAvailable(llvm::Value *val, llvm::Instruction **point,
+                          const llvm::DominatorTree &dt, unsigned depth = 0) {
+  auto inst = llvm::dyn_cast<llvm::Instruction>(val);
+  if (!inst || dt.dominates(inst, *point)) {
+    return true;
+  } else if (inst == *point) {
+    *point = inst->getNextNode();
+    return true;
+  } else if (depth >= kMaxHoistDepth || llvm::isa<llvm::PHINode>(inst) ||
+             inst->mayReadOrWriteMemory() || inst->mayHaveSideEffects()) {
+    return false;
+  }
+
+  for (auto &op : inst->operands()) {
+    if (!MakeAvailable(op.get(), point, dt, depth + 1)) {
+      return false;
+    }
+  }
+
+  inst->moveBefore(*point);
+  return true;
+}
+
+// Lowers `__remill_read_memory_<suffix>(memory, addr)`.
+//
+// The read intrinsics are `readnone`, so the optimizer (including when the
+// semantics were compiled) may have moved a read after a write that follows
+// it in program order. The load is therefore placed just after the definition
+// of `memory`, which is where the read happens in program order, rather than
+// where the call is. If the computation of `addr` can't be moved that far up,
+// then the load is placed just after `addr` is computed. Either way, the load
+// stays where the call is if it would otherwise be moved to a block that isn't
+// control equivalent to that of the call, e.g. out of one side of a branch.
+static void LowerRead(llvm::CallInst *call, const std::string &suffix,
+                      unsigned addr_space, llvm::Constant *base,
+                      const llvm::DominatorTree &dt,
+                      const llvm::PostDominatorTree &pdt) {
+  auto addr = call->getArgOperand(1);
+  llvm::Instruction *point = call;
+  auto after_memory =
+      AfterDefinition(call->getArgOperand(0), call->getFunction());
+  if (IsControlEquivalent(after_memory, call, dt, pdt) &&
+      MakeAvailable(addr, &after_memory, dt)) {
+    point = after_memory;
+  } else {
+    auto after_addr = AfterDefinition(addr, call->getFunction());
+    if (IsControlEquivalent(after_addr, call, dt, pdt)) {
+      point = after_addr;
+    }
+  }
+
+  llvm::IRBuilder<> ir(point);
+  auto val_type = call->getType();
+  auto mem_type = MemoryValueType(suffix, val_type);
+  auto ptr = GuestAddressToPointer(ir, addr, mem_type, addr_space, base);
+  auto load = ir.CreateLoad(ptr);
+  SetUnaligned(load);
+
+  llvm::Value *val = load;
+  if (mem_type != val_type) {
+    val = ir.CreateFPTrunc(val, val_type);
+  }
+  call->replaceAllUsesWith(val);
+  call->eraseFromParent();
+}
+
+// Lowers `__remill_write_memory_<suffix>(memory, addr, val)`.
+static void LowerWrite(llvm::CallInst *call, const std::string &suffix,
+                       unsigned addr_space, llvm::Constant *base) {
+  llvm::IRBuilder<> ir(call);
+  llvm::Value *val = call->getArgOperand(2);
+  auto mem_type = MemoryValueType(suffix, val->getType());
+  if (mem_type != val->getType()) {
+    val = ir.CreateFPExt(val, mem_type);
+  }
+  auto ptr = GuestAddressToPointer(ir, call->getArgOperand(1), mem_type,
+                                   addr_space, base);
+  SetUnaligned(ir.CreateStore(val, ptr));
+  call->replaceAllUsesWith(call->getArgOperand(0));
+  call->eraseFromParent();
+}
+
+// Lowers `__remill_barrier_*(memory)`.
+static void LowerBarrier(llvm::CallInst *call, llvm::AtomicOrdering ordering) {
+  llvm::IRBuilder<> ir(call);
+  ir.CreateFence(ordering);
+  call->replaceAllUsesWith(call->getArgOperand(0));
+  call->eraseFromParent();
+}
+
+}  // namespace
+
+// Replaces calls to the memory access and barrier intrinsics with plain LLVM
+// loads, stores, and fences.
+void LowerMemoryIntrinsics(llvm::Module *module, unsigned addr_space,
+                           llvm::Constant *base) {
+
+  // The reads are placed relative to the definitions of the memory states
+  // that they read, so they are lowered before the writes and barriers, which
+  // forward those memory states.
+  std::unordered_map<llvm::Function *, std::unique_ptr<llvm::DominatorTree>>
+      dom_trees;
+  std::unordered_map<llvm::Function *,
+                     std::unique_ptr<llvm::PostDominatorTree>>
+      post_dom_trees;
+  for (auto suffix : kAccessSuffixes) {
+    for (auto call : CallersOf(
+             module->getFunction(std::string("__remill_read_memory_") +
+                                 suffix))) {
+      auto func = call->getFunction();
+      auto &dt = dom_trees[func];
+      auto &pdt = post_dom_trees[func];
+      if (!dt) {
+        dt.reset(new llvm::DominatorTree(*func));
+        pdt.reset(new llvm::PostDominatorTree);
+        pdt->recalculate(*func);
+      }
+      LowerRead(call, suffix, addr_space, base, *dt, *pdt);
+    }
+  }
+
+  for (auto suffix : kAccessSuffixes) {
+    for (auto call : CallersOf(
+             module->getFunction(std::string("__remill_write_memory_") +
+                                 suffix))) {
+      LowerWrite(call, suffix, addr_space, base);
+    }
+  }
+
+  for (const auto &barrier : kBarriers) {
+    for (auto call : CallersOf(module->getFunction(barrier.first))) {
+      LowerBarrier(call, barrier.second);
+    }
+  }
+}
+
+}  // namespace remill
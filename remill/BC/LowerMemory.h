@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+namespace llvm {
+class Constant;
+class Module;
+}  // namespace llvm
+namespace remill {
+
+// Replaces every call to the `__remill_read_memory_*` and
+// `__remill_write_memory_*` intrinsics in `module` with a direct (unaligned)
+// LLVM `load` or `store`, and every call to a `__remill_barrier_*` intrinsic
+// with the equivalent LLVM `fence`. The `Memory *` value threaded through
+// these intrinsics is forwarded to its users, so that it no longer orders
+// anything once this pass has run.
+//
+// Guest addresses are converted into host pointers using
+// `GuestAddressToPointer`: either directly into pointers in the address space
+// `addr_space`, or, if `base` is non-null, into byte offsets from `base`.
+//
+// The memory read intrinsics are `readnone`, so the optimizer may have moved
+// a read after a write that it precedes in program order. Each load is
+// therefore placed just after the definition of the `Memory *` value passed
+// to the read, rather than where the call to the read intrinsic is. This must
+// run before anything else that forwards the `Memory *` values, such as
+// `LowerAtomicIntrinsics`.
+//
+// NOTE: This does not lower the atomic intrinsics, nor does it remove calls
+//       to `__remill_atomic_begin` and `__remill_atomic_end`. Lift with native
+//       atomics enabled (see `InstructionLifter::use_native_atomics`) and
+//       call `LowerAtomicIntrinsics` with the same `addr_space` and `base` to
+//       fully flatten the memory model.
+void LowerMemoryIntrinsics(llvm::Module *module, unsigned addr_space = 0,
+                           llvm::Constant *base = nullptr);
+
+}  // namespace remill
@@ -0,0 +1,286 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "remill/BC/ModuleSaver.h"
+
+#include <glog/logging.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Process.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <sstream>
+#include <system_error>
+#include <utility>
+
+#ifdef REMILL_HAS_ZSTD
+#  include <zstd.h>
+#endif
+
+#include "remill/BC/Compat/BitcodeReaderWriter.h"
+#include "remill/BC/Compat/Verifier.h"
+#include "remill/BC/Version.h"
+#include "remill/OS/FileSystem.h"
+
+namespace remill {
+namespace {
+
+#ifdef REMILL_HAS_ZSTD
+
+// zstd's own default level, which compresses bitcode to about a fifth of its
+// size, at several hundred megabytes per second per thread.
+static constexpr int kZstdLevel = 3;
+
+static bool Compress(const std::string &data, std::string *out) {
+  auto cctx = ZSTD_createCCtx();
+  CHECK(cctx) << "Unable to create zstd compression context";
+
+  // Compress large files with all cores. This fails harmlessly, and leaves
+  // compression single-threaded, if zstd was built without multithreading.
+  ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, kZstdLevel);
+  ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1);
+  ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers,
+                         static_cast<int>(std::thread::hardware_concurrency()));
+
+  out->resize(ZSTD_compressBound(data.size()));
+  const auto size =
+      ZSTD_compress2(cctx, &((*out)[0]), out->size(), data.data(), data.size());
+  ZSTD_freeCCtx(cctx);
+
+  if (ZSTD_isError(size)) {
+    LOG(ERROR) << "Unable to compress bitcode: " << ZSTD_getErrorName(size);
+    return false;
+  }
+
+  out->resize(size);
+  return true;
+}
+
+#else
+
+static bool Compress(const std::string &, std::string *) {
+  LOG(ERROR) << "Unable to compress bitcode: remill was built without zstd";
+  return false;
+}
+
+#endif  // REMILL_HAS_ZSTD
+
+}  // namespace
+
+// Returns `true` if remill was built with support for `compression`.
+bool IsBitcodeCompressionAvailable(BitcodeCompression compression) {
+  switch (compression) {
+    case BitcodeCompression::kNone: return true;
+    case BitcodeCompression::kZstd:
+#ifdef REMILL_HAS_ZSTD
+      return true;
+#else
+      return false;
+#endif
+  }
+  return false;
+}
+
+// Returns the file extension for bitcode compressed with `compression`.
+const char *BitcodeFileExtension(BitcodeCompression compression) {
+  switch (compression) {
+    case BitcodeCompression::kNone: return ".bc";
+    case BitcodeCompression::kZstd: return ".bc.zst";
+  }
+  return ".bc";
+}
+
+// Decompress the zstd-compressed bitcode in `data` into `out`.
+bool DecompressBitcode(std::string_view data, std::string *out) {
+#ifdef REMILL_HAS_ZSTD
+  auto dstream = ZSTD_createDStream();
+  CHECK(dstream) << "Unable to create zstd decompression context";
+  ZSTD_initDStream(dstream);
+
+  // The frames written by `ModuleSaver` record their decompressed size, but
+  // those written by e.g. `zstd` reading from a pipe don't, so the data is
+  // decompressed in chunks.
+  std::string chunk(ZSTD_DStreamOutSize(), '\0');
+  ZSTD_inBuffer input = {data.data(), data.size(), 0};
+  size_t ret = 0;
+  out->clear();
+  for (;;) {
+    ZSTD_outBuffer output = {&(chunk[0]), chunk.size(), 0};
+    ret = ZSTD_decompressStream(dstream, &output, &input);
+    if (ZSTD_isError(ret)) {
+      LOG(ERROR) << "Unable to decompress bitcode: " << ZSTD_getErrorName(ret);
+      ZSTD_freeDStream(dstream);
+      return false;
+    }
+
+    out->append(chunk.data(), output.pos);
+    if (input.pos == input.size && output.pos < output.size) {
+      break;
+    }
+  }
+
+  ZSTD_freeDStream(dstream);
+  LOG_IF(ERROR, ret) << "Unable to decompress truncated bitcode";
+  return !ret;
+#else
+  (void) data;
+  (void) out;
+  LOG(ERROR) << "Unable to decompress bitcode: remill was built without zstd";
+  return false;
+#endif
+}
+
+ModuleSaver::ModuleSaver(BitcodeCompression compression_)
+    : compression(compression_) {
+  CHECK(IsBitcodeCompressionAvailable(compression))
+      << "Bitcode compression is not available; was remill built with zstd?";
+  writer = std::thread([this] { WriteFiles(); });
+}
+
+ModuleSaver::~ModuleSaver(void) {
+  {
+    std::lock_guard<std::mutex> locker(lock);
+    stop = true;
+  }
+  changed.notify_all();
+  writer.join();
+}
+
+// Verify and serialize `module`, then compress and write it to `file_name`
+// in the background.
+bool ModuleSaver::Save(llvm::Module *module, const std::string &file_name,
+                       DoneCallback done) {
+  DLOG(INFO) << "Saving bitcode to file " << file_name;
+
+  std::string error;
+  llvm::raw_string_ostream error_stream(error);
+  if (llvm::verifyModule(*module, &error_stream)) {
+    error_stream.flush();
+    LOG(ERROR) << "Error writing module to file " << file_name << ": "
+               << error;
+    return false;
+  }
+
+  PendingFile file = {file_name, {}, std::move(done)};
+  llvm::raw_string_ostream bitcode_stream(file.bitcode);
+#if LLVM_VERSION_NUMBER < LLVM_VERSION(7, 0)
+  llvm::WriteBitcodeToFile(module, bitcode_stream);
+#else
+  llvm::WriteBitcodeToFile(*module, bitcode_stream);
+#endif
+  bitcode_stream.flush();
+
+  {
+    std::lock_guard<std::mutex> locker(lock);
+    pending.push_back(std::move(file));
+    ++num_unwritten;
+  }
+  changed.notify_all();
+  return true;
+}
+
+// Wait for all saves to finish.
+bool ModuleSaver::Wait(void) {
+  std::unique_lock<std::mutex> locker(lock);
+  changed.wait(locker, [this] { return !num_unwritten; });
+  const auto ret = all_written;
+  all_written = true;
+  return ret;
+}
+
+// Compress and write files until the saver is destroyed.
+void ModuleSaver::WriteFiles(void) {
+  std::unique_lock<std::mutex> locker(lock);
+  for (;;) {
+    changed.wait(locker, [this] { return stop || !pending.empty(); });
+    if (pending.empty()) {
+      return;  // Only stop once everything has been written.
+    }
+
+    auto file = std::move(pending.front());
+    pending.pop_front();
+
+    locker.unlock();
+    const auto written = WriteFile(file);
+    if (file.done) {
+      file.done(written);
+    }
+    file = {};  // Free the bitcode before waiting for the next file.
+    locker.lock();
+
+    all_written = all_written && written;
+    --num_unwritten;
+    changed.notify_all();
+  }
+}
+
+// Compress and write one file.
+bool ModuleSaver::WriteFile(const PendingFile &file) const {
+  std::string compressed;
+  const std::string *data = &(file.bitcode);
+  if (BitcodeCompression::kZstd == compression) {
+    if (!Compress(file.bitcode, &compressed)) {
+      LOG(ERROR) << "Error writing bitcode to file: " << file.file_name;
+      return false;
+    }
+    data = &compressed;
+  }
+
+  std::stringstream ss;
+  ss << file.file_name << ".tmp." << llvm::sys::Process::getProcessId();
+  const auto tmp_name = ss.str();
+
+  std::error_code ec;
+  {
+#if LLVM_VERSION_NUMBER < LLVM_VERSION(7, 0)
+    llvm::raw_fd_ostream os(tmp_name, ec, llvm::sys::fs::F_None);
+#else
+    llvm::raw_fd_ostream os(tmp_name, ec, llvm::sys::fs::OF_None);
+#endif
+    if (ec) {
+      LOG(ERROR) << "Unable to open output bitcode file for writing: "
+                 << tmp_name << ": " << ec.message();
+      return false;
+    }
+
+    os.write(data->data(), data->size());
+    os.close();
+    if (os.has_error()) {
+      ec = os.error();
+      os.clear_error();
+    }
+  }
+
+  if (ec) {
+    RemoveFile(tmp_name);
+    LOG(ERROR) << "Error writing bitcode to file: " << file.file_name << ": "
+               << ec.message();
+    return false;
+  }
+
+  // Don't fall back on copying the file, as readers could then see it
+  // partially written.
+  ec = llvm::sys::fs::rename(tmp_name, file.file_name);
+  if (ec) {
+    RemoveFile(tmp_name);
+    LOG(ERROR) << "Unable to rename " << tmp_name << " to " << file.file_name
+               << ": " << ec.message();
+    return false;
+  }
+  return true;
+}
+
+}  // namespace remill
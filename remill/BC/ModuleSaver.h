@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+namespace llvm {
+class Module;
+}  // namespace llvm
+namespace remill {
+
+// How the bitcode files written by `ModuleSaver` are compressed.
+enum class BitcodeCompression : uint32_t {
+  kNone,
+
+  // Each file is a single zstd frame, which can be decompressed with
+  // `zstd -d`, or loaded directly by `LoadModuleFromFile`. This requires
+  // remill to have been built with zstd.
+  kZstd
+};
+
+// Returns `true` if remill was built with support for `compression`.
+bool IsBitcodeCompressionAvailable(BitcodeCompression compression);
+
+// Returns the file extension for bitcode compressed with `compression`, i.e.
+// `.bc` or `.bc.zst`.
+const char *BitcodeFileExtension(BitcodeCompression compression);
+
+// Decompress the zstd-compressed bitcode in `data` into `out`. Returns `false`
+// if `data` isn't valid zstd data, or if remill was built without zstd.
+bool DecompressBitcode(std::string_view data, std::string *out);
+
+// Saves modules to bitcode files on a background thread, so that the caller
+// can keep lifting while large outputs are compressed and written, instead of
+// saving everything in one long serial step at the end.
+//
+// Modules are serialized into memory by `Save` itself, as LLVM contexts are
+// not thread-safe; only the compression and writing of the files happen in the
+// background. Files are written in the order in which they were saved, each
+// into a temporary file that is renamed once complete, so that readers never
+// see partially written files.
+class ModuleSaver {
+ public:
+  // Called on the background thread once a file has been written, or has
+  // failed to be written.
+  using DoneCallback = std::function<void(bool saved)>;
+
+  explicit ModuleSaver(
+      BitcodeCompression compression_ = BitcodeCompression::kNone);
+
+  // Waits for all saves to finish.
+  ~ModuleSaver(void);
+
+  // Verify and serialize `module`, then compress and write it to `file_name`
+  // in the background. `module` can be changed or destroyed as soon as this
+  // returns. Returns `false`, without calling `done`, if `module` doesn't
+  // verify.
+  bool Save(llvm::Module *module, const std::string &file_name,
+            DoneCallback done = nullptr);
+
+  // Wait for all saves to finish. Returns `false` if any file that was saved
+  // since the last call to `Wait` couldn't be written.
+  bool Wait(void);
+
+  const BitcodeCompression compression;
+
+ private:
+  ModuleSaver(const ModuleSaver &) = delete;
+  ModuleSaver &operator=(const ModuleSaver &) = delete;
+
+  struct PendingFile {
+    std::string file_name;
+    std::string bitcode;
+    DoneCallback done;
+  };
+
+  // Compress and write files until the saver is destroyed.
+  void WriteFiles(void);
+
+  // Compress and write one file.
+  bool WriteFile(const PendingFile &file) const;
+
+  std::mutex lock;
+  std::condition_variable changed;
+  std::deque<PendingFile> pending;
+
+  // Number of files that are queued in `pending`, or being written.
+  uint64_t num_unwritten{0};
+  bool all_written{true};
+  bool stop{false};
+
+  std::thread writer;
+};
+
+}  // namespace remill
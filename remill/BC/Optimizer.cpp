@@ -41,6 +41,11 @@
 #include "remill/BC/Compat/TargetLibraryInfo.h"
 #include "remill/BC/DeadStoreEliminator.h"
 #include "remill/BC/Util.h"
+#include "remill/BC/Version.h"
+
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(4, 0)
+#  include <llvm/Transforms/IPO/AlwaysInliner.h>
+#endif
 
 namespace remill {
 
@@ -60,11 +65,19 @@ void OptimizeModule(const remill::Arch *arch, llvm::Module *module,
   TLI->disableAllFunctions();  // `-fno-builtin`.
 
   llvm::PassManagerBuilder builder;
-  builder.OptLevel = 3;
+  builder.OptLevel = guide.quick ? 1 : 3;
   builder.SizeLevel = 0;
-  builder.Inliner = llvm::createFunctionInliningPass(250);
+  if (guide.quick) {
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(4, 0)
+    builder.Inliner = llvm::createAlwaysInlinerLegacyPass();
+#else
+    builder.Inliner = llvm::createAlwaysInlinerPass();
+#endif
+  } else {
+    builder.Inliner = llvm::createFunctionInliningPass(250);
+  }
   builder.LibraryInfo = TLI;  // Deleted by `llvm::~PassManagerBuilder`.
-  builder.DisableUnrollLoops = false;  // Unroll loops!
+  builder.DisableUnrollLoops = guide.quick;  // Unroll loops, unless quick.
   IF_LLVM_LT_900(builder.DisableUnitAtATime = false;)
   builder.RerollLoops = false;
   builder.SLPVectorize = guide.slp_vectorize;
@@ -40,6 +40,10 @@ struct OptimizationGuide {
   bool verify_input;
   bool verify_output;
   bool eliminate_dead_stores;
+
+  // Only inline semantics and run cheap clean-up passes, trading the quality
+  // of the optimized code for compile time.
+  bool quick;
 };
 
 template <typename T>
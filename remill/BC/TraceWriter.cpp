@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "remill/BC/TraceWriter.h"
+
+#include <glog/logging.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalValue.h>
+#include <llvm/IR/Instruction.h>
+#include <llvm/IR/Module.h>
+
+#include <memory>
+#include <sstream>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "remill/Arch/Arch.h"
+#include "remill/BC/Util.h"
+#include "remill/OS/FileSystem.h"
+
+namespace remill {
+
+TraceWriter::TraceWriter(const Arch *arch_, const std::string &dir_name_,
+                         BitcodeCompression compression_)
+    : arch(arch_),
+      dir_name(dir_name_),
+      saver(compression_) {
+  CHECK(TryCreateDirectory(dir_name))
+      << "Unable to create trace output directory " << dir_name;
+
+  const auto index_path = dir_name + PathSeparator() + "index.txt";
+  index.open(index_path, std::ios::out | std::ios::trunc);
+  CHECK(index.good()) << "Unable to open trace index file " << index_path;
+}
+
+std::string TraceWriter::FilePath(const std::string &name) const {
+  return dir_name + PathSeparator() + name +
+         BitcodeFileExtension(saver.compression);
+}
+
+// Move the lifted traces into a new module, save it, and leave declarations
+// of the traces behind in their original modules.
+//
+// Anything outside of the batch that uses a trace, e.g. a trace that is still
+// being lifted, is switched over to the trace's declaration before the trace
+// is moved, so that the original module never refers to the new one. The
+// traces are renamed while they and their declarations share a module.
+bool TraceWriter::WriteTraces(std::map<uint64_t, llvm::Function *> *traces) {
+  if (traces->empty()) {
+    return true;
+  }
+
+  const auto first_trace = traces->begin()->second;
+  const auto file_stem = first_trace->getName().str();
+  std::unique_ptr<llvm::Module> module(
+      new llvm::Module(file_stem, first_trace->getContext()));
+  arch->PrepareModuleDataLayout(module.get());
+
+  std::vector<std::string> names;
+  std::vector<llvm::Function *> funcs;
+  names.reserve(traces->size());
+  funcs.reserve(traces->size());
+  for (const auto &entry : *traces) {
+    auto func = entry.second;
+    CHECK(!func->isDeclaration())
+        << "Cannot write undefined trace " << func->getName().str();
+
+    // Traces in other files call this one through external declarations.
+    func->setLinkage(llvm::GlobalValue::ExternalLinkage);
+    names.push_back(func->getName().str());
+    funcs.push_back(func);
+  }
+
+  const std::unordered_set<llvm::Function *> batch(funcs.begin(), funcs.end());
+  auto name_it = names.begin();
+  for (auto &entry : *traces) {
+    auto func = entry.second;
+    const auto &name = *name_it++;
+    func->setName(name + ".written");
+    auto decl = DeclareLiftedFunction(func->getParent(), name);
+    decl->setLinkage(llvm::GlobalValue::ExternalLinkage);
+
+    for (auto use_it = func->use_begin(); use_it != func->use_end();) {
+      auto &use = *use_it++;
+      auto inst = llvm::dyn_cast<llvm::Instruction>(use.getUser());
+      CHECK(inst != nullptr)
+          << "Cannot write trace " << name << ", which is used by "
+          << LLVMThingToString(use.getUser());
+      if (!batch.count(inst->getFunction())) {
+        use.set(decl);
+      }
+    }
+    entry.second = decl;
+  }
+
+  MoveFunctionsIntoModule(funcs, module.get());
+  name_it = names.begin();
+  for (auto func : funcs) {
+    const auto &name = *name_it++;
+    func->setName(name);
+    CHECK_EQ(func->getName().str(), name)
+        << "Trace " << name << " is already declared in " << file_stem;
+  }
+
+  // The index lines are only added once the file has been written, which
+  // happens in the background.
+  std::stringstream lines;
+  name_it = names.begin();
+  for (const auto &entry : *traces) {
+    lines << std::hex << entry.first << std::dec << ' ' << *name_it++ << ' '
+          << file_stem << BitcodeFileExtension(saver.compression) << '\n';
+  }
+
+  const auto saved = saver.Save(
+      module.get(), FilePath(file_stem),
+      [this, lines = lines.str()](bool written) {
+        if (written) {
+          index << lines;
+          index.flush();
+        }
+      });
+  LOG_IF(ERROR, !saved) << "Could not save LLVM bitcode to "
+                        << FilePath(file_stem);
+
+  module.reset();
+  return saved;
+}
+
+bool TraceWriter::WriteModule(llvm::Module *module, const std::string &name) {
+  const auto path = FilePath(name);
+  if (!saver.Save(module, path)) {
+    LOG(ERROR) << "Could not save LLVM bitcode to " << path;
+    return false;
+  }
+  return true;
+}
+
+// Wait for all files to be written.
+bool TraceWriter::Wait(void) {
+  if (!saver.Wait()) {
+    LOG(ERROR) << "Could not save LLVM bitcode to " << dir_name;
+    return false;
+  }
+  return true;
+}
+
+}  // namespace remill
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <string>
+
+#include "remill/BC/ModuleSaver.h"
+
+namespace llvm {
+class Function;
+class Module;
+}  // namespace llvm
+namespace remill {
+
+class Arch;
+
+// Streams lifted traces out to bitcode files as soon as they are optimized,
+// instead of collecting every trace into one module that is only saved at the
+// end. This keeps only the traces that are still being worked on in memory,
+// and lets other tools start compiling or analyzing the first files while
+// the rest of the code is still being lifted.
+//
+// Each batch of traces is moved into its own module (see
+// `MoveFunctionIntoModule`), which also declares everything the traces
+// reference, i.e. intrinsics and traces in other files. The files can be
+// compiled independently, or linked together with `llvm-link`.
+//
+// The output directory also contains `index.txt`, which lists every written
+// trace on a line of its own: the hexadecimal address of the trace, the name
+// of its function, and the name of the file that defines it. Each line is
+// added once its file is complete.
+//
+// Files are compressed and written in the background (see `ModuleSaver`),
+// while the next traces are lifted.
+class TraceWriter {
+ public:
+  // Write files into the directory `dir_name`, creating it if it doesn't
+  // already exist.
+  TraceWriter(const Arch *arch, const std::string &dir_name,
+              BitcodeCompression compression = BitcodeCompression::kNone);
+
+  // Move the lifted traces in `traces`, keyed by address, into a new module,
+  // and save it to a file named after the first trace. The traces are listed
+  // in the index once the file has been written. Returns `false` if the module
+  // couldn't be saved; failures to write the file are reported by `Wait`.
+  //
+  // The moved traces are destroyed along with the new module. Each entry of
+  // `traces` is replaced with a declaration of the trace in the module from
+  // which it was moved, and anything else that used the trace, e.g. a trace
+  // that will be written to a later file, now uses that declaration. This
+  // lets a trace manager keep reporting the trace as lifted.
+  bool WriteTraces(std::map<uint64_t, llvm::Function *> *traces);
+
+  // Save `module`, e.g. one that defines the execution counters of the
+  // written traces, to the file `<name>.bc` in the output directory.
+  bool WriteModule(llvm::Module *module, const std::string &name);
+
+  // Wait for all files to be written. Returns `false` if any couldn't be.
+  bool Wait(void);
+
+  // Path of the file `<name>.bc`, or `<name>.bc.zst` if it's compressed, in
+  // the output directory.
+  std::string FilePath(const std::string &name) const;
+
+ private:
+  TraceWriter(void) = delete;
+
+  const Arch *const arch;
+  const std::string dir_name;
+
+  // Only written to by `saver`'s background thread once the writer has been
+  // created, and so must outlive it.
+  std::ofstream index;
+  ModuleSaver saver;
+};
+
+}  // namespace remill
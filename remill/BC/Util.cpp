@@ -40,6 +40,7 @@
 #include <llvm/IR/Metadata.h>
 #include <llvm/IR/Module.h>
 #include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
 #include <llvm/Support/SourceMgr.h>
 #include <llvm/Support/raw_ostream.h>
 
@@ -53,6 +54,7 @@
 #include "remill/BC/Compat/ToolOutputFile.h"
 #include "remill/BC/Compat/Verifier.h"
 #include "remill/BC/IntrinsicTable.h"
+#include "remill/BC/ModuleSaver.h"
 #include "remill/BC/Util.h"
 #include "remill/BC/Version.h"
 #include "remill/OS/FileSystem.h"
@@ -336,7 +338,25 @@ std::unique_ptr<llvm::Module> LoadModuleFromFile(llvm::LLVMContext *context,
                                                  const std::string &file_name,
                                                  bool allow_failure) {
   llvm::SMDiagnostic err;
-  auto module = llvm::parseIRFile(file_name, err, *context);
+  std::unique_ptr<llvm::Module> module;
+
+  // Bitcode compressed by `ModuleSaver`.
+  if (llvm::StringRef(file_name).endswith(".zst")) {
+    auto buff = llvm::MemoryBuffer::getFile(file_name);
+    std::string bitcode;
+    if (!buff ||
+        !DecompressBitcode(std::string_view((*buff)->getBufferStart(),
+                                            (*buff)->getBufferSize()),
+                           &bitcode)) {
+      LOG_IF(FATAL, !allow_failure)
+          << "Unable to read compressed module file " << file_name;
+      return {};
+    }
+    module = llvm::parseIR(llvm::MemoryBufferRef(bitcode, file_name), err,
+                           *context);
+  } else {
+    module = llvm::parseIRFile(file_name, err, *context);
+  }
 
   if (!module) {
     LOG_IF(FATAL, !allow_failure) << "Unable to parse module file " << file_name
@@ -739,20 +759,21 @@ static llvm::Function *DeclareFunctionInModule(llvm::Function *func,
   return dest_func;
 }
 
-static llvm::GlobalVariable *DeclareVarInModule(llvm::GlobalVariable *var,
-                                                llvm::Module *dest_module);
+// Maps constants to the constants into which they were moved, so that each
+// constant is only moved once when moving many functions at once.
+using ConstantMap = std::unordered_map<llvm::Constant *, llvm::Constant *>;
 
-template <typename T>
-static void ClearMetaData(T *value) {
-  llvm::SmallVector<std::pair<unsigned, llvm::MDNode *>, 4> mds;
-  value->getAllMetadata(mds);
-  for (auto md_info : mds) {
-    value->setMetadata(md_info.first, nullptr);
-  }
-}
+static llvm::GlobalVariable *DeclareVarInModule(llvm::GlobalVariable *var,
+                                                llvm::Module *dest_module,
+                                                ConstantMap &moved);
 
 static llvm::Constant *MoveConstantIntoModule(llvm::Constant *c,
-                                              llvm::Module *dest_module) {
+                                              llvm::Module *dest_module,
+                                              ConstantMap &moved);
+
+static llvm::Constant *
+MoveConstantIntoModuleUncached(llvm::Constant *c, llvm::Module *dest_module,
+                               ConstantMap &moved) {
 
   auto &dest_context = dest_module->getContext();
   auto type = c->getType();
@@ -769,7 +790,7 @@ static llvm::Constant *MoveConstantIntoModule(llvm::Constant *c,
   }
 
   if (auto gv = llvm::dyn_cast<llvm::GlobalVariable>(c); gv) {
-    return DeclareVarInModule(gv, dest_module);
+    return DeclareVarInModule(gv, dest_module, moved);
 
   } else if (auto func = llvm::dyn_cast<llvm::Function>(c); func) {
     return DeclareFunctionInModule(func, dest_module);
@@ -877,100 +898,106 @@ static llvm::Constant *MoveConstantIntoModule(llvm::Constant *c,
       case llvm::Instruction::Add: {
         const auto b = llvm::dyn_cast<llvm::AddOperator>(ce);
         return llvm::ConstantExpr::getAdd(
-            MoveConstantIntoModule(ce->getOperand(0), dest_module),
-            MoveConstantIntoModule(ce->getOperand(1), dest_module),
+            MoveConstantIntoModule(ce->getOperand(0), dest_module, moved),
+            MoveConstantIntoModule(ce->getOperand(1), dest_module, moved),
             b->hasNoUnsignedWrap(), b->hasNoSignedWrap());
       }
       case llvm::Instruction::Sub: {
         const auto b = llvm::dyn_cast<llvm::SubOperator>(ce);
         return llvm::ConstantExpr::getSub(
-            MoveConstantIntoModule(ce->getOperand(0), dest_module),
-            MoveConstantIntoModule(ce->getOperand(1), dest_module),
+            MoveConstantIntoModule(ce->getOperand(0), dest_module, moved),
+            MoveConstantIntoModule(ce->getOperand(1), dest_module, moved),
             b->hasNoUnsignedWrap(), b->hasNoSignedWrap());
       }
       case llvm::Instruction::And:
         return llvm::ConstantExpr::getAnd(
-            MoveConstantIntoModule(ce->getOperand(0), dest_module),
-            MoveConstantIntoModule(ce->getOperand(1), dest_module));
+            MoveConstantIntoModule(ce->getOperand(0), dest_module, moved),
+            MoveConstantIntoModule(ce->getOperand(1), dest_module, moved));
       case llvm::Instruction::Or:
         return llvm::ConstantExpr::getOr(
-            MoveConstantIntoModule(ce->getOperand(0), dest_module),
-            MoveConstantIntoModule(ce->getOperand(1), dest_module));
+            MoveConstantIntoModule(ce->getOperand(0), dest_module, moved),
+            MoveConstantIntoModule(ce->getOperand(1), dest_module, moved));
       case llvm::Instruction::Xor:
         return llvm::ConstantExpr::getXor(
-            MoveConstantIntoModule(ce->getOperand(0), dest_module),
-            MoveConstantIntoModule(ce->getOperand(1), dest_module));
+            MoveConstantIntoModule(ce->getOperand(0), dest_module, moved),
+            MoveConstantIntoModule(ce->getOperand(1), dest_module, moved));
       case llvm::Instruction::ICmp:
         return llvm::ConstantExpr::getICmp(
             ce->getPredicate(),
-            MoveConstantIntoModule(ce->getOperand(0), dest_module),
-            MoveConstantIntoModule(ce->getOperand(1), dest_module));
+            MoveConstantIntoModule(ce->getOperand(0), dest_module, moved),
+            MoveConstantIntoModule(ce->getOperand(1), dest_module, moved));
       case llvm::Instruction::ZExt:
         return llvm::ConstantExpr::getZExt(
-            MoveConstantIntoModule(ce->getOperand(0), dest_module), type);
+            MoveConstantIntoModule(ce->getOperand(0), dest_module, moved),
+            type);
       case llvm::Instruction::SExt:
         return llvm::ConstantExpr::getSExt(
-            MoveConstantIntoModule(ce->getOperand(0), dest_module), type);
+            MoveConstantIntoModule(ce->getOperand(0), dest_module, moved),
+            type);
       case llvm::Instruction::Trunc:
         return llvm::ConstantExpr::getTrunc(
-            MoveConstantIntoModule(ce->getOperand(0), dest_module), type);
+            MoveConstantIntoModule(ce->getOperand(0), dest_module, moved),
+            type);
       case llvm::Instruction::Select:
         return llvm::ConstantExpr::getSelect(
-            MoveConstantIntoModule(ce->getOperand(0), dest_module),
-            MoveConstantIntoModule(ce->getOperand(1), dest_module),
-            MoveConstantIntoModule(ce->getOperand(2), dest_module));
+            MoveConstantIntoModule(ce->getOperand(0), dest_module, moved),
+            MoveConstantIntoModule(ce->getOperand(1), dest_module, moved),
+            MoveConstantIntoModule(ce->getOperand(2), dest_module, moved));
       case llvm::Instruction::Shl: {
         const auto b = llvm::dyn_cast<llvm::ShlOperator>(ce);
         return llvm::ConstantExpr::getShl(
-            MoveConstantIntoModule(ce->getOperand(0), dest_module),
-            MoveConstantIntoModule(ce->getOperand(1), dest_module),
+            MoveConstantIntoModule(ce->getOperand(0), dest_module, moved),
+            MoveConstantIntoModule(ce->getOperand(1), dest_module, moved),
             b->hasNoUnsignedWrap(), b->hasNoSignedWrap());
       }
       case llvm::Instruction::LShr: {
         const auto b = llvm::dyn_cast<llvm::LShrOperator>(ce);
         return llvm::ConstantExpr::getLShr(
-            MoveConstantIntoModule(ce->getOperand(0), dest_module),
-            MoveConstantIntoModule(ce->getOperand(1), dest_module),
+            MoveConstantIntoModule(ce->getOperand(0), dest_module, moved),
+            MoveConstantIntoModule(ce->getOperand(1), dest_module, moved),
             b->isExact());
       }
       case llvm::Instruction::AShr: {
         const auto b = llvm::dyn_cast<llvm::AShrOperator>(ce);
         return llvm::ConstantExpr::getAShr(
-            MoveConstantIntoModule(ce->getOperand(0), dest_module),
-            MoveConstantIntoModule(ce->getOperand(1), dest_module),
+            MoveConstantIntoModule(ce->getOperand(0), dest_module, moved),
+            MoveConstantIntoModule(ce->getOperand(1), dest_module, moved),
             b->isExact());
       }
       case llvm::Instruction::UDiv: {
         const auto b = llvm::dyn_cast<llvm::UDivOperator>(ce);
         return llvm::ConstantExpr::getUDiv(
-            MoveConstantIntoModule(ce->getOperand(0), dest_module),
-            MoveConstantIntoModule(ce->getOperand(1), dest_module),
+            MoveConstantIntoModule(ce->getOperand(0), dest_module, moved),
+            MoveConstantIntoModule(ce->getOperand(1), dest_module, moved),
             b->isExact());
       }
       case llvm::Instruction::SDiv: {
         const auto b = llvm::dyn_cast<llvm::SDivOperator>(ce);
         return llvm::ConstantExpr::getSDiv(
-            MoveConstantIntoModule(ce->getOperand(0), dest_module),
-            MoveConstantIntoModule(ce->getOperand(1), dest_module),
+            MoveConstantIntoModule(ce->getOperand(0), dest_module, moved),
+            MoveConstantIntoModule(ce->getOperand(1), dest_module, moved),
             b->isExact());
       }
       case llvm::Instruction::URem:
         return llvm::ConstantExpr::getURem(
-            MoveConstantIntoModule(ce->getOperand(0), dest_module),
-            MoveConstantIntoModule(ce->getOperand(1), dest_module));
+            MoveConstantIntoModule(ce->getOperand(0), dest_module, moved),
+            MoveConstantIntoModule(ce->getOperand(1), dest_module, moved));
       case llvm::Instruction::SRem:
         return llvm::ConstantExpr::getSRem(
-            MoveConstantIntoModule(ce->getOperand(0), dest_module),
-            MoveConstantIntoModule(ce->getOperand(1), dest_module));
+            MoveConstantIntoModule(ce->getOperand(0), dest_module, moved),
+            MoveConstantIntoModule(ce->getOperand(1), dest_module, moved));
       case llvm::Instruction::IntToPtr:
         return llvm::ConstantExpr::getIntToPtr(
-            MoveConstantIntoModule(ce->getOperand(0), dest_module), type);
+            MoveConstantIntoModule(ce->getOperand(0), dest_module, moved),
+            type);
       case llvm::Instruction::PtrToInt:
         return llvm::ConstantExpr::getPtrToInt(
-            MoveConstantIntoModule(ce->getOperand(0), dest_module), type);
+            MoveConstantIntoModule(ce->getOperand(0), dest_module, moved),
+            type);
       case llvm::Instruction::BitCast:
         return llvm::ConstantExpr::getBitCast(
-            MoveConstantIntoModule(ce->getOperand(0), dest_module), type);
+            MoveConstantIntoModule(ce->getOperand(0), dest_module, moved),
+            type);
       case llvm::Instruction::GetElementPtr: {
         const auto g = llvm::dyn_cast<llvm::GEPOperator>(ce);
         const auto ni = g->getNumIndices();
@@ -978,11 +1005,12 @@ static llvm::Constant *MoveConstantIntoModule(llvm::Constant *c,
             g->getSourceElementType(), dest_context);
         std::vector<llvm::Constant *> indices(ni);
         for (auto i = 0u; i < ni; ++i) {
-          indices[i] =
-              MoveConstantIntoModule(ce->getOperand(i + 1u), dest_module);
+          indices[i] = MoveConstantIntoModule(ce->getOperand(i + 1u),
+                                              dest_module, moved);
         }
         return llvm::ConstantExpr::getGetElementPtr(
-            source_type, MoveConstantIntoModule(ce->getOperand(0), dest_module),
+            source_type,
+            MoveConstantIntoModule(ce->getOperand(0), dest_module, moved),
             indices, g->isInBounds(), g->getInRangeIndex());
       }
       default:
@@ -1003,7 +1031,7 @@ static llvm::Constant *MoveConstantIntoModule(llvm::Constant *c,
       new_elems.reserve(a->getNumOperands());
       for (auto it = a->op_begin(), end = a->op_end(); it != end; ++it) {
         new_elems.push_back(MoveConstantIntoModule(
-            llvm::cast<llvm::Constant>(it->get()), dest_module));
+            llvm::cast<llvm::Constant>(it->get()), dest_module, moved));
       }
 
       return llvm::ConstantArray::get(llvm::cast<llvm::ArrayType>(type),
@@ -1014,7 +1042,7 @@ static llvm::Constant *MoveConstantIntoModule(llvm::Constant *c,
       new_elems.reserve(s->getNumOperands());
       for (auto it = s->op_begin(), end = s->op_end(); it != end; ++it) {
         new_elems.push_back(MoveConstantIntoModule(
-            llvm::cast<llvm::Constant>(it->get()), dest_module));
+            llvm::cast<llvm::Constant>(it->get()), dest_module, moved));
       }
 
       return llvm::ConstantStruct::get(llvm::cast<llvm::StructType>(type),
@@ -1025,7 +1053,7 @@ static llvm::Constant *MoveConstantIntoModule(llvm::Constant *c,
       new_elems.reserve(v->getNumOperands());
       for (auto it = v->op_begin(), end = v->op_end(); it != end; ++it) {
         new_elems.push_back(MoveConstantIntoModule(
-            llvm::cast<llvm::Constant>(it->get()), dest_module));
+            llvm::cast<llvm::Constant>(it->get()), dest_module, moved));
       }
 
       return llvm::ConstantVector::get(new_elems);
@@ -1054,7 +1082,8 @@ static llvm::Constant *MoveConstantIntoModule(llvm::Constant *c,
 }
 
 llvm::GlobalVariable *DeclareVarInModule(llvm::GlobalVariable *var,
-                                         llvm::Module *dest_module) {
+                                         llvm::Module *dest_module,
+                                         ConstantMap &moved) {
   auto dest_var = dest_module->getGlobalVariable(var->getName());
   if (dest_var) {
     return dest_var;
@@ -1070,7 +1099,8 @@ llvm::GlobalVariable *DeclareVarInModule(llvm::GlobalVariable *var,
 
   if (var->hasInitializer() && var->hasLocalLinkage()) {
     auto initializer = var->getInitializer();
-    dest_var->setInitializer(MoveConstantIntoModule(initializer, dest_module));
+    dest_var->setInitializer(
+        MoveConstantIntoModule(initializer, dest_module, moved));
   } else {
     LOG_IF(FATAL, var->hasLocalLinkage())
         << "Cannot declare internal variable " << var->getName().str()
@@ -1080,6 +1110,19 @@ llvm::GlobalVariable *DeclareVarInModule(llvm::GlobalVariable *var,
   return dest_var;
 }
 
+llvm::Constant *MoveConstantIntoModule(llvm::Constant *c,
+                                       llvm::Module *dest_module,
+                                       ConstantMap &moved) {
+
+  // NOTE: References to the values of an `std::unordered_map` survive the
+  //       insertions made by the recursive calls.
+  auto &moved_c = moved[c];
+  if (!moved_c) {
+    moved_c = MoveConstantIntoModuleUncached(c, dest_module, moved);
+  }
+  return moved_c;
+}
+
 }  // namespace
 
 // Clone function `source_func` into `dest_func`, using `value_map` to map over
@@ -1135,6 +1178,10 @@ void CloneFunctionInto(llvm::Function *source_func, llvm::Function *dest_func,
 
   llvm::SmallVector<std::pair<unsigned, llvm::MDNode *>, 4> mds;
 
+  // Constants shared by the initializers of the cloned globals are only moved
+  // once.
+  ConstantMap moved;
+
   // Fixup the references in the cloned instructions so that they point into
   // the cloned function, or point to declared globals in the module containing
   // `dest_func`.
@@ -1213,7 +1260,7 @@ void CloneFunctionInto(llvm::Function *source_func, llvm::Function *dest_func,
           if (new_global_val_var != global_val_var &&
               global_val_var->hasInitializer()) {
             new_global_val_var->setInitializer(MoveConstantIntoModule(
-                global_val_var->getInitializer(), dest_mod));
+                global_val_var->getInitializer(), dest_mod, moved));
           }
 
           new_global_val = new_global_val_var;
@@ -1256,53 +1303,53 @@ void CloneFunctionInto(llvm::Function *source_func, llvm::Function *dest_func,
 //
 // TODO(pag): Make this work across distinct `llvm::LLVMContext`s.
 void MoveFunctionIntoModule(llvm::Function *func, llvm::Module *dest_module) {
-  const auto source_context = &(func->getContext());
+  MoveFunctionsIntoModule({func}, dest_module);
+}
+
+// Move the functions `funcs` from their modules into `dest_module`.
+void MoveFunctionsIntoModule(llvm::ArrayRef<llvm::Function *> funcs,
+                             llvm::Module *dest_module) {
   const auto dest_context = &(dest_module->getContext());
-  CHECK(source_context == dest_context)
-      << "Cannot move function across two independent LLVM contexts.";
-
-  auto source_module = func->getParent();
-  CHECK(source_module != dest_module)
-      << "Cannot move function to the same module.";
-
-  auto existing = dest_module->getFunction(func->getName());
-  if (existing) {
-    CHECK(existing->isDeclaration())
-        << "Function " << func->getName().str()
-        << " already exists in destination module.";
-    existing->setName(llvm::Twine::createNull());
-    existing->setLinkage(llvm::GlobalValue::PrivateLinkage);
-    existing->setVisibility(llvm::GlobalValue::DefaultVisibility);
-  }
 
-  const auto in_same_context = source_context == dest_context;
+  // Move all of the functions before substituting any of their operands, so
+  // that calls between them resolve to the moved functions themselves rather
+  // than to declarations which would then need to be replaced.
+  for (auto func : funcs) {
+    CHECK(&(func->getContext()) == dest_context)
+        << "Cannot move function across two independent LLVM contexts.";
+
+    CHECK(func->getParent() != dest_module)
+        << "Cannot move function to the same module.";
+
+    auto existing = dest_module->getFunction(func->getName());
+    if (existing) {
+      CHECK(existing->isDeclaration())
+          << "Function " << func->getName().str()
+          << " already exists in destination module.";
+      existing->setName(llvm::Twine::createNull());
+      existing->setLinkage(llvm::GlobalValue::PrivateLinkage);
+      existing->setVisibility(llvm::GlobalValue::DefaultVisibility);
+    }
 
-  if (in_same_context) {
     func->removeFromParent();
     dest_module->getFunctionList().push_back(func);
-  }
 
-  if (existing) {
-    existing->replaceAllUsesWith(func);
-    existing->eraseFromParent();
-    existing = nullptr;
-  }
-
-  if (!in_same_context) {
-    IF_LLVM_GTE_370(ClearMetaData(func);)
+    if (existing) {
+      existing->replaceAllUsesWith(func);
+      existing->eraseFromParent();
+    }
   }
 
-  for (auto &block : *func) {
-    for (auto &inst : block) {
-
-      if (!in_same_context) {
-        ClearMetaData(&inst);
-      }
-
-      // Substitute globals in the operands.
-      for (auto &op : inst.operands()) {
-        if (auto c = llvm::dyn_cast<llvm::Constant>(op.get()); c) {
-          op.set(MoveConstantIntoModule(c, dest_module));
+  // Substitute globals in the operands. Each global and constant expression
+  // is only moved once, no matter how many of the functions use it.
+  ConstantMap moved;
+  for (auto func : funcs) {
+    for (auto &block : *func) {
+      for (auto &inst : block) {
+        for (auto &op : inst.operands()) {
+          if (auto c = llvm::dyn_cast<llvm::Constant>(op.get()); c) {
+            op.set(MoveConstantIntoModule(c, dest_module, moved));
+          }
         }
       }
     }
@@ -1983,4 +2030,24 @@ StripAndAccumulateConstantOffsets(const llvm::DataLayout &dl,
   return {base, total_offset};
 }
 
+// Convert the guest address `addr` into a host pointer to a value of type
+// `val_type`.
+llvm::Value *GuestAddressToPointer(llvm::IRBuilder<> &ir, llvm::Value *addr,
+                                   llvm::Type *val_type, unsigned addr_space,
+                                   llvm::Constant *base) {
+  if (!base) {
+    return ir.CreateIntToPtr(addr,
+                             llvm::PointerType::get(val_type, addr_space));
+  }
+
+  const auto base_addr_space = base->getType()->getPointerAddressSpace();
+  auto byte_type = llvm::Type::getInt8Ty(ir.getContext());
+  auto byte_ptr = ir.CreateGEP(
+      byte_type,
+      ir.CreateBitCast(base, llvm::PointerType::get(byte_type, base_addr_space)),
+      addr);
+  return ir.CreateBitCast(byte_ptr,
+                          llvm::PointerType::get(val_type, base_addr_space));
+}
+
 }  // namespace remill
@@ -18,6 +18,7 @@
 
 // clang-format off
 #include "remill/BC/Compat/CTypes.h"
+#include <llvm/ADT/ArrayRef.h>
 #include <llvm/ADT/SmallVector.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/Module.h>
@@ -36,6 +37,7 @@ namespace llvm {
 class Argument;
 class BasicBlock;
 class CallInst;
+class Constant;
 class Function;
 class FunctionType;
 class GlobalObject;
@@ -133,7 +135,8 @@ llvm::GlobalVariable *FindGlobaVariable(llvm::Module *M,
 // Try to verify a module.
 bool VerifyModule(llvm::Module *module);
 
-// Parses and loads a bitcode file into memory.
+// Parses and loads a bitcode file into memory. Files whose names end with
+// `.zst` are decompressed first (see `ModuleSaver`).
 std::unique_ptr<llvm::Module> LoadModuleFromFile(llvm::LLVMContext *context,
                                                  const std::string &file_name,
                                                  bool allow_failure = false);
@@ -166,6 +169,8 @@ bool StoreModuleIRToFile(llvm::Module *module, const std::string &file_name,
                          bool allow_failure = false);
 
 // Find the path to the semantics bitcode file associated with `FLAGS_arch`.
+// Code that lifts for several architectures should instead use
+// `FindSemanticsBitcodeFile(GetArchName(arch->arch_name))`.
 std::string FindTargetSemanticsBitcodeFile(void);
 
 // Find the path to the semantics bitcode file associated with `REMILL_ARCH`,
@@ -242,6 +247,13 @@ std::string ModuleName(const std::unique_ptr<llvm::Module> &module);
 // Move a function from one module into another module.
 void MoveFunctionIntoModule(llvm::Function *func, llvm::Module *dest_module);
 
+// Move many functions from their modules into `dest_module`. This is much
+// faster than moving them one at a time, as the globals and constants that
+// they share are only moved once, and calls between them don't go through
+// temporary declarations.
+void MoveFunctionsIntoModule(llvm::ArrayRef<llvm::Function *> funcs,
+                             llvm::Module *dest_module);
+
 // Get an instance of `type` that belongs to `context`.
 llvm::Type *RecontextualizeType(llvm::Type *type, llvm::LLVMContext &context);
 
@@ -287,4 +299,13 @@ std::pair<llvm::Value *, int64_t>
 StripAndAccumulateConstantOffsets(const llvm::DataLayout &dl,
                                   llvm::Value *base);
 
+// Convert the guest address `addr` into a host pointer to a value of type
+// `val_type`. If `base` is non-null, then it points to the host location of
+// guest address zero, and `addr` is treated as a byte offset from `base`.
+// Otherwise, `addr` is cast directly to a pointer in the address space
+// `addr_space`.
+llvm::Value *GuestAddressToPointer(llvm::IRBuilder<> &ir, llvm::Value *addr,
+                                   llvm::Type *val_type, unsigned addr_space,
+                                   llvm::Constant *base = nullptr);
+
 }  // namespace remill
@@ -0,0 +1,1381 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "remill/JIT/JIT.h"
+
+#include <glog/logging.h>
+#include <llvm/DebugInfo/DIContext.h>
+#include <llvm/DebugInfo/DWARF/DWARFContext.h>
+#include <llvm/ExecutionEngine/JITEventListener.h>
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+#include <llvm/ExecutionEngine/SectionMemoryManager.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Object/ObjectFile.h>
+#include <llvm/Object/SymbolSize.h>
+#include <llvm/Support/TargetSelect.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "remill/Arch/Arch.h"
+#include "remill/Arch/Instruction.h"
+#include "remill/BC/Compat/Error.h"
+#include "remill/BC/GuestDebugInfo.h"
+#include "remill/BC/IntrinsicTable.h"
+#include "remill/BC/Lifter.h"
+#include "remill/BC/LowerAtomics.h"
+#include "remill/BC/LowerMemory.h"
+#include "remill/BC/Optimizer.h"
+#include "remill/BC/Util.h"
+#include "remill/BC/Version.h"
+
+namespace remill {
+namespace {
+
+// The JIT whose lifted code is running on this thread. The default dispatcher
+// uses this to find the traces of the program counters that it is given.
+//
+// NOTE: Lifted code only reaches the default dispatcher by way of code that
+//       hasn't been chained (see `ChainTraces`). The handlers that chained
+//       code calls are given their JIT, and so work outside of `Execute`.
+static thread_local JIT *gCurrentJIT = nullptr;
+
+// Default implementation of `__remill_jump`, `__remill_function_call`, and
+// `__remill_missing_block`.
+static Memory *DispatchToTrace(State &state, uint64_t pc, Memory *memory) {
+  CHECK(gCurrentJIT != nullptr)
+      << "Lifted code is not running inside of `JIT::Execute`";
+
+  if (auto trace = gCurrentJIT->GetOrLiftTrace(pc)) {
+    return trace(state, pc, memory);
+  }
+
+  LOG(ERROR) << "Unable to dispatch to trace at address " << std::hex << pc
+             << std::dec;
+  return memory;
+}
+
+// Default implementation of `__remill_function_return`.
+static Memory *ReturnToCaller(State &, uint64_t, Memory *memory) {
+  return memory;
+}
+
+static const std::pair<const char *, LiftedTraceFunction>
+    kDefaultDispatchers[] = {
+        {"__remill_jump", DispatchToTrace},
+        {"__remill_function_call", DispatchToTrace},
+        {"__remill_missing_block", DispatchToTrace},
+        {"__remill_function_return", ReturnToCaller},
+};
+
+// Name of the function that handles inline cache misses.
+static const char kInlineCacheMissName[] = "__remill_jit_inline_cache_miss";
+
+// An inline cache entry. Each inline cache is a pointer to one of these. The
+// program counter of a published entry never changes, so that lifted code
+// only needs one atomic load to find a consistent program counter and trace
+// pair. The trace can be atomically replaced by a more optimized one.
+//
+// NOTE: This must match the type built by `InlineCacheEntryType`.
+struct InlineCacheEntry {
+  uint64_t pc;
+  LiftedTraceFunction trace;
+};
+
+// The IR type of an `InlineCacheEntry`.
+static llvm::StructType *InlineCacheEntryType(llvm::FunctionType *func_type) {
+  auto &context = func_type->getContext();
+  return llvm::StructType::get(
+      context, {llvm::Type::getInt64Ty(context),
+                llvm::PointerType::get(func_type, 0)});
+}
+
+// Returns `jit` as a constant in `module`. Modules are compiled in the same
+// process as the JIT, so the handlers that lifted code calls into are passed
+// their JIT this way, rather than by way of any thread-local state.
+static llvm::Constant *JITPointer(llvm::Module *module, void *jit) {
+  auto &context = module->getContext();
+  return llvm::ConstantExpr::getIntToPtr(
+      llvm::ConstantInt::get(module->getDataLayout().getIntPtrType(context),
+                             reinterpret_cast<uintptr_t>(jit)),
+      llvm::PointerType::get(llvm::Type::getInt8Ty(context), 0));
+}
+
+// Add `name` to `symbols` as the address `address`.
+static void AddSymbol(llvm::orc::LLJIT &jit, llvm::orc::SymbolMap &symbols,
+                      const std::string &name, void *address) {
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(17, 0)
+  symbols[jit.mangleAndIntern(name)] = {
+      llvm::orc::ExecutorAddr::fromPtr(address),
+      llvm::JITSymbolFlags::Exported};
+#else
+  symbols[jit.mangleAndIntern(name)] = llvm::JITEvaluatedSymbol(
+      llvm::pointerToJITTargetAddress(address), llvm::JITSymbolFlags::Exported);
+#endif
+}
+
+// Replace every call to `__remill_function_return` in `module` with the
+// memory pointer it is given. This is what the default dispatcher does.
+static void InlineFunctionReturns(llvm::Module *module) {
+  for (auto call : CallersOf(module->getFunction("__remill_function_return"))) {
+    call->replaceAllUsesWith(call->getArgOperand(2));
+    call->eraseFromParent();
+  }
+}
+
+// Replace every call to the control-flow intrinsic `intrinsic` in `module`
+// with a monomorphic inline cache. If the target program counter matches
+// the cached one, then the cached trace is called directly. Otherwise, the
+// inline cache miss handler of `jit` finds the target trace, updates the
+// cache, and calls the trace.
+static void AddInlineCaches(llvm::Module *module, llvm::Function *intrinsic,
+                            void *jit) {
+  if (!intrinsic) {
+    return;
+  }
+
+  auto &context = module->getContext();
+  const auto &dl = module->getDataLayout();
+  const auto func_type = intrinsic->getFunctionType();
+  const auto entry_type = InlineCacheEntryType(func_type);
+  const auto entry_ptr_type = llvm::PointerType::get(entry_type, 0);
+  const auto i64_type = llvm::Type::getInt64Ty(context);
+  const auto jit_ptr = JITPointer(module, jit);
+
+  auto miss_func = llvm::cast<llvm::Function>(
+      module
+          ->getOrInsertFunction(
+              kInlineCacheMissName,
+              llvm::FunctionType::get(
+                  func_type->getReturnType(),
+                  {func_type->getParamType(0), i64_type,
+                   func_type->getParamType(2),
+                   llvm::PointerType::get(entry_ptr_type, 0),
+                   jit_ptr->getType()},
+                  false))
+          .getCallee());
+
+  // Every inline cache starts off pointing to an entry that never matches.
+  const char empty_entry_name[] = "__remill_jit_empty_entry";
+  auto empty_entry = module->getGlobalVariable(empty_entry_name, true);
+  if (!empty_entry) {
+    empty_entry = new llvm::GlobalVariable(
+        *module, entry_type, true, llvm::GlobalValue::PrivateLinkage,
+        llvm::ConstantStruct::get(
+            entry_type,
+            {llvm::ConstantInt::get(i64_type, ~0ULL),
+             llvm::Constant::getNullValue(entry_type->getElementType(1))}),
+        empty_entry_name);
+  }
+
+  for (auto call : CallersOf(intrinsic)) {
+    auto state = call->getArgOperand(0);
+    auto pc = call->getArgOperand(1);
+    auto memory = call->getArgOperand(2);
+
+    auto cache = new llvm::GlobalVariable(
+        *module, entry_ptr_type, false, llvm::GlobalValue::PrivateLinkage,
+        empty_entry, "__remill_jit_inline_cache");
+
+    // Calls that are immediately returned are kept as tail calls, so that
+    // chained traces don't grow the stack.
+    auto ret = llvm::dyn_cast_or_null<llvm::ReturnInst>(call->getNextNode());
+    const auto is_tail_call = ret && ret->getReturnValue() == call;
+
+    auto block = call->getParent();
+    auto func = block->getParent();
+    auto cont_block = block->splitBasicBlock(call);
+    auto hit_block = llvm::BasicBlock::Create(context, "", func, cont_block);
+    auto miss_block = llvm::BasicBlock::Create(context, "", func, cont_block);
+    block->getTerminator()->eraseFromParent();
+
+    llvm::IRBuilder<> ir(block);
+    auto entry = ir.CreateAlignedLoad(entry_ptr_type, cache,
+                                      dl.getPointerABIAlignment(0));
+    entry->setAtomic(llvm::AtomicOrdering::Acquire);
+    auto pc64 = ir.CreateZExtOrBitCast(pc, i64_type);
+    auto cached_pc =
+        ir.CreateLoad(i64_type, ir.CreateStructGEP(entry_type, entry, 0));
+    ir.CreateCondBr(ir.CreateICmpEQ(pc64, cached_pc), hit_block, miss_block);
+
+    ir.SetInsertPoint(hit_block);
+    auto trace = ir.CreateAlignedLoad(entry_type->getElementType(1),
+                                      ir.CreateStructGEP(entry_type, entry, 1),
+                                      dl.getPointerABIAlignment(0));
+    trace->setAtomic(llvm::AtomicOrdering::Monotonic);
+    auto hit_call = ir.CreateCall(func_type, trace, {state, pc, memory});
+
+    ir.SetInsertPoint(miss_block);
+    auto miss_call =
+        ir.CreateCall(miss_func, {state, pc64, memory, cache, jit_ptr});
+
+    if (is_tail_call) {
+      hit_call->setTailCall(true);
+      miss_call->setTailCall(true);
+      llvm::ReturnInst::Create(context, hit_call, hit_block);
+      llvm::ReturnInst::Create(context, miss_call, miss_block);
+      cont_block->eraseFromParent();
+
+    } else {
+      llvm::BranchInst::Create(cont_block, hit_block);
+      llvm::BranchInst::Create(cont_block, miss_block);
+      auto new_memory =
+          llvm::PHINode::Create(func_type->getReturnType(), 2, "", call);
+      new_memory->addIncoming(hit_call, hit_block);
+      new_memory->addIncoming(miss_call, miss_block);
+      call->replaceAllUsesWith(new_memory);
+      call->eraseFromParent();
+    }
+  }
+}
+
+// Name of the function that is told about traces that have become hot.
+static const char kTierUpName[] = "__remill_jit_tier_up";
+
+// Instrument the quickly compiled `trace`, which starts at `pc`, so that it
+// counts how many times it is entered, and calls the tier up function of `jit`
+// when that count reaches `threshold`. Once a fully optimized version of the
+// trace is published to the trace's `__remill_jit_hot_trace` variable, the
+// trace tail-calls that version on entry instead.
+//
+// NOTE: `threshold` must be non-zero; the count wraps around to zero.
+static void AddEntryCounter(llvm::Function *trace, uint64_t pc,
+                            uint32_t threshold, void *jit) {
+  CHECK_NE(threshold, 0u);
+
+  auto module = trace->getParent();
+  auto &context = module->getContext();
+  const auto &dl = module->getDataLayout();
+  const auto func_type = trace->getFunctionType();
+  const auto func_ptr_type = llvm::PointerType::get(func_type, 0);
+  const auto i32_type = llvm::Type::getInt32Ty(context);
+  const auto i64_type = llvm::Type::getInt64Ty(context);
+  const auto jit_ptr = JITPointer(module, jit);
+
+  auto tier_up_func = llvm::cast<llvm::Function>(
+      module
+          ->getOrInsertFunction(
+              kTierUpName,
+              llvm::FunctionType::get(
+                  llvm::Type::getVoidTy(context),
+                  {i64_type, llvm::PointerType::get(func_ptr_type, 0),
+                   jit_ptr->getType()},
+                  false))
+          .getCallee());
+
+  auto hot_trace = new llvm::GlobalVariable(
+      *module, func_ptr_type, false, llvm::GlobalValue::PrivateLinkage,
+      llvm::Constant::getNullValue(func_ptr_type), "__remill_jit_hot_trace");
+  auto count = new llvm::GlobalVariable(
+      *module, i32_type, false, llvm::GlobalValue::PrivateLinkage,
+      llvm::ConstantInt::get(i32_type, 0), "__remill_jit_entry_count");
+
+  // Split the entry block after its `alloca`s, so that they stay static.
+  auto entry_block = &(trace->getEntryBlock());
+  auto inst_it = entry_block->begin();
+  while (llvm::isa<llvm::AllocaInst>(*inst_it)) {
+    ++inst_it;
+  }
+  auto body_block = entry_block->splitBasicBlock(inst_it);
+  auto hot_block = llvm::BasicBlock::Create(context, "", trace, body_block);
+  auto count_block = llvm::BasicBlock::Create(context, "", trace, body_block);
+  auto notify_block = llvm::BasicBlock::Create(context, "", trace, body_block);
+  entry_block->getTerminator()->eraseFromParent();
+
+  llvm::IRBuilder<> ir(entry_block);
+  auto hot_func = ir.CreateAlignedLoad(func_ptr_type, hot_trace,
+                                       dl.getPointerABIAlignment(0));
+  hot_func->setAtomic(llvm::AtomicOrdering::Acquire);
+  ir.CreateCondBr(ir.CreateIsNull(hot_func), count_block, hot_block);
+
+  ir.SetInsertPoint(hot_block);
+  std::vector<llvm::Value *> args;
+  for (auto &arg : trace->args()) {
+    args.push_back(&arg);
+  }
+  auto hot_call = ir.CreateCall(func_type, hot_func, args);
+  hot_call->setTailCall(true);
+  ir.CreateRet(hot_call);
+
+  // The count is approximate, as racing threads can lose increments. They
+  // then store the same count though, so `threshold` is never skipped over.
+  ir.SetInsertPoint(count_block);
+  const auto count_align = dl.getABITypeAlign(i32_type);
+  auto old_count = ir.CreateAlignedLoad(i32_type, count, count_align);
+  old_count->setAtomic(llvm::AtomicOrdering::Monotonic);
+  auto new_count = ir.CreateAdd(old_count, ir.getInt32(1));
+  ir.CreateAlignedStore(new_count, count, count_align)
+      ->setAtomic(llvm::AtomicOrdering::Monotonic);
+  ir.CreateCondBr(ir.CreateICmpEQ(new_count, ir.getInt32(threshold)),
+                  notify_block, body_block);
+
+  ir.SetInsertPoint(notify_block);
+  ir.CreateCall(tier_up_func, {ir.getInt64(pc), hot_trace, jit_ptr});
+  ir.CreateBr(body_block);
+}
+
+// Create an empty module for code that will run on the host.
+static std::unique_ptr<llvm::Module>
+CreateHostModule(llvm::orc::LLJIT &jit, llvm::LLVMContext &context,
+                 const char *name) {
+  auto module = std::make_unique<llvm::Module>(name, context);
+  module->setDataLayout(jit.getDataLayout());
+  module->setTargetTriple(jit.getTargetTriple().str());
+  return module;
+}
+
+// Reports objects compiled by the JIT to profilers and debuggers. Perf map
+// entries cover the code of each guest instruction, as told by the line tables
+// of the guest debug locations in the object, or else whole functions.
+class ProfilerListener : public llvm::JITEventListener {
+ public:
+  explicit ProfilerListener(const JIT &options_);
+  virtual ~ProfilerListener(void);
+
+  void notifyObjectLoaded(
+      ObjectKey key, const llvm::object::ObjectFile &obj,
+      const llvm::RuntimeDyld::LoadedObjectInfo &info) override;
+
+  void notifyFreeingObject(ObjectKey key) override;
+
+ private:
+  ProfilerListener(void) = delete;
+
+  // Write perf map entries for the functions in `obj`, which has been loaded
+  // at the addresses described by `info`.
+  void WritePerfMap(const llvm::object::ObjectFile &obj,
+                    const llvm::RuntimeDyld::LoadedObjectInfo &info);
+
+  void WritePerfMapEntry(uint64_t addr, uint64_t size,
+                         const std::string &name);
+
+  const JIT &options;
+  llvm::JITEventListener *const debugger;
+
+  // Objects can be loaded by the foreground and tier-up threads at once.
+  std::mutex lock;
+
+  // Opened on first use.
+  FILE *perf_map;
+  bool opened_perf_map;
+};
+
+ProfilerListener::ProfilerListener(const JIT &options_)
+    : options(options_),
+      debugger(llvm::JITEventListener::createGDBRegistrationListener()),
+      perf_map(nullptr),
+      opened_perf_map(false) {}
+
+ProfilerListener::~ProfilerListener(void) {
+  if (perf_map) {
+    fclose(perf_map);
+  }
+}
+
+void ProfilerListener::notifyObjectLoaded(
+    ObjectKey key, const llvm::object::ObjectFile &obj,
+    const llvm::RuntimeDyld::LoadedObjectInfo &info) {
+  if (options.register_with_debugger) {
+    debugger->notifyObjectLoaded(key, obj, info);
+  }
+  if (options.emit_perf_map) {
+    WritePerfMap(obj, info);
+  }
+}
+
+void ProfilerListener::notifyFreeingObject(ObjectKey key) {
+  if (options.register_with_debugger) {
+    debugger->notifyFreeingObject(key);
+  }
+}
+
+void ProfilerListener::WritePerfMap(
+    const llvm::object::ObjectFile &obj,
+    const llvm::RuntimeDyld::LoadedObjectInfo &info) {
+
+  // The object for debugging has the addresses at which its sections were
+  // loaded, rather than the ones at which they were compiled.
+  auto debug_obj_owner = info.getObjectForDebug(obj);
+  auto debug_obj = debug_obj_owner.getBinary();
+  if (!debug_obj) {
+    LOG(ERROR) << "Unable to find where compiled code was loaded";
+    return;
+  }
+
+  auto dwarf = llvm::DWARFContext::create(*debug_obj);
+  std::lock_guard<std::mutex> locker(lock);
+
+  for (const auto &sym_size : llvm::object::computeSymbolSizes(*debug_obj)) {
+    const auto &sym = sym_size.first;
+    const auto size = sym_size.second;
+    auto maybe_type = sym.getType();
+    auto maybe_name = sym.getName();
+    auto maybe_addr = sym.getAddress();
+    if (IsError(maybe_type) || IsError(maybe_name) || IsError(maybe_addr) ||
+        *maybe_type != llvm::object::SymbolRef::ST_Function || !size) {
+      continue;
+    }
+
+    const auto name = maybe_name->str();
+    const auto addr = *maybe_addr;
+
+    auto section_index = llvm::object::SectionedAddress::UndefSection;
+    auto maybe_section = sym.getSection();
+    if (!IsError(maybe_section) &&
+        *maybe_section != debug_obj->section_end()) {
+      section_index = (*maybe_section)->getIndex();
+    }
+
+    // Rows for code that was inlined from anything other than a lifted
+    // trace, e.g. a runtime helper with debug info, are attributed to the
+    // preceding guest instruction.
+    const std::string file_name = kGuestDebugFileName;
+    auto rows = dwarf->getLineInfoForAddressRange({addr, section_index}, size);
+
+    auto range_begin = addr;
+    auto range_name = name;
+    auto has_range_pc = false;
+    uint64_t range_pc = 0;
+    for (const auto &row : rows) {
+      const auto &row_file = row.second.FileName;
+      if (row_file.size() < file_name.size() ||
+          row_file.compare(row_file.size() - file_name.size(),
+                           file_name.size(), file_name)) {
+        continue;
+      }
+
+      const auto pc =
+          GuestPCFromDebugLocation(row.second.Line, row.second.Column);
+      if (has_range_pc && pc == range_pc) {
+        continue;
+      }
+
+      if (row.first > range_begin) {
+        WritePerfMapEntry(range_begin, row.first - range_begin, range_name);
+      }
+
+      std::stringstream ss;
+      ss << name << '@' << std::hex << pc;
+      range_begin = std::max(range_begin, row.first);
+      range_name = ss.str();
+      range_pc = pc;
+      has_range_pc = true;
+    }
+
+    if (addr + size > range_begin) {
+      WritePerfMapEntry(range_begin, addr + size - range_begin, range_name);
+    }
+  }
+
+  if (perf_map) {
+    fflush(perf_map);
+  }
+}
+
+void ProfilerListener::WritePerfMapEntry(uint64_t addr, uint64_t size,
+                                         const std::string &name) {
+  if (!opened_perf_map) {
+    opened_perf_map = true;
+    std::stringstream ss;
+    ss << "/tmp/perf-" << getpid() << ".map";
+    const auto path = ss.str();
+    perf_map = fopen(path.c_str(), "a");
+    LOG_IF(ERROR, !perf_map) << "Unable to open perf map " << path;
+  }
+
+  if (perf_map) {
+    fprintf(perf_map, "%" PRIx64 " %" PRIx64 " %s\n", addr, size,
+            name.c_str());
+  }
+}
+
+// Forwards questions about code bytes, trace names, and devirtualization to
+// the user's trace manager, but keeps track of lifted traces itself. Traces
+// that were lifted in a prior batch are represented by declarations in
+// `module`, which is the module that traces are lifted into, as their
+// definitions belong to the JIT.
+class JITTraceManager : public TraceManager {
+ public:
+  virtual ~JITTraceManager(void) = default;
+
+  JITTraceManager(TraceManager &source_, llvm::Module *module_)
+      : source(source_),
+        module(module_),
+        add_debug_locations(false) {}
+
+  std::string TraceName(uint64_t addr) override {
+    return source.TraceName(addr);
+  }
+
+  void SetLiftedTraceBlocks(
+      uint64_t addr, llvm::Function *lifted_func,
+      const std::map<uint64_t, llvm::BasicBlock *> &blocks) override {
+    if (add_debug_locations) {
+      AddGuestDebugLocations(addr, lifted_func, blocks);
+    }
+  }
+
+  void SetLiftedTraceDefinition(uint64_t addr,
+                                llvm::Function *lifted_func) override {
+    new_traces[addr] = lifted_func;
+  }
+
+  llvm::Function *GetLiftedTraceDeclaration(uint64_t addr) override {
+    return GetLiftedTraceDefinition(addr);
+  }
+
+  llvm::Function *GetLiftedTraceDefinition(uint64_t addr) override {
+    auto new_trace_it = new_traces.find(addr);
+    if (new_trace_it != new_traces.end()) {
+      return new_trace_it->second;
+    }
+
+    auto decl_it = decls.find(addr);
+    if (decl_it != decls.end()) {
+      return decl_it->second;
+    }
+
+    return nullptr;
+  }
+
+  void ForEachDevirtualizedTarget(
+      const Instruction &inst,
+      std::function<void(uint64_t, DevirtualizedTargetKind)> func) override {
+    source.ForEachDevirtualizedTarget(inst, func);
+  }
+
+  bool TryReadExecutableByte(uint64_t addr, uint8_t *byte) override {
+    return source.TryReadExecutableByte(addr, byte);
+  }
+
+  // Replace the definitions of the traces lifted in the current batch with
+  // declarations, now that the definitions have been handed off to the JIT.
+  // The declarations are external, so that they link against those
+  // definitions.
+  void CommitNewTraces(void) {
+    for (const auto &trace : new_traces) {
+      auto decl = DeclareLiftedFunction(module, TraceName(trace.first));
+      decl->setLinkage(llvm::GlobalValue::ExternalLinkage);
+      decls[trace.first] = decl;
+    }
+    new_traces.clear();
+  }
+
+  TraceManager &source;
+  llvm::Module *const module;
+
+  // Should lifted traces be tied back to guest program counters?
+  bool add_debug_locations;
+
+  // Traces lifted in the current batch.
+  std::unordered_map<uint64_t, llvm::Function *> new_traces;
+
+  // Traces lifted in prior batches.
+  std::unordered_map<uint64_t, llvm::Function *> decls;
+};
+
+// The maximum number of traces that are lifted into one hot region.
+static constexpr size_t kMaxHotRegionSize = 16;
+
+// Decides which traces belong to a hot region. The hot trace, and the first
+// traces that the lifter takes off of its work list after it, are lifted into
+// the region. Every other trace is represented by a declaration in `module`,
+// and calls to it are later redirected to the dispatcher.
+class HotRegionManager : public TraceManager {
+ public:
+  virtual ~HotRegionManager(void) = default;
+
+  HotRegionManager(TraceManager &source_, llvm::Module *module_)
+      : source(source_),
+        module(module_),
+        add_debug_locations(false) {}
+
+  std::string TraceName(uint64_t addr) override {
+    return source.TraceName(addr);
+  }
+
+  void SetLiftedTraceBlocks(
+      uint64_t addr, llvm::Function *lifted_func,
+      const std::map<uint64_t, llvm::BasicBlock *> &blocks) override {
+    if (add_debug_locations) {
+      AddGuestDebugLocations(addr, lifted_func, blocks);
+    }
+  }
+
+  void SetLiftedTraceDefinition(uint64_t addr,
+                                llvm::Function *lifted_func) override {
+    region[addr] = lifted_func;
+  }
+
+  // The lifter asks this about the address of every instruction that it
+  // lifts, so this must not admit anything into the region.
+  llvm::Function *GetLiftedTraceDeclaration(uint64_t addr) override {
+    auto region_it = region.find(addr);
+    if (region_it != region.end()) {
+      return region_it->second;
+    }
+
+    auto outside_it = outside.find(addr);
+    if (outside_it != outside.end()) {
+      return outside_it->second;
+    }
+
+    return nullptr;
+  }
+
+  // The lifter asks this about each trace that it takes off of its work list,
+  // and only lifts the trace if this returns `nullptr`. Once the region is
+  // full, every other trace is left outside of it.
+  llvm::Function *GetLiftedTraceDefinition(uint64_t addr) override {
+    if (auto trace = GetLiftedTraceDeclaration(addr)) {
+      return trace;
+    }
+
+    if (region.size() < kMaxHotRegionSize) {
+      return nullptr;
+    }
+
+    auto decl = DeclareLiftedFunction(module, TraceName(addr));
+    outside.emplace(addr, decl);
+    return decl;
+  }
+
+  void ForEachDevirtualizedTarget(
+      const Instruction &inst,
+      std::function<void(uint64_t, DevirtualizedTargetKind)> func) override {
+    source.ForEachDevirtualizedTarget(inst, func);
+  }
+
+  bool TryReadExecutableByte(uint64_t addr, uint8_t *byte) override {
+    return source.TryReadExecutableByte(addr, byte);
+  }
+
+  TraceManager &source;
+  llvm::Module *const module;
+
+  // Should lifted traces be tied back to guest program counters?
+  bool add_debug_locations;
+
+  // Traces that have been lifted into the current region.
+  std::unordered_map<uint64_t, llvm::Function *> region;
+
+  // Traces that are reachable from, but not part of, the current region.
+  std::unordered_map<uint64_t, llvm::Function *> outside;
+};
+
+// The LLVM context, semantics, and instruction lifter used to lift traces.
+// LLVM contexts can't be used by two threads at once, so hot traces are
+// re-lifted in the background using a second one of these.
+class LiftingContext {
+ public:
+  LiftingContext(OSName os_name, ArchName arch_name);
+
+  // Lower the memory intrinsics used by `semantics`, and by the traces that
+  // have been lifted into it.
+  void LowerMemory(void);
+
+  llvm::orc::ThreadSafeContext tsc;
+  llvm::LLVMContext &context;
+  const Arch::ArchPtr arch;
+  const std::unique_ptr<llvm::Module> semantics;
+  const IntrinsicTable intrinsics;
+  InstructionLifter inst_lifter;
+
+  // Have the memory intrinsics in `semantics` been lowered?
+  bool lowered_memory;
+};
+
+LiftingContext::LiftingContext(OSName os_name, ArchName arch_name)
+    : tsc(std::make_unique<llvm::LLVMContext>()),
+      context(*tsc.getContext()),
+      arch(Arch::Build(&context, os_name, arch_name)),
+      semantics(LoadArchSemantics(arch.get())),
+      intrinsics(semantics.get()),
+      inst_lifter(arch.get(), intrinsics),
+      lowered_memory(false) {}
+
+void LiftingContext::LowerMemory(void) {
+  LowerMemoryIntrinsics(semantics.get());
+  LowerAtomicIntrinsics(semantics.get());
+  lowered_memory = true;
+}
+
+// Re-lifts hot traces into larger regions, and fully optimizes them.
+class HotRegionLifter {
+ public:
+  HotRegionLifter(OSName os_name, ArchName arch_name, TraceManager &source);
+
+  // Lift the region of traces starting at the hot trace at `addr`, optimize
+  // it, and move it into a new module for the host. The hot trace is renamed
+  // to `root_name`, so that it doesn't clash with its quickly compiled
+  // version, and the other traces of the region are internal to the module.
+  // Returns `nullptr` if the region can't be lifted.
+  std::unique_ptr<llvm::Module> Lift(uint64_t addr, bool use_flat_memory,
+                                     llvm::orc::LLJIT &jit,
+                                     std::string &root_name);
+
+  LiftingContext lifting;
+  HotRegionManager manager;
+  TraceLifter trace_lifter;
+};
+
+HotRegionLifter::HotRegionLifter(OSName os_name, ArchName arch_name,
+                                 TraceManager &source)
+    : lifting(os_name, arch_name),
+      manager(source, lifting.semantics.get()),
+      trace_lifter(lifting.inst_lifter, manager) {}
+
+std::unique_ptr<llvm::Module>
+HotRegionLifter::Lift(uint64_t addr, bool use_flat_memory,
+                      llvm::orc::LLJIT &jit, std::string &root_name) {
+  CHECK(use_flat_memory || !lifting.lowered_memory)
+      << "Flat memory cannot be disabled once traces have been lifted with it";
+
+  lifting.inst_lifter.use_native_atomics = use_flat_memory;
+  manager.region.clear();
+  manager.outside.clear();
+  if (!trace_lifter.Lift(addr)) {
+    return nullptr;
+  }
+
+  auto root_it = manager.region.find(addr);
+  CHECK(root_it != manager.region.end() && root_it->second)
+      << "Lifting from address " << std::hex << addr << std::dec
+      << " did not produce a trace for that address";
+  auto root = root_it->second;
+
+  // Traces outside of the region are reached through the dispatcher, which
+  // finds their latest compiled versions.
+  for (const auto &trace : manager.outside) {
+    for (auto call : CallersOf(trace.second)) {
+      auto ret = llvm::dyn_cast_or_null<llvm::ReturnInst>(call->getNextNode());
+      if (ret && ret->getReturnValue() == call) {
+        call->setCalledFunction(lifting.intrinsics.jump);
+      } else {
+        call->setCalledFunction(lifting.intrinsics.function_call);
+      }
+    }
+    trace.second->eraseFromParent();
+  }
+
+  if (use_flat_memory) {
+    lifting.LowerMemory();
+  }
+
+  root->setName(root->getName() + ".hot");
+  root_name = root->getName().str();
+
+  // The other traces of the region are made internal, so that the inliner
+  // can merge them into their callers, and then delete them.
+  std::vector<llvm::Function *> traces;
+  std::vector<std::string> trace_names;
+  for (const auto &trace : manager.region) {
+    if (!trace.second) {
+      continue;
+    }
+    traces.push_back(trace.second);
+    trace_names.push_back(trace.second->getName().str());
+    if (trace.second != root) {
+      trace.second->setLinkage(llvm::GlobalValue::InternalLinkage);
+    }
+  }
+
+  OptimizationGuide guide = {};
+  guide.eliminate_dead_stores = true;
+  OptimizeModule(lifting.arch.get(), lifting.semantics.get(), traces, guide);
+
+  // Traces can't be declared across modules while they're internal, so they
+  // are only made internal again once the whole region has been moved.
+  auto module = CreateHostModule(jit, lifting.context, "hot_region");
+  std::vector<llvm::Function *> funcs;
+  for (const auto &trace_name : trace_names) {
+    if (auto func = lifting.semantics->getFunction(trace_name)) {
+      func->setLinkage(llvm::GlobalValue::ExternalLinkage);
+      funcs.push_back(func);
+    }
+  }
+  MoveFunctionsIntoModule(funcs, module.get());
+  AddGuestDebugCompileUnits(module.get());
+  for (const auto &trace_name : trace_names) {
+    auto func = module->getFunction(trace_name);
+    if (func && trace_name != root_name) {
+      func->setLinkage(llvm::GlobalValue::InternalLinkage);
+    }
+  }
+
+  manager.region.clear();
+  return module;
+}
+
+// A request to re-optimize the hot trace starting at `pc`.
+struct TierUpRequest {
+  uint64_t pc;
+
+  // Where the quickly compiled trace looks for its optimized version.
+  LiftedTraceFunction *hot_trace;
+
+  bool use_flat_memory;
+  bool add_debug_locations;
+};
+
+}  // namespace
+
+class JIT::Impl {
+ public:
+  Impl(const JIT &options_, OSName os_name_, ArchName arch_name_,
+       TraceManager &source_);
+  ~Impl(void);
+
+  void DefineSymbol(const std::string &name, void *address);
+
+  // Lift the traces reachable from `addr`, and add them to the JIT in a new
+  // module.
+  bool LiftTraces(uint64_t addr);
+
+  LiftedTraceFunction GetOrLiftTrace(uint64_t addr);
+
+  // Lift the trace at `addr`, unless it has already been lifted as `name`,
+  // and compile it. This is called without holding `lock`.
+  LiftedTraceFunction LiftAndCompile(uint64_t addr, std::string name);
+
+  // Chain the traces in `module` to each other, bypassing the default
+  // dispatcher where possible.
+  void ChainTraces(llvm::Module *module);
+
+  // Add `module`, whose context is `module_tsc`, to the JIT.
+  bool AddModule(std::unique_ptr<llvm::Module> module,
+                 const llvm::orc::ThreadSafeContext &module_tsc);
+
+  // Compile the module containing the function `name`, if it hasn't been
+  // already, and return the function.
+  LiftedTraceFunction Lookup(const std::string &name);
+
+  // Queue the hot trace at `pc` to be re-optimized in the background.
+  void RequestTierUp(uint64_t pc, LiftedTraceFunction *hot_trace);
+
+  // Re-optimize queued hot traces until the JIT is destroyed.
+  void TierUpLoop(void);
+
+  // Re-lift and fully optimize a hot trace, and swap it in.
+  void TierUp(const TierUpRequest &request);
+
+  // Default implementation of `__remill_jit_inline_cache_miss`.
+  static Memory *HandleInlineCacheMiss(State &state, uint64_t pc,
+                                       Memory *memory,
+                                       const InlineCacheEntry **cache,
+                                       Impl *impl);
+
+  // Default implementation of `__remill_jit_tier_up`.
+  static void HandleTierUp(uint64_t pc, LiftedTraceFunction *hot_trace,
+                           Impl *impl);
+
+  const JIT &options;
+  const OSName os_name;
+  const ArchName arch_name;
+  TraceManager &source;
+
+  // Lifts traces the first time that they are executed.
+  LiftingContext fast;
+  const uint64_t addr_mask;
+  JITTraceManager manager;
+  TraceLifter trace_lifter;
+
+  // Must outlive `jit`, whose object linking layer reports to it.
+  ProfilerListener profiler;
+  std::unique_ptr<llvm::orc::LLJIT> jit;
+
+  // Have we added the default dispatchers to the JIT yet?
+  bool defined_dispatchers;
+
+  // Guards the tables below. This isn't held while traces are lifted or
+  // compiled, so that threads running already compiled code aren't held up.
+  std::mutex lock;
+
+  // Traces that some thread is lifting or compiling, and the condition that
+  // threads wanting the same traces wait on until that is done.
+  std::unordered_set<uint64_t> compiling;
+  std::condition_variable compiling_cond;
+
+  // Names of the symbols defined by `DefineSymbol`.
+  std::unordered_set<std::string> defined_symbols;
+
+  // Traces that have been lifted and handed off to the JIT, by the name of
+  // their functions.
+  std::unordered_map<uint64_t, std::string> lifted_traces;
+
+  // Traces that have been compiled. Hot traces map to their most optimized
+  // version.
+  std::unordered_map<uint64_t, LiftedTraceFunction> compiled_traces;
+
+  // Inline cache entries, shared by all inline caches that target the same
+  // program counter.
+  std::unordered_map<uint64_t, std::unique_ptr<InlineCacheEntry>>
+      inline_cache_entries;
+
+  // Re-lifts hot traces. This is only used by `tier_up_thread`, and is
+  // created on first use.
+  std::unique_ptr<HotRegionLifter> hot;
+
+  std::mutex tier_up_lock;
+  std::condition_variable tier_up_cond;
+
+  // Hot traces waiting to be re-optimized, and all traces that have ever been
+  // queued, so that racing requests for the same trace are only handled once.
+  std::deque<TierUpRequest> tier_up_queue;
+  std::unordered_set<uint64_t> tier_up_requested;
+
+  // Started by the first request to re-optimize a trace.
+  std::thread tier_up_thread;
+  bool stop_tier_up;
+};
+
+JIT::Impl::Impl(const JIT &options_, OSName os_name_, ArchName arch_name_,
+                TraceManager &source_)
+    : options(options_),
+      os_name(os_name_),
+      arch_name(arch_name_),
+      source(source_),
+      fast(os_name, arch_name),
+      addr_mask(~0ULL >> (64UL - fast.arch->address_size)),
+      manager(source, fast.semantics.get()),
+      trace_lifter(fast.inst_lifter, manager),
+      profiler(options),
+      defined_dispatchers(false),
+      stop_tier_up(false) {
+
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmPrinter();
+
+  // Objects are linked with RuntimeDyld, which can report them to profilers
+  // and debuggers.
+  llvm::orc::LLJITBuilder builder;
+  builder.setObjectLinkingLayerCreator(
+      [this](llvm::orc::ExecutionSession &session, const llvm::Triple &triple) {
+        auto layer = std::make_unique<llvm::orc::RTDyldObjectLinkingLayer>(
+            session, [](auto &&...) {
+              return std::make_unique<llvm::SectionMemoryManager>();
+            });
+        if (triple.isOSBinFormatCOFF()) {
+          layer->setOverrideObjectFlagsWithResponsibilityFlags(true);
+          layer->setAutoClaimResponsibilityForObjectSymbols(true);
+        }
+        layer->registerJITEventListener(profiler);
+        return std::unique_ptr<llvm::orc::ObjectLayer>(std::move(layer));
+      });
+
+  auto maybe_jit = builder.create();
+  CHECK(!IsError(maybe_jit))
+      << "Unable to create ORC JIT: " << GetErrorString(maybe_jit);
+  jit = std::move(*maybe_jit);
+
+  // Fall back on the host process for anything that isn't defined by the
+  // user, e.g. intrinsics implemented by the host program, or `libm`.
+  auto maybe_gen =
+      llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+          jit->getDataLayout().getGlobalPrefix());
+  CHECK(!IsError(maybe_gen))
+      << "Unable to search host process for symbols: "
+      << GetErrorString(maybe_gen);
+  jit->getMainJITDylib().addGenerator(std::move(*maybe_gen));
+}
+
+JIT::Impl::~Impl(void) {
+  do {
+    std::lock_guard<std::mutex> locker(tier_up_lock);
+    stop_tier_up = true;
+  } while (false);
+
+  tier_up_cond.notify_one();
+  if (tier_up_thread.joinable()) {
+    tier_up_thread.join();
+  }
+}
+
+void JIT::Impl::DefineSymbol(const std::string &name, void *address) {
+  std::lock_guard<std::mutex> locker(lock);
+  CHECK(!defined_dispatchers)
+      << "Symbol " << name << " must be defined before any trace is compiled";
+  CHECK(defined_symbols.insert(name).second)
+      << "Symbol " << name << " is already defined";
+
+  llvm::orc::SymbolMap symbols;
+  AddSymbol(*jit, symbols, name, address);
+  auto err = jit->getMainJITDylib().define(
+      llvm::orc::absoluteSymbols(std::move(symbols)));
+  CHECK(!IsError(err)) << "Unable to define symbol " << name << ": "
+                       << GetErrorString(err);
+}
+
+// Lift the traces reachable from `addr`, and add them to the JIT in a new
+// module.
+bool JIT::Impl::LiftTraces(uint64_t addr) {
+  auto context_lock = fast.tsc.getLock();
+
+  // Lowering rewrites the semantics module itself, so it can't be undone.
+  CHECK(options.use_flat_memory || !fast.lowered_memory)
+      << "Flat memory cannot be disabled once traces have been lifted with it";
+
+  // Another thread may have lifted this trace, as part of its own batch,
+  // while this one waited for the context.
+  if (manager.decls.count(addr)) {
+    return true;
+  }
+
+  fast.inst_lifter.use_native_atomics = options.use_flat_memory;
+  manager.add_debug_locations =
+      options.emit_perf_map || options.register_with_debugger;
+  if (!trace_lifter.Lift(addr) || manager.new_traces.empty()) {
+    manager.new_traces.clear();
+    return false;
+  }
+
+  if (options.use_flat_memory) {
+    fast.LowerMemory();
+  }
+
+  // With tiered compilation, only hot traces are worth optimizing fully.
+  OptimizationGuide guide = {};
+  guide.quick = options.use_tiered_compilation;
+  guide.eliminate_dead_stores = !options.use_tiered_compilation;
+  OptimizeModule(fast.arch.get(), fast.semantics.get(), manager.new_traces,
+                 guide);
+
+  // The module is compiled for the host, not for the target architecture.
+  auto module = CreateHostModule(*jit, fast.context, "lifted_traces");
+
+  std::vector<llvm::Function *> funcs;
+  funcs.reserve(manager.new_traces.size());
+  for (const auto &trace : manager.new_traces) {
+    funcs.push_back(trace.second);
+  }
+  MoveFunctionsIntoModule(funcs, module.get());
+
+  std::vector<std::pair<uint64_t, std::string>> trace_names;
+  trace_names.reserve(manager.new_traces.size());
+  for (const auto &trace : manager.new_traces) {
+    trace_names.emplace_back(trace.first, trace.second->getName().str());
+    if (options.use_tiered_compilation && options.tier_up_threshold) {
+      AddEntryCounter(trace.second, trace.first, options.tier_up_threshold,
+                      this);
+    }
+  }
+  AddGuestDebugCompileUnits(module.get());
+  manager.CommitNewTraces();
+  ChainTraces(module.get());
+
+  if (!AddModule(std::move(module), fast.tsc)) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> locker(lock);
+  for (auto &trace_name : trace_names) {
+    lifted_traces[trace_name.first] = std::move(trace_name.second);
+  }
+  return true;
+}
+
+bool JIT::Impl::AddModule(std::unique_ptr<llvm::Module> module,
+                          const llvm::orc::ThreadSafeContext &module_tsc) {
+  auto err = jit->addIRModule(
+      llvm::orc::ThreadSafeModule(std::move(module), module_tsc));
+  if (IsError(err)) {
+    LOG(ERROR) << "Unable to add lifted traces to JIT: "
+               << GetErrorString(err);
+    return false;
+  }
+
+  return true;
+}
+
+LiftedTraceFunction JIT::Impl::Lookup(const std::string &name) {
+  auto maybe_sym = jit->lookup(name);
+  if (IsError(maybe_sym)) {
+    LOG(ERROR) << "Unable to compile trace " << name << ": "
+               << GetErrorString(maybe_sym);
+    return nullptr;
+  }
+
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(15, 0)
+  return maybe_sym->toPtr<LiftedTraceFunction>();
+#else
+  return reinterpret_cast<LiftedTraceFunction>(
+      static_cast<uintptr_t>(maybe_sym->getAddress()));
+#endif
+}
+
+// Only checking for, and publishing, compiled traces happens under `lock`.
+// The first thread to want a trace marks it as being compiled, and then lifts
+// and compiles it without holding `lock`. Other threads that want the same
+// trace wait for it to be published.
+LiftedTraceFunction JIT::Impl::GetOrLiftTrace(uint64_t addr_) {
+  const auto addr = addr_ & addr_mask;
+  std::string name;
+  do {
+    std::unique_lock<std::mutex> locker(lock);
+    compiling_cond.wait(
+        locker, [this, addr](void) { return !compiling.count(addr); });
+
+    auto compiled_it = compiled_traces.find(addr);
+    if (compiled_it != compiled_traces.end()) {
+      return compiled_it->second;
+    }
+
+    // Anything not defined by the user goes to the default dispatcher.
+    if (!defined_dispatchers) {
+      defined_dispatchers = true;
+      llvm::orc::SymbolMap symbols;
+      for (const auto &dispatcher : kDefaultDispatchers) {
+        if (defined_symbols.count(dispatcher.first)) {
+          continue;
+        }
+        AddSymbol(*jit, symbols, dispatcher.first,
+                  reinterpret_cast<void *>(dispatcher.second));
+      }
+      AddSymbol(*jit, symbols, kInlineCacheMissName,
+                reinterpret_cast<void *>(HandleInlineCacheMiss));
+      AddSymbol(*jit, symbols, kTierUpName,
+                reinterpret_cast<void *>(HandleTierUp));
+      auto err = jit->getMainJITDylib().define(
+          llvm::orc::absoluteSymbols(std::move(symbols)));
+      CHECK(!IsError(err))
+          << "Unable to define default dispatchers: " << GetErrorString(err);
+    }
+
+    auto lifted_it = lifted_traces.find(addr);
+    if (lifted_it != lifted_traces.end()) {
+      name = lifted_it->second;
+    }
+    compiling.insert(addr);
+  } while (false);
+
+  auto trace = LiftAndCompile(addr, std::move(name));
+
+  do {
+    std::lock_guard<std::mutex> locker(lock);
+    compiling.erase(addr);
+
+    // A hot version of the trace may have been published in the meantime.
+    if (trace) {
+      trace = compiled_traces.emplace(addr, trace).first->second;
+    }
+  } while (false);
+
+  compiling_cond.notify_all();
+  return trace;
+}
+
+// Lift the trace at `addr`, unless it has already been lifted as `name`, and
+// compile it.
+LiftedTraceFunction JIT::Impl::LiftAndCompile(uint64_t addr,
+                                              std::string name) {
+  if (name.empty()) {
+    if (!LiftTraces(addr)) {
+      LOG(ERROR) << "Unable to lift trace at address " << std::hex << addr
+                 << std::dec;
+      return nullptr;
+    }
+
+    std::lock_guard<std::mutex> locker(lock);
+    auto lifted_it = lifted_traces.find(addr);
+    if (lifted_it == lifted_traces.end()) {
+      LOG(ERROR) << "Lifting from address " << std::hex << addr << std::dec
+                 << " did not produce a trace for that address";
+      return nullptr;
+    }
+    name = lifted_it->second;
+  }
+
+  return Lookup(name);
+}
+
+// Chain the traces in `module` to each other, bypassing the default
+// dispatcher where possible. Intrinsics overridden by `DefineSymbol` are left
+// alone.
+void JIT::Impl::ChainTraces(llvm::Module *module) {
+  if (!defined_symbols.count("__remill_function_return")) {
+    InlineFunctionReturns(module);
+  }
+
+  for (auto name : {"__remill_jump", "__remill_function_call",
+                    "__remill_missing_block"}) {
+    if (!defined_symbols.count(name)) {
+      AddInlineCaches(module, module->getFunction(name), this);
+    }
+  }
+}
+
+void JIT::Impl::RequestTierUp(uint64_t pc, LiftedTraceFunction *hot_trace) {
+  std::lock_guard<std::mutex> locker(tier_up_lock);
+  if (stop_tier_up || !tier_up_requested.insert(pc).second) {
+    return;
+  }
+
+  tier_up_queue.push_back(
+      {pc, hot_trace, options.use_flat_memory,
+       options.emit_perf_map || options.register_with_debugger});
+  if (!tier_up_thread.joinable()) {
+    tier_up_thread = std::thread([this](void) { TierUpLoop(); });
+  }
+  tier_up_cond.notify_one();
+}
+
+void JIT::Impl::TierUpLoop(void) {
+  for (;;) {
+    std::unique_lock<std::mutex> locker(tier_up_lock);
+    tier_up_cond.wait(locker, [this](void) {
+      return stop_tier_up || !tier_up_queue.empty();
+    });
+    if (stop_tier_up) {
+      return;
+    }
+
+    const auto request = tier_up_queue.front();
+    tier_up_queue.pop_front();
+    locker.unlock();
+
+    TierUp(request);
+  }
+}
+
+// Re-lift the hot trace into a region that includes the traces it reaches,
+// compile it, and then publish it to everything that might call the quickly
+// compiled version: the compiled traces table, the trace's inline cache
+// entry, and the quickly compiled trace itself.
+void JIT::Impl::TierUp(const TierUpRequest &request) {
+  if (!hot) {
+    hot.reset(new HotRegionLifter(os_name, arch_name, source));
+  }
+
+  std::string root_name;
+  do {
+    auto context_lock = hot->lifting.tsc.getLock();
+    hot->manager.add_debug_locations = request.add_debug_locations;
+    auto module =
+        hot->Lift(request.pc, request.use_flat_memory, *jit, root_name);
+    if (!module) {
+      LOG(ERROR) << "Unable to re-lift hot trace at address " << std::hex
+                 << request.pc << std::dec;
+      return;
+    }
+
+    ChainTraces(module.get());
+    if (!AddModule(std::move(module), hot->lifting.tsc)) {
+      return;
+    }
+  } while (false);
+
+  auto trace = Lookup(root_name);
+  if (!trace) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> locker(lock);
+  compiled_traces[request.pc] = trace;
+
+  auto entry_it = inline_cache_entries.find(request.pc);
+  if (entry_it != inline_cache_entries.end()) {
+    __atomic_store_n(&(entry_it->second->trace), trace, __ATOMIC_RELEASE);
+  }
+
+  __atomic_store_n(request.hot_trace, trace, __ATOMIC_RELEASE);
+}
+
+// Find the trace for `pc`, point `cache` at its entry, and call the trace.
+Memory *JIT::Impl::HandleInlineCacheMiss(State &state, uint64_t pc,
+                                         Memory *memory,
+                                         const InlineCacheEntry **cache,
+                                         Impl *impl) {
+  auto trace = impl->GetOrLiftTrace(pc);
+  if (!trace) {
+    LOG(ERROR) << "Unable to dispatch to trace at address " << std::hex << pc
+               << std::dec;
+    return memory;
+  }
+
+  const InlineCacheEntry *entry = nullptr;
+  do {
+    std::lock_guard<std::mutex> locker(impl->lock);
+    auto &entry_ptr = impl->inline_cache_entries[pc];
+    if (!entry_ptr) {
+      entry_ptr.reset(new InlineCacheEntry{pc, trace});
+    }
+    entry = entry_ptr.get();
+  } while (false);
+
+  // Publish the entry; lifted code reads the cache with acquire semantics.
+  __atomic_store_n(cache, entry, __ATOMIC_RELEASE);
+  return trace(state, pc, memory);
+}
+
+// Called by a quickly compiled trace once it has become hot.
+void JIT::Impl::HandleTierUp(uint64_t pc, LiftedTraceFunction *hot_trace,
+                             Impl *impl) {
+  impl->RequestTierUp(pc, hot_trace);
+}
+
+JIT::JIT(OSName os_name, ArchName arch_name, TraceManager &source)
+    : use_flat_memory(false),
+      use_tiered_compilation(false),
+      tier_up_threshold(1000),
+      emit_perf_map(false),
+      register_with_debugger(false),
+      impl(new Impl(*this, os_name, arch_name, source)) {}
+
+JIT::~JIT(void) {}
+
+void JIT::DefineSymbol(const std::string &name, void *address) {
+  impl->DefineSymbol(name, address);
+}
+
+LiftedTraceFunction JIT::GetOrLiftTrace(uint64_t addr) {
+  return impl->GetOrLiftTrace(addr);
+}
+
+Memory *JIT::Execute(State &state, uint64_t pc, Memory *memory) {
+  auto trace = GetOrLiftTrace(pc);
+  if (!trace) {
+    return memory;
+  }
+
+  auto prev_jit = gCurrentJIT;
+  gCurrentJIT = this;
+  memory = trace(state, pc, memory);
+  gCurrentJIT = prev_jit;
+  return memory;
+}
+
+}  // namespace remill
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "remill/Arch/Name.h"
+#include "remill/OS/OS.h"
+
+struct Memory;
+struct State;
+
+namespace remill {
+
+class TraceManager;
+
+// A compiled lifted trace. This has the same form as `__remill_basic_block`.
+//
+// NOTE: On 32-bit targets, lifted code only observes the low 32 bits of the
+//       program counter argument.
+using LiftedTraceFunction = Memory *(*) (State &, uint64_t, Memory *);
+
+// Lifts traces on demand, and compiles them into host code using LLVM's ORC
+// JIT, so that they can be called directly from the host process.
+//
+// Traces are lifted in batches by the `TraceLifter`, optimized, and then moved
+// into their own module with `MoveFunctionIntoModule`. A batch is only
+// compiled once one of its traces is first looked up.
+//
+// Lifted code calls into the runtime through the `__remill_*` intrinsics.
+// Symbols that are not given to `DefineSymbol` are resolved against the
+// host process. By default, the JIT implements `__remill_jump`,
+// `__remill_function_call`, and `__remill_missing_block` by lifting (on a
+// miss) and then calling the trace of the target program counter, and
+// `__remill_function_return` by returning to its caller.
+//
+// Lifted traces are chained together so that they bypass these dispatchers.
+// Calls to `__remill_function_return` are replaced with returns, and every
+// call to one of the other dispatchers is given its own monomorphic inline
+// cache: if the target program counter matches the cached one, then the
+// cached trace is (tail-)called directly; otherwise, the dispatcher is
+// consulted, and the cache is updated. Dispatchers overridden with
+// `DefineSymbol` are always called.
+//
+// With tiered compilation, a trace is first compiled with minimal
+// optimization, so that it starts running as soon as possible. Traces that
+// turn out to be hot are then re-lifted into larger regions, fully optimized
+// on a background thread, and swapped in for their quickly compiled versions.
+//
+// Compiled code is linked with LLVM's RuntimeDyld, and can be reported to
+// profilers and debuggers, with each part of it tied back to the guest
+// instruction from which it was lifted.
+//
+// NOTE: This is only available when remill is built against LLVM 11 or
+//       newer.
+class JIT {
+ public:
+  // Create a JIT for code of `arch_name` running on `os_name`. Executable
+  // bytes, trace names, and devirtualization hints come from `source`, which
+  // must outlive the JIT. The JIT itself tracks which traces are lifted, so
+  // the `*LiftedTrace*` methods of `source` are never used.
+  //
+  // NOTE: With `use_tiered_compilation`, `source` is also used by the
+  //       background thread, and so it must be thread-safe.
+  JIT(OSName os_name, ArchName arch_name, TraceManager &source);
+  ~JIT(void);
+
+  // Make the host function or variable at `address` available to lifted code
+  // under the name `name`. This is how runtimes provide the memory access,
+  // hyper call, and other intrinsics, and how they can override the default
+  // dispatcher. This must be called before any trace is compiled.
+  void DefineSymbol(const std::string &name, void *address);
+
+  // Return the compiled trace starting at `addr`, lifting and compiling it if
+  // it hasn't been already. Returns `nullptr` if the trace can't be lifted or
+  // compiled. The trace can be called directly, rather than by way of
+  // `Execute`.
+  LiftedTraceFunction GetOrLiftTrace(uint64_t addr);
+
+  // Execute lifted code starting at `pc`. Returns the memory pointer once the
+  // lifted code returns, e.g. by way of `__remill_function_return`, or
+  // `__remill_error`.
+  Memory *Execute(State &state, uint64_t pc, Memory *memory);
+
+  // Lower memory accesses into direct accesses of the host address space
+  // (see `LowerMemoryIntrinsics`), instead of calls to the memory intrinsics.
+  // Atomic read-modify-write instructions are lifted into, and lowered from,
+  // the atomic memory intrinsics (see `LowerAtomicIntrinsics`).
+  //
+  // NOTE: This rewrites the semantics used by all later traces, and so it
+  //       can't be unset once a trace has been lifted with it.
+  bool use_flat_memory;
+
+  // Compile traces in two tiers. Traces are first compiled quickly, and are
+  // instrumented to count how many times they are entered. Once a trace has
+  // been entered `tier_up_threshold` times, a background thread re-lifts it,
+  // together with the traces that it reaches, into a single region, fully
+  // optimizes that region, and then swaps it in.
+  //
+  // NOTE: This must be set before any trace is lifted.
+  bool use_tiered_compilation;
+
+  // How many times a quickly compiled trace must be entered before it is
+  // re-optimized. Zero means never, in which case traces aren't instrumented
+  // to count their entries.
+  uint32_t tier_up_threshold;
+
+  // Write entries for compiled code to `/tmp/perf-<pid>.map`, so that `perf`
+  // can attribute samples to guest code. The code of each guest instruction
+  // gets its own entry, named after its trace and program counter, e.g.
+  // `sub_401000@401005`, as told by the guest debug locations attached to
+  // lifted code (see `AddGuestDebugLocations`).
+  //
+  // NOTE: This must be set before any trace is lifted.
+  bool emit_perf_map;
+
+  // Register compiled code with debuggers through the GDB JIT interface,
+  // along with line tables that map it back to guest program counters.
+  //
+  // NOTE: This must be set before any trace is lifted.
+  bool register_with_debugger;
+
+ private:
+  class Impl;
+
+  JIT(const JIT &) = delete;
+  JIT(JIT &&) noexcept = delete;
+  JIT(void) = delete;
+
+  std::unique_ptr<Impl> impl;
+};
+
+}  // namespace remill
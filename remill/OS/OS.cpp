@@ -20,6 +20,18 @@
 #include <glog/logging.h>
 #include <llvm/ADT/Triple.h>
 
+#if REMILL_ON_LINUX || REMILL_ON_MACOS
+#  include <sys/resource.h>
+#endif
+
+#if REMILL_ON_LINUX
+#  include <unistd.h>
+
+#  include <cstdio>
+#elif REMILL_ON_MACOS
+#  include <mach/mach.h>
+#endif
+
 DEFINE_string(os, REMILL_OS,
               "Operating system name of the code being "
               "translated. Valid OSes: linux, macos, windows, solaris.");
@@ -70,4 +82,57 @@ std::string GetOSName(OSName name) {
   return "invalid";
 }
 
+uint64_t GetResidentMemorySize(void) {
+#if REMILL_ON_LINUX
+
+  // The second field of `/proc/self/statm` is the number of resident pages.
+  auto statm = fopen("/proc/self/statm", "r");
+  if (!statm) {
+    return 0;
+  }
+
+  unsigned long long num_pages = 0;
+  unsigned long long num_resident_pages = 0;
+  auto num_fields = fscanf(statm, "%llu %llu", &num_pages, &num_resident_pages);
+  fclose(statm);
+  if (2 != num_fields) {
+    return 0;
+  }
+
+  return num_resident_pages * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+
+#elif REMILL_ON_MACOS
+  mach_task_basic_info_data_t info = {};
+  mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+  if (KERN_SUCCESS != task_info(mach_task_self(), MACH_TASK_BASIC_INFO,
+                                reinterpret_cast<task_info_t>(&info),
+                                &count)) {
+    return 0;
+  }
+  return info.resident_size;
+
+#else
+  return 0;
+#endif
+}
+
+uint64_t GetPeakResidentMemorySize(void) {
+#if REMILL_ON_LINUX || REMILL_ON_MACOS
+  struct rusage usage = {};
+  if (getrusage(RUSAGE_SELF, &usage)) {
+    return 0;
+  }
+
+  // Linux reports this in kibibytes, and macOS in bytes.
+#  if REMILL_ON_LINUX
+  return static_cast<uint64_t>(usage.ru_maxrss) * 1024u;
+#  else
+  return static_cast<uint64_t>(usage.ru_maxrss);
+#  endif
+
+#else
+  return 0;
+#endif
+}
+
 }  // namespace remill
@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include <string>
 
 #ifndef REMILL_OS
@@ -72,4 +73,12 @@ OSName GetOSName(std::string name_);
 
 std::string GetOSName(OSName name);
 
+// Returns the amount of physical memory, in bytes, that is currently used by
+// this process, or `0` if it can't be determined on this host.
+uint64_t GetResidentMemorySize(void);
+
+// Returns the largest amount of physical memory, in bytes, that this process
+// has used at any one time, or `0` if it can't be determined on this host.
+uint64_t GetPeakResidentMemorySize(void);
+
 }  // namespace remill
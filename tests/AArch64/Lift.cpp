@@ -22,14 +22,18 @@
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Type.h>
+#include <llvm/Transforms/IPO/Internalize.h>
 
 #include <algorithm>
 #include <cstdint>
 #include <fstream>
+#include <iomanip>
 #include <map>
 #include <memory>
 #include <sstream>
 #include <string>
+#include <unordered_set>
+#include <vector>
 
 #include "remill/Arch/Arch.h"
 #include "remill/Arch/Instruction.h"
@@ -49,6 +53,17 @@
 DEFINE_string(bc_out, "",
               "Name of the file in which to place the generated bitcode.");
 
+DEFINE_string(corpus_out, "",
+              "Name of the file in which to save the code of the tests, "
+              "instead of lifting them, for use as a remill-bench corpus.");
+
+DEFINE_uint64(num_shards, 1,
+              "Number of shards into which the tests are split. Each shard "
+              "is lifted into its own bitcode file, and the shards can then "
+              "be compiled separately and linked together.");
+
+DEFINE_uint64(shard_index, 0, "Index of the shard of the tests to lift.");
+
 DECLARE_string(arch);
 DECLARE_string(os);
 
@@ -62,8 +77,9 @@ namespace {
 // Decode a test and add it as a basic block to the module.
 //
 // TODO(pag): Eventually handle control-flow.
-static void AddFunctionToModule(llvm::Module *module, const remill::Arch *arch,
-                                const test::TestInfo &test) {
+static llvm::Function *AddFunctionToModule(llvm::Module *module,
+                                           const remill::Arch *arch,
+                                           const test::TestInfo &test) {
   DLOG(INFO) << "Adding block for: " << test.test_name;
 
   std::stringstream ss;
@@ -157,6 +173,34 @@ static void AddFunctionToModule(llvm::Module *module, const remill::Arch *arch,
       remill::AddTerminatingTailCall(block, intrinsics.missing_block);
     }
   }
+
+  return func;
+}
+
+// Save the address, code bytes, and name of each test on a line of its own.
+static void WriteCorpus(const std::vector<const test::TestInfo *> &tests) {
+  std::ofstream out(FLAGS_corpus_out);
+  CHECK(out) << "Unable to open corpus file " << FLAGS_corpus_out;
+
+  out << std::hex << std::setfill('0');
+  for (auto test : tests) {
+    out << test->test_begin << ' ';
+    for (auto addr = test->test_begin; addr < test->test_end; ++addr) {
+      out << std::setw(2)
+          << static_cast<unsigned>(*reinterpret_cast<const uint8_t *>(addr));
+    }
+    out << ' ' << test->test_name << '\n';
+  }
+}
+
+// Every shard has its own copy of the semantics. Hide everything except the
+// lifted tests so that the shards can be linked into one test runner.
+static void InternalizeShard(
+    llvm::Module *module,
+    const std::unordered_set<const llvm::GlobalValue *> &lifted_tests) {
+  llvm::internalizeModule(*module, [&](const llvm::GlobalValue &gv) {
+    return lifted_tests.count(&gv) != 0;
+  });
 }
 
 }  // namespace
@@ -166,6 +210,23 @@ extern "C" int main(int argc, char *argv[]) {
   google::ParseCommandLineFlags(&argc, &argv, true);
   google::InitGoogleLogging(argv[0]);
 
+  CHECK(0 < FLAGS_num_shards) << "Must have at least one shard of tests";
+  CHECK(FLAGS_shard_index < FLAGS_num_shards)
+      << "Shard index " << FLAGS_shard_index << " is out of range for "
+      << FLAGS_num_shards << " shards";
+
+  if (!FLAGS_corpus_out.empty()) {
+    std::vector<const test::TestInfo *> tests;
+    for (auto i = 0U;; ++i) {
+      const auto &test = test::__aarch64_test_table_begin[i];
+      if (&test >= &(test::__aarch64_test_table_end[0]))
+        break;
+      tests.push_back(&test);
+    }
+    WriteCorpus(tests);
+    return 0;
+  }
+
   auto os = remill::GetOSName(REMILL_OS);
   auto context = new llvm::LLVMContext;
 
@@ -177,11 +238,20 @@ extern "C" int main(int argc, char *argv[]) {
   auto module = remill::LoadModuleFromFile(context, bc_file);
   remill::GetHostArch(*context)->PrepareModule(module.get());
 
+  // Round-robin the tests across the shards, so that the tests of big
+  // instruction classes don't all end up in the same shard.
+  std::unordered_set<const llvm::GlobalValue *> lifted_tests;
   for (auto i = 0U;; ++i) {
     const auto &test = test::__aarch64_test_table_begin[i];
     if (&test >= &(test::__aarch64_test_table_end[0]))
       break;
-    AddFunctionToModule(module.get(), arch, test);
+    if ((i % FLAGS_num_shards) == FLAGS_shard_index) {
+      lifted_tests.insert(AddFunctionToModule(module.get(), arch, test));
+    }
+  }
+
+  if (1 < FLAGS_num_shards) {
+    InternalizeShard(module.get(), lifted_tests);
   }
 
   DLOG(INFO) << "Serializing bitcode to " << FLAGS_bc_out;
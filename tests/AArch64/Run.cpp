@@ -19,30 +19,73 @@
 #include <dlfcn.h>
 #include <gflags/gflags.h>
 #include <glog/logging.h>
+#include <gtest/gtest-spi.h>
 #include <gtest/gtest.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
 #include <setjmp.h>
 #include <signal.h>
+#include <sys/mman.h>
 #include <ucontext.h>
 
+#include <algorithm>
 #include <cfenv>
+#include <chrono>
 #include <cmath>
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <iomanip>
 #include <iostream>
 #include <limits>
 #include <map>
+#include <random>
+#include <sstream>
 #include <string>
 #include <type_traits>
+#include <unordered_map>
 #include <vector>
 
 #include "remill/Arch/AArch64/Runtime/State.h"
+#include "remill/Arch/Arch.h"
+#include "remill/Arch/Instruction.h"
+#include "remill/Arch/Name.h"
 #include "remill/Arch/Runtime/Runtime.h"
+#include "remill/BC/Lifter.h"
+#include "remill/BC/Util.h"
+#include "remill/BC/Version.h"
+#include "remill/JIT/JIT.h"
+#include "remill/OS/OS.h"
 #include "tests/AArch64/Test.h"
 
 DECLARE_string(arch);
 DECLARE_string(os);
 
+DEFINE_bool(stress, false,
+            "Instead of running the tests, run randomly generated sequences "
+            "of instructions natively and through the JIT, and report the "
+            "sequences whose states differ, along with lifting and "
+            "execution throughput.");
+
+DEFINE_uint64(stress_sequences, 1000,
+              "Number of random instruction sequences to run with --stress.");
+
+DEFINE_uint64(stress_sequence_length, 16,
+              "Number of instructions in each random sequence.");
+
+DEFINE_uint64(stress_batch_size, 64,
+              "Number of random sequences lifted by each JIT. Every batch is "
+              "lifted by a new JIT, with its own LLVM context.");
+
+DEFINE_uint64(stress_inputs, 4,
+              "Number of times to run each random sequence, each time with "
+              "random inputs and flags.");
+
+DEFINE_uint64(stress_seed, 1,
+              "Seed from which the random sequences and inputs are "
+              "generated.");
+
 namespace {
 
 struct alignas(128) Stack {
@@ -114,6 +157,10 @@ uint64_t gStackSaveSlots[2] = {0, 0};
 // `gAArch64StateAfter`, respectively.
 extern void InvokeTestCase(uint64_t, uint64_t, uint64_t);
 
+// Saves the native state after a test case into `gNativeState`, and returns
+// from `InvokeTestCase`. Every test case ends by branching here.
+extern void __aarch64_save_state_after(void);
+
 #define MAKE_RW_MEMORY(size) \
   NEVER_INLINE uint##size##_t __remill_read_memory_##size(Memory *, \
                                                           addr_t addr) { \
@@ -355,14 +402,16 @@ inline static bool operator!=(const T &a, const T &b) {
   return !!memcmp(&a, &b, sizeof(a));
 }
 
-static void RunWithFlags(const test::TestInfo *info, NZCV flags,
+// Run the native and lifted code of `info`, and compare their states.
+// Returns `false` if the host doesn't support the native code.
+static bool RunWithFlags(const test::TestInfo *info, NZCV flags,
                          std::string desc, uint64_t arg1, uint64_t arg2,
                          uint64_t arg3) {
 
   DLOG(INFO) << "Testing instruction: " << info->test_name << ": " << desc;
   if (sigsetjmp(gUnsupportedInstrBuf, true)) {
     DLOG(INFO) << "Unsupported instruction " << info->test_name;
-    return;
+    return false;
   }
 
   memcpy(&gLiftedStack, &gRandomStack, sizeof(gLiftedStack));
@@ -462,6 +511,8 @@ static void RunWithFlags(const test::TestInfo *info, NZCV flags,
 
     EXPECT_TRUE(!"Lifted and native stacks did not match.");
   }
+
+  return true;
 }
 
 TEST_P(InstrTest, SemanticsMatchNative) {
@@ -615,6 +666,416 @@ static void SetupSignals(void) {
   sigaltstack(&sig_stack, nullptr);
 }
 
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(11, 0)
+
+using StressClock = std::chrono::steady_clock;
+
+// How long it took to run some code, in nanoseconds.
+static double NanosecondsSince(StressClock::time_point start) {
+  return std::chrono::duration<double, std::nano>(StressClock::now() - start)
+      .count();
+}
+
+// Every native test case starts with two instructions that the lifted code
+// skips, which put the address of `gNativeState` into `x28`. A random
+// sequence doesn't need the address, so it starts with two `nop`s instead.
+static constexpr uint32_t kNop = 0xd503201fU;
+static constexpr uint64_t kPrologueSize = 8;
+
+// A randomly generated sequence of straight-line instructions, which is run
+// like a test case.
+struct StressSequence {
+
+  // Address of the first random instruction, just after the prologue.
+  uint64_t address{0};
+  uint64_t num_insts{0};
+  std::string bytes;
+
+  // One line per instruction, for reporting mismatches.
+  std::string disassembly;
+};
+
+// Generates random sequences of instructions that remill has semantics for,
+// and that can run natively in place of a test case. Every 32-bit word is a
+// candidate, and remill's decoder picks out the instructions among them.
+// Instructions that access memory or system registers, or that use registers
+// that the test harness relies on, are skipped.
+class StressGenerator {
+ public:
+  StressGenerator(const remill::Arch *arch_, llvm::Module *semantics_)
+      : arch(arch_),
+        semantics(semantics_),
+        gen(FLAGS_stress_seed) {}
+
+  // Generate a sequence of instructions that starts at `address`. The
+  // sequence may be shorter than requested if too few candidates are usable.
+  void Generate(uint64_t address, StressSequence *seq);
+
+  uint64_t Random(void) {
+    return gen();
+  }
+
+ private:
+  bool IsRunnable(const remill::Instruction &inst) const;
+  bool HasSemantics(const remill::Instruction &inst);
+
+  const remill::Arch *const arch;
+  llvm::Module *const semantics;
+  std::mt19937_64 gen;
+  std::unordered_map<std::string, bool> has_semantics;
+};
+
+// Returns `true` if a random instruction can use the register `name`. The
+// native code runs on the caller's registers, so it can't touch the
+// callee-saved registers (`x19` through `x28`, and the low halves of `v8`
+// through `v15`), the frame pointer, the link register, or the stack pointer.
+// `x28` also holds a different value in the native and lifted code, and
+// `x18` is reserved by some platforms.
+static bool IsUsableRegister(const std::string &name) {
+  if (name.empty() || name == "XZR" || name == "WZR" ||
+      name == "IGNORE_WRITE_TO_XZR" || name == "PC") {
+    return true;
+  }
+
+  const auto num_pos = name.find_first_of("0123456789");
+  if (num_pos == std::string::npos || num_pos == 0) {
+    return false;
+  }
+
+  const auto prefix = name.substr(0, num_pos);
+  const auto num = strtoul(name.c_str() + num_pos, nullptr, 10);
+  if (prefix == "X" || prefix == "W") {
+    return num < 18;
+  } else if (prefix == "V" || prefix == "Q" || prefix == "D" ||
+             prefix == "S" || prefix == "H" || prefix == "B") {
+    return num < 8 || num > 15;
+  } else {
+    return false;
+  }
+}
+
+bool StressGenerator::IsRunnable(const remill::Instruction &inst) const {
+  switch (inst.category) {
+    case remill::Instruction::kCategoryNormal:
+    case remill::Instruction::kCategoryNoOp: break;
+    default: return false;
+  }
+
+  // System registers (e.g. `tpidr_el0`, `fpcr`) differ between the native
+  // and lifted code.
+  if (!inst.function.compare(0, 4, "MRS_") ||
+      !inst.function.compare(0, 4, "MSR_")) {
+    return false;
+  }
+
+  for (const auto &op : inst.operands) {
+    switch (op.type) {
+      case remill::Operand::kTypeRegister:
+        if (!IsUsableRegister(op.reg.name)) {
+          return false;
+        }
+        break;
+      case remill::Operand::kTypeShiftRegister:
+        if (!IsUsableRegister(op.shift_reg.reg.name)) {
+          return false;
+        }
+        break;
+      case remill::Operand::kTypeAddress:
+        if (op.addr.IsMemoryAccess() ||
+            !IsUsableRegister(op.addr.base_reg.name) ||
+            !IsUsableRegister(op.addr.index_reg.name)) {
+          return false;
+        }
+        break;
+      default: break;
+    }
+  }
+  return true;
+}
+
+bool StressGenerator::HasSemantics(const remill::Instruction &inst) {
+  auto sem_it = has_semantics.find(inst.function);
+  if (sem_it == has_semantics.end()) {
+    auto isel = remill::FindGlobaVariable(semantics, "ISEL_" + inst.function);
+    sem_it = has_semantics.emplace(inst.function, !!isel).first;
+  }
+  return sem_it->second;
+}
+
+void StressGenerator::Generate(uint64_t address, StressSequence *seq) {
+  seq->address = address;
+  seq->num_insts = 0;
+  seq->bytes.clear();
+  seq->disassembly.clear();
+
+  const auto max_attempts = 1000 * FLAGS_stress_sequence_length;
+  remill::Instruction inst;
+
+  for (uint64_t attempt = 0; seq->num_insts < FLAGS_stress_sequence_length &&
+                             attempt < max_attempts;
+       ++attempt) {
+    const auto word = static_cast<uint32_t>(gen());
+    const std::string inst_bytes(reinterpret_cast<const char *>(&word),
+                                 sizeof(word));
+
+    const auto pc = address + seq->bytes.size();
+    inst.Reset();
+    if (!arch->DecodeInstruction(pc, inst_bytes, inst) ||
+        !HasSemantics(inst) || !IsRunnable(inst)) {
+      continue;
+    }
+
+    std::stringstream ss;
+    ss << "  " << std::hex << std::setfill('0') << std::setw(8) << word
+       << "  " << inst.Serialize() << '\n';
+
+    seq->bytes.append(inst_bytes);
+    seq->disassembly.append(ss.str());
+    seq->num_insts += 1;
+  }
+}
+
+// Exposes the code of the random sequences of a batch to the JIT.
+class StressTraceManager : public remill::TraceManager {
+ public:
+  virtual ~StressTraceManager(void) = default;
+
+  void SetLiftedTraceDefinition(uint64_t, llvm::Function *) override {}
+
+  bool TryReadExecutableByte(uint64_t addr, uint8_t *byte) override {
+    auto byte_it = memory.find(addr);
+    if (byte_it != memory.end()) {
+      *byte = byte_it->second;
+      return true;
+    } else {
+      return false;
+    }
+  }
+
+ public:
+  std::unordered_map<uint64_t, uint8_t> memory;
+};
+
+// Time spent, and work done, by a stress run.
+struct StressTotals {
+  uint64_t num_sequences{0};
+  uint64_t num_insts{0};
+  uint64_t num_runs{0};
+  uint64_t num_unsupported{0};
+  uint64_t num_mismatches{0};
+  double generate_ns{0};
+  double lift_ns{0};
+  double run_ns{0};
+};
+
+// Run `seq` natively and through the JIT with random inputs and flags, and
+// report whether or not their states ever differ.
+static void StressSequenceWithInputs(const StressSequence &seq,
+                                     StressGenerator &gen,
+                                     StressTotals *totals) {
+  std::stringstream name_ss;
+  name_ss << "stress_" << std::hex << seq.address;
+  const auto name = name_ss.str();
+
+  for (uint64_t i = 0; i < FLAGS_stress_inputs; ++i) {
+    const uint64_t args[3] = {gen.Random(), gen.Random(), gen.Random()};
+    const test::TestInfo info = {
+        static_cast<uintptr_t>(seq.address - kPrologueSize),
+        static_cast<uintptr_t>(seq.address + seq.bytes.size()),
+        name.c_str(),
+        &(args[0]),
+        &(args[3]),
+        3,
+        ""};
+
+    NZCV flags;
+    flags.flat = static_cast<uint32_t>(gen.Random() & 0xFU) << 28;
+
+    std::stringstream desc;
+    desc << name << " with X0=0x" << std::hex << args[0] << " X1=0x"
+         << args[1] << " X2=0x" << args[2] << " and N=" << flags.n
+         << ", Z=" << flags.z << ", C=" << flags.c << ", V=" << flags.v;
+
+    // Intercept the failures of the state comparison, so that they are
+    // reported along with the sequence that caused them.
+    testing::TestPartResultArray failures;
+    auto ran = false;
+    const auto start = StressClock::now();
+    {
+      testing::ScopedFakeTestPartResultReporter reporter(
+          testing::ScopedFakeTestPartResultReporter::
+              INTERCEPT_ONLY_CURRENT_THREAD,
+          &failures);
+      ran = RunWithFlags(&info, flags, desc.str(), args[0], args[1], args[2]);
+    }
+    totals->run_ns += NanosecondsSince(start);
+
+    if (!ran) {
+      totals->num_unsupported += 1;
+      return;
+    }
+
+    totals->num_runs += 1;
+    if (failures.size()) {
+      totals->num_mismatches += 1;
+      printf("Mismatch in %s:\n%s", desc.str().c_str(),
+             seq.disassembly.c_str());
+      for (auto f = 0; f < failures.size(); ++f) {
+        printf("%s\n", failures.GetTestPartResult(f).message());
+      }
+      printf("\n");
+      return;
+    }
+  }
+}
+
+// Differentially test randomly generated instruction sequences, lifting them
+// in batches with the JIT, and report any mismatches along with the
+// throughput of generating, lifting, and running the sequences.
+static int RunStress(void) {
+  const auto arch_name = remill::kArchAArch64LittleEndian;
+  const auto os_name = remill::GetOSName(REMILL_OS);
+
+  llvm::LLVMContext context;
+  auto arch = remill::Arch::Build(&context, os_name, arch_name);
+  auto semantics = remill::LoadArchSemantics(arch);
+  StressGenerator gen(arch.get(), semantics.get());
+
+  // Every sequence is followed by an absolute indirect branch back into the
+  // test harness, through `x28`, which random instructions don't use. The
+  // branch target is loaded from the literal that follows the branch.
+  // Sequences are spaced apart so that the JIT doesn't lift one into another.
+  const uint32_t kBranchToSaveState[] = {
+      0x5800005cU,  // ldr x28, .+8
+      0xd61f0380U,  // br x28
+  };
+  const auto save_state_after =
+      reinterpret_cast<uint64_t>(__aarch64_save_state_after);
+  const auto batch_size = std::max<uint64_t>(1, FLAGS_stress_batch_size);
+  const auto slot_size =
+      ((FLAGS_stress_sequence_length * test::kMaxInstrLen + 64) & ~63ull) +
+      64;
+  const auto code_size = batch_size * slot_size;
+  auto code = reinterpret_cast<uint8_t *>(
+      mmap(nullptr, code_size, PROT_READ | PROT_WRITE | PROT_EXEC,
+           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+  CHECK(MAP_FAILED != code) << "Unable to map memory for random sequences";
+
+  StressTotals totals;
+  std::vector<StressSequence> batch(batch_size);
+  for (uint64_t i = 0, batch_num = 0; i < FLAGS_stress_sequences;
+       ++batch_num) {
+    StressTraceManager manager;
+    remill::JIT jit(os_name, arch_name, manager);
+
+    // Like the lifted code of the tests, the lifted code of each sequence
+    // should return once it reaches the end of the sequence, rather than
+    // having the JIT lift whatever comes next.
+    const std::pair<const char *, LiftedFunc *> dispatchers[] = {
+        {"__remill_jump", __remill_jump},
+        {"__remill_function_call", __remill_function_call},
+        {"__remill_function_return", __remill_function_return},
+        {"__remill_missing_block", __remill_missing_block}};
+    for (const auto &dispatcher : dispatchers) {
+      jit.DefineSymbol(dispatcher.first,
+                       reinterpret_cast<void *>(dispatcher.second));
+    }
+
+    auto start = StressClock::now();
+    auto num_in_batch = 0u;
+    for (; num_in_batch < batch_size && i < FLAGS_stress_sequences;
+         ++num_in_batch, ++i) {
+      auto &seq = batch[num_in_batch];
+      const auto slot = &(code[num_in_batch * slot_size]);
+      const auto seq_begin = &(slot[kPrologueSize]);
+      gen.Generate(reinterpret_cast<uint64_t>(seq_begin), &seq);
+      CHECK(0 < seq.num_insts) << "Unable to generate a random sequence";
+
+      const auto seq_end = &(seq_begin[seq.bytes.size()]);
+      memcpy(&(slot[0]), &kNop, sizeof(kNop));
+      memcpy(&(slot[sizeof(kNop)]), &kNop, sizeof(kNop));
+      memcpy(seq_begin, seq.bytes.data(), seq.bytes.size());
+      memcpy(seq_end, kBranchToSaveState, sizeof(kBranchToSaveState));
+      memcpy(&(seq_end[sizeof(kBranchToSaveState)]), &save_state_after,
+             sizeof(save_state_after));
+      __builtin___clear_cache(
+          reinterpret_cast<char *>(slot),
+          reinterpret_cast<char *>(&(slot[slot_size])));
+
+      for (size_t b = 0; b < seq.bytes.size(); ++b) {
+        manager.memory[seq.address + b] = seq_begin[b];
+      }
+
+      totals.num_sequences += 1;
+      totals.num_insts += seq.num_insts;
+    }
+    totals.generate_ns += NanosecondsSince(start);
+
+    start = StressClock::now();
+    for (auto s = 0u; s < num_in_batch; ++s) {
+      const auto &seq = batch[s];
+      auto lifted_func = jit.GetOrLiftTrace(seq.address);
+      CHECK(lifted_func != nullptr)
+          << "Unable to lift random sequence:\n" << seq.disassembly;
+      gTranslatedFuncs[seq.address - kPrologueSize] =
+          reinterpret_cast<LiftedFunc *>(lifted_func);
+    }
+    const auto lift_ns = NanosecondsSince(start);
+    totals.lift_ns += lift_ns;
+
+    start = StressClock::now();
+    for (auto s = 0u; s < num_in_batch; ++s) {
+      StressSequenceWithInputs(batch[s], gen, &totals);
+    }
+    const auto run_ns = NanosecondsSince(start);
+
+    // Lifting a batch should use roughly the same amount of memory as the
+    // batches before it, as each batch starts with a new JIT.
+    printf("batch %llu: %u sequences, lifted in %.1f ms, ran in %.1f ms, "
+           "%.1f MiB resident\n",
+           static_cast<unsigned long long>(batch_num), num_in_batch,
+           lift_ns / 1e6, run_ns / 1e6,
+           remill::GetResidentMemorySize() / (1024.0 * 1024.0));
+    gTranslatedFuncs.clear();
+  }
+
+  munmap(code, code_size);
+
+  const auto PerSecond = [](uint64_t count, double ns) {
+    return ns > 0 ? count * 1e9 / ns : 0.0;
+  };
+
+  printf("\n");
+  printf("sequences:  %llu (%llu instructions)\n",
+         static_cast<unsigned long long>(totals.num_sequences),
+         static_cast<unsigned long long>(totals.num_insts));
+  printf("generated:  %.1f instructions/s\n",
+         PerSecond(totals.num_insts, totals.generate_ns));
+  printf("lifted:     %.1f sequences/s, %.1f instructions/s\n",
+         PerSecond(totals.num_sequences, totals.lift_ns),
+         PerSecond(totals.num_insts, totals.lift_ns));
+  printf("ran:        %.1f runs/s (%llu runs, %llu unsupported)\n",
+         PerSecond(totals.num_runs, totals.run_ns),
+         static_cast<unsigned long long>(totals.num_runs),
+         static_cast<unsigned long long>(totals.num_unsupported));
+  printf("peak RSS:   %.1f MiB\n",
+         remill::GetPeakResidentMemorySize() / (1024.0 * 1024.0));
+  printf("mismatches: %llu\n",
+         static_cast<unsigned long long>(totals.num_mismatches));
+
+  return totals.num_mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+#else
+
+static int RunStress(void) {
+  LOG(ERROR) << "Stress testing requires remill's JIT, which needs LLVM 11 "
+             << "or newer";
+  return EXIT_FAILURE;
+}
+
+#endif  // LLVM_VERSION_NUMBER >= LLVM_VERSION(11, 0)
+
 int main(int argc, char **argv) {
   google::ParseCommandLineFlags(&argc, &argv, true);
   google::InitGoogleLogging(argv[0]);
@@ -648,6 +1109,11 @@ int main(int argc, char **argv) {
     b = static_cast<uint8_t>(random());
   }
 
+  if (FLAGS_stress) {
+    SetupSignals();
+    return RunStress();
+  }
+
   testing::InitGoogleTest(&argc, argv);
 
   SetupSignals();
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <vector>
+
+#include "TestUtil.h"
+#include "remill/BC/Annotate.h"
+
+namespace {
+
+using Functions = std::vector<llvm::Function *>;
+
+class FunctionOriginIndexTest : public testing::Test {
+ protected:
+  FunctionOriginIndexTest(void) : module("annotated", context) {}
+
+  llvm::Function *Declare(const char *name) {
+    return llvm::Function::Create(
+        llvm::FunctionType::get(llvm::Type::getVoidTy(context), false),
+        llvm::GlobalValue::ExternalLinkage, name, &module);
+  }
+
+  llvm::LLVMContext context;
+  llvm::Module module;
+};
+
+// Functions annotated before the index is built are found in it, and so are
+// those annotated through it afterwards.
+TEST_F(FunctionOriginIndexTest, IndexesAnnotatedFunctions) {
+  auto lifted = Declare("lifted");
+  auto plain = Declare("plain");
+  auto abi = Declare("abi");
+  remill::Annotate<remill::LiftedFunction>(lifted);
+
+  remill::FunctionOriginIndex index(module);
+  index.Annotate<remill::AbiLibraries>(abi);
+
+  EXPECT_TRUE(index.HasOriginType<remill::LiftedFunction>(lifted));
+  EXPECT_FALSE(index.HasOriginType<remill::BaseFunction>(plain));
+  EXPECT_TRUE(index.HasOriginType<remill::AbiLibraries>(abi));
+  EXPECT_TRUE(remill::HasOriginType<remill::AbiLibraries>(abi));
+  EXPECT_EQ((index.GetFunctionsByOrigin<Functions, remill::BaseFunction>()),
+            (Functions{lifted, abi}));
+}
+
+// An origin type also matches the origin types derived from it, whose values
+// it prefixes, but not its siblings.
+TEST_F(FunctionOriginIndexTest, FindsDerivedOrigins) {
+  auto abi = Declare("abi");
+  auto helper = Declare("helper");
+  auto cfg = Declare("cfg");
+  auto external = Declare("external");
+  remill::Annotate<remill::AbiLibraries>(abi);
+  remill::Annotate<remill::RemillHelper>(helper);
+  remill::Annotate<remill::CFGExternal>(cfg);
+  remill::Annotate<remill::ExternalFunction>(external);
+
+  remill::FunctionOriginIndex index(module);
+  EXPECT_EQ(
+      (index.GetFunctionsByOrigin<Functions, remill::ExternalFunction>()),
+      (Functions{abi, cfg, external}));
+  EXPECT_EQ((index.GetFunctionsByOrigin<Functions, remill::CFGExternal,
+                                        remill::Helper>()),
+            (Functions{helper, cfg}));
+  EXPECT_TRUE(index.HasOriginType<remill::ExternalFunction>(abi));
+  EXPECT_FALSE(index.HasOriginType<remill::CFGExternal>(abi));
+  EXPECT_FALSE(index.HasOriginType<remill::AbiLibraries>(external));
+}
+
+// Removing an origin type removes the annotation from the function itself,
+// and not just from the index.
+TEST_F(FunctionOriginIndexTest, RemovesAnnotations) {
+  auto abi = Declare("abi");
+  auto helper = Declare("helper");
+  remill::Annotate<remill::AbiLibraries>(abi);
+  remill::Annotate<remill::Helper>(helper);
+
+  remill::FunctionOriginIndex index(module);
+  EXPECT_FALSE(index.Remove<remill::Helper>(abi));
+  EXPECT_TRUE(index.HasOriginType<remill::AbiLibraries>(abi));
+
+  EXPECT_TRUE(index.Remove<remill::ExternalFunction>(abi));
+  EXPECT_FALSE(index.HasOriginType<remill::BaseFunction>(abi));
+  EXPECT_EQ(abi->getMetadata(remill::BaseFunction::metadata_kind), nullptr);
+  EXPECT_FALSE(remill::HasOriginType<remill::BaseFunction>(abi));
+  EXPECT_EQ((index.GetFunctionsByOrigin<Functions, remill::BaseFunction>()),
+            (Functions{helper}));
+
+  // A rebuilt index agrees.
+  remill::FunctionOriginIndex rebuilt(module);
+  EXPECT_FALSE(rebuilt.HasOriginType<remill::BaseFunction>(abi));
+  EXPECT_TRUE(rebuilt.HasOriginType<remill::Helper>(helper));
+}
+
+// Annotating a function again replaces its origin type, but keeps its place in
+// the order of the index.
+TEST_F(FunctionOriginIndexTest, ReannotatesFunctions) {
+  auto first = Declare("first");
+  auto second = Declare("second");
+  remill::Annotate<remill::LiftedFunction>(first);
+  remill::Annotate<remill::LiftedFunction>(second);
+
+  remill::FunctionOriginIndex index(module);
+  EXPECT_TRUE((index.ChangeOriginType<remill::EntrypointFunction,
+                                      remill::LiftedFunction>(first)));
+  EXPECT_FALSE((index.ChangeOriginType<remill::Semantics,
+                                       remill::ExternalFunction>(second)));
+
+  EXPECT_FALSE(index.HasOriginType<remill::LiftedFunction>(first));
+  EXPECT_TRUE(index.HasOriginType<remill::EntrypointFunction>(first));
+  EXPECT_TRUE(remill::HasOriginType<remill::EntrypointFunction>(first));
+  EXPECT_EQ((index.GetFunctionsByOrigin<Functions, remill::LiftedFunction>()),
+            (Functions{second}));
+  EXPECT_EQ((index.GetFunctionsByOrigin<Functions, remill::EntrypointFunction,
+                                        remill::LiftedFunction>()),
+            (Functions{first, second}));
+}
+
+}  // namespace
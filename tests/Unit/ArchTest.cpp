@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <thread>
+#include <vector>
+
+#include "TestUtil.h"
+
+namespace {
+
+using ArchTest = test::LiftingTest;
+
+// Overlapping registers that are added later take precedence, so each byte
+// of `RAX` maps to the smallest register that covers it.
+TEST_F(ArchTest, RegisterAtStateOffsetPrefersSubRegisters) {
+  const auto rax = arch->RegisterByName("RAX");
+  const auto eax = arch->RegisterByName("EAX");
+  const auto ah = arch->RegisterByName("AH");
+  const auto al = arch->RegisterByName("AL");
+  ASSERT_NE(rax, nullptr);
+  ASSERT_NE(eax, nullptr);
+  ASSERT_NE(ah, nullptr);
+  ASSERT_NE(al, nullptr);
+
+  EXPECT_EQ(arch->RegisterAtStateOffset(al->offset), al);
+  EXPECT_EQ(arch->RegisterAtStateOffset(ah->offset), ah);
+  EXPECT_EQ(arch->RegisterAtStateOffset(rax->offset + 2), eax);
+  EXPECT_EQ(arch->RegisterAtStateOffset(rax->offset + 4), rax);
+}
+
+// The offset table is built on first use, which may happen on many threads
+// at once.
+TEST_F(ArchTest, RegisterAtStateOffsetIsThreadSafe) {
+  const auto al = arch->RegisterByName("AL");
+  ASSERT_NE(al, nullptr);
+
+  std::vector<const remill::Register *> found(8, nullptr);
+  std::vector<std::thread> threads;
+  for (auto &reg : found) {
+    threads.emplace_back([&reg, this, al](void) {
+      reg = arch->RegisterAtStateOffset(al->offset);
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  for (auto reg : found) {
+    EXPECT_EQ(reg, al);
+  }
+}
+
+}  // namespace
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TestUtil.h"
+
+#include "remill/BC/LowerAtomics.h"
+
+namespace {
+
+using AtomicsTest = test::LiftingTest;
+
+// `lock add [rax], rbx`
+static const std::initializer_list<uint8_t> kLockAdd = {0xf0, 0x48, 0x01,
+                                                        0x18};
+
+// Returns `true` if `func` does a sequentially consistent `atomicrmw add`.
+static bool HasAtomicAdd(llvm::Function *func) {
+  for (auto &inst : llvm::instructions(*func)) {
+    if (auto rmw = llvm::dyn_cast<llvm::AtomicRMWInst>(&inst)) {
+      if (rmw->getOperation() == llvm::AtomicRMWInst::Add &&
+          rmw->getOrdering() ==
+              llvm::AtomicOrdering::SequentiallyConsistent) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// Without native atomics, the read-modify-write is wrapped in calls to
+// `__remill_atomic_begin` and `__remill_atomic_end`.
+TEST_F(AtomicsTest, LockedAddIsWrappedInAtomicBeginEnd) {
+  const auto callees = Callees(Lift(0x1000, {0xf0, 0x48, 0x01, 0x18, 0xc3}));
+  EXPECT_TRUE(callees.count(intrinsics.atomic_begin));
+  EXPECT_TRUE(callees.count(intrinsics.atomic_end));
+  EXPECT_TRUE(callees.count(Semantics(SemanticsName(kLockAdd))));
+}
+
+// With native atomics, the `ATOMIC_` variant of the semantics is used, and
+// the read-modify-write isn't wrapped in anything.
+TEST_F(AtomicsTest, NativeAtomicsUseAtomicSemantics) {
+  inst_lifter.use_native_atomics = true;
+
+  auto atomic_add = Semantics("ATOMIC_" + SemanticsName(kLockAdd));
+  ASSERT_NE(atomic_add, nullptr);
+
+  const auto callees = Callees(Lift(0x1000, {0xf0, 0x48, 0x01, 0x18, 0xc3}));
+  EXPECT_TRUE(callees.count(atomic_add));
+  EXPECT_FALSE(callees.count(intrinsics.atomic_begin));
+  EXPECT_FALSE(callees.count(intrinsics.atomic_end));
+}
+
+// `LowerAtomicIntrinsics` turns the `__remill_fetch_and_add_*` call done by
+// the `ATOMIC_` semantics into an `atomicrmw`.
+TEST_F(AtomicsTest, FetchAndAddIsLoweredToAtomicRMW) {
+  inst_lifter.use_native_atomics = true;
+
+  auto atomic_add = Semantics("ATOMIC_" + SemanticsName(kLockAdd));
+  ASSERT_NE(atomic_add, nullptr);
+  EXPECT_FALSE(HasAtomicAdd(atomic_add));
+
+  (void) Lift(0x1000, {0xf0, 0x48, 0x01, 0x18, 0xc3});
+  remill::LowerAtomicIntrinsics(semantics.get());
+
+  auto fetch_and_add = semantics->getFunction("__remill_fetch_and_add_64");
+  ASSERT_NE(fetch_and_add, nullptr);
+  EXPECT_TRUE(remill::CallersOf(fetch_and_add).empty());
+  EXPECT_TRUE(HasAtomicAdd(atomic_add));
+}
+
+}  // namespace
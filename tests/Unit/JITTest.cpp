@@ -0,0 +1,310 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TestUtil.h"
+#include "remill/Arch/X86/Runtime/State.h"
+#include "remill/JIT/JIT.h"
+
+namespace {
+
+// Size of the guest stack, in quadwords.
+static constexpr size_t kStackSize = 64;
+
+// Address to which the code run by `JITTest::Call` returns. The JIT returns
+// from `Execute` once the code returns, so nothing is ever lifted here.
+static constexpr uint64_t kReturnAddress = 0xdead0000;
+
+// Runs AMD64 code with the JIT. Guest memory is host memory, so that the
+// guest stack can live in the test.
+class JITTest : public testing::Test {
+ protected:
+  JITTest(void) : jit(remill::kOSLinux, remill::kArchAMD64, manager) {
+    jit.use_flat_memory = true;
+    memset(&state, 0, sizeof(state));
+    memset(stack, 0, sizeof(stack));
+  }
+
+  // Call the code at `pc` as a function, and return `rax`. The other
+  // registers are left as they are.
+  uint64_t Call(uint64_t pc) {
+    stack[kStackSize - 1] = kReturnAddress;
+    state.gpr.rsp.qword =
+        reinterpret_cast<uintptr_t>(&(stack[kStackSize - 1]));
+    (void) jit.Execute(state, pc, nullptr);
+    EXPECT_EQ(state.gpr.rsp.qword,
+              reinterpret_cast<uintptr_t>(&(stack[kStackSize])));
+    return state.gpr.rax.qword;
+  }
+
+  // Wait for the trace at `pc` to be swapped for something other than
+  // `trace`, and return what it was swapped for, or `trace` if that takes too
+  // long.
+  remill::LiftedTraceFunction WaitForSwap(uint64_t pc,
+                                          remill::LiftedTraceFunction trace) {
+    auto new_trace = trace;
+    for (auto i = 0; i < 1000 && new_trace == trace; ++i) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      new_trace = jit.GetOrLiftTrace(pc);
+    }
+    return new_trace;
+  }
+
+  test::BytesTraceManager manager;
+  remill::JIT jit;
+  State state;
+  uint64_t stack[kStackSize];
+};
+
+TEST_F(JITTest, LiftsAndRunsCode) {
+
+  // mov eax, 42; add eax, 8; ret
+  manager.AddCode(0x1000, {0xb8, 0x2a, 0x00, 0x00, 0x00, 0x83, 0xc0, 0x08,
+                           0xc3});
+  EXPECT_EQ(Call(0x1000), 50u);
+
+  // Running it again uses the already compiled trace.
+  auto trace = jit.GetOrLiftTrace(0x1000);
+  ASSERT_NE(trace, nullptr);
+  EXPECT_EQ(jit.GetOrLiftTrace(0x1000), trace);
+  EXPECT_EQ(Call(0x1000), 50u);
+}
+
+TEST_F(JITTest, ChainsDirectCalls) {
+
+  // call 0x3000; add eax, 1; ret
+  manager.AddCode(0x2000, {0xe8, 0xfb, 0x0f, 0x00, 0x00, 0x83, 0xc0, 0x01,
+                           0xc3});
+
+  // mov eax, 41; ret
+  manager.AddCode(0x3000, {0xb8, 0x29, 0x00, 0x00, 0x00, 0xc3});
+
+  EXPECT_EQ(Call(0x2000), 42u);
+  EXPECT_EQ(Call(0x3000), 41u);
+}
+
+// The callee is compiled in an earlier batch than its caller, which reaches
+// it through a declaration.
+TEST_F(JITTest, ChainsDirectCallsToEarlierTraces) {
+
+  // call 0x3000; add eax, 1; ret
+  manager.AddCode(0x2000, {0xe8, 0xfb, 0x0f, 0x00, 0x00, 0x83, 0xc0, 0x01,
+                           0xc3});
+
+  // mov eax, 41; ret
+  manager.AddCode(0x3000, {0xb8, 0x29, 0x00, 0x00, 0x00, 0xc3});
+
+  EXPECT_EQ(Call(0x3000), 41u);
+  EXPECT_EQ(Call(0x2000), 42u);
+}
+
+// Each indirect call has a monomorphic inline cache, which misses on the first
+// call, hits on later calls to the same target, and misses again whenever the
+// target changes.
+TEST_F(JITTest, ChainsIndirectCalls) {
+
+  // call rbx; ret
+  manager.AddCode(0x4000, {0xff, 0xd3, 0xc3});
+
+  // add eax, 1; ret
+  manager.AddCode(0x5000, {0x83, 0xc0, 0x01, 0xc3});
+
+  // add eax, 10; ret
+  manager.AddCode(0x6000, {0x83, 0xc0, 0x0a, 0xc3});
+
+  state.gpr.rbx.qword = 0x5000;
+  EXPECT_EQ(Call(0x4000), 1u);  // Miss.
+  EXPECT_EQ(Call(0x4000), 2u);  // Hit.
+
+  state.gpr.rbx.qword = 0x6000;
+  EXPECT_EQ(Call(0x4000), 12u);  // Miss.
+  EXPECT_EQ(Call(0x4000), 22u);  // Hit.
+
+  state.gpr.rbx.qword = 0x5000;
+  EXPECT_EQ(Call(0x4000), 23u);  // Miss.
+}
+
+TEST_F(JITTest, ChainsIndirectJumps) {
+
+  // jmp rbx
+  manager.AddCode(0x4000, {0xff, 0xe3});
+
+  // add eax, 1; ret
+  manager.AddCode(0x5000, {0x83, 0xc0, 0x01, 0xc3});
+
+  // add eax, 10; ret
+  manager.AddCode(0x6000, {0x83, 0xc0, 0x0a, 0xc3});
+
+  state.gpr.rbx.qword = 0x5000;
+  EXPECT_EQ(Call(0x4000), 1u);  // Miss.
+  EXPECT_EQ(Call(0x4000), 2u);  // Hit.
+
+  state.gpr.rbx.qword = 0x6000;
+  EXPECT_EQ(Call(0x4000), 12u);  // Miss.
+
+  state.gpr.rbx.qword = 0x5000;
+  EXPECT_EQ(Call(0x4000), 13u);  // Miss.
+}
+
+// Hot traces are re-lifted into a region, along with the traces that they
+// reach, and are then swapped in for their quickly compiled versions.
+TEST_F(JITTest, TiersUpHotTraces) {
+  jit.use_tiered_compilation = true;
+  jit.tier_up_threshold = 2;
+
+  // call 0x3000; add eax, 1; ret
+  manager.AddCode(0x2000, {0xe8, 0xfb, 0x0f, 0x00, 0x00, 0x83, 0xc0, 0x01,
+                           0xc3});
+
+  // mov eax, 41; add eax, 1; ret
+  manager.AddCode(0x3000, {0xb8, 0x29, 0x00, 0x00, 0x00, 0x83, 0xc0, 0x01,
+                           0xc3});
+
+  EXPECT_EQ(Call(0x2000), 43u);
+  auto quick_trace = jit.GetOrLiftTrace(0x2000);
+  ASSERT_NE(quick_trace, nullptr);
+  EXPECT_EQ(Call(0x2000), 43u);  // Reaches the threshold.
+
+  auto hot_trace = WaitForSwap(0x2000, quick_trace);
+  EXPECT_NE(hot_trace, quick_trace);
+  EXPECT_EQ(Call(0x2000), 43u);
+  EXPECT_EQ(Call(0x3000), 42u);
+}
+
+// A threshold of zero means that traces are never re-optimized.
+TEST_F(JITTest, NeverTiersUpWithZeroThreshold) {
+  jit.use_tiered_compilation = true;
+  jit.tier_up_threshold = 0;
+
+  // mov eax, 42; add eax, 8; ret
+  manager.AddCode(0x1000, {0xb8, 0x2a, 0x00, 0x00, 0x00, 0x83, 0xc0, 0x08,
+                           0xc3});
+
+  EXPECT_EQ(Call(0x1000), 50u);
+  auto quick_trace = jit.GetOrLiftTrace(0x1000);
+  ASSERT_NE(quick_trace, nullptr);
+  for (auto i = 0; i < 10; ++i) {
+    EXPECT_EQ(Call(0x1000), 50u);
+  }
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  EXPECT_EQ(jit.GetOrLiftTrace(0x1000), quick_trace);
+}
+
+// Threads racing to get the same trace all get the one compiled version of it,
+// including when the trace was lifted in another thread's batch.
+TEST_F(JITTest, LiftsTracesFromManyThreads) {
+
+  // call 0x3000; add eax, 1; ret
+  manager.AddCode(0x2000, {0xe8, 0xfb, 0x0f, 0x00, 0x00, 0x83, 0xc0, 0x01,
+                           0xc3});
+
+  // mov eax, 41; ret
+  manager.AddCode(0x3000, {0xb8, 0x29, 0x00, 0x00, 0x00, 0xc3});
+
+  // mov eax, 42; add eax, 8; ret
+  manager.AddCode(0x1000, {0xb8, 0x2a, 0x00, 0x00, 0x00, 0x83, 0xc0, 0x08,
+                           0xc3});
+
+  const uint64_t pcs[] = {0x2000, 0x3000, 0x1000};
+  remill::LiftedTraceFunction traces[8] = {};
+  std::vector<std::thread> threads;
+  for (auto i = 0u; i < 8u; ++i) {
+    threads.emplace_back([this, &pcs, &traces, i](void) {
+      traces[i] = jit.GetOrLiftTrace(pcs[i % 3]);
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  for (auto i = 0u; i < 8u; ++i) {
+    ASSERT_NE(traces[i], nullptr);
+    EXPECT_EQ(traces[i], jit.GetOrLiftTrace(pcs[i % 3]));
+  }
+  EXPECT_EQ(Call(0x2000), 42u);
+  EXPECT_EQ(Call(0x1000), 50u);
+}
+
+// Traces returned by `GetOrLiftTrace` can be called directly, in which case
+// their inline caches and entry counters still find the JIT.
+TEST_F(JITTest, RunsTracesOutsideOfExecute) {
+  jit.use_tiered_compilation = true;
+  jit.tier_up_threshold = 1;
+
+  // call rbx; ret
+  manager.AddCode(0x4000, {0xff, 0xd3, 0xc3});
+
+  // add eax, 1; ret
+  manager.AddCode(0x5000, {0x83, 0xc0, 0x01, 0xc3});
+
+  auto trace = jit.GetOrLiftTrace(0x4000);
+  ASSERT_NE(trace, nullptr);
+
+  stack[kStackSize - 1] = kReturnAddress;
+  state.gpr.rsp.qword =
+      reinterpret_cast<uintptr_t>(&(stack[kStackSize - 1]));
+  state.gpr.rbx.qword = 0x5000;
+  (void) trace(state, 0x4000, nullptr);  // Misses, and reaches the threshold.
+  EXPECT_EQ(state.gpr.rax.qword, 1u);
+
+  EXPECT_NE(WaitForSwap(0x4000, trace), trace);
+}
+
+TEST_F(JITTest, WritesPerfMap) {
+  std::stringstream path_ss;
+  path_ss << "/tmp/perf-" << getpid() << ".map";
+  const auto path = path_ss.str();
+  std::remove(path.c_str());
+
+  jit.emit_perf_map = true;
+
+  // mov eax, 42; add eax, 8; ret
+  manager.AddCode(0x7000, {0xb8, 0x2a, 0x00, 0x00, 0x00, 0x83, 0xc0, 0x08,
+                           0xc3});
+  EXPECT_EQ(Call(0x7000), 50u);
+
+  // Each line is the hexadecimal address and size of some code, and the
+  // name of its trace, followed by the program counter of the guest
+  // instruction from which it was lifted.
+  std::ifstream perf_map(path);
+  ASSERT_TRUE(perf_map.good());
+  auto num_entries = 0u;
+  std::string line;
+  while (std::getline(perf_map, line)) {
+    std::stringstream line_ss(line);
+    std::string addr, size, name;
+    line_ss >> addr >> size >> name;
+    EXPECT_FALSE(name.empty()) << "Malformed perf map line: " << line;
+    if (!name.compare(0, 9, "sub_7000@")) {
+      ++num_entries;
+    }
+  }
+  EXPECT_LT(0u, num_entries);
+  std::remove(path.c_str());
+}
+
+}  // namespace
@@ -0,0 +1,76 @@
+# Copyright (c) 2020 Trail of Bits, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Checks that `remill-lift --server` lifts a request the same way every time
+# that it is sent, and the same way as a one-shot run of `remill-lift`. Run as:
+#
+#   cmake -DREMILL_LIFT=<path> -DWORK_DIR=<dir> -P LiftServerTest.cmake
+
+if(NOT REMILL_LIFT OR NOT WORK_DIR)
+  message(FATAL_ERROR "REMILL_LIFT and WORK_DIR must be defined")
+endif()
+
+# `mov rax, [rdi]; add rax, [rsi]; ret`. The memory accesses are lowered by
+# `--flat_memory`, which rewrites the semantics functions that the lifted code
+# calls, and so would leak into later requests if they shared the semantics.
+set(bytes "488b07480306c3")
+set(flags --arch amd64 --os linux --flat_memory)
+
+file(MAKE_DIRECTORY "${WORK_DIR}")
+
+execute_process(
+  COMMAND "${REMILL_LIFT}" ${flags} --bytes ${bytes} --address 0x1000
+          --ir_out "${WORK_DIR}/one_shot.ll"
+  RESULT_VARIABLE result
+)
+if(NOT result EQUAL 0)
+  message(FATAL_ERROR "One-shot remill-lift failed: ${result}")
+endif()
+file(READ "${WORK_DIR}/one_shot.ll" one_shot)
+
+set(request "bytes=${bytes} address=0x1000 format=ir\n")
+file(WRITE "${WORK_DIR}/requests.txt" "${request}${request}")
+
+execute_process(
+  COMMAND "${REMILL_LIFT}" ${flags} --server
+  INPUT_FILE "${WORK_DIR}/requests.txt"
+  OUTPUT_VARIABLE responses
+  RESULT_VARIABLE result
+)
+if(NOT result EQUAL 0)
+  message(FATAL_ERROR "remill-lift --server failed: ${result}")
+endif()
+
+# Each response is `ok <size>`, a newline, and then `<size>` bytes of IR.
+foreach(i RANGE 1 2)
+  if(NOT responses MATCHES "^ok ([0-9]+)\n")
+    message(FATAL_ERROR "Response ${i} is not ok: ${responses}")
+  endif()
+  set(size ${CMAKE_MATCH_1})
+  string(LENGTH "${CMAKE_MATCH_0}" header_size)
+  string(SUBSTRING "${responses}" ${header_size} ${size} module)
+  math(EXPR rest_begin "${header_size} + ${size}")
+  string(SUBSTRING "${responses}" ${rest_begin} -1 responses)
+
+  if(NOT module STREQUAL one_shot)
+    file(WRITE "${WORK_DIR}/server_${i}.ll" "${module}")
+    message(FATAL_ERROR
+      "Response ${i} differs from the one-shot output; compare "
+      "${WORK_DIR}/server_${i}.ll with ${WORK_DIR}/one_shot.ll")
+  endif()
+endforeach()
+
+if(NOT responses STREQUAL "")
+  message(FATAL_ERROR "Unexpected trailing output: ${responses}")
+endif()
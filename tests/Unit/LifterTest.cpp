@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TestUtil.h"
+
+namespace {
+
+using LifterTest = test::LiftingTest;
+
+// `add rax, rbx`
+static const std::initializer_list<uint8_t> kAddRaxRbx = {0x48, 0x01, 0xd8};
+
+// The flags written by `add` are all overwritten by `cmp`, so they needn't be
+// computed.
+TEST_F(LifterTest, FlagsOverwrittenBeforeReadAreNotComputed) {
+  const auto add_func = SemanticsName(kAddRaxRbx);
+  auto flagless_add = Semantics("NOFLAGS_" + add_func);
+  ASSERT_NE(flagless_add, nullptr);
+
+  // add rax, rbx; cmp rax, rcx; ret
+  const auto callees = Callees(
+      Lift(0x1000, {0x48, 0x01, 0xd8, 0x48, 0x39, 0xc8, 0xc3}));
+  EXPECT_TRUE(callees.count(flagless_add));
+  EXPECT_FALSE(callees.count(Semantics(add_func)));
+}
+
+// The zero flag written by `add` is read by `jz`, so the flags must be
+// computed.
+TEST_F(LifterTest, FlagsReadByJccAreComputed) {
+  const auto add_func = SemanticsName(kAddRaxRbx);
+  auto add = Semantics(add_func);
+  ASSERT_NE(add, nullptr);
+
+  // add rax, rbx; jz .+2; ret
+  const auto callees = Callees(Lift(0x1000, {0x48, 0x01, 0xd8, 0x74, 0x00,
+                                             0xc3}));
+  EXPECT_TRUE(callees.count(add));
+  EXPECT_FALSE(callees.count(Semantics("NOFLAGS_" + add_func)));
+}
+
+// `cpuid` doesn't read the flags itself, but it hands the state to the
+// runtime, which can, so the flags written by `add` must be computed even
+// though `cmp` overwrites them.
+TEST_F(LifterTest, FlagsSyncedWithRuntimeAreComputed) {
+  const auto add_func = SemanticsName(kAddRaxRbx);
+  auto add = Semantics(add_func);
+  ASSERT_NE(add, nullptr);
+
+  // add rax, rbx; cpuid; cmp rax, rcx; ret
+  const auto callees = Callees(Lift(
+      0x1000, {0x48, 0x01, 0xd8, 0x0f, 0xa2, 0x48, 0x39, 0xc8, 0xc3}));
+  EXPECT_TRUE(callees.count(add));
+  EXPECT_FALSE(callees.count(Semantics("NOFLAGS_" + add_func)));
+}
+
+}  // namespace
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TestUtil.h"
+
+#include <llvm/IR/IRBuilder.h>
+
+#include "remill/BC/LowerMemory.h"
+
+namespace {
+
+// Guest memory is put in its own address space, so that loads and stores of
+// guest memory can be told apart from those of the `State` structure.
+static constexpr unsigned kGuestAddressSpace = 1;
+
+// Returns `true` if `inst` loads from or stores to guest memory.
+static bool AccessesGuestMemory(llvm::Instruction *inst, bool is_store) {
+  llvm::Value *ptr = nullptr;
+  if (auto load = llvm::dyn_cast<llvm::LoadInst>(inst)) {
+    ptr = is_store ? nullptr : load->getPointerOperand();
+  } else if (auto store = llvm::dyn_cast<llvm::StoreInst>(inst)) {
+    ptr = is_store ? store->getPointerOperand() : nullptr;
+  }
+  return ptr &&
+         ptr->getType()->getPointerAddressSpace() == kGuestAddressSpace;
+}
+
+class LowerMemoryTest : public test::LiftingTest {
+ protected:
+  // Lifts `bytes`, which read and then write the same memory location, lowers
+  // the memory intrinsics, and checks that the semantics of the instruction
+  // load from memory before storing to it.
+  void CheckLoadBeforeStore(std::initializer_list<uint8_t> bytes) {
+    auto sem = Semantics(SemanticsName(bytes));
+    ASSERT_NE(sem, nullptr);
+
+    (void) Lift(0x1000, bytes);
+    remill::LowerMemoryIntrinsics(semantics.get(), kGuestAddressSpace);
+
+    // The semantics of these instructions are straight-line code, so the
+    // order of the instructions in the block is the order of execution.
+    ASSERT_EQ(sem->size(), 1u);
+
+    llvm::Instruction *load = nullptr;
+    llvm::Instruction *store = nullptr;
+    for (auto &inst : sem->getEntryBlock()) {
+      if (!load && AccessesGuestMemory(&inst, false)) {
+        load = &inst;
+      } else if (!store && AccessesGuestMemory(&inst, true)) {
+        store = &inst;
+        EXPECT_NE(load, nullptr) << "Store to guest memory before the load";
+      }
+    }
+    EXPECT_NE(load, nullptr);
+    EXPECT_NE(store, nullptr);
+  }
+};
+
+// `xchg [rax], rbx` reads and writes `[rax]`.
+TEST_F(LowerMemoryTest, XchgLoadsBeforeStoring) {
+  CheckLoadBeforeStore({0x48, 0x87, 0x18, 0xc3});
+}
+
+// `xadd [rax], rbx` reads and writes `[rax]`.
+TEST_F(LowerMemoryTest, XaddLoadsBeforeStoring) {
+  CheckLoadBeforeStore({0x48, 0x0f, 0xc1, 0x18, 0xc3});
+}
+
+// A read that only happens on one side of a branch must not be loaded from
+// host memory on the other side, where its address might not be mapped.
+TEST_F(LowerMemoryTest, ConditionalReadIsNotHoisted) {
+  auto read = semantics->getFunction("__remill_read_memory_64");
+  ASSERT_NE(read, nullptr);
+
+  // uint64_t f(Memory *memory, addr_t addr, bool cond) {
+  //   return cond ? __remill_read_memory_64(memory, addr) : 0;
+  // }
+  auto read_type = read->getFunctionType();
+  auto func = llvm::Function::Create(
+      llvm::FunctionType::get(read_type->getReturnType(),
+                              {read_type->getParamType(0),
+                               read_type->getParamType(1),
+                               llvm::Type::getInt1Ty(context)},
+                              false),
+      llvm::GlobalValue::ExternalLinkage, "conditional_read", semantics.get());
+  auto args = func->arg_begin();
+  auto memory = &*args++;
+  auto addr = &*args++;
+  auto cond = &*args++;
+
+  auto entry = llvm::BasicBlock::Create(context, "entry", func);
+  auto taken = llvm::BasicBlock::Create(context, "taken", func);
+  auto exit = llvm::BasicBlock::Create(context, "exit", func);
+  llvm::IRBuilder<> ir(entry);
+  ir.CreateCondBr(cond, taken, exit);
+  ir.SetInsertPoint(taken);
+  auto val = ir.CreateCall(read, {memory, addr});
+  ir.CreateBr(exit);
+  ir.SetInsertPoint(exit);
+  auto phi = ir.CreatePHI(read_type->getReturnType(), 2);
+  phi->addIncoming(val, taken);
+  phi->addIncoming(llvm::Constant::getNullValue(phi->getType()), entry);
+  ir.CreateRet(phi);
+
+  remill::LowerMemoryIntrinsics(semantics.get(), kGuestAddressSpace);
+
+  auto num_loads = 0u;
+  for (auto &block : *func) {
+    for (auto &inst : block) {
+      if (AccessesGuestMemory(&inst, false)) {
+        ++num_loads;
+        EXPECT_EQ(&block, taken) << "Guest memory is loaded speculatively";
+      }
+    }
+  }
+  EXPECT_EQ(num_loads, 1u);
+}
+
+}  // namespace
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/Support/FileSystem.h>
+#include <unistd.h>
+
+#include <sstream>
+
+#include "TestUtil.h"
+#include "remill/BC/ModuleSaver.h"
+
+namespace {
+
+class ModuleSaverTest : public testing::Test {
+ protected:
+  ModuleSaverTest(void) : module("saved", context) {
+    std::stringstream ss;
+    ss << "/tmp/remill-module-saver-" << getpid();
+    dir = ss.str();
+    CHECK(!llvm::sys::fs::create_directories(dir));
+
+    // int answer(void) { return 42; }
+    auto func = llvm::Function::Create(
+        llvm::FunctionType::get(llvm::Type::getInt32Ty(context), false),
+        llvm::GlobalValue::ExternalLinkage, "answer", &module);
+    llvm::IRBuilder<> ir(llvm::BasicBlock::Create(context, "", func));
+    ir.CreateRet(ir.getInt32(42));
+  }
+
+  ~ModuleSaverTest(void) {
+    (void) llvm::sys::fs::remove_directories(dir);
+  }
+
+  // Save `module` with `compression`, load it back, and check that it still
+  // defines `answer`.
+  void CheckRoundTrip(remill::BitcodeCompression compression) {
+    const auto file_name =
+        dir + "/module" + remill::BitcodeFileExtension(compression);
+    {
+      remill::ModuleSaver saver(compression);
+      ASSERT_TRUE(saver.Save(&module, file_name));
+      ASSERT_TRUE(saver.Wait());
+    }
+
+    llvm::LLVMContext load_context;
+    auto loaded = remill::LoadModuleFromFile(&load_context, file_name, true);
+    ASSERT_NE(loaded, nullptr);
+    auto func = loaded->getFunction("answer");
+    ASSERT_NE(func, nullptr);
+    EXPECT_FALSE(func->isDeclaration());
+  }
+
+  llvm::LLVMContext context;
+  llvm::Module module;
+  std::string dir;
+};
+
+TEST_F(ModuleSaverTest, RoundTripsUncompressedBitcode) {
+  CheckRoundTrip(remill::BitcodeCompression::kNone);
+}
+
+TEST_F(ModuleSaverTest, RoundTripsZstdBitcode) {
+  if (!remill::IsBitcodeCompressionAvailable(
+          remill::BitcodeCompression::kZstd)) {
+    GTEST_SKIP() << "remill was built without zstd";
+  }
+  CheckRoundTrip(remill::BitcodeCompression::kZstd);
+}
+
+// A file is only saved once its temporary file is renamed into place, so a
+// failed rename is a failed save, and leaves nothing behind.
+TEST_F(ModuleSaverTest, FailsIfFileCannotBeRenamed) {
+
+  // Nothing can be renamed over a directory that isn't empty.
+  const auto file_name = dir + "/module.bc";
+  ASSERT_FALSE(llvm::sys::fs::create_directories(file_name + "/child"));
+
+  auto done_called = false;
+  auto saved = true;
+  remill::ModuleSaver saver;
+  ASSERT_TRUE(saver.Save(&module, file_name, [&](bool saved_) {
+    done_called = true;
+    saved = saved_;
+  }));
+  EXPECT_FALSE(saver.Wait());
+  EXPECT_TRUE(done_called);
+  EXPECT_FALSE(saved);
+  EXPECT_TRUE(llvm::sys::fs::is_directory(file_name));
+
+  std::error_code ec;
+  for (llvm::sys::fs::directory_iterator it(dir, ec), end; it != end && !ec;
+       it.increment(ec)) {
+    EXPECT_EQ(it->path(), file_name) << "Unexpected file " << it->path();
+  }
+}
+
+}  // namespace
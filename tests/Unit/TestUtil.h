@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "remill/Arch/Arch.h"
+#include "remill/Arch/Instruction.h"
+#include "remill/Arch/Name.h"
+#include "remill/BC/IntrinsicTable.h"
+#include "remill/BC/Lifter.h"
+#include "remill/BC/Util.h"
+#include "remill/OS/OS.h"
+
+namespace test {
+
+// Serves code bytes that were added by the test to the trace lifter, and
+// remembers the lifted traces.
+class BytesTraceManager : public remill::TraceManager {
+ public:
+  virtual ~BytesTraceManager(void) = default;
+
+  // Add `bytes` to the code, starting at `addr`.
+  void AddCode(uint64_t addr, std::initializer_list<uint8_t> bytes) {
+    for (auto byte : bytes) {
+      code[addr++] = byte;
+    }
+  }
+
+  void SetLiftedTraceDefinition(uint64_t addr,
+                                llvm::Function *lifted_func) override {
+    traces[addr] = lifted_func;
+  }
+
+  llvm::Function *GetLiftedTraceDeclaration(uint64_t addr) override {
+    auto trace_it = traces.find(addr);
+    if (trace_it != traces.end()) {
+      return trace_it->second;
+    } else {
+      return nullptr;
+    }
+  }
+
+  llvm::Function *GetLiftedTraceDefinition(uint64_t addr) override {
+    return GetLiftedTraceDeclaration(addr);
+  }
+
+  bool TryReadExecutableByte(uint64_t addr, uint8_t *byte) override {
+    auto byte_it = code.find(addr);
+    if (byte_it != code.end()) {
+      *byte = byte_it->second;
+      return true;
+    } else {
+      return false;
+    }
+  }
+
+  std::unordered_map<uint64_t, uint8_t> code;
+  std::unordered_map<uint64_t, llvm::Function *> traces;
+};
+
+// Lifts AMD64 code into a fresh copy of the AMD64 semantics.
+class LiftingTest : public testing::Test {
+ protected:
+  LiftingTest(void)
+      : arch(remill::Arch::Build(&context, remill::kOSLinux,
+                                 remill::kArchAMD64)),
+        semantics(remill::LoadArchSemantics(arch)),
+        intrinsics(semantics),
+        inst_lifter(arch, intrinsics),
+        trace_lifter(inst_lifter, manager) {}
+
+  // Lift `bytes` at `addr`, and return the trace that starts at `addr`.
+  llvm::Function *Lift(uint64_t addr, std::initializer_list<uint8_t> bytes) {
+    manager.AddCode(addr, bytes);
+    CHECK(trace_lifter.Lift(addr));
+    auto trace = manager.GetLiftedTraceDefinition(addr);
+    CHECK(trace != nullptr);
+    return trace;
+  }
+
+  // Returns the name of the semantics function that `bytes` decode to.
+  std::string SemanticsName(std::initializer_list<uint8_t> bytes) {
+    remill::Instruction inst;
+    const std::string inst_bytes(bytes.begin(), bytes.end());
+    CHECK(arch->DecodeInstruction(0, inst_bytes, inst));
+    return inst.function;
+  }
+
+  // Returns the semantics function of the instruction selection `isel_name`,
+  // or `nullptr` if there is none.
+  llvm::Function *Semantics(const std::string &isel_name) {
+    auto isel = semantics->getGlobalVariable("ISEL_" + isel_name);
+    if (!isel || !isel->hasInitializer()) {
+      return nullptr;
+    }
+    return llvm::dyn_cast<llvm::Function>(
+        isel->getInitializer()->stripPointerCasts());
+  }
+
+  // Returns the functions called by `func`.
+  static std::unordered_set<llvm::Function *> Callees(llvm::Function *func) {
+    std::unordered_set<llvm::Function *> callees;
+    for (auto &inst : llvm::instructions(*func)) {
+      if (auto call = llvm::dyn_cast<llvm::CallInst>(&inst)) {
+        if (auto callee = call->getCalledFunction()) {
+          callees.insert(callee);
+        }
+      }
+    }
+    return callees;
+  }
+
+  llvm::LLVMContext context;
+  const remill::Arch::ArchPtr arch;
+  const std::unique_ptr<llvm::Module> semantics;
+  const remill::IntrinsicTable intrinsics;
+  remill::InstructionLifter inst_lifter;
+  BytesTraceManager manager;
+  remill::TraceLifter trace_lifter;
+};
+
+}  // namespace test
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <llvm/IR/Verifier.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/raw_ostream.h>
+#include <unistd.h>
+
+#include <map>
+#include <sstream>
+
+#include "TestUtil.h"
+#include "remill/BC/TraceWriter.h"
+
+namespace {
+
+class TraceWriterTest : public test::LiftingTest {
+ protected:
+  TraceWriterTest(void) {
+    std::stringstream ss;
+    ss << "/tmp/remill-trace-writer-" << getpid();
+    dir = ss.str();
+  }
+
+  ~TraceWriterTest(void) {
+    (void) llvm::sys::fs::remove_directories(dir);
+  }
+
+  std::string dir;
+};
+
+// The callee is written to an earlier file than its caller. Until then, the
+// caller is still in the module that it was lifted into, and must call the
+// callee through a declaration in that module.
+TEST_F(TraceWriterTest, CallsTracesWrittenToEarlierFiles) {
+
+  // ret
+  manager.AddCode(0x2000, {0xc3});
+
+  // call 0x2000; ret
+  auto caller = Lift(0x1000, {0xe8, 0xfb, 0x0f, 0x00, 0x00, 0xc3});
+  auto callee = manager.GetLiftedTraceDefinition(0x2000);
+  ASSERT_NE(callee, nullptr);
+  ASSERT_TRUE(Callees(caller).count(callee));
+
+  remill::TraceWriter writer(arch.get(), dir);
+  std::map<uint64_t, llvm::Function *> batch = {{0x2000, callee}};
+  ASSERT_TRUE(writer.WriteTraces(&batch));
+
+  auto callee_decl = batch[0x2000];
+  EXPECT_TRUE(callee_decl->isDeclaration());
+  EXPECT_EQ(callee_decl->getParent(), semantics.get());
+  EXPECT_EQ(callee_decl->getName().str(), "sub_2000");
+  EXPECT_TRUE(Callees(caller).count(callee_decl));
+  EXPECT_FALSE(llvm::verifyModule(*semantics, &llvm::errs()));
+
+  batch = {{0x1000, caller}};
+  ASSERT_TRUE(writer.WriteTraces(&batch));
+  ASSERT_TRUE(writer.Wait());
+
+  llvm::LLVMContext load_context;
+  auto callee_module = remill::LoadModuleFromFile(
+      &load_context, writer.FilePath("sub_2000"), true);
+  ASSERT_NE(callee_module, nullptr);
+  auto loaded_callee = callee_module->getFunction("sub_2000");
+  ASSERT_NE(loaded_callee, nullptr);
+  EXPECT_FALSE(loaded_callee->isDeclaration());
+
+  auto caller_module = remill::LoadModuleFromFile(
+      &load_context, writer.FilePath("sub_1000"), true);
+  ASSERT_NE(caller_module, nullptr);
+  auto loaded_caller = caller_module->getFunction("sub_1000");
+  ASSERT_NE(loaded_caller, nullptr);
+  EXPECT_FALSE(loaded_caller->isDeclaration());
+  auto callee_in_caller = caller_module->getFunction("sub_2000");
+  ASSERT_NE(callee_in_caller, nullptr);
+  EXPECT_TRUE(callee_in_caller->isDeclaration());
+  EXPECT_TRUE(Callees(loaded_caller).count(callee_in_caller));
+  EXPECT_FALSE(llvm::verifyModule(*caller_module, &llvm::errs()));
+}
+
+}  // namespace
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include "TestUtil.h"
+
+namespace {
+
+class UtilTest : public testing::Test {
+ protected:
+  UtilTest(void)
+      : source("source", context),
+        dest("dest", context),
+        i32_type(llvm::Type::getInt32Ty(context)),
+        func_type(llvm::FunctionType::get(i32_type, false)) {}
+
+  // Define `int name(void)` in `module`, and return a builder at its entry.
+  llvm::Function *DefineFunction(llvm::Module *module, const char *name,
+                                 llvm::IRBuilder<> &ir) {
+    auto func = llvm::Function::Create(
+        func_type, llvm::GlobalValue::ExternalLinkage, name, module);
+    ir.SetInsertPoint(llvm::BasicBlock::Create(context, "", func));
+    return func;
+  }
+
+  llvm::LLVMContext context;
+  llvm::Module source;
+  llvm::Module dest;
+  llvm::IntegerType *const i32_type;
+  llvm::FunctionType *const func_type;
+};
+
+// The caller is moved before its callee, but still calls the moved callee
+// itself, rather than a declaration of it.
+TEST_F(UtilTest, MovedFunctionsCallEachOther) {
+  llvm::IRBuilder<> ir(context);
+  auto callee = DefineFunction(&source, "callee", ir);
+  ir.CreateRet(ir.getInt32(1));
+
+  auto caller = DefineFunction(&source, "caller", ir);
+  auto call = ir.CreateCall(callee);
+  ir.CreateRet(call);
+
+  remill::MoveFunctionsIntoModule({caller, callee}, &dest);
+
+  EXPECT_EQ(caller->getParent(), &dest);
+  EXPECT_EQ(callee->getParent(), &dest);
+  EXPECT_EQ(call->getCalledFunction(), callee);
+  EXPECT_EQ(dest.getFunction("callee"), callee);
+  EXPECT_EQ(source.getFunction("callee"), nullptr);
+  EXPECT_EQ(dest.size(), 2u);
+  EXPECT_FALSE(llvm::verifyModule(dest, &llvm::errs()));
+}
+
+// Globals that are shared by the initializers of the globals that a cloned
+// function uses are only declared once in the destination module.
+TEST_F(UtilTest, ClonedGlobalsShareTheirInitializers) {
+  auto ptr_type = llvm::PointerType::get(i32_type, 0);
+  auto x = new llvm::GlobalVariable(source, i32_type, false,
+                                    llvm::GlobalValue::ExternalLinkage,
+                                    llvm::ConstantInt::get(i32_type, 1), "x");
+  auto p = new llvm::GlobalVariable(
+      source, ptr_type, false, llvm::GlobalValue::ExternalLinkage, x, "p");
+  auto q = new llvm::GlobalVariable(
+      source, ptr_type, false, llvm::GlobalValue::ExternalLinkage, x, "q");
+
+  // int reader(void) { return *p + *q; }
+  llvm::IRBuilder<> ir(context);
+  auto reader = DefineFunction(&source, "reader", ir);
+  auto p_val = ir.CreateLoad(i32_type, ir.CreateLoad(ptr_type, p));
+  auto q_val = ir.CreateLoad(i32_type, ir.CreateLoad(ptr_type, q));
+  ir.CreateRet(ir.CreateAdd(p_val, q_val));
+
+  auto clone = llvm::Function::Create(
+      func_type, llvm::GlobalValue::ExternalLinkage, "reader", &dest);
+  remill::CloneFunctionInto(reader, clone);
+
+  auto dest_x = dest.getGlobalVariable("x");
+  auto dest_p = dest.getGlobalVariable("p");
+  auto dest_q = dest.getGlobalVariable("q");
+  ASSERT_NE(dest_x, nullptr);
+  ASSERT_NE(dest_p, nullptr);
+  ASSERT_NE(dest_q, nullptr);
+  EXPECT_EQ(dest_p->getInitializer(), dest_x);
+  EXPECT_EQ(dest_q->getInitializer(), dest_x);
+  EXPECT_EQ(dest.global_size(), 3u);
+  EXPECT_FALSE(llvm::verifyModule(dest, &llvm::errs()));
+}
+
+}  // namespace
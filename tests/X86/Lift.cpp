@@ -22,14 +22,17 @@
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Type.h>
+#include <llvm/Transforms/IPO/Internalize.h>
 
 #include <algorithm>
 #include <cstdint>
 #include <fstream>
+#include <iomanip>
 #include <map>
 #include <memory>
 #include <sstream>
 #include <string>
+#include <unordered_set>
 
 #include "remill/Arch/Arch.h"
 #include "remill/Arch/Instruction.h"
@@ -49,6 +52,17 @@
 DEFINE_string(bc_out, "",
               "Name of the file in which to place the generated bitcode.");
 
+DEFINE_string(corpus_out, "",
+              "Name of the file in which to save the code of the tests, "
+              "instead of lifting them, for use as a remill-bench corpus.");
+
+DEFINE_uint64(num_shards, 1,
+              "Number of shards into which the tests are split. Each shard "
+              "is lifted into its own bitcode file, and the shards can then "
+              "be compiled separately and linked together.");
+
+DEFINE_uint64(shard_index, 0, "Index of the shard of the tests to lift.");
+
 DECLARE_string(arch);
 DECLARE_string(os);
 
@@ -91,12 +105,44 @@ class TestTraceManager : public remill::TraceManager {
   std::unordered_map<uint64_t, llvm::Function *> traces;
 };
 
+// Save the address, code bytes, and name of each test on a line of its own.
+static void WriteCorpus(const std::vector<const test::TestInfo *> &tests) {
+  std::ofstream out(FLAGS_corpus_out);
+  CHECK(out) << "Unable to open corpus file " << FLAGS_corpus_out;
+
+  out << std::hex << std::setfill('0');
+  for (auto test : tests) {
+    out << test->test_begin << ' ';
+    for (auto addr = test->test_begin; addr < test->test_end; ++addr) {
+      out << std::setw(2)
+          << static_cast<unsigned>(*reinterpret_cast<const uint8_t *>(addr));
+    }
+    out << ' ' << test->test_name << '\n';
+  }
+}
+
+// Every shard has its own copy of the semantics, and of any traces that its
+// tests share with those of other shards. Hide everything except the lifted
+// tests so that the shards can be linked into one test runner.
+static void InternalizeShard(
+    llvm::Module *module,
+    const std::unordered_set<const llvm::GlobalValue *> &lifted_tests) {
+  llvm::internalizeModule(*module, [&](const llvm::GlobalValue &gv) {
+    return lifted_tests.count(&gv) != 0;
+  });
+}
+
 }  // namespace
 
 extern "C" int main(int argc, char *argv[]) {
   google::ParseCommandLineFlags(&argc, &argv, true);
   google::InitGoogleLogging(argv[0]);
 
+  CHECK(0 < FLAGS_num_shards) << "Must have at least one shard of tests";
+  CHECK(FLAGS_shard_index < FLAGS_num_shards)
+      << "Shard index " << FLAGS_shard_index << " is out of range for "
+      << FLAGS_num_shards << " shards";
+
   DLOG(INFO) << "Generating tests.";
 
   std::vector<const test::TestInfo *> tests;
@@ -108,6 +154,11 @@ extern "C" int main(int argc, char *argv[]) {
     tests.push_back(&test);
   }
 
+  if (!FLAGS_corpus_out.empty()) {
+    WriteCorpus(tests);
+    return 0;
+  }
+
   TestTraceManager manager;
 
   // Add all code byts from the test cases to the memory.
@@ -127,7 +178,16 @@ extern "C" int main(int argc, char *argv[]) {
   remill::InstructionLifter inst_lifter(arch, intrinsics);
   remill::TraceLifter trace_lifter(inst_lifter, manager);
 
-  for (auto test : tests) {
+  std::unordered_set<const llvm::GlobalValue *> lifted_tests;
+  for (auto i = 0U; i < tests.size(); ++i) {
+
+    // Round-robin the tests across the shards, so that the tests of big
+    // instruction classes don't all end up in the same shard.
+    if ((i % FLAGS_num_shards) != FLAGS_shard_index) {
+      continue;
+    }
+
+    auto test = tests[i];
     if (!trace_lifter.Lift(test->test_begin)) {
       LOG(ERROR) << "Unable to lift test " << test->test_name;
       continue;
@@ -139,6 +199,11 @@ extern "C" int main(int argc, char *argv[]) {
 
     auto lifted_trace = manager.GetLiftedTraceDefinition(test->test_begin);
     lifted_trace->setName(ss.str());
+    lifted_tests.insert(lifted_trace);
+  }
+
+  if (1 < FLAGS_num_shards) {
+    InternalizeShard(module.get(), lifted_tests);
   }
 
   DLOG(INFO) << "Serializing bitcode to " << FLAGS_bc_out;
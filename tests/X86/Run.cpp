@@ -19,25 +19,45 @@
 #include <dlfcn.h>
 #include <gflags/gflags.h>
 #include <glog/logging.h>
+#include <gtest/gtest-spi.h>
 #include <gtest/gtest.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
 #include <setjmp.h>
 #include <signal.h>
+#include <sys/mman.h>
 #include <ucontext.h>
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <iomanip>
 #include <iostream>
 #include <limits>
 #include <map>
+#include <random>
+#include <sstream>
 #include <string>
 #include <type_traits>
+#include <unordered_map>
 #include <vector>
 
+#include "remill/Arch/Arch.h"
 #include "remill/Arch/Float.h"
+#include "remill/Arch/Instruction.h"
+#include "remill/Arch/Name.h"
 #include "remill/Arch/Runtime/Runtime.h"
 #include "remill/Arch/X86/Runtime/State.h"
+#include "remill/Arch/X86/XED.h"
+#include "remill/BC/Lifter.h"
+#include "remill/BC/Util.h"
+#include "remill/BC/Version.h"
+#include "remill/JIT/JIT.h"
+#include "remill/OS/OS.h"
 #include "tests/X86/Test.h"
 
 DECLARE_string(arch);
@@ -48,6 +68,40 @@ DEFINE_bool(
     "Trace values of fxsave.cs and fxsave.ds for 32-bit instructions. Disabled "
     "by default since it is commonly broken in virtualized environments.");
 
+DEFINE_bool(benchmark, false,
+            "Instead of checking the semantics of each test, measure how "
+            "much slower its lifted code runs than its native code, and "
+            "report the slowdown of each instruction and class of "
+            "instructions.");
+
+DEFINE_uint64(benchmark_iterations, 1000,
+              "Number of times to run the native and lifted code of each "
+              "test with --benchmark.");
+
+DEFINE_bool(stress, false,
+            "Instead of running the tests, run randomly generated sequences "
+            "of instructions natively and through the JIT, and report the "
+            "sequences whose states differ, along with lifting and "
+            "execution throughput. Only available for 64-bit code.");
+
+DEFINE_uint64(stress_sequences, 1000,
+              "Number of random instruction sequences to run with --stress.");
+
+DEFINE_uint64(stress_sequence_length, 16,
+              "Number of instructions in each random sequence.");
+
+DEFINE_uint64(stress_batch_size, 64,
+              "Number of random sequences lifted by each JIT. Every batch is "
+              "lifted by a new JIT, with its own LLVM context.");
+
+DEFINE_uint64(stress_inputs, 4,
+              "Number of times to run each random sequence, each time with "
+              "random inputs and flags.");
+
+DEFINE_uint64(stress_seed, 1,
+              "Seed from which the random sequences and inputs are "
+              "generated.");
+
 namespace {
 
 struct alignas(128) Stack {
@@ -159,6 +213,10 @@ CR8Reg gCR8;
 // `gNativeState`, respectively.
 extern void InvokeTestCase(uint64_t, uint64_t, uint64_t);
 
+// Saves the machine state after a native test case, and returns to the normal
+// stack. Running this as a test case measures the cost of `InvokeTestCase`.
+extern void __x86_save_state_after(void);
+
 #define MAKE_RW_MEMORY(size) \
   NEVER_INLINE uint##size##_t __remill_read_memory_##size(Memory *, \
                                                           addr_t addr) { \
@@ -585,7 +643,10 @@ inline static bool operator!=(const T &a, const T &b) {
   return !!memcmp(&a, &b, sizeof(a));
 }
 
-static void RunWithFlags(const test::TestInfo *info, Flags flags,
+// Run the native and lifted code of `info` with the given flags and inputs,
+// and compare the states that they leave behind. Returns `false` if the test
+// can't be run on this host.
+static bool RunWithFlags(const test::TestInfo *info, Flags flags,
                          std::string desc, uint64_t arg1, uint64_t arg2,
                          uint64_t arg3) {
 
@@ -593,13 +654,13 @@ static void RunWithFlags(const test::TestInfo *info, Flags flags,
   auto stack_addr = reinterpret_cast<uintptr_t>(&(gLiftedStack.bytes[0]));
   if (sizeof(addr_t) < sizeof(uintptr_t) &&
       static_cast<uintptr_t>(static_cast<addr_t>(stack_addr)) != stack_addr) {
-    return;
+    return false;
   }
 
   DLOG(INFO) << "Testing instruction: " << info->test_name << ": " << desc;
   if (sigsetjmp(gUnsupportedInstrBuf, true)) {
     DLOG(INFO) << "Unsupported instruction " << info->test_name;
-    return;
+    return false;
   }
 
   memcpy(&gLiftedStack, &gRandomStack, sizeof(gLiftedStack));
@@ -740,6 +801,13 @@ static void RunWithFlags(const test::TestInfo *info, Flags flags,
   memset(&(native_state->aflag), 0, sizeof(native_state->aflag));
   memset(&(lifted_state->aflag), 0, sizeof(lifted_state->aflag));
 
+#if REMILL_X86_LAZY_FLAGS
+
+  // The lifted code computes any deferred flags into `aflag` before it exits,
+  // but leaves behind the record of the operation they were deferred from.
+  memset(&(lifted_state->lazy_aflag), 0, sizeof(lifted_state->lazy_aflag));
+#endif
+
   // Only compare the non-undefined flags state.
   native_state->rflag.flat |= info->ignored_flags_mask;
   lifted_state->rflag.flat |= info->ignored_flags_mask;
@@ -886,6 +954,8 @@ static void RunWithFlags(const test::TestInfo *info, Flags flags,
 
     EXPECT_TRUE(!"Lifted and native stacks did not match.");
   }
+
+  return true;
 }
 
 TEST_P(InstrTest, SemanticsMatchNative) {
@@ -1044,6 +1114,664 @@ static void SetupSignals(void) {
   sigaltstack(&sig_stack, nullptr);
 }
 
+using BenchmarkClock = std::chrono::steady_clock;
+
+// How long it took to run some code in a benchmark loop, in nanoseconds.
+static double NanosecondsSince(BenchmarkClock::time_point start) {
+  return std::chrono::duration<double, std::nano>(BenchmarkClock::now() -
+                                                  start)
+      .count();
+}
+
+// Run the native code at `test_to_run` `iterations` times, with the first
+// inputs of `info`. Returns the time this took, or a negative number if the
+// code faulted.
+static double TimeNativeTest(const test::TestInfo *info, uintptr_t test_to_run,
+                             uint64_t iterations) {
+  const auto args = info->args_begin;
+  gTestToRun = test_to_run;
+  gStackSwitcher = &(gLiftedStack._redzone2[0]);
+  gRflagsForTest = gRflagsInitial;
+  ResetFlags();
+
+  if (sigsetjmp(gJmpBuf, true)) {
+    gInNativeTest = false;
+    ResetFlags();
+    return -1;
+  }
+
+  gInNativeTest = true;
+  const auto start = BenchmarkClock::now();
+  for (uint64_t i = 0; i < iterations; ++i) {
+    InvokeTestCase(args[0], args[1], args[2]);
+  }
+  const auto elapsed = NanosecondsSince(start);
+  gInNativeTest = false;
+  ResetFlags();
+  return elapsed;
+}
+
+// Run `lifted_func` `iterations` times, each time starting from
+// `initial_state`. If `lifted_func` is `nullptr`, then only the state is
+// reset, which measures the cost of the loop itself. Returns the time this
+// took, or a negative number if the code faulted.
+static double TimeLiftedTest(LiftedFunc *lifted_func,
+                             const X86State &initial_state,
+                             uint64_t iterations) {
+  auto lifted_state = reinterpret_cast<X86State *>(&gLiftedState);
+  std::fesetenv(FE_DFL_ENV);
+  FixGlibcMxcsrBug();
+
+  if (sigsetjmp(gJmpBuf, true)) {
+    ResetFlags();
+    return -1;
+  }
+
+  const auto start = BenchmarkClock::now();
+  for (uint64_t i = 0; i < iterations; ++i) {
+    memcpy(lifted_state, &initial_state, sizeof(initial_state));
+    asm volatile("" : : : "memory");
+    if (lifted_func) {
+      (void) lifted_func(*lifted_state,
+                         static_cast<addr_t>(lifted_state->gpr.rip.aword),
+                         nullptr);
+    }
+  }
+  const auto elapsed = NanosecondsSince(start);
+  ResetFlags();
+  return elapsed;
+}
+
+// Total time spent running the native and lifted code of some tests, in
+// nanoseconds per run, not counting the cost of invoking a test.
+struct BenchmarkTiming {
+  uint64_t num_tests{0};
+  double native_ns{0};
+  double lifted_ns{0};
+};
+
+// Time the native code of `info`, and `lifted_func`, its lifted code. Returns
+// `false` if either faults, or if the test uses an instruction that the host
+// doesn't support.
+static bool BenchmarkTest(const test::TestInfo *info, LiftedFunc *lifted_func,
+                          BenchmarkTiming *timing) {
+  static std::aligned_storage<sizeof(X86State), alignof(X86State)>::type
+      initial_state_storage;
+  auto &initial_state = *reinterpret_cast<X86State *>(&initial_state_storage);
+
+  const auto iterations = std::max<uint64_t>(1, FLAGS_benchmark_iterations);
+
+  if (sigsetjmp(gUnsupportedInstrBuf, true)) {
+    return false;
+  }
+
+  // Run the test once to make sure that it doesn't fault, and to record the
+  // state in which the lifted code should start.
+  memcpy(&gLiftedStack, &gRandomStack, sizeof(gLiftedStack));
+  if (0 > TimeNativeTest(info, info->test_begin, 1)) {
+    return false;
+  }
+  memcpy(&initial_state, &gLiftedState, sizeof(initial_state));
+  initial_state.gpr.rip.aword = static_cast<addr_t>(info->test_begin);
+  if (0 > TimeLiftedTest(lifted_func, initial_state, 1)) {
+    return false;
+  }
+
+  const auto native_ns = TimeNativeTest(info, info->test_begin, iterations);
+  const auto invoke_ns = TimeNativeTest(
+      info, reinterpret_cast<uintptr_t>(__x86_save_state_after), iterations);
+  const auto lifted_ns = TimeLiftedTest(lifted_func, initial_state,
+                                        iterations);
+  const auto reset_ns = TimeLiftedTest(nullptr, initial_state, iterations);
+  if (0 > native_ns || 0 > invoke_ns || 0 > lifted_ns || 0 > reset_ns) {
+    return false;
+  }
+
+  timing->num_tests += 1;
+  timing->native_ns += std::max(0.0, native_ns - invoke_ns) / iterations;
+  timing->lifted_ns += std::max(0.0, lifted_ns - reset_ns) / iterations;
+  return true;
+}
+
+// Returns the class of instructions that `info` tests, e.g. `X87`, and the
+// instruction itself, e.g. `X87/FADD`, based on the path of its file.
+static std::pair<std::string, std::string>
+TestInstructionClass(const test::TestInfo *info) {
+  std::string path = info->test_file;
+  const auto ext_pos = path.rfind('.');
+  if (ext_pos != std::string::npos) {
+    path.resize(ext_pos);
+  }
+
+  const auto file_pos = path.rfind('/');
+  if (file_pos == std::string::npos || !file_pos) {
+    return {"", path};
+  }
+
+  const auto dir_pos = path.rfind('/', file_pos - 1);
+  const auto instruction =
+      path.substr(dir_pos == std::string::npos ? 0 : dir_pos + 1);
+  return {instruction.substr(0, instruction.find('/')), instruction};
+}
+
+static void PrintBenchmarkTimings(
+    const char *title, const std::map<std::string, BenchmarkTiming> &timings) {
+  std::vector<std::pair<double, std::string>> order;
+  for (const auto &entry : timings) {
+    const auto &timing = entry.second;
+    const auto slowdown = timing.native_ns > 0
+                              ? timing.lifted_ns / timing.native_ns
+                              : 0.0;
+    order.emplace_back(slowdown, entry.first);
+  }
+
+  // Slowest first.
+  std::sort(order.rbegin(), order.rend());
+
+  printf("%-24s %6s %12s %12s %9s\n", title, "tests", "native ns",
+         "lifted ns", "slowdown");
+  for (const auto &entry : order) {
+    const auto &timing = timings.at(entry.second);
+    printf("%-24s %6llu %12.1f %12.1f %8.1fx\n", entry.second.c_str(),
+           static_cast<unsigned long long>(timing.num_tests),
+           timing.native_ns, timing.lifted_ns, entry.first);
+  }
+  printf("\n");
+}
+
+// Measure the slowdown of the lifted code of every test, relative to its
+// native code, and report it per instruction and per class of instructions.
+static int RunBenchmark(void) {
+
+  // Can't fit a 64-bit stack address into a 32-bit register.
+  auto stack_addr = reinterpret_cast<uintptr_t>(&(gLiftedStack.bytes[0]));
+  if (sizeof(addr_t) < sizeof(uintptr_t) &&
+      static_cast<uintptr_t>(static_cast<addr_t>(stack_addr)) != stack_addr) {
+    LOG(ERROR) << "Cannot benchmark tests with a 64-bit stack address";
+    return EXIT_FAILURE;
+  }
+
+  std::map<std::string, BenchmarkTiming> class_timings;
+  std::map<std::string, BenchmarkTiming> instruction_timings;
+  BenchmarkTiming total;
+  auto num_skipped = 0u;
+  auto num_unlifted = 0u;
+
+  for (auto info : gTests) {
+
+    // Timing a test without lifted code would only time resetting the state.
+    const auto func_it = gTranslatedFuncs.find(info->test_begin);
+    if (func_it == gTranslatedFuncs.end() || !func_it->second) {
+      LOG(ERROR) << "No lifted code to benchmark for " << info->test_name;
+      ++num_unlifted;
+      continue;
+    }
+
+    BenchmarkTiming timing;
+    if (!BenchmarkTest(info, func_it->second, &timing)) {
+      DLOG(INFO) << "Skipping benchmark of " << info->test_name;
+      ++num_skipped;
+      continue;
+    }
+
+    const auto names = TestInstructionClass(info);
+    for (auto totals : {&(class_timings[names.first]),
+                        &(instruction_timings[names.second]), &total}) {
+      totals->num_tests += timing.num_tests;
+      totals->native_ns += timing.native_ns;
+      totals->lifted_ns += timing.lifted_ns;
+    }
+  }
+
+  PrintBenchmarkTimings("class", class_timings);
+  PrintBenchmarkTimings("instruction", instruction_timings);
+  PrintBenchmarkTimings("total", {{"all", total}});
+  printf("Skipped %u tests that faulted or that the host can't run.\n",
+         num_skipped);
+  if (num_unlifted) {
+    printf("Skipped %u tests that have no lifted code.\n", num_unlifted);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(11, 0)
+
+// A randomly generated sequence of straight-line instructions, which is run
+// like a test case.
+struct StressSequence {
+  uint64_t address{0};
+  uint64_t num_insts{0};
+  std::string bytes;
+
+  // Flags that are left undefined by the sequence, and so aren't compared.
+  uint64_t ignored_flags_mask{0};
+
+  // One line per instruction, for reporting mismatches.
+  std::string disassembly;
+};
+
+// Generates random sequences of instructions that remill has semantics for,
+// and that can run natively in place of a test case. Candidates are random
+// bytes that XED decodes, and that are then re-encoded by XED into their
+// canonical forms. Instructions that access memory, that use the stack
+// pointer or segment registers, that are privileged, or whose results aren't
+// deterministic are skipped. So are those that read flags that an earlier
+// instruction in the sequence left undefined.
+class StressGenerator {
+ public:
+  StressGenerator(const remill::Arch *arch_, llvm::Module *semantics_)
+      : arch(arch_),
+        semantics(semantics_),
+        gen(FLAGS_stress_seed) {}
+
+  // Generate a sequence of instructions that starts at `address`. The
+  // sequence may be shorter than requested if too few candidates are usable.
+  void Generate(uint64_t address, StressSequence *seq);
+
+  uint64_t Random(void) {
+    return gen();
+  }
+
+ private:
+  bool IsRunnable(const xed_decoded_inst_t &xedd) const;
+  bool HasSemantics(const remill::Instruction &inst);
+
+  const remill::Arch *const arch;
+  llvm::Module *const semantics;
+  std::mt19937_64 gen;
+  std::unordered_map<std::string, bool> has_semantics;
+};
+
+static bool DecodeLong64(xed_decoded_inst_t *xedd, const uint8_t *bytes,
+                         unsigned num_bytes) {
+  xed_decoded_inst_zero(xedd);
+  xed_decoded_inst_set_mode(xedd, XED_MACHINE_MODE_LONG_64,
+                            XED_ADDRESS_WIDTH_64b);
+  return XED_ERROR_NONE == xed_decode(xedd, bytes, num_bytes);
+}
+
+bool StressGenerator::IsRunnable(const xed_decoded_inst_t &xedd) const {
+  switch (xed_decoded_inst_get_category(&xedd)) {
+    case XED_CATEGORY_INTERRUPT:
+    case XED_CATEGORY_IO:
+    case XED_CATEGORY_IOSTRINGOP:
+    case XED_CATEGORY_RDRAND:
+    case XED_CATEGORY_RDSEED:
+    case XED_CATEGORY_SEGOP:
+    case XED_CATEGORY_SYSCALL:
+    case XED_CATEGORY_SYSRET:
+    case XED_CATEGORY_SYSTEM: return false;
+    default: break;
+  }
+
+  if (xed_decoded_inst_get_attribute(&xedd, XED_ATTRIBUTE_RING0) ||
+      xed_decoded_inst_number_of_memory_operands(&xedd)) {
+    return false;
+  }
+
+  // The native code runs on the test stack, and the lifted code on the
+  // lifted state, so neither can be allowed to move the stack pointer.
+  const auto xedi = xed_decoded_inst_inst(&xedd);
+  for (auto i = 0U; i < xed_inst_noperands(xedi); ++i) {
+    const auto name = xed_operand_name(xed_inst_operand(xedi, i));
+    if (!xed_operand_is_register(name)) {
+      continue;
+    }
+    const auto reg = xed_decoded_inst_get_reg(&xedd, name);
+    if (XED_REG_RSP == xed_get_largest_enclosing_register(reg) ||
+        XED_REG_CLASS_SR == xed_reg_class(reg)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool StressGenerator::HasSemantics(const remill::Instruction &inst) {
+  auto sem_it = has_semantics.find(inst.function);
+  if (sem_it == has_semantics.end()) {
+    auto isel = remill::FindGlobaVariable(semantics, "ISEL_" + inst.function);
+    sem_it = has_semantics.emplace(inst.function, !!isel).first;
+  }
+  return sem_it->second;
+}
+
+void StressGenerator::Generate(uint64_t address, StressSequence *seq) {
+  seq->address = address;
+  seq->num_insts = 0;
+  seq->bytes.clear();
+  seq->disassembly.clear();
+
+  const auto max_attempts = 1000 * FLAGS_stress_sequence_length;
+  uint32_t undefined_flags = 0;
+  remill::Instruction inst;
+  xed_decoded_inst_t xedd;
+
+  for (uint64_t attempt = 0; seq->num_insts < FLAGS_stress_sequence_length &&
+                             attempt < max_attempts;
+       ++attempt) {
+    uint8_t candidate[test::kMaxInstrLen];
+    for (auto &byte : candidate) {
+      byte = static_cast<uint8_t>(gen());
+    }
+
+    uint8_t encoded[test::kMaxInstrLen];
+    unsigned num_encoded = 0;
+    if (!DecodeLong64(&xedd, candidate, sizeof(candidate))) {
+      continue;
+    }
+    xed_encoder_request_init_from_decode(&xedd);
+    if (XED_ERROR_NONE !=
+            xed_encode(&xedd, encoded, sizeof(encoded), &num_encoded) ||
+        !DecodeLong64(&xedd, encoded, num_encoded) || !IsRunnable(xedd)) {
+      continue;
+    }
+
+    uint32_t read_flags = 0;
+    uint32_t written_flags = 0;
+    uint32_t new_undefined_flags = 0;
+    if (auto rflags = xed_decoded_inst_get_rflags_info(&xedd)) {
+      read_flags = static_cast<uint32_t>(
+          xed_flag_set_mask(xed_simple_flag_get_read_flag_set(rflags)));
+      new_undefined_flags = static_cast<uint32_t>(
+          xed_flag_set_mask(xed_simple_flag_get_undefined_flag_set(rflags)));
+
+      // Flags that are only written under some conditions (e.g. by a shift
+      // by zero) might keep their undefined values.
+      if (!xed_simple_flag_get_may_write(rflags)) {
+        written_flags = static_cast<uint32_t>(
+            xed_flag_set_mask(xed_simple_flag_get_written_flag_set(rflags)));
+      }
+    }
+
+    if (read_flags & undefined_flags) {
+      continue;
+    }
+
+    const auto pc = address + seq->bytes.size();
+    const std::string inst_bytes(reinterpret_cast<const char *>(encoded),
+                                 num_encoded);
+    inst.Reset();
+    if (!arch->DecodeInstruction(pc, inst_bytes, inst) ||
+        inst.NumBytes() != num_encoded || !HasSemantics(inst)) {
+      continue;
+    }
+
+    switch (inst.category) {
+      case remill::Instruction::kCategoryNormal:
+      case remill::Instruction::kCategoryNoOp: break;
+      default: continue;
+    }
+
+    char disassembly[128] = {};
+    xed_format_context(XED_SYNTAX_INTEL, &xedd, disassembly,
+                       sizeof(disassembly), pc, nullptr, nullptr);
+
+    std::stringstream ss;
+    ss << "  " << std::hex << std::setfill('0');
+    for (auto b = 0U; b < num_encoded; ++b) {
+      ss << std::setw(2) << static_cast<unsigned>(encoded[b]);
+    }
+    ss << "  " << disassembly << '\n';
+
+    undefined_flags = (undefined_flags & ~written_flags) | new_undefined_flags;
+    seq->bytes.append(inst_bytes);
+    seq->disassembly.append(ss.str());
+    seq->num_insts += 1;
+  }
+
+  seq->ignored_flags_mask = undefined_flags;
+}
+
+// Exposes the code of the random sequences of a batch to the JIT.
+class StressTraceManager : public remill::TraceManager {
+ public:
+  virtual ~StressTraceManager(void) = default;
+
+  void SetLiftedTraceDefinition(uint64_t, llvm::Function *) override {}
+
+  bool TryReadExecutableByte(uint64_t addr, uint8_t *byte) override {
+    auto byte_it = memory.find(addr);
+    if (byte_it != memory.end()) {
+      *byte = byte_it->second;
+      return true;
+    } else {
+      return false;
+    }
+  }
+
+ public:
+  std::unordered_map<uint64_t, uint8_t> memory;
+};
+
+// Time spent, and work done, by a stress run.
+struct StressTotals {
+  uint64_t num_sequences{0};
+  uint64_t num_insts{0};
+  uint64_t num_runs{0};
+  uint64_t num_unsupported{0};
+  uint64_t num_mismatches{0};
+  double generate_ns{0};
+  double lift_ns{0};
+  double run_ns{0};
+};
+
+// Run `seq` natively and through the JIT with random inputs and flags, and
+// report whether or not their states ever differ.
+static void StressSequenceWithInputs(const StressSequence &seq,
+                                     StressGenerator &gen,
+                                     StressTotals *totals) {
+  std::stringstream name_ss;
+  name_ss << "stress_" << std::hex << seq.address;
+  const auto name = name_ss.str();
+
+  for (uint64_t i = 0; i < FLAGS_stress_inputs; ++i) {
+    const uint64_t args[3] = {gen.Random(), gen.Random(), gen.Random()};
+    const test::TestInfo info = {
+        static_cast<uintptr_t>(seq.address),
+        static_cast<uintptr_t>(seq.address + seq.bytes.size()),
+        name.c_str(),
+        __FILE__,
+        &(args[0]),
+        &(args[3]),
+        3,
+        seq.ignored_flags_mask};
+
+    const auto random_flags = gen.Random();
+    Flags flags = gRflagsInitial;
+    flags.cf = random_flags & 1u;
+    flags.pf = (random_flags >> 1) & 1u;
+    flags.af = (random_flags >> 2) & 1u;
+    flags.zf = (random_flags >> 3) & 1u;
+    flags.sf = (random_flags >> 4) & 1u;
+    flags.of = (random_flags >> 5) & 1u;
+
+    std::stringstream desc;
+    desc << name << " with ARG1=0x" << std::hex << args[0] << " ARG2=0x"
+         << args[1] << " ARG3=0x" << args[2] << " and RFLAGS=0x"
+         << flags.flat;
+
+    // Intercept the failures of the state comparison, so that they are
+    // reported along with the sequence that caused them.
+    testing::TestPartResultArray failures;
+    auto ran = false;
+    const auto start = BenchmarkClock::now();
+    {
+      testing::ScopedFakeTestPartResultReporter reporter(
+          testing::ScopedFakeTestPartResultReporter::
+              INTERCEPT_ONLY_CURRENT_THREAD,
+          &failures);
+      ran = RunWithFlags(&info, flags, desc.str(), args[0], args[1], args[2]);
+    }
+    totals->run_ns += NanosecondsSince(start);
+
+    if (!ran) {
+      totals->num_unsupported += 1;
+      return;
+    }
+
+    totals->num_runs += 1;
+    if (failures.size()) {
+      totals->num_mismatches += 1;
+      printf("Mismatch in %s:\n%s", desc.str().c_str(),
+             seq.disassembly.c_str());
+      for (auto f = 0; f < failures.size(); ++f) {
+        printf("%s\n", failures.GetTestPartResult(f).message());
+      }
+      printf("\n");
+      return;
+    }
+  }
+}
+
+// Differentially test randomly generated instruction sequences, lifting them
+// in batches with the JIT, and report any mismatches along with the
+// throughput of generating, lifting, and running the sequences.
+static int RunStress(void) {
+  if (64 != ADDRESS_SIZE_BITS) {
+    LOG(ERROR) << "Stress testing is only supported for 64-bit code";
+    return EXIT_FAILURE;
+  }
+
+#  if HAS_FEATURE_AVX512
+  const auto arch_name = remill::kArchAMD64_AVX512;
+#  elif HAS_FEATURE_AVX
+  const auto arch_name = remill::kArchAMD64_AVX;
+#  else
+  const auto arch_name = remill::kArchAMD64;
+#  endif
+  const auto os_name = remill::GetOSName(REMILL_OS);
+
+  llvm::LLVMContext context;
+  auto arch = remill::Arch::Build(&context, os_name, arch_name);
+  auto semantics = remill::LoadArchSemantics(arch);
+  StressGenerator gen(arch.get(), semantics.get());
+
+  // Every sequence is followed by an absolute indirect jump back into the
+  // test harness, which doesn't clobber any registers or flags. Sequences
+  // are spaced apart so that the JIT doesn't lift one into another.
+  const uint8_t kJumpToSaveState[] = {0xFF, 0x25, 0, 0, 0, 0};
+  const auto save_state_after =
+      reinterpret_cast<uint64_t>(__x86_save_state_after);
+  const auto batch_size = std::max<uint64_t>(1, FLAGS_stress_batch_size);
+  const auto slot_size =
+      ((FLAGS_stress_sequence_length * test::kMaxInstrLen + 64) & ~63ull) +
+      64;
+  const auto code_size = batch_size * slot_size;
+  auto code = reinterpret_cast<uint8_t *>(
+      mmap(nullptr, code_size, PROT_READ | PROT_WRITE | PROT_EXEC,
+           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+  CHECK(MAP_FAILED != code) << "Unable to map memory for random sequences";
+
+  StressTotals totals;
+  std::vector<StressSequence> batch(batch_size);
+  for (uint64_t i = 0, batch_num = 0; i < FLAGS_stress_sequences;
+       ++batch_num) {
+    StressTraceManager manager;
+    remill::JIT jit(os_name, arch_name, manager);
+
+    // Like the lifted code of the tests, the lifted code of each sequence
+    // should return once it reaches the end of the sequence, rather than
+    // having the JIT lift whatever comes next.
+    const std::pair<const char *, LiftedFunc *> dispatchers[] = {
+        {"__remill_jump", __remill_jump},
+        {"__remill_function_call", __remill_function_call},
+        {"__remill_function_return", __remill_function_return},
+        {"__remill_missing_block", __remill_missing_block}};
+    for (const auto &dispatcher : dispatchers) {
+      jit.DefineSymbol(dispatcher.first,
+                       reinterpret_cast<void *>(dispatcher.second));
+    }
+
+    auto start = BenchmarkClock::now();
+    auto num_in_batch = 0u;
+    for (; num_in_batch < batch_size && i < FLAGS_stress_sequences;
+         ++num_in_batch, ++i) {
+      auto &seq = batch[num_in_batch];
+      const auto slot = &(code[num_in_batch * slot_size]);
+      gen.Generate(reinterpret_cast<uint64_t>(slot), &seq);
+      CHECK(0 < seq.num_insts) << "Unable to generate a random sequence";
+
+      memcpy(slot, seq.bytes.data(), seq.bytes.size());
+      memcpy(&(slot[seq.bytes.size()]), kJumpToSaveState,
+             sizeof(kJumpToSaveState));
+      memcpy(&(slot[seq.bytes.size() + sizeof(kJumpToSaveState)]),
+             &save_state_after, sizeof(save_state_after));
+
+      for (size_t b = 0; b < seq.bytes.size(); ++b) {
+        manager.memory[seq.address + b] = slot[b];
+      }
+
+      totals.num_sequences += 1;
+      totals.num_insts += seq.num_insts;
+    }
+    totals.generate_ns += NanosecondsSince(start);
+
+    start = BenchmarkClock::now();
+    for (auto s = 0u; s < num_in_batch; ++s) {
+      const auto &seq = batch[s];
+      auto lifted_func = jit.GetOrLiftTrace(seq.address);
+      CHECK(lifted_func != nullptr)
+          << "Unable to lift random sequence:\n" << seq.disassembly;
+      gTranslatedFuncs[seq.address] =
+          reinterpret_cast<LiftedFunc *>(lifted_func);
+    }
+    const auto lift_ns = NanosecondsSince(start);
+    totals.lift_ns += lift_ns;
+
+    start = BenchmarkClock::now();
+    for (auto s = 0u; s < num_in_batch; ++s) {
+      StressSequenceWithInputs(batch[s], gen, &totals);
+    }
+    const auto run_ns = NanosecondsSince(start);
+
+    // Lifting a batch should use roughly the same amount of memory as the
+    // batches before it, as each batch starts with a new JIT.
+    printf("batch %llu: %u sequences, lifted in %.1f ms, ran in %.1f ms, "
+           "%.1f MiB resident\n",
+           static_cast<unsigned long long>(batch_num), num_in_batch,
+           lift_ns / 1e6, run_ns / 1e6,
+           remill::GetResidentMemorySize() / (1024.0 * 1024.0));
+    gTranslatedFuncs.clear();
+  }
+
+  munmap(code, code_size);
+
+  const auto PerSecond = [](uint64_t count, double ns) {
+    return ns > 0 ? count * 1e9 / ns : 0.0;
+  };
+
+  printf("\n");
+  printf("sequences:  %llu (%llu instructions)\n",
+         static_cast<unsigned long long>(totals.num_sequences),
+         static_cast<unsigned long long>(totals.num_insts));
+  printf("generated:  %.1f instructions/s\n",
+         PerSecond(totals.num_insts, totals.generate_ns));
+  printf("lifted:     %.1f sequences/s, %.1f instructions/s\n",
+         PerSecond(totals.num_sequences, totals.lift_ns),
+         PerSecond(totals.num_insts, totals.lift_ns));
+  printf("ran:        %.1f runs/s (%llu runs, %llu unsupported)\n",
+         PerSecond(totals.num_runs, totals.run_ns),
+         static_cast<unsigned long long>(totals.num_runs),
+         static_cast<unsigned long long>(totals.num_unsupported));
+  printf("peak RSS:   %.1f MiB\n",
+         remill::GetPeakResidentMemorySize() / (1024.0 * 1024.0));
+  printf("mismatches: %llu\n",
+         static_cast<unsigned long long>(totals.num_mismatches));
+
+  return totals.num_mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+#else
+
+static int RunStress(void) {
+  LOG(ERROR) << "Stress testing requires remill's JIT, which needs LLVM 11 "
+             << "or newer";
+  return EXIT_FAILURE;
+}
+
+#endif  // LLVM_VERSION_NUMBER >= LLVM_VERSION(11, 0)
+
 int main(int argc, char **argv) {
   google::ParseCommandLineFlags(&argc, &argv, true);
   google::InitGoogleLogging(argv[0]);
@@ -1079,6 +1807,16 @@ int main(int argc, char **argv) {
     b = static_cast<uint8_t>(random());
   }
 
+  if (FLAGS_benchmark) {
+    SetupSignals();
+    return RunBenchmark();
+  }
+
+  if (FLAGS_stress) {
+    SetupSignals();
+    return RunStress();
+  }
+
   testing::InitGoogleTest(&argc, argv);
 
   SetupSignals();
@@ -27,6 +27,10 @@ struct alignas(128) TestInfo {
   const uintptr_t test_begin;
   const uintptr_t test_end;
   const char *test_name;
+
+  // Path of the file that defines the test. The name of its directory is the
+  // test's class of instructions, e.g. `X87`.
+  const char *test_file;
   const uint64_t *const args_begin;
   const uint64_t *const args_end;
   const uint64_t num_args;
@@ -0,0 +1,763 @@
+/*
+ * Copyright (c) 2020 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <remill/Arch/Arch.h>
+#include <remill/Arch/Instruction.h>
+#include <remill/Arch/Name.h>
+#include <remill/BC/IntrinsicTable.h>
+#include <remill/BC/Lifter.h>
+#include <remill/BC/Optimizer.h>
+#include <remill/BC/Util.h>
+#include <remill/BC/Version.h>
+#include <remill/OS/FileSystem.h>
+#include <remill/OS/OS.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+DECLARE_string(os);
+
+DEFINE_string(archs, "x86,amd64,amd64_avx,aarch64",
+              "Comma-separated list of the architectures to benchmark. Run "
+              "one architecture per process to get its own peak memory "
+              "usage.");
+
+DEFINE_string(corpus_dir, "",
+              "Path to a directory of test code corpora, with one file "
+              "named <arch>.txt for each architecture, as written by the "
+              "--corpus_out flag of the lift-<arch>-tests programs.");
+
+DEFINE_uint64(synthetic_traces, 256,
+              "Number of synthetic instruction streams to generate for each "
+              "architecture.");
+
+DEFINE_uint64(synthetic_trace_size, 64,
+              "Number of instructions in each synthetic instruction stream.");
+
+DEFINE_uint64(seed, 1,
+              "Seed of the random number generator used to generate the "
+              "synthetic instruction streams.");
+
+DEFINE_uint64(decode_iterations, 10,
+              "Number of times to decode each corpus when measuring the "
+              "decoder, which is much faster than the rest.");
+
+DEFINE_bool(csv, false, "Print the results as comma-separated values.");
+
+DEFINE_bool(isel_metrics, false,
+            "Instead of measuring throughput, lift an instruction for each "
+            "semantics function (ISEL), and report how many LLVM "
+            "instructions it is lifted into before and after optimization, "
+            "and how many memory intrinsics its optimized code calls.");
+
+DEFINE_uint64(isel_search_attempts, 1000000,
+              "Number of random candidate instructions to decode when "
+              "looking for instructions of the ISELs that the tests corpus "
+              "doesn't use.");
+
+DEFINE_string(isel_baseline, "",
+              "Path to the output of an earlier run with --isel_metrics "
+              "--csv. ISELs that regressed relative to it, or that it has "
+              "but that are no longer measured, are reported, and make the "
+              "exit status non-zero.");
+
+DEFINE_double(isel_regression_percent, 10,
+              "By how much, in percent, the optimized code of an ISEL can "
+              "grow relative to --isel_baseline before it is reported as a "
+              "regression. Any increase in memory intrinsic calls is a "
+              "regression.");
+
+namespace {
+
+// A run of code bytes, starting at `address`. Lifting starts at the first
+// byte of each region.
+struct Region {
+  uint64_t address;
+  std::string bytes;
+};
+
+// A named set of code regions.
+struct Corpus {
+  std::string name;
+  std::vector<Region> regions;
+};
+
+// What was measured for one corpus on one architecture.
+struct Result {
+  uint64_t decoded_insts{0};
+  double decode_seconds{0};
+  uint64_t lifted_insts{0};
+  double lift_seconds{0};
+  uint64_t num_traces{0};
+  double optimize_seconds{0};
+  uint64_t ir_insts{0};
+  uint64_t peak_memory{0};
+};
+
+using Clock = std::chrono::steady_clock;
+
+static double SecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Returns a fresh copy of `semantics` to lift into. The semantics of each
+// architecture are only loaded once, as loading them again into the same
+// context would rename their `State` structure, which would then not match the
+// one that the architecture was initialized with.
+static std::unique_ptr<llvm::Module>
+CopySemantics(const llvm::Module &semantics) {
+#if LLVM_VERSION_NUMBER < LLVM_VERSION(7, 0)
+  return llvm::CloneModule(&semantics);
+#else
+  return llvm::CloneModule(semantics);
+#endif
+}
+
+class BenchTraceManager : public remill::TraceManager {
+ public:
+  virtual ~BenchTraceManager(void) = default;
+
+  explicit BenchTraceManager(const Corpus &corpus) {
+    for (const auto &region : corpus.regions) {
+      regions[region.address] = &region;
+    }
+  }
+
+ protected:
+  void SetLiftedTraceDefinition(uint64_t addr,
+                                llvm::Function *lifted_func) override {
+    traces[addr] = lifted_func;
+  }
+
+  // Every lifted instruction has a block, so this counts them.
+  void SetLiftedTraceBlocks(
+      uint64_t, llvm::Function *,
+      const std::map<uint64_t, llvm::BasicBlock *> &blocks) override {
+    num_lifted_insts += blocks.size();
+  }
+
+  llvm::Function *GetLiftedTraceDeclaration(uint64_t addr) override {
+    auto trace_it = traces.find(addr);
+    if (trace_it != traces.end()) {
+      return trace_it->second;
+    } else {
+      return nullptr;
+    }
+  }
+
+  llvm::Function *GetLiftedTraceDefinition(uint64_t addr) override {
+    return GetLiftedTraceDeclaration(addr);
+  }
+
+  bool TryReadExecutableByte(uint64_t addr, uint8_t *byte) override {
+    auto region_it = regions.upper_bound(addr);
+    if (region_it == regions.begin()) {
+      return false;
+    }
+
+    const auto &region = *(--region_it)->second;
+    const auto offset = addr - region.address;
+    if (offset >= region.bytes.size()) {
+      return false;
+    }
+
+    *byte = static_cast<uint8_t>(region.bytes[offset]);
+    return true;
+  }
+
+ public:
+  std::map<uint64_t, const Region *> regions;
+  std::unordered_map<uint64_t, llvm::Function *> traces;
+  uint64_t num_lifted_insts{0};
+};
+
+// Load the test code corpus of `arch_name` from `--corpus_dir`, if there is
+// one. Each line of the corpus file contains the hexadecimal address of a
+// test, followed by its code bytes in hexadecimal, and then its name.
+static bool LoadTestCorpus(const std::string &arch_name, Corpus *corpus) {
+  corpus->name = "tests";
+  if (FLAGS_corpus_dir.empty()) {
+    return false;
+  }
+
+  const auto path =
+      FLAGS_corpus_dir + remill::PathSeparator() + arch_name + ".txt";
+  if (!remill::FileExists(path)) {
+    return false;
+  }
+
+  std::ifstream file(path);
+  std::string line;
+  for (auto line_num = 1; std::getline(file, line); ++line_num) {
+    std::istringstream ss(line);
+    Region region;
+    std::string hex;
+    if (!(ss >> std::hex >> region.address >> hex) || hex.size() % 2) {
+      LOG(FATAL) << "Invalid corpus entry on line " << line_num << " of "
+                 << path;
+    }
+
+    for (size_t i = 0; i < hex.size(); i += 2) {
+      region.bytes.push_back(
+          static_cast<char>(std::stoul(hex.substr(i, 2), nullptr, 16)));
+    }
+    corpus->regions.push_back(std::move(region));
+  }
+
+  return !corpus->regions.empty();
+}
+
+// Generate straight-line streams of random instructions that have semantics.
+// Control flow is left out so that each stream is lifted into exactly one
+// trace. The streams only depend on `--seed` and the architecture.
+static void MakeSyntheticCorpus(const remill::Arch *arch,
+                                llvm::Module *semantics, Corpus *corpus) {
+  corpus->name = "synthetic";
+
+  std::mt19937_64 gen(FLAGS_seed ^ static_cast<uint64_t>(arch->arch_name));
+  const auto max_inst_size = arch->MaxInstructionSize();
+  const auto max_attempts = 1000 * FLAGS_synthetic_trace_size;
+
+  uint64_t address = 0x10000;
+  remill::Instruction inst;
+  std::string candidate;
+  std::unordered_map<std::string, bool> has_semantics;
+
+  for (uint64_t i = 0; i < FLAGS_synthetic_traces; ++i) {
+    Region region;
+    region.address = address;
+
+    uint64_t num_insts = 0;
+    for (uint64_t attempt = 0;
+         num_insts < FLAGS_synthetic_trace_size && attempt < max_attempts;
+         ++attempt) {
+      candidate.clear();
+      for (uint64_t b = 0; b < max_inst_size; ++b) {
+        candidate.push_back(static_cast<char>(gen() & 0xFFu));
+      }
+
+      inst.Reset();
+      const auto pc = region.address + region.bytes.size();
+      if (!arch->DecodeInstruction(pc, candidate, inst) || !inst.IsValid() ||
+          inst.IsError() || inst.IsControlFlow() || !inst.NumBytes()) {
+        continue;
+      }
+
+      auto sem_it = has_semantics.find(inst.function);
+      if (sem_it == has_semantics.end()) {
+        auto isel =
+            remill::FindGlobaVariable(semantics, "ISEL_" + inst.function);
+        sem_it = has_semantics.emplace(inst.function, !!isel).first;
+      }
+
+      if (sem_it->second) {
+        region.bytes.append(inst.bytes);
+        ++num_insts;
+      }
+    }
+
+    // Leave a gap of unmapped memory after each stream, so that lifting
+    // stops there.
+    address = ((address + region.bytes.size()) & ~0xFFull) + 0x200;
+    corpus->regions.push_back(std::move(region));
+  }
+}
+
+// Measure decoding, lifting, and optimizing `corpus`.
+static Result Benchmark(const remill::Arch *arch,
+                        const llvm::Module &semantics, const Corpus &corpus) {
+  Result result;
+
+  // Decoding is measured on its own by sweeping linearly through each region.
+  // Bytes that don't decode are skipped one at a time.
+  const auto max_inst_size = arch->MaxInstructionSize();
+  remill::Instruction inst;
+  auto start = Clock::now();
+  for (uint64_t i = 0; i < FLAGS_decode_iterations; ++i) {
+    for (const auto &region : corpus.regions) {
+      for (size_t offset = 0; offset < region.bytes.size();) {
+        inst.Reset();
+        std::string_view bytes(region.bytes);
+        bytes = bytes.substr(offset, max_inst_size);
+        if (arch->DecodeInstruction(region.address + offset, bytes, inst) &&
+            inst.NumBytes()) {
+          offset += inst.NumBytes();
+          ++result.decoded_insts;
+        } else {
+          offset += 1;
+        }
+      }
+    }
+  }
+  result.decode_seconds = SecondsSince(start);
+
+  // Lifting and optimizing use a fresh copy of the semantics, so that one
+  // corpus doesn't affect the next. Copying it isn't measured.
+  auto module = CopySemantics(semantics);
+  remill::IntrinsicTable intrinsics(module.get());
+  remill::InstructionLifter inst_lifter(arch, intrinsics);
+  BenchTraceManager manager(corpus);
+  remill::TraceLifter trace_lifter(inst_lifter, manager);
+
+  start = Clock::now();
+  for (const auto &region : corpus.regions) {
+    if (!trace_lifter.Lift(region.address)) {
+      LOG(ERROR) << "Could not lift trace at address " << std::hex
+                 << region.address << std::dec;
+    }
+  }
+  result.lift_seconds = SecondsSince(start);
+  result.lifted_insts = manager.num_lifted_insts;
+  result.num_traces = manager.traces.size();
+
+  // Optimize the same way as `remill-lift`.
+  remill::OptimizationGuide guide = {};
+  guide.eliminate_dead_stores = true;
+  start = Clock::now();
+  remill::OptimizeModule(arch, module.get(), manager.traces, guide);
+  result.optimize_seconds = SecondsSince(start);
+
+  for (const auto &lifted_entry : manager.traces) {
+    for (const auto &block : *lifted_entry.second) {
+      result.ir_insts += block.size();
+    }
+  }
+
+  result.peak_memory = remill::GetPeakResidentMemorySize();
+  return result;
+}
+
+static void PrintHeader(void) {
+  if (FLAGS_csv) {
+    std::cout << "arch,corpus,traces,guest_insts,decode_insts_per_sec,"
+              << "lift_insts_per_sec,optimize_ms_per_trace,"
+              << "ir_insts_per_guest_inst,peak_rss_mib" << std::endl;
+  } else {
+    printf("%-10s %-10s %7s %9s %12s %12s %10s %9s %9s\n", "arch", "corpus",
+           "traces", "insts", "decode/s", "lift/s", "opt ms/tr", "ir/inst",
+           "rss MiB");
+  }
+}
+
+static void PrintResult(const std::string &arch_name,
+                        const std::string &corpus_name,
+                        const Result &result) {
+  auto per = [](double num, double denom) {
+    return denom ? num / denom : 0.0;
+  };
+
+  const auto decode_rate = per(result.decoded_insts, result.decode_seconds);
+  const auto lift_rate = per(result.lifted_insts, result.lift_seconds);
+  const auto optimize_ms =
+      per(result.optimize_seconds * 1000.0, result.num_traces);
+  const auto ir_ratio = per(result.ir_insts, result.lifted_insts);
+  const auto peak_mib = result.peak_memory / double(1u << 20u);
+
+  if (FLAGS_csv) {
+    std::cout << arch_name << ',' << corpus_name << ',' << result.num_traces
+              << ',' << result.lifted_insts << ',' << decode_rate << ','
+              << lift_rate << ',' << optimize_ms << ',' << ir_ratio << ','
+              << peak_mib << std::endl;
+  } else {
+    printf("%-10s %-10s %7llu %9llu %12.0f %12.0f %10.3f %9.2f %9.1f\n",
+           arch_name.c_str(), corpus_name.c_str(),
+           static_cast<unsigned long long>(result.num_traces),
+           static_cast<unsigned long long>(result.lifted_insts), decode_rate,
+           lift_rate, optimize_ms, ir_ratio, peak_mib);
+    fflush(stdout);
+  }
+}
+
+// The size of the lifted code of one representative instruction of a
+// semantics function (ISEL), before and after optimization.
+struct IselResult {
+  std::string bytes;
+  uint64_t ir_insts_before{0};
+  uint64_t ir_insts_after{0};
+  uint64_t memory_intrinsics{0};
+};
+
+// Results indexed by the name of the ISEL, without its `ISEL_` prefix.
+using IselResults = std::map<std::string, IselResult>;
+
+static std::string HexBytes(const std::string &bytes) {
+  std::stringstream ss;
+  ss << std::hex << std::setfill('0');
+  for (auto byte : bytes) {
+    ss << std::setw(2) << static_cast<unsigned>(static_cast<uint8_t>(byte));
+  }
+  return ss.str();
+}
+
+// Find one instruction that is lifted with each ISEL in `semantics`. The
+// instructions of the `tests` corpus are preferred, as they are what the
+// semantics were written for. ISELs that the tests don't use are searched for
+// among random candidate instructions. Each representative is put in a region
+// of its own, and `isel_of_region` names the ISEL of each region.
+static void FindIselRepresentatives(
+    const remill::Arch *arch, llvm::Module *semantics,
+    const Corpus &tests, Corpus *representatives,
+    std::map<uint64_t, std::string> *isel_of_region) {
+  representatives->name = "isels";
+
+  std::set<std::string> uncovered;
+  remill::ForEachISel(semantics, [&](llvm::GlobalVariable *isel,
+                                     llvm::Function *) {
+    const auto name = isel->getName().str();
+    if (!name.compare(0, 5, "ISEL_")) {
+      uncovered.insert(name.substr(5));
+    }
+  });
+
+  const auto max_inst_size = arch->MaxInstructionSize();
+  uint64_t address = 0x10000;
+  remill::Instruction inst;
+
+  auto try_bytes = [&](uint64_t pc, std::string_view bytes) -> size_t {
+    inst.Reset();
+    if (!arch->DecodeInstruction(pc, bytes, inst) || !inst.IsValid() ||
+        inst.IsError() || !inst.NumBytes()) {
+      return 0;
+    }
+
+    auto isel_it = uncovered.find(inst.function);
+    if (isel_it != uncovered.end()) {
+      Region region;
+      region.address = address;
+      region.bytes = inst.bytes;
+      (*isel_of_region)[address] = inst.function;
+      representatives->regions.push_back(std::move(region));
+      uncovered.erase(isel_it);
+
+      // Leave a gap of unmapped memory after each instruction, so that
+      // lifting stops there.
+      address += 0x100;
+    }
+    return inst.NumBytes();
+  };
+
+  for (const auto &region : tests.regions) {
+    for (size_t offset = 0; offset < region.bytes.size();) {
+      std::string_view bytes(region.bytes);
+      bytes = bytes.substr(offset, max_inst_size);
+      offset += std::max<size_t>(1, try_bytes(region.address + offset, bytes));
+    }
+  }
+
+  std::mt19937_64 gen(FLAGS_seed ^ static_cast<uint64_t>(arch->arch_name));
+  std::string candidate;
+  for (uint64_t i = 0; i < FLAGS_isel_search_attempts && !uncovered.empty();
+       ++i) {
+    candidate.clear();
+    for (uint64_t b = 0; b < max_inst_size; ++b) {
+      candidate.push_back(static_cast<char>(gen() & 0xFFu));
+    }
+    try_bytes(address, candidate);
+  }
+
+  for (const auto &name : uncovered) {
+    LOG(INFO) << "No representative instruction found for ISEL_" << name;
+  }
+  LOG_IF(WARNING, !uncovered.empty())
+      << "No representative instructions were found for " << uncovered.size()
+      << " ISELs of " << remill::GetArchName(arch->arch_name);
+}
+
+// Memory intrinsics are what accesses to guest memory are lifted into.
+static bool IsMemoryIntrinsic(llvm::Function *func) {
+  if (!func) {
+    return false;
+  }
+  const auto name = func->getName();
+  return name.startswith("__remill_read_memory_") ||
+         name.startswith("__remill_write_memory_") ||
+         name.startswith("__remill_compare_exchange_memory_") ||
+         name.startswith("__remill_fetch_and_");
+}
+
+static uint64_t CountInstructions(llvm::Function *func) {
+  uint64_t num_insts = 0;
+  for (const auto &block : *func) {
+    num_insts += block.size();
+  }
+  return num_insts;
+}
+
+// Lift each of the `representatives` into a copy of `semantics`, and measure
+// its code before and after optimizing it the same way as `remill-lift`.
+static IselResults
+MeasureIsels(const remill::Arch *arch, const llvm::Module &semantics,
+             const Corpus &representatives,
+             const std::map<uint64_t, std::string> &isel_of_region) {
+  auto module = CopySemantics(semantics);
+  remill::IntrinsicTable intrinsics(module.get());
+  remill::InstructionLifter inst_lifter(arch, intrinsics);
+  BenchTraceManager manager(representatives);
+  remill::TraceLifter trace_lifter(inst_lifter, manager);
+
+  IselResults results;
+  std::map<uint64_t, llvm::Function *> traces;
+  for (const auto &region : representatives.regions) {
+    const auto &name = isel_of_region.at(region.address);
+    if (!trace_lifter.Lift(region.address)) {
+      LOG(ERROR) << "Could not lift representative of ISEL_" << name;
+      continue;
+    }
+
+    auto &result = results[name];
+    auto trace = manager.traces.at(region.address);
+    result.bytes = HexBytes(region.bytes);
+    result.ir_insts_before = CountInstructions(trace);
+    traces[region.address] = trace;
+  }
+
+  remill::OptimizationGuide guide = {};
+  guide.eliminate_dead_stores = true;
+  remill::OptimizeModule(arch, module.get(), traces, guide);
+
+  for (const auto &trace_entry : traces) {
+    auto &result = results[isel_of_region.at(trace_entry.first)];
+    result.ir_insts_after = CountInstructions(trace_entry.second);
+    for (auto &block : *trace_entry.second) {
+      for (auto &inst : block) {
+        if (auto call = llvm::dyn_cast<llvm::CallInst>(&inst)) {
+          if (IsMemoryIntrinsic(call->getCalledFunction())) {
+            result.memory_intrinsics += 1;
+          }
+        }
+      }
+    }
+  }
+
+  return results;
+}
+
+// Load the results of an earlier run of `--isel_metrics --csv`, indexed by
+// architecture.
+static std::map<std::string, IselResults> LoadIselBaseline(void) {
+  std::map<std::string, IselResults> baseline;
+  if (FLAGS_isel_baseline.empty()) {
+    return baseline;
+  }
+
+  std::ifstream file(FLAGS_isel_baseline);
+  CHECK(file) << "Unable to open ISEL baseline " << FLAGS_isel_baseline;
+
+  std::string line;
+  std::getline(file, line);  // Header.
+  for (auto line_num = 2; std::getline(file, line); ++line_num) {
+    std::vector<std::string> fields;
+    std::stringstream ss(line);
+    for (std::string field; std::getline(ss, field, ',');) {
+      fields.push_back(field);
+    }
+    CHECK_EQ(fields.size(), 6u)
+        << "Invalid ISEL baseline entry on line " << line_num << " of "
+        << FLAGS_isel_baseline;
+
+    auto &result = baseline[fields[0]][fields[1]];
+    result.bytes = fields[2];
+    result.ir_insts_before = std::stoull(fields[3]);
+    result.ir_insts_after = std::stoull(fields[4]);
+    result.memory_intrinsics = std::stoull(fields[5]);
+  }
+  return baseline;
+}
+
+// Returns `true` if the optimized code of `result` is too much bigger than
+// that of `baseline`, or calls more memory intrinsics.
+static bool IsRegression(const IselResult &result,
+                         const IselResult &baseline) {
+  const auto max_ir_insts = baseline.ir_insts_after *
+                            (1.0 + FLAGS_isel_regression_percent / 100.0);
+  return result.ir_insts_after > max_ir_insts ||
+         result.memory_intrinsics > baseline.memory_intrinsics;
+}
+
+static void PrintIselHeader(void) {
+  if (FLAGS_csv) {
+    std::cout << "arch,isel,bytes,ir_insts_before,ir_insts_after,"
+              << "memory_intrinsics" << std::endl;
+  } else {
+    printf("%-10s %-48s %8s %8s %8s %10s\n", "arch", "isel", "ir", "opt ir",
+           "mem ops", "baseline");
+  }
+}
+
+// Print the results of `arch_name`, and return how many ISELs regressed
+// relative to `baseline`. ISELs in `baseline` that are missing from `results`
+// are regressions too, as they were either removed or lost their
+// representatives, and so are no longer measured.
+static unsigned PrintIselResults(const std::string &arch_name,
+                                 const IselResults &results,
+                                 const IselResults &baseline) {
+  auto num_regressions = 0u;
+  for (const auto &entry : results) {
+    const auto &result = entry.second;
+    auto baseline_it = baseline.find(entry.first);
+    const auto regressed = baseline_it != baseline.end() &&
+                           IsRegression(result, baseline_it->second);
+    num_regressions += regressed;
+
+    if (FLAGS_csv) {
+      std::cout << arch_name << ',' << entry.first << ',' << result.bytes
+                << ',' << result.ir_insts_before << ','
+                << result.ir_insts_after << ',' << result.memory_intrinsics
+                << std::endl;
+    } else {
+      std::string baseline_desc = "-";
+      if (baseline_it != baseline.end()) {
+        baseline_desc = std::to_string(baseline_it->second.ir_insts_after) +
+                        "/" +
+                        std::to_string(baseline_it->second.memory_intrinsics);
+      }
+      printf("%-10s %-48s %8llu %8llu %8llu %10s%s\n", arch_name.c_str(),
+             entry.first.c_str(),
+             static_cast<unsigned long long>(result.ir_insts_before),
+             static_cast<unsigned long long>(result.ir_insts_after),
+             static_cast<unsigned long long>(result.memory_intrinsics),
+             baseline_desc.c_str(), regressed ? "  REGRESSED" : "");
+    }
+
+    if (regressed) {
+      LOG(ERROR) << "ISEL_" << entry.first << " of " << arch_name
+                 << " regressed: " << result.ir_insts_after
+                 << " optimized instructions and " << result.memory_intrinsics
+                 << " memory intrinsics, up from "
+                 << baseline_it->second.ir_insts_after << " and "
+                 << baseline_it->second.memory_intrinsics;
+    }
+  }
+
+  for (const auto &entry : baseline) {
+    if (results.count(entry.first)) {
+      continue;
+    }
+
+    ++num_regressions;
+    if (!FLAGS_csv) {
+      const auto baseline_desc =
+          std::to_string(entry.second.ir_insts_after) + "/" +
+          std::to_string(entry.second.memory_intrinsics);
+      printf("%-10s %-48s %8s %8s %8s %10s  MISSING\n", arch_name.c_str(),
+             entry.first.c_str(), "-", "-", "-", baseline_desc.c_str());
+    }
+    LOG(ERROR) << "ISEL_" << entry.first << " of " << arch_name
+               << " is in the baseline, but was not measured";
+  }
+
+  fflush(stdout);
+  return num_regressions;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  std::vector<std::string> arch_names;
+  std::stringstream archs(FLAGS_archs);
+  for (std::string arch_name; std::getline(archs, arch_name, ',');) {
+    if (remill::kArchInvalid == remill::GetArchName(arch_name)) {
+      std::cerr << "Invalid architecture '" << arch_name
+                << "' passed to --archs" << std::endl;
+      return EXIT_FAILURE;
+    }
+    arch_names.push_back(arch_name);
+  }
+
+  if (FLAGS_isel_metrics) {
+    const auto baseline = LoadIselBaseline();
+    auto num_regressions = 0u;
+    PrintIselHeader();
+    for (const auto &arch_name : arch_names) {
+      llvm::LLVMContext context;
+      auto arch = remill::Arch::Build(&context, remill::GetOSName(FLAGS_os),
+                                      remill::GetArchName(arch_name));
+      CHECK(arch) << "Could not build architecture " << arch_name;
+
+      Corpus tests, representatives;
+      std::map<uint64_t, std::string> isel_of_region;
+      LoadTestCorpus(arch_name, &tests);
+      const auto semantics = remill::LoadArchSemantics(arch.get());
+      FindIselRepresentatives(arch.get(), semantics.get(), tests,
+                              &representatives, &isel_of_region);
+
+      const auto baseline_it = baseline.find(arch_name);
+      num_regressions += PrintIselResults(
+          arch_name,
+          MeasureIsels(arch.get(), *semantics, representatives,
+                       isel_of_region),
+          baseline_it != baseline.end() ? baseline_it->second
+                                        : IselResults());
+    }
+
+    if (num_regressions) {
+      std::cerr << num_regressions << " ISELs regressed relative to "
+                << FLAGS_isel_baseline << std::endl;
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+
+  PrintHeader();
+  for (const auto &arch_name : arch_names) {
+    llvm::LLVMContext context;
+    auto arch = remill::Arch::Build(&context, remill::GetOSName(FLAGS_os),
+                                    remill::GetArchName(arch_name));
+    CHECK(arch) << "Could not build architecture " << arch_name;
+
+    std::vector<Corpus> corpora(1);
+    if (LoadTestCorpus(arch_name, &(corpora.back()))) {
+      corpora.emplace_back();
+    }
+
+    const auto semantics = remill::LoadArchSemantics(arch.get());
+    MakeSyntheticCorpus(arch.get(), semantics.get(), &(corpora.back()));
+
+    for (const auto &corpus : corpora) {
+      PrintResult(arch_name, corpus.name,
+                  Benchmark(arch.get(), *semantics, corpus));
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -16,104 +16,532 @@
 
 #include <gflags/gflags.h>
 #include <glog/logging.h>
+#include <llvm/IR/Constants.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/GlobalValue.h>
+#include <llvm/IR/GlobalVariable.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/Instructions.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Type.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/Object/Binary.h>
+#include <llvm/Object/ObjectFile.h>
 #include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
 #include <llvm/Support/raw_ostream.h>
+#include <llvm/Transforms/Utils/Cloning.h>
 #include <remill/Arch/Arch.h>
 #include <remill/Arch/Instruction.h>
 #include <remill/Arch/Name.h>
 #include <remill/BC/ABI.h>
+#include <remill/BC/Compat/BitcodeReaderWriter.h>
+#include <remill/BC/Compat/Error.h>
+#include <remill/BC/ExecutionCounters.h>
 #include <remill/BC/IntrinsicTable.h>
 #include <remill/BC/Lifter.h>
+#include <remill/BC/LowerAtomics.h>
+#include <remill/BC/LowerMemory.h>
+#include <remill/BC/ModuleSaver.h>
 #include <remill/BC/Optimizer.h>
+#include <remill/BC/TraceWriter.h>
 #include <remill/BC/Util.h>
+#include <remill/BC/Version.h>
 #include <remill/OS/OS.h>
 #include <remill/Version/Version.h>
 
+#ifdef __GLIBC__
+#  include <malloc.h>
+#endif
+
+#ifndef _WIN32
+#  include <sys/socket.h>
+#  include <sys/un.h>
+#  include <unistd.h>
+
+#  include <cerrno>
+#  include <csignal>
+#  include <cstring>
+#endif
+
 #include <algorithm>
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <fstream>
 #include <functional>
 #include <iostream>
+#include <iterator>
 #include <map>
 #include <memory>
 #include <sstream>
 #include <string>
 #include <system_error>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+DECLARE_string(arch);
+DECLARE_string(os);
 
 DEFINE_uint64(address, 0,
               "Address at which we should assume the bytes are"
-              "located in virtual memory.");
+              "located in virtual memory. For --binary, this is added to the "
+              "address of each section.");
 
 DEFINE_uint64(entry_address, 0,
               "Address of instruction that should be "
               "considered the entrypoint of this code. "
               "Defaults to the value of --address.");
 
+DEFINE_string(entry_addresses, "",
+              "Comma-separated list of additional entrypoint addresses. "
+              "All entrypoints are lifted into the same module.");
+
+DEFINE_string(entry_address_file, "",
+              "Path to a file containing additional entrypoint addresses, "
+              "one per line.");
+
 DEFINE_string(bytes, "", "Hex-encoded byte string to lift.");
 
+DEFINE_string(raw_file, "",
+              "Path to a file containing raw bytes to lift. The file is "
+              "mapped into memory starting at --address.");
+
+DEFINE_string(binary, "",
+              "Path to an executable or object file (e.g. ELF, Mach-O, PE) "
+              "whose code sections should be lifted. Each section is mapped "
+              "at its own address, plus --address.");
+
 DEFINE_string(ir_out, "", "Path to file where the LLVM IR should be saved.");
 DEFINE_string(bc_out, "",
               "Path to file where the LLVM bitcode should be "
               "saved.");
 
+DEFINE_bool(zstd, false,
+            "Compress the saved LLVM bitcode with zstd. This applies to "
+            "--bc_out, and to the files in --trace_out_dir, which are then "
+            "named *.bc.zst.");
+
+DEFINE_string(trace_out_dir, "",
+              "Path to a directory into which the lifted traces should be "
+              "saved as they are optimized, in bitcode files of "
+              "--traces_per_file traces each, instead of into one module. "
+              "The directory also gets an index of the traces, index.txt "
+              "(see `remill::TraceWriter`).");
+
+DEFINE_uint64(traces_per_file, 1,
+              "Number of traces to save into each file with --trace_out_dir. "
+              "Traces are optimized and saved once at least this many are "
+              "waiting, so larger batches amortize the cost of running the "
+              "optimizer.");
+
 DEFINE_string(slice_inputs, "",
               "Comma-separated list of registers to treat as inputs.");
 DEFINE_string(slice_outputs, "",
               "Comma-separated list of registers to treat as outputs.");
 
-using Memory = std::map<uint64_t, uint8_t>;
+DEFINE_bool(native_atomics, false,
+            "Lift atomic read-modify-write instructions into single calls "
+            "to the atomic memory intrinsics where possible, instead of "
+            "wrapping them in calls to `__remill_atomic_begin` and "
+            "`__remill_atomic_end`.");
+
+DEFINE_bool(flat_memory, false,
+            "Lower the memory access intrinsics into direct loads and stores "
+            "of the host address space, treating guest addresses as host "
+            "addresses. If `--native_atomics` is also given, then the "
+            "atomic memory intrinsics are lowered into LLVM atomics.");
+
+DEFINE_bool(count_executions, false,
+            "Instrument the lifted code with counters of how many times each "
+            "trace and basic block executes. The counters, and a table "
+            "mapping them back to program counters, are defined in the "
+            "output module (see `remill::ExecutionCounters`).");
+
+DEFINE_string(branch_profile, "",
+              "Path to a file containing a profile of conditional branches, "
+              "used to add branch weights to the lifted code. Each line of "
+              "the file contains the hexadecimal address of a branch, "
+              "followed by the number of times it was taken, and the number "
+              "of times it was not taken.");
+
+DEFINE_bool(server, false,
+            "Run as a server that reads lift requests from stdin, and writes "
+            "the lifted code of each to stdout. The semantics are only "
+            "loaded once, and are shared by all requests.");
+
+DEFINE_string(server_socket, "",
+              "Path to a Unix domain socket on which to serve lift requests, "
+              "instead of stdin and stdout.");
+
+DEFINE_uint64(max_memory_mb, 0,
+              "In server mode, reload the semantics into a fresh LLVM context "
+              "before a request once the process is using more than this "
+              "many megabytes of memory. Zero means no limit.");
+
+DEFINE_uint64(max_requests_per_context, 0,
+              "In server mode, reload the semantics into a fresh LLVM context "
+              "after this many requests. Zero means no limit.");
+
+using BranchProfile =
+    std::unordered_map<uint64_t, std::pair<uint64_t, uint64_t>>;
+
+// The executable memory of the code being lifted. This is a set of
+// non-overlapping regions, whose bytes are either owned by the region, or
+// belong to a memory-mapped file, so that large inputs aren't copied.
+//
+// Each of the `Add*` methods returns `false`, and describes the problem in
+// `error`, if the bytes can't be mapped.
+class Memory {
+ public:
+  // Map `size` bytes at `data` into memory starting at `base`. The bytes
+  // must outlive this memory.
+  bool AddRegion(uint64_t base, const uint8_t *data, uint64_t size,
+                 uint64_t addr_mask, const std::string &source,
+                 std::string *error);
+
+  // Map `bytes` into memory starting at `base`.
+  bool AddBytes(uint64_t base, std::vector<uint8_t> bytes, uint64_t addr_mask,
+                const std::string &source, std::string *error);
+
+  // Map the contents of the file at `path` into memory starting at `base`.
+  bool AddRawFile(uint64_t base, const std::string &path, uint64_t addr_mask,
+                  std::string *error);
+
+  // Map the code sections of the executable or object file at `path` into
+  // memory, each at its address plus `bias`.
+  bool AddBinary(uint64_t bias, const std::string &path, uint64_t addr_mask,
+                 std::string *error);
+
+  bool TryReadByte(uint64_t addr, uint8_t *byte) const;
+
+ private:
+  struct Region {
+    const uint8_t *data;
+    uint64_t size;
+  };
+
+  // Regions, by their base address.
+  std::map<uint64_t, Region> regions;
+
+  // Storage for the bytes of the regions.
+  std::vector<std::vector<uint8_t>> owned_bytes;
+  std::vector<std::unique_ptr<llvm::MemoryBuffer>> files;
+  std::vector<llvm::object::OwningBinary<llvm::object::ObjectFile>> binaries;
+};
 
-// Unhexlify the data passed to `--bytes`, and fill in `memory` with each
-// such byte.
-static Memory UnhexlifyInputBytes(uint64_t addr_mask) {
-  Memory memory;
+bool Memory::AddRegion(uint64_t base, const uint8_t *data, uint64_t size,
+                       uint64_t addr_mask, const std::string &source,
+                       std::string *error) {
+  if (!size) {
+    return true;
+  }
+
+  // Make sure that a region near the top of the address space doesn't wrap
+  // around and start filling out low byte addresses.
+  const auto last_addr = base + (size - 1);
+  if (last_addr < base || last_addr != (last_addr & addr_mask)) {
+    std::stringstream ss;
+    ss << "Bytes of " << source << " mapped at address " << std::hex << base
+       << " do not fit in the address space. Did you mean to specify a "
+       << "64-bit architecture to --arch?";
+    *error = ss.str();
+    return false;
+  }
+
+  auto next_it = regions.upper_bound(base);
+  auto overlaps = next_it != regions.end() && next_it->first <= last_addr;
+  if (next_it != regions.begin()) {
+    auto prev_it = std::prev(next_it);
+    overlaps = overlaps || (base - prev_it->first) < prev_it->second.size;
+  }
+
+  if (overlaps) {
+    std::stringstream ss;
+    ss << "Bytes of " << source << " mapped at address " << std::hex << base
+       << " overlap with other bytes to lift";
+    *error = ss.str();
+    return false;
+  }
 
-  for (size_t i = 0; i < FLAGS_bytes.size(); i += 2) {
-    char nibbles[] = {FLAGS_bytes[i], FLAGS_bytes[i + 1], '\0'};
+  regions[base] = {data, size};
+  return true;
+}
+
+bool Memory::AddBytes(uint64_t base, std::vector<uint8_t> bytes,
+                      uint64_t addr_mask, const std::string &source,
+                      std::string *error) {
+  owned_bytes.push_back(std::move(bytes));
+  const auto &data = owned_bytes.back();
+  return AddRegion(base, data.data(), data.size(), addr_mask, source, error);
+}
+
+bool Memory::AddRawFile(uint64_t base, const std::string &path,
+                        uint64_t addr_mask, std::string *error) {
+  // Large files are mapped into memory, rather than read.
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(13, 0)
+  auto maybe_buf = llvm::MemoryBuffer::getFile(
+      path, false /* IsText */, false /* RequiresNullTerminator */);
+#else
+  auto maybe_buf =
+      llvm::MemoryBuffer::getFile(path, -1, false /* RequiresNullTerminator */);
+#endif
+  if (remill::IsError(maybe_buf)) {
+    *error = "Unable to open raw file " + path + ": " +
+             remill::GetErrorString(maybe_buf);
+    return false;
+  }
+
+  files.push_back(std::move(*maybe_buf));
+  const auto &buf = files.back();
+  return AddRegion(base,
+                   reinterpret_cast<const uint8_t *>(buf->getBufferStart()),
+                   buf->getBufferSize(), addr_mask, path, error);
+}
+
+bool Memory::AddBinary(uint64_t bias, const std::string &path,
+                       uint64_t addr_mask, std::string *error) {
+  auto maybe_binary = llvm::object::ObjectFile::createObjectFile(path);
+  if (remill::IsError(maybe_binary)) {
+    *error = "Unable to open binary " + path + ": " +
+             remill::GetErrorString(maybe_binary);
+    return false;
+  }
+
+  binaries.push_back(std::move(*maybe_binary));
+  auto num_code_sections = 0u;
+  for (const auto &section : binaries.back().getBinary()->sections()) {
+    if (!section.isText() || section.isVirtual()) {
+      continue;
+    }
+
+    std::string name = "section";
+    auto maybe_name = section.getName();
+    if (!remill::IsError(maybe_name)) {
+      name = maybe_name->str();
+    }
+
+#if LLVM_VERSION_NUMBER >= LLVM_VERSION(9, 0)
+    auto maybe_contents = section.getContents();
+    if (remill::IsError(maybe_contents)) {
+      *error = "Unable to read " + name + " of binary " + path + ": " +
+               remill::GetErrorString(maybe_contents);
+      return false;
+    }
+    const auto contents = *maybe_contents;
+#else
+    llvm::StringRef contents;
+    if (auto ec = section.getContents(contents)) {
+      *error = "Unable to read " + name + " of binary " + path + ": " +
+               ec.message();
+      return false;
+    }
+#endif
+
+    if (!AddRegion(section.getAddress() + bias,
+                   reinterpret_cast<const uint8_t *>(contents.data()),
+                   contents.size(), addr_mask, name + " of " + path, error)) {
+      return false;
+    }
+    ++num_code_sections;
+  }
+
+  if (!num_code_sections) {
+    *error = "Binary " + path + " has no code sections to lift";
+    return false;
+  }
+
+  return true;
+}
+
+bool Memory::TryReadByte(uint64_t addr, uint8_t *byte) const {
+  auto region_it = regions.upper_bound(addr);
+  if (region_it == regions.begin()) {
+    return false;
+  }
+
+  --region_it;
+  const auto offset = addr - region_it->first;
+  if (offset >= region_it->second.size) {
+    return false;
+  }
+
+  *byte = region_it->second.data[offset];
+  return true;
+}
+
+// What to lift, and how to shape the lifted module. In one-shot mode, this
+// comes from the command-line flags of the same names, and in server mode,
+// from each request.
+struct LiftRequest {
+  uint64_t address = 0;
+  uint64_t entry_address = 0;
+  std::string entry_addresses;
+  std::string entry_address_file;
+  std::string bytes;
+  std::string raw_file;
+  std::string binary;
+  std::string slice_inputs;
+  std::string slice_outputs;
+
+  // Only used in server mode. Should the response be LLVM IR, rather than
+  // bitcode?
+  bool emit_ir = false;
+};
+
+// Unhexlify the data passed to `--bytes`.
+static bool UnhexlifyInputBytes(const std::string &hex,
+                                std::vector<uint8_t> *bytes,
+                                std::string *error) {
+  if (hex.size() % 2) {
+    *error = "Please specify an even number of nibbles to --bytes.";
+    return false;
+  }
+
+  bytes->reserve(hex.size() / 2);
+  for (size_t i = 0; i < hex.size(); i += 2) {
+    char nibbles[] = {hex[i], hex[i + 1], '\0'};
     char *parsed_to = nullptr;
     auto byte_val = strtol(nibbles, &parsed_to, 16);
 
     if (parsed_to != &(nibbles[2])) {
-      std::cerr << "Invalid hex byte value '" << nibbles
-                << "' specified in --bytes." << std::endl;
-      exit(EXIT_FAILURE);
+      *error = std::string("Invalid hex byte value '") + nibbles +
+               "' specified in --bytes.";
+      return false;
     }
 
-    auto byte_addr = FLAGS_address + (i / 2);
-    auto masked_addr = byte_addr & addr_mask;
+    bytes->push_back(static_cast<uint8_t>(byte_val));
+  }
 
-    // Make sure that if a really big number is specified for `--address`,
-    // that we don't accidentally wrap around and start filling out low
-    // byte addresses.
-    if (masked_addr < byte_addr) {
-      std::cerr << "Too many bytes specified to --bytes, would result "
-                << "in a 32-bit overflow.";
-      exit(EXIT_FAILURE);
+  return true;
+}
 
-    } else if (masked_addr < FLAGS_address) {
-      std::cerr << "Too many bytes specified to --bytes, would result "
-                << "in a 64-bit overflow.";
-      exit(EXIT_FAILURE);
+// Parse an address in the same way as the integer flags: hexadecimal if it
+// starts with `0x`, and decimal otherwise.
+static bool TryParseAddress(std::string str, uint64_t *addr) {
+  str.erase(0, str.find_first_not_of(" \t\r"));
+  str.erase(str.find_last_not_of(" \t\r") + 1);
+  if (str.empty() || str[0] == '-') {
+    return false;
+  }
+
+  auto base = 10;
+  if (str.size() > 2 && str[0] == '0' && (str[1] == 'x' || str[1] == 'X')) {
+    base = 16;
+  }
+
+  char *parsed_to = nullptr;
+  *addr = strtoull(str.c_str(), &parsed_to, base);
+  return parsed_to == &(str[str.size()]);
+}
+
+// Collect the entrypoints of `request`, in order, without duplicates.
+// Defaults to the request's address.
+static bool GetEntryAddresses(const LiftRequest &request,
+                              std::vector<uint64_t> *entry_addresses,
+                              std::string *error) {
+  std::vector<uint64_t> addrs;
+  if (request.entry_address) {
+    addrs.push_back(request.entry_address);
+  }
+
+  std::stringstream list(request.entry_addresses);
+  std::string entry;
+  while (std::getline(list, entry, ',')) {
+    uint64_t addr = 0;
+    if (!TryParseAddress(entry, &addr)) {
+      *error = "Invalid address '" + entry +
+               "' specified in --entry_addresses.";
+      return false;
+    }
+    addrs.push_back(addr);
+  }
+
+  if (!request.entry_address_file.empty()) {
+    std::ifstream file(request.entry_address_file);
+    if (!file) {
+      *error = "Unable to open entrypoint address file " +
+               request.entry_address_file;
+      return false;
+    }
+
+    std::string line;
+    for (auto line_num = 1; std::getline(file, line); ++line_num) {
+      if (line.find_first_not_of(" \t\r") == std::string::npos) {
+        continue;
+      }
+
+      uint64_t addr = 0;
+      if (!TryParseAddress(line, &addr)) {
+        *error = "Invalid address on line " + std::to_string(line_num) +
+                 " of " + request.entry_address_file;
+        return false;
+      }
+      addrs.push_back(addr);
     }
+  }
+
+  if (addrs.empty()) {
+    addrs.push_back(request.address);
+  }
 
-    memory[byte_addr] = static_cast<uint8_t>(byte_val);
+  for (auto addr : addrs) {
+    if (std::find(entry_addresses->begin(), entry_addresses->end(), addr) ==
+        entry_addresses->end()) {
+      entry_addresses->push_back(addr);
+    }
+  }
+  return true;
+}
+
+// Read in the branch profile in the file passed to `--branch_profile`.
+static BranchProfile LoadBranchProfile(void) {
+  BranchProfile profile;
+  std::ifstream file(FLAGS_branch_profile);
+  if (!file) {
+    std::cerr << "Unable to open branch profile file "
+              << FLAGS_branch_profile << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  std::string line;
+  for (auto line_num = 1; std::getline(file, line); ++line_num) {
+    std::istringstream ss(line);
+    uint64_t addr = 0;
+    uint64_t taken = 0;
+    uint64_t not_taken = 0;
+    if (!(ss >> std::hex >> addr >> std::dec >> taken >> not_taken)) {
+      std::cerr << "Invalid branch profile entry on line " << line_num
+                << " of " << FLAGS_branch_profile << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    profile[addr] = {taken, not_taken};
   }
 
-  return memory;
+  return profile;
+}
+
+// How saved bitcode is compressed (see `--zstd`).
+static remill::BitcodeCompression SavedBitcodeCompression(void) {
+  if (!FLAGS_zstd) {
+    return remill::BitcodeCompression::kNone;
+  }
+  LOG_IF(FATAL, !remill::IsBitcodeCompressionAvailable(
+                    remill::BitcodeCompression::kZstd))
+      << "--zstd requires remill to be built with zstd";
+  return remill::BitcodeCompression::kZstd;
 }
 
 class SimpleTraceManager : public remill::TraceManager {
  public:
   virtual ~SimpleTraceManager(void) = default;
 
-  explicit SimpleTraceManager(Memory &memory_) : memory(memory_) {}
+  SimpleTraceManager(const Memory &memory_,
+                     const BranchProfile &branch_profile_)
+      : memory(memory_),
+        branch_profile(branch_profile_) {}
 
  protected:
   // Called when we have lifted, i.e. defined the contents, of a new trace.
@@ -123,6 +551,16 @@ class SimpleTraceManager : public remill::TraceManager {
     traces[addr] = lifted_func;
   }
 
+  // Called with the blocks of a newly lifted trace, while they can still be
+  // tied back to the addresses of their instructions.
+  void SetLiftedTraceBlocks(
+      uint64_t addr, llvm::Function *lifted_func,
+      const std::map<uint64_t, llvm::BasicBlock *> &blocks) override {
+    if (FLAGS_count_executions) {
+      counters.InstrumentTrace(addr, lifted_func, blocks);
+    }
+  }
+
   // Get a declaration for a lifted trace. The idea here is that a derived
   // class might have additional global info available to them that lets
   // them declare traces ahead of time. In order to distinguish between
@@ -150,9 +588,17 @@ class SimpleTraceManager : public remill::TraceManager {
   // at address `addr` is executable and readable, and updates the byte
   // pointed to by `byte` with the read value.
   bool TryReadExecutableByte(uint64_t addr, uint8_t *byte) override {
-    auto byte_it = memory.find(addr);
-    if (byte_it != memory.end()) {
-      *byte = byte_it->second;
+    return memory.TryReadByte(addr, byte);
+  }
+
+  // Try to get a profile of the conditional branch instruction at address
+  // `addr` from the profile passed to `--branch_profile`.
+  bool TryGetBranchProfile(uint64_t addr, uint64_t *taken,
+                           uint64_t *not_taken) override {
+    auto profile_it = branch_profile.find(addr);
+    if (profile_it != branch_profile.end()) {
+      *taken = profile_it->second.first;
+      *not_taken = profile_it->second.second;
       return true;
     } else {
       return false;
@@ -160,8 +606,10 @@ class SimpleTraceManager : public remill::TraceManager {
   }
 
  public:
-  Memory &memory;
+  const Memory &memory;
+  const BranchProfile &branch_profile;
   std::unordered_map<uint64_t, llvm::Function *> traces;
+  remill::ExecutionCounters counters;
 };
 
 // Looks for calls to a function like `__remill_function_return`, and
@@ -182,113 +630,327 @@ static void MuteStateEscape(llvm::Module *module, const char *func_name) {
   }
 }
 
-static void SetVersion() {
-  std::stringstream ss;
-  auto vs = remill::Version::GetVersionString();
-  if (0 == vs.size()) {
-    vs = "unknown";
+// The LLVM context used to lift requests, and everything that lives in it.
+// An LLVM context never frees the types and constants created in it, so a
+// long-running session periodically replaces this with a fresh one.
+class LiftingContext {
+ public:
+  // If `reusable`, then a pristine copy of the semantics is kept, so that
+  // the context can be `Reset` between requests.
+  LiftingContext(remill::OSName os_name, remill::ArchName arch_name,
+                 bool reusable);
+
+  // Replace `module` with a fresh copy of the semantics, so that one request
+  // doesn't affect the next. Lowering and optimizing lifted code rewrites
+  // the semantics functions in `module`, and not just the lifted traces.
+  void Reset(void);
+
+  llvm::LLVMContext context;
+  const remill::Arch::ArchPtr arch;
+
+  // The semantics module, into which code is lifted, and in which it is
+  // lowered and optimized.
+  std::unique_ptr<llvm::Module> module;
+  std::unique_ptr<remill::IntrinsicTable> intrinsics;
+  std::unique_ptr<remill::InstructionLifter> inst_lifter;
+
+ private:
+  // Pristine copy of the semantics, if the context is reusable.
+  std::unique_ptr<llvm::Module> semantics;
+
+  // Point the lifter at `module`.
+  void InitLifter(void);
+};
+
+LiftingContext::LiftingContext(remill::OSName os_name,
+                               remill::ArchName arch_name, bool reusable)
+    : arch(remill::Arch::Build(&context, os_name, arch_name)),
+      module(remill::LoadArchSemantics(arch)) {
+  if (reusable) {
+#if LLVM_VERSION_NUMBER < LLVM_VERSION(7, 0)
+    semantics = llvm::CloneModule(module.get());
+#else
+    semantics = llvm::CloneModule(*module);
+#endif
   }
-  ss << vs << "\n";
-  if (!remill::Version::HasVersionData()) {
-    ss << "No extended version information found!\n";
-  } else {
-    ss << "Commit Hash: " << remill::Version::GetCommitHash() << "\n";
-    ss << "Commit Date: " << remill::Version::GetCommitDate() << "\n";
-    ss << "Last commit by: " << remill::Version::GetAuthorName() << " ["
-       << remill::Version::GetAuthorEmail() << "]\n";
-    ss << "Commit Subject: [" << remill::Version::GetCommitSubject() << "]\n";
-    ss << "\n";
-    if (remill::Version::HasUncommittedChanges()) {
-      ss << "Uncommitted changes were present during build.\n";
-    } else {
-      ss << "All changes were committed prior to building.\n";
-    }
+  InitLifter();
+}
+
+void LiftingContext::Reset(void) {
+  if (!semantics) {
+    return;
   }
-  google::SetVersionString(ss.str());
+
+  inst_lifter.reset();
+  intrinsics.reset();
+#if LLVM_VERSION_NUMBER < LLVM_VERSION(7, 0)
+  module = llvm::CloneModule(semantics.get());
+#else
+  module = llvm::CloneModule(*semantics);
+#endif
+  InitLifter();
 }
 
-int main(int argc, char *argv[]) {
-  SetVersion();
-  google::ParseCommandLineFlags(&argc, &argv, true);
-  google::InitGoogleLogging(argv[0]);
+void LiftingContext::InitLifter(void) {
+  intrinsics.reset(new remill::IntrinsicTable(module.get()));
+  inst_lifter.reset(new remill::InstructionLifter(arch.get(), *intrinsics));
+  inst_lifter->use_native_atomics = FLAGS_native_atomics;
+}
 
+// Lifts the code described by lift requests. The semantics, and everything
+// derived from them, are loaded once, and shared by all requests, until the
+// lifting context is recycled (see `--max_memory_mb`).
+class LiftSession {
+ public:
+  // If `serving`, then the session can lift any number of requests.
+  // Otherwise, it can only lift one.
+  LiftSession(remill::OSName os_name_, remill::ArchName arch_name_,
+              bool serving_);
 
-  if (FLAGS_bytes.empty()) {
-    std::cerr << "Please specify a sequence of hex bytes to --bytes."
-              << std::endl;
-    return EXIT_FAILURE;
+  // Lift the code described by `request` into a new module. Returns `nullptr`
+  // and describes the problem in `error` if the request is invalid.
+  //
+  // NOTE: The returned module must be destroyed before the next request, as
+  //       its context might be recycled.
+  std::unique_ptr<llvm::Module> Lift(const LiftRequest &request,
+                                     std::string *error);
+
+  // Lift the code described by `request`, saving the lifted traces into
+  // files in the directory `dir_name` as they are optimized (see
+  // `--trace_out_dir`). Returns `false` and describes the problem in `error`
+  // if the request is invalid, or if a file couldn't be saved.
+  bool LiftIntoFiles(const LiftRequest &request, const std::string &dir_name,
+                     std::string *error);
+
+ private:
+  // Replace the lifting context with a fresh one if the current one has
+  // served too many requests, or if the process is using too much memory.
+  void MaybeRecycle(void);
+
+  // Check `request`, and map the bytes that it describes into `memory`.
+  bool LoadRequest(const LiftRequest &request, Memory *memory,
+                   std::vector<uint64_t> *entry_addresses, std::string *error);
+
+  // Lower and optimize the lifted traces in `traces`.
+  template <typename Traces>
+  void OptimizeTraces(const Traces &traces);
+
+  std::unique_ptr<llvm::Module>
+  LiftIntoModule(const LiftRequest &request, std::string *error);
+
+  bool StreamIntoFiles(const LiftRequest &request, const std::string &dir_name,
+                       std::string *error);
+
+  // Create the `slice` function, which calls `entry_trace` with registers
+  // passed as arguments.
+  bool MakeSlice(const LiftRequest &request, llvm::Module *dest_module,
+                 llvm::Function *entry_trace, uint64_t entry_address,
+                 std::string *error);
+
+  const remill::OSName os_name;
+  const remill::ArchName arch_name;
+  const bool serving;
+  std::unique_ptr<LiftingContext> lifting;
+  const uint64_t addr_mask;
+  const BranchProfile branch_profile;
+
+  // Number of requests served by `lifting`.
+  uint64_t num_requests;
+};
+
+LiftSession::LiftSession(remill::OSName os_name_,
+                         remill::ArchName arch_name_, bool serving_)
+    : os_name(os_name_),
+      arch_name(arch_name_),
+      serving(serving_),
+      lifting(new LiftingContext(os_name, arch_name, serving)),
+      addr_mask(~0ULL >> (64UL - lifting->arch->address_size)),
+      branch_profile(FLAGS_branch_profile.empty() ? BranchProfile()
+                                                  : LoadBranchProfile()),
+      num_requests(0) {}
+
+std::unique_ptr<llvm::Module> LiftSession::Lift(const LiftRequest &request,
+                                                std::string *error) {
+  MaybeRecycle();
+  auto dest_module = LiftIntoModule(request, error);
+  lifting->Reset();
+  ++num_requests;
+  return dest_module;
+}
+
+bool LiftSession::LiftIntoFiles(const LiftRequest &request,
+                                const std::string &dir_name,
+                                std::string *error) {
+  MaybeRecycle();
+  const auto ret = StreamIntoFiles(request, dir_name, error);
+  lifting->Reset();
+  ++num_requests;
+  return ret;
+}
+
+void LiftSession::MaybeRecycle(void) {
+  if (!num_requests) {
+    return;
   }
 
-  if (FLAGS_bytes.size() % 2) {
-    std::cerr << "Please specify an even number of nibbles to --bytes."
-              << std::endl;
-    return EXIT_FAILURE;
+  const auto max_memory = FLAGS_max_memory_mb << 20u;
+  const auto memory = remill::GetResidentMemorySize();
+  if ((!FLAGS_max_requests_per_context ||
+       num_requests < FLAGS_max_requests_per_context) &&
+      (!max_memory || memory <= max_memory)) {
+    return;
   }
 
-  if (!FLAGS_entry_address) {
-    FLAGS_entry_address = FLAGS_address;
+  LOG(INFO) << "Reloading semantics into a fresh LLVM context after "
+            << num_requests << " requests, using " << (memory >> 20u)
+            << " MiB of memory";
+
+  // Free the old context before creating the new one, so that they aren't
+  // both resident at once.
+  lifting.reset();
+#ifdef __GLIBC__
+  malloc_trim(0);
+#endif
+  lifting.reset(new LiftingContext(os_name, arch_name, serving));
+  num_requests = 0;
+}
+
+bool LiftSession::LoadRequest(const LiftRequest &request, Memory *memory,
+                              std::vector<uint64_t> *entry_addresses,
+                              std::string *error) {
+  if (request.bytes.empty() && request.raw_file.empty() &&
+      request.binary.empty()) {
+    *error = "Please specify a sequence of hex bytes to --bytes, or a "
+             "file to --raw_file or --binary.";
+    return false;
   }
 
-  // Make sure `--address` and `--entry_address` are in-bounds for the target
-  // architecture's address size.
-  llvm::LLVMContext context;
-  auto arch = remill::Arch::GetTargetArch(context);
-  const uint64_t addr_mask = ~0ULL >> (64UL - arch->address_size);
-  if (FLAGS_address != (FLAGS_address & addr_mask)) {
-    std::cerr << "Value " << std::hex << FLAGS_address
-              << " passed to --address does not fit into 32-bits. Did mean"
-              << " to specify a 64-bit architecture to --arch?" << std::endl;
-    return EXIT_FAILURE;
+  if (!GetEntryAddresses(request, entry_addresses, error)) {
+    return false;
   }
 
-  if (FLAGS_entry_address != (FLAGS_entry_address & addr_mask)) {
-    std::cerr
-        << "Value " << std::hex << FLAGS_entry_address
-        << " passed to --entry_address does not fit into 32-bits. Did mean"
-        << " to specify a 64-bit architecture to --arch?" << std::endl;
-    return EXIT_FAILURE;
+  const auto make_slice =
+      !request.slice_inputs.empty() || !request.slice_outputs.empty();
+  if (make_slice && entry_addresses->size() > 1) {
+    *error = "Please specify only one entrypoint address when using "
+             "--slice_inputs or --slice_outputs.";
+    return false;
   }
 
-  std::unique_ptr<llvm::Module> module(remill::LoadArchSemantics(arch));
+  // Make sure `--address` and the entrypoints are in-bounds for the target
+  // architecture's address size.
+  if (request.address != (request.address & addr_mask)) {
+    std::stringstream ss;
+    ss << "Value " << std::hex << request.address
+       << " passed to --address does not fit into 32-bits. Did mean"
+       << " to specify a 64-bit architecture to --arch?";
+    *error = ss.str();
+    return false;
+  }
 
-  const auto state_ptr_type = remill::StatePointerType(module.get());
-  const auto mem_ptr_type = remill::MemoryPointerType(module.get());
+  for (auto entry_address : *entry_addresses) {
+    if (entry_address != (entry_address & addr_mask)) {
+      std::stringstream ss;
+      ss << "Entrypoint address " << std::hex << entry_address
+         << " does not fit into 32-bits. Did mean"
+         << " to specify a 64-bit architecture to --arch?";
+      *error = ss.str();
+      return false;
+    }
+  }
 
-  Memory memory = UnhexlifyInputBytes(addr_mask);
-  SimpleTraceManager manager(memory);
-  remill::IntrinsicTable intrinsics(module);
-  remill::InstructionLifter inst_lifter(arch, intrinsics);
-  remill::TraceLifter trace_lifter(inst_lifter, manager);
+  if (!request.bytes.empty()) {
+    std::vector<uint8_t> bytes;
+    if (!UnhexlifyInputBytes(request.bytes, &bytes, error) ||
+        !memory->AddBytes(request.address, std::move(bytes), addr_mask,
+                         "--bytes", error)) {
+      return false;
+    }
+  }
+  if (!request.raw_file.empty() &&
+      !memory->AddRawFile(request.address, request.raw_file, addr_mask,
+                         error)) {
+    return false;
+  }
+  if (!request.binary.empty() &&
+      !memory->AddBinary(request.address, request.binary, addr_mask, error)) {
+    return false;
+  }
+  return true;
+}
 
-  // Lift all discoverable traces starting from `--entry_address` into
-  // `module`.
-  trace_lifter.Lift(FLAGS_entry_address);
+// Flatten the memory model before optimizing, so that the optimizer can
+// reason about the resulting loads and stores. Then optimize the module, but
+// with a particular focus on only the functions that we actually lifted.
+template <typename Traces>
+void LiftSession::OptimizeTraces(const Traces &traces) {
+  const auto arch = lifting->arch.get();
+  const auto module = lifting->module.get();
+
+  if (FLAGS_flat_memory) {
+    remill::LowerMemoryIntrinsics(module);
+    if (FLAGS_native_atomics) {
+      remill::LowerAtomicIntrinsics(module);
+    }
+  }
 
-  // Optimize the module, but with a particular focus on only the functions
-  // that we actually lifted.
   remill::OptimizationGuide guide = {};
   guide.eliminate_dead_stores = true;
-  remill::OptimizeModule(arch, module, manager.traces, guide);
+  remill::OptimizeModule(arch, module, traces, guide);
+}
+
+std::unique_ptr<llvm::Module>
+LiftSession::LiftIntoModule(const LiftRequest &request, std::string *error) {
+  auto &context = lifting->context;
+  const auto arch = lifting->arch.get();
+
+  Memory memory;
+  std::vector<uint64_t> entry_addresses;
+  if (!LoadRequest(request, &memory, &entry_addresses, error)) {
+    return nullptr;
+  }
+
+  const auto make_slice =
+      !request.slice_inputs.empty() || !request.slice_outputs.empty();
+
+  SimpleTraceManager manager(memory, branch_profile);
+  remill::TraceLifter trace_lifter(*lifting->inst_lifter, manager);
+
+  // Lift all discoverable traces starting from each entrypoint into `module`.
+  // Traces reachable from more than one entrypoint are only lifted once.
+  for (auto entry_address : entry_addresses) {
+    if (!trace_lifter.Lift(entry_address)) {
+      LOG(ERROR) << "Could not lift trace at entrypoint address " << std::hex
+                 << entry_address << std::dec;
+    }
+  }
+
+  OptimizeTraces(manager.traces);
 
   // Create a new module in which we will move all the lifted functions. Prepare
   // the module for code of this architecture, i.e. set the data layout, triple,
   // etc.
-  llvm::Module dest_module("lifted_code", context);
-  arch->PrepareModuleDataLayout(&dest_module);
+  std::unique_ptr<llvm::Module> dest_module(
+      new llvm::Module("lifted_code", context));
+  arch->PrepareModuleDataLayout(dest_module.get());
 
   llvm::Function *entry_trace = nullptr;
-  const auto make_slice =
-      !FLAGS_slice_inputs.empty() || !FLAGS_slice_outputs.empty();
 
   // Move the lifted code into a new module. This module will be much smaller
   // because it won't be bogged down with all of the semantics definitions.
   // This is a good JITing strategy: optimize the lifted code in the semantics
   // module, move it to a new module, instrument it there, then JIT compile it.
+  std::vector<llvm::Function *> lifted_funcs;
+  lifted_funcs.reserve(manager.traces.size());
   for (auto &lifted_entry : manager.traces) {
-    if (lifted_entry.first == FLAGS_entry_address) {
+    lifted_funcs.push_back(lifted_entry.second);
+  }
+  remill::MoveFunctionsIntoModule(lifted_funcs, dest_module.get());
+
+  for (auto &lifted_entry : manager.traces) {
+    if (lifted_entry.first == entry_addresses.front()) {
       entry_trace = lifted_entry.second;
     }
-    remill::MoveFunctionIntoModule(lifted_entry.second, &dest_module);
 
     // If we are providing a prototype, then we'll be re-optimizing the new
     // module, and we want everything to get inlined.
@@ -300,143 +962,533 @@ int main(int argc, char *argv[]) {
     }
   }
 
+  if (FLAGS_count_executions) {
+    manager.counters.DefineCounters(dest_module.get());
+  }
+
   // We have a prototype, so go create a function that will call our entrypoint.
-  if (make_slice) {
-    CHECK_NOTNULL(entry_trace);
+  if (make_slice &&
+      !MakeSlice(request, dest_module.get(), entry_trace,
+                 entry_addresses.front(), error)) {
+    return nullptr;
+  }
 
-    llvm::SmallVector<llvm::StringRef, 4> input_reg_names;
-    llvm::SmallVector<llvm::StringRef, 4> output_reg_names;
-    llvm::StringRef(FLAGS_slice_inputs)
-        .split(input_reg_names, ',', -1, false /* KeepEmpty */);
-    llvm::StringRef(FLAGS_slice_outputs)
-        .split(output_reg_names, ',', -1, false /* KeepEmpty */);
+  return dest_module;
+}
 
-    CHECK(!(input_reg_names.empty() && output_reg_names.empty()))
-        << "Empty lists passed to both --slice_inputs and --slice_outputs";
+bool LiftSession::StreamIntoFiles(const LiftRequest &request,
+                                  const std::string &dir_name,
+                                  std::string *error) {
+  auto &context = lifting->context;
+  const auto arch = lifting->arch.get();
 
-    // Use the registers to build a function prototype.
-    llvm::SmallVector<llvm::Type *, 8> arg_types;
-    arg_types.push_back(mem_ptr_type);
+  if (!request.slice_inputs.empty() || !request.slice_outputs.empty()) {
+    *error = "--slice_inputs and --slice_outputs can't be used with "
+             "--trace_out_dir.";
+    return false;
+  }
 
-    for (auto &reg_name : input_reg_names) {
-      const auto reg = arch->RegisterByName(reg_name.str());
-      CHECK(reg != nullptr)
-          << "Invalid register name '" << reg_name.str()
-          << "' used in input slice list '" << FLAGS_slice_inputs << "'";
+  Memory memory;
+  std::vector<uint64_t> entry_addresses;
+  if (!LoadRequest(request, &memory, &entry_addresses, error)) {
+    return false;
+  }
 
-      arg_types.push_back(reg->type);
+  SimpleTraceManager manager(memory, branch_profile);
+  remill::TraceLifter trace_lifter(*lifting->inst_lifter, manager);
+  remill::TraceWriter writer(arch, dir_name, SavedBitcodeCompression());
+  const auto traces_per_file = std::max<uint64_t>(1, FLAGS_traces_per_file);
+
+  // Save the traces that have been lifted, but not yet saved, once there are
+  // enough of them. Saved traces are left behind as declarations, so the
+  // manager still reports them as lifted, and they aren't lifted again.
+  auto write_traces = [&](bool flush) -> bool {
+    std::map<uint64_t, llvm::Function *> pending;
+    for (const auto &lifted_entry : manager.traces) {
+      if (!lifted_entry.second->isDeclaration()) {
+        pending.insert(lifted_entry);
+      }
     }
 
-    const auto first_output_reg_index = arg_types.size();
+    if (pending.empty() || (!flush && pending.size() < traces_per_file)) {
+      return true;
+    }
+
+    OptimizeTraces(pending);
+
+    std::map<uint64_t, llvm::Function *> batch;
+    for (auto pending_it = pending.begin(); pending_it != pending.end();) {
+      batch.insert(*pending_it++);
+      if (batch.size() < traces_per_file && pending_it != pending.end()) {
+        continue;
+      }
 
-    // Outputs are "returned" by pointer through arguments.
-    for (auto &reg_name : output_reg_names) {
-      const auto reg = arch->RegisterByName(reg_name.str());
-      CHECK(reg != nullptr)
-          << "Invalid register name '" << reg_name.str()
-          << "' used in output slice list '" << FLAGS_slice_outputs << "'";
+      if (!writer.WriteTraces(&batch)) {
+        *error = "Could not save lifted traces to " + dir_name;
+        return false;
+      }
 
-      arg_types.push_back(llvm::PointerType::get(reg->type, 0));
+      for (const auto &written_entry : batch) {
+        manager.traces[written_entry.first] = written_entry.second;
+      }
+      batch.clear();
     }
+    return true;
+  };
 
-    const auto state_type = state_ptr_type->getPointerElementType();
-    const auto func_type =
-        llvm::FunctionType::get(mem_ptr_type, arg_types, false);
-    const auto func = llvm::Function::Create(
-        func_type, llvm::GlobalValue::ExternalLinkage, "slice", &dest_module);
+  for (auto entry_address : entry_addresses) {
+    if (!trace_lifter.Lift(entry_address)) {
+      LOG(ERROR) << "Could not lift trace at entrypoint address " << std::hex
+                 << entry_address << std::dec;
+    }
+    if (!write_traces(false)) {
+      return false;
+    }
+  }
 
-    // Store all of the function arguments (corresponding with specific registers)
-    // into the stack-allocated `State` structure.
-    auto entry = llvm::BasicBlock::Create(context, "", func);
-    llvm::IRBuilder<> ir(entry);
+  if (!write_traces(true)) {
+    return false;
+  }
 
-    const auto state_ptr = ir.CreateAlloca(state_type);
+  // The counters are shared by the traces in every file, and so are defined
+  // in a file of their own.
+  if (FLAGS_count_executions) {
+    llvm::Module counters_module("execution_counters", context);
+    arch->PrepareModuleDataLayout(&counters_module);
+    manager.counters.DefineCounters(&counters_module);
+    if (!writer.WriteModule(&counters_module, "execution_counters")) {
+      *error = "Could not save execution counters to " + dir_name;
+      return false;
+    }
+  }
 
-    const remill::Register *pc_reg =
-        arch->RegisterByName(arch->ProgramCounterRegisterName());
+  if (!writer.Wait()) {
+    *error = "Could not save lifted traces to " + dir_name;
+    return false;
+  }
+
+  return true;
+}
+
+bool LiftSession::MakeSlice(const LiftRequest &request,
+                            llvm::Module *dest_module,
+                            llvm::Function *entry_trace,
+                            uint64_t entry_address, std::string *error) {
+  auto &context = lifting->context;
+  const auto arch = lifting->arch.get();
+  const auto module = lifting->module.get();
+
+  if (!entry_trace) {
+    std::stringstream ss;
+    ss << "Could not lift the entrypoint at address " << std::hex
+       << entry_address << " to slice";
+    *error = ss.str();
+    return false;
+  }
+
+  llvm::SmallVector<llvm::StringRef, 4> input_reg_names;
+  llvm::SmallVector<llvm::StringRef, 4> output_reg_names;
+  llvm::StringRef(request.slice_inputs)
+      .split(input_reg_names, ',', -1, false /* KeepEmpty */);
+  llvm::StringRef(request.slice_outputs)
+      .split(output_reg_names, ',', -1, false /* KeepEmpty */);
+
+  if (input_reg_names.empty() && output_reg_names.empty()) {
+    *error = "Empty lists passed to both --slice_inputs and --slice_outputs";
+    return false;
+  }
+
+  const auto state_ptr_type = remill::StatePointerType(module);
+  const auto mem_ptr_type = remill::MemoryPointerType(module);
+
+  // Use the registers to build a function prototype.
+  llvm::SmallVector<llvm::Type *, 8> arg_types;
+  arg_types.push_back(mem_ptr_type);
+
+  for (auto &reg_name : input_reg_names) {
+    const auto reg = arch->RegisterByName(reg_name.str());
+    if (!reg) {
+      *error = "Invalid register name '" + reg_name.str() +
+               "' used in input slice list '" + request.slice_inputs + "'";
+      return false;
+    }
+
+    arg_types.push_back(reg->type);
+  }
 
-    CHECK(pc_reg != nullptr)
-        << "Could not find the register in the state structure "
-        << "associated with the program counter.";
+  const auto first_output_reg_index = arg_types.size();
 
-    // Store the program counter into the state.
-    const auto pc_reg_ptr = pc_reg->AddressOf(state_ptr, entry);
-    const auto trace_pc =
-        llvm::ConstantInt::get(pc_reg->type, FLAGS_entry_address, false);
+  // Outputs are "returned" by pointer through arguments.
+  for (auto &reg_name : output_reg_names) {
+    const auto reg = arch->RegisterByName(reg_name.str());
+    if (!reg) {
+      *error = "Invalid register name '" + reg_name.str() +
+               "' used in output slice list '" + request.slice_outputs + "'";
+      return false;
+    }
+
+    arg_types.push_back(llvm::PointerType::get(reg->type, 0));
+  }
+
+  const auto state_type = state_ptr_type->getPointerElementType();
+  const auto func_type =
+      llvm::FunctionType::get(mem_ptr_type, arg_types, false);
+  const auto func = llvm::Function::Create(
+      func_type, llvm::GlobalValue::ExternalLinkage, "slice", dest_module);
+
+  // Store all of the function arguments (corresponding with specific registers)
+  // into the stack-allocated `State` structure.
+  auto entry = llvm::BasicBlock::Create(context, "", func);
+  llvm::IRBuilder<> ir(entry);
+
+  const auto state_ptr = ir.CreateAlloca(state_type);
+
+  const remill::Register *pc_reg =
+      arch->RegisterByName(arch->ProgramCounterRegisterName());
+
+  CHECK(pc_reg != nullptr)
+      << "Could not find the register in the state structure "
+      << "associated with the program counter.";
+
+  // Store the program counter into the state.
+  const auto pc_reg_ptr = pc_reg->AddressOf(state_ptr, entry);
+  const auto trace_pc =
+      llvm::ConstantInt::get(pc_reg->type, entry_address, false);
+  ir.SetInsertPoint(entry);
+  ir.CreateStore(trace_pc, pc_reg_ptr);
+
+  auto args_it = func->arg_begin();
+  for (auto &reg_name : input_reg_names) {
+    const auto reg = arch->RegisterByName(reg_name.str());
+    auto &arg = *++args_it;  // Pre-increment, as first arg is memory pointer.
+    arg.setName(reg_name);
+    CHECK_EQ(arg.getType(), reg->type);
+    auto reg_ptr = reg->AddressOf(state_ptr, entry);
+    ir.SetInsertPoint(entry);
+    ir.CreateStore(&arg, reg_ptr);
+  }
+
+  llvm::Value *mem_ptr = &*func->arg_begin();
+
+  llvm::Value *trace_args[remill::kNumBlockArgs] = {};
+  trace_args[remill::kStatePointerArgNum] = state_ptr;
+  trace_args[remill::kMemoryPointerArgNum] = mem_ptr;
+  trace_args[remill::kPCArgNum] = trace_pc;
+
+  mem_ptr = ir.CreateCall(entry_trace, trace_args);
+
+  // Go read all output registers out of the state and store them
+  // into the output parameters.
+  args_it = func->arg_begin();
+  for (size_t i = 0, j = 0; i < func->arg_size(); ++i, ++args_it) {
+    if (i < first_output_reg_index) {
+      continue;
+    }
+
+    const auto &reg_name = output_reg_names[j++];
+    const auto reg = arch->RegisterByName(reg_name.str());
+    auto &arg = *args_it;
+    arg.setName(reg_name + "_output");
+
+    auto reg_ptr = reg->AddressOf(state_ptr, entry);
     ir.SetInsertPoint(entry);
-    ir.CreateStore(trace_pc, pc_reg_ptr);
+    ir.CreateStore(ir.CreateLoad(reg_ptr), &arg);
+  }
+
+  // Return the memory pointer, so that all memory accesses are
+  // preserved.
+  ir.CreateRet(mem_ptr);
+
+  // We want the stack-allocated `State` to be subject to scalarization
+  // and mem2reg, but to "encourage" that, we need to prevent the
+  // `alloca`d `State` from escaping.
+  MuteStateEscape(dest_module, "__remill_error");
+  MuteStateEscape(dest_module, "__remill_function_call");
+  MuteStateEscape(dest_module, "__remill_function_return");
+  MuteStateEscape(dest_module, "__remill_jump");
+  MuteStateEscape(dest_module, "__remill_missing_block");
+
+  remill::OptimizationGuide guide = {};
+  guide.slp_vectorize = true;
+  guide.loop_vectorize = true;
+  guide.eliminate_dead_stores = false;
+  remill::OptimizeBareModule(dest_module, guide);
+  return true;
+}
 
-    auto args_it = func->arg_begin();
-    for (auto &reg_name : input_reg_names) {
-      const auto reg = arch->RegisterByName(reg_name.str());
-      auto &arg = *++args_it;  // Pre-increment, as first arg is memory pointer.
-      arg.setName(reg_name);
-      CHECK_EQ(arg.getType(), reg->type);
-      auto reg_ptr = reg->AddressOf(state_ptr, entry);
-      ir.SetInsertPoint(entry);
-      ir.CreateStore(&arg, reg_ptr);
+// Serialize `module` to LLVM IR or bitcode.
+static bool SerializeModule(llvm::Module *module, bool emit_ir,
+                            std::string *data, std::string *error) {
+  llvm::raw_string_ostream error_stream(*error);
+  if (llvm::verifyModule(*module, &error_stream)) {
+    error_stream.flush();
+    return false;
+  }
+
+  llvm::raw_string_ostream os(*data);
+  if (emit_ir) {
+    module->print(os, nullptr);
+  } else {
+#if LLVM_VERSION_NUMBER < LLVM_VERSION(7, 0)
+    llvm::WriteBitcodeToFile(module, os);
+#else
+    llvm::WriteBitcodeToFile(*module, os);
+#endif
+  }
+  os.flush();
+  return true;
+}
+
+// Read one line from `in`, without its trailing newline. Returns `false` at
+// the end of the input.
+static bool ReadLine(FILE *in, std::string *line) {
+  line->clear();
+  char buf[512];
+  while (fgets(buf, sizeof(buf), in)) {
+    line->append(buf);
+    if (!line->empty() && line->back() == '\n') {
+      line->pop_back();
+      if (!line->empty() && line->back() == '\r') {
+        line->pop_back();
+      }
+      return true;
+    }
+  }
+  return !line->empty();
+}
+
+// Parse a request line of space-separated `name=value` options into
+// `request`. The names are the same as those of the command-line flags, plus
+// `format`, which is either `bc` or `ir`.
+static bool ParseRequest(const std::string &line, LiftRequest *request,
+                         std::string *error) {
+  std::stringstream ss(line);
+  std::string option;
+  while (ss >> option) {
+    const auto eq_pos = option.find('=');
+    if (eq_pos == std::string::npos) {
+      *error = "Expected name=value, but got '" + option + "'";
+      return false;
+    }
+
+    const auto name = option.substr(0, eq_pos);
+    const auto value = option.substr(eq_pos + 1);
+    if (name == "address" || name == "entry_address") {
+      auto &addr = name == "address" ? request->address
+                                     : request->entry_address;
+      if (!TryParseAddress(value, &addr)) {
+        *error = "Invalid address '" + value + "' for " + name;
+        return false;
+      }
+    } else if (name == "entry_addresses") {
+      request->entry_addresses = value;
+    } else if (name == "entry_address_file") {
+      request->entry_address_file = value;
+    } else if (name == "bytes") {
+      request->bytes = value;
+    } else if (name == "raw_file") {
+      request->raw_file = value;
+    } else if (name == "binary") {
+      request->binary = value;
+    } else if (name == "slice_inputs") {
+      request->slice_inputs = value;
+    } else if (name == "slice_outputs") {
+      request->slice_outputs = value;
+    } else if (name == "format" && (value == "bc" || value == "ir")) {
+      request->emit_ir = value == "ir";
+    } else {
+      *error = "Invalid option '" + option + "'";
+      return false;
+    }
+  }
+  return true;
+}
+
+// Serve the lift requests read from `in`, one per line, until the end of the
+// input. Each response is written to `out`, and is either `ok <size>`
+// followed by a newline and `<size>` bytes of lifted code, or `error`
+// followed by a message and a newline.
+static void ServeRequests(LiftSession &session, FILE *in, FILE *out) {
+  std::string line;
+  while (ReadLine(in, &line)) {
+    if (line.find_first_not_of(" \t") == std::string::npos) {
+      continue;
     }
 
-    llvm::Value *mem_ptr = &*func->arg_begin();
+    LiftRequest request;
+    std::string error;
+    std::string data;
+    std::unique_ptr<llvm::Module> dest_module;
+    if (ParseRequest(line, &request, &error)) {
+      dest_module = session.Lift(request, &error);
+    }
 
-    llvm::Value *trace_args[remill::kNumBlockArgs] = {};
-    trace_args[remill::kStatePointerArgNum] = state_ptr;
-    trace_args[remill::kMemoryPointerArgNum] = mem_ptr;
-    trace_args[remill::kPCArgNum] = trace_pc;
+    if (!dest_module ||
+        !SerializeModule(dest_module.get(), request.emit_ir, &data, &error)) {
+      std::replace(error.begin(), error.end(), '\n', ' ');
+      fprintf(out, "error %s\n", error.c_str());
+    } else {
+      fprintf(out, "ok %zu\n", data.size());
+      fwrite(data.data(), 1, data.size(), out);
+    }
 
-    mem_ptr = ir.CreateCall(entry_trace, trace_args);
+    if (fflush(out)) {
+      return;
+    }
+  }
+}
 
-    // Go read all output registers out of the state and store them
-    // into the output parameters.
-    args_it = func->arg_begin();
-    for (size_t i = 0, j = 0; i < func->arg_size(); ++i, ++args_it) {
-      if (i < first_output_reg_index) {
+// Serve the lift requests of each client that connects to the Unix domain
+// socket at `path`, one client at a time. This only returns on error.
+static int ServeSocket(LiftSession &session, const std::string &path) {
+#ifdef _WIN32
+  std::cerr << "--server_socket is not supported on Windows" << std::endl;
+  return EXIT_FAILURE;
+#else
+
+  // Clients that disconnect early shouldn't take down the server.
+  signal(SIGPIPE, SIG_IGN);
+
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    std::cerr << "Socket path " << path << " is too long" << std::endl;
+    return EXIT_FAILURE;
+  }
+  strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+  auto fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(path.c_str());
+  if (fd < 0 ||
+      bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) ||
+      listen(fd, SOMAXCONN)) {
+    std::cerr << "Unable to listen on socket " << path << ": "
+              << strerror(errno) << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  for (;;) {
+    auto client_fd = accept(fd, nullptr, nullptr);
+    if (client_fd < 0) {
+      if (errno == EINTR) {
         continue;
       }
+      std::cerr << "Unable to accept connection on socket " << path << ": "
+                << strerror(errno) << std::endl;
+      close(fd);
+      return EXIT_FAILURE;
+    }
 
-      const auto &reg_name = output_reg_names[j++];
-      const auto reg = arch->RegisterByName(reg_name.str());
-      auto &arg = *args_it;
-      arg.setName(reg_name + "_output");
+    auto in = fdopen(client_fd, "r");
+    auto out = fdopen(dup(client_fd), "w");
+    if (in && out) {
+      ServeRequests(session, in, out);
+    }
+    if (out) {
+      fclose(out);
+    }
+    if (in) {
+      fclose(in);
+    } else {
+      close(client_fd);
+    }
+  }
+#endif
+}
 
-      auto reg_ptr = reg->AddressOf(state_ptr, entry);
-      ir.SetInsertPoint(entry);
-      ir.CreateStore(ir.CreateLoad(reg_ptr), &arg);
+static void SetVersion() {
+  std::stringstream ss;
+  auto vs = remill::Version::GetVersionString();
+  if (0 == vs.size()) {
+    vs = "unknown";
+  }
+  ss << vs << "\n";
+  if (!remill::Version::HasVersionData()) {
+    ss << "No extended version information found!\n";
+  } else {
+    ss << "Commit Hash: " << remill::Version::GetCommitHash() << "\n";
+    ss << "Commit Date: " << remill::Version::GetCommitDate() << "\n";
+    ss << "Last commit by: " << remill::Version::GetAuthorName() << " ["
+       << remill::Version::GetAuthorEmail() << "]\n";
+    ss << "Commit Subject: [" << remill::Version::GetCommitSubject() << "]\n";
+    ss << "\n";
+    if (remill::Version::HasUncommittedChanges()) {
+      ss << "Uncommitted changes were present during build.\n";
+    } else {
+      ss << "All changes were committed prior to building.\n";
     }
+  }
+  google::SetVersionString(ss.str());
+}
 
-    // Return the memory pointer, so that all memory accesses are
-    // preserved.
-    ir.CreateRet(mem_ptr);
+int main(int argc, char *argv[]) {
+  SetVersion();
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  LiftSession session(remill::GetOSName(FLAGS_os),
+                      remill::GetArchName(FLAGS_arch),
+                      FLAGS_server || !FLAGS_server_socket.empty());
+
+  if (!FLAGS_trace_out_dir.empty() &&
+      (FLAGS_server || !FLAGS_server_socket.empty())) {
+    std::cerr << "--trace_out_dir can't be used in server mode" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (!FLAGS_server_socket.empty()) {
+    return ServeSocket(session, FLAGS_server_socket);
+  } else if (FLAGS_server) {
+    ServeRequests(session, stdin, stdout);
+    return EXIT_SUCCESS;
+  }
 
-    // We want the stack-allocated `State` to be subject to scalarization
-    // and mem2reg, but to "encourage" that, we need to prevent the
-    // `alloca`d `State` from escaping.
-    MuteStateEscape(&dest_module, "__remill_error");
-    MuteStateEscape(&dest_module, "__remill_function_call");
-    MuteStateEscape(&dest_module, "__remill_function_return");
-    MuteStateEscape(&dest_module, "__remill_jump");
-    MuteStateEscape(&dest_module, "__remill_missing_block");
+  LiftRequest request;
+  request.address = FLAGS_address;
+  request.entry_address = FLAGS_entry_address;
+  request.entry_addresses = FLAGS_entry_addresses;
+  request.entry_address_file = FLAGS_entry_address_file;
+  request.bytes = FLAGS_bytes;
+  request.raw_file = FLAGS_raw_file;
+  request.binary = FLAGS_binary;
+  request.slice_inputs = FLAGS_slice_inputs;
+  request.slice_outputs = FLAGS_slice_outputs;
+
+  std::string error;
+  if (!FLAGS_trace_out_dir.empty()) {
+    if (!session.LiftIntoFiles(request, FLAGS_trace_out_dir, &error)) {
+      std::cerr << error << std::endl;
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
 
-    guide.slp_vectorize = true;
-    guide.loop_vectorize = true;
-    guide.eliminate_dead_stores = false;
-    remill::OptimizeBareModule(&dest_module, guide);
+  auto dest_module = session.Lift(request, &error);
+  if (!dest_module) {
+    std::cerr << error << std::endl;
+    return EXIT_FAILURE;
   }
 
   int ret = EXIT_SUCCESS;
 
-  if (!FLAGS_ir_out.empty()) {
-    if (!remill::StoreModuleIRToFile(&dest_module, FLAGS_ir_out, true)) {
-      LOG(ERROR) << "Could not save LLVM IR to " << FLAGS_ir_out;
+  // The bitcode is compressed and written in the background while the IR is
+  // being printed.
+  remill::ModuleSaver saver(SavedBitcodeCompression());
+  if (!FLAGS_bc_out.empty()) {
+    if (!saver.Save(dest_module.get(), FLAGS_bc_out)) {
       ret = EXIT_FAILURE;
     }
   }
-  if (!FLAGS_bc_out.empty()) {
-    if (!remill::StoreModuleToFile(&dest_module, FLAGS_bc_out, true)) {
-      LOG(ERROR) << "Could not save LLVM bitcode to " << FLAGS_bc_out;
+  if (!FLAGS_ir_out.empty()) {
+    if (!remill::StoreModuleIRToFile(dest_module.get(), FLAGS_ir_out, true)) {
+      LOG(ERROR) << "Could not save LLVM IR to " << FLAGS_ir_out;
       ret = EXIT_FAILURE;
     }
   }
+  if (!saver.Wait()) {
+    LOG(ERROR) << "Could not save LLVM bitcode to " << FLAGS_bc_out;
+    ret = EXIT_FAILURE;
+  }
 
   return ret;
 }